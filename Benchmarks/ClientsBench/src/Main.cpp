@@ -0,0 +1,140 @@
+#include <Cam-Core.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Core/Log.h"
+
+/// <summary>
+/// Fills Core::Clients and Core::IPTable with more addresses than they can hold, looks them up again,
+/// and inserts them once more after the time-out, when the oldest entries have to be replaced.
+/// Usage: ClientsBench [addresses]
+/// </summary>
+
+static constexpr uint32 DEFAULT_ADDRESSES = 100000;
+static constexpr uint32 LOOKUP_ROUNDS = 10;
+
+// Measures the tables, not the random number generator of the system.
+class CountingCrypto : public Core::Crypto
+{
+public:
+
+	virtual bool GenKeys(key_t *pub, key_t *pri) override { return false; }
+	virtual uint64 GenToken() override { return ++m_Token; }
+	virtual bool SignSignature(Byte *sig, uint32 sig_bytes, Byte const *data, uint32 data_size, Byte const *pri_key, uint32 pri_key_bytes) override { return false; }
+	virtual bool TestSignature(void const *sig, uint32 sig_bytes, void const *src, uint32 src_bytes, Byte const *pub_key, uint32 pub_key_bytes) override { return false; }
+
+private:
+
+	uint64 m_Token = 0;
+};
+
+static void LogPhase(const char *table, const char *phase, uint32 operations, int64 elapsed_us, uint32 placed)
+{
+	CAM_LOG_INFO("{0:<8} {1:<26}: {2:>8.1f} ms, {3:>7.1f} ns per operation, {4} placed",
+		table, phase, elapsed_us / 1000.0, elapsed_us * 1000.0 / operations, placed);
+}
+
+static void BenchmarkClients(const std::vector<Core::addr_t> &addresses)
+{
+	uint32 count = (uint32)addresses.size();
+	CountingCrypto crypto;
+	Core::IPTable iptable;
+	Core::Clients clients(&crypto, &iptable);
+
+	// The addresses arrive one millisecond apart, the table is full long before all of them are placed.
+	int64 now_ms = 1000000;
+	int64 start_us = Core::QueryUS();
+	uint32 placed = 0;
+	for (uint32 i = 0; i < count; ++i)
+	{
+		placed += clients.Insert(addresses[i], now_ms + i) != nullptr;
+	}
+
+	LogPhase("Clients", "insert", count, Core::QueryUS() - start_us, placed);
+
+	now_ms += count;
+	start_us = Core::QueryUS();
+	placed = 0;
+	for (uint32 round = 0; round < LOOKUP_ROUNDS; ++round)
+	{
+		for (uint32 i = 0; i < count; ++i)
+		{
+			placed += clients.Insert(addresses[i], now_ms) != nullptr;
+		}
+	}
+
+	LogPhase("Clients", "lookup", count * LOOKUP_ROUNDS, Core::QueryUS() - start_us, placed / LOOKUP_ROUNDS);
+
+	// All clients timed out, every new address replaces the least recently used one.
+	now_ms += 60000;
+	start_us = Core::QueryUS();
+	placed = 0;
+	for (uint32 i = 0; i < count; ++i)
+	{
+		placed += clients.Insert(addresses[(i * 7919ull) % count], now_ms + i) != nullptr;
+	}
+
+	LogPhase("Clients", "insert after the time-out", count, Core::QueryUS() - start_us, placed);
+}
+
+static void BenchmarkIPTable(const std::vector<Core::addr_t> &addresses)
+{
+	uint32 count = (uint32)addresses.size();
+	Core::IPTable iptable;
+
+	int64 now_ms = 1000000;
+	int64 start_us = Core::QueryUS();
+	for (uint32 i = 0; i < count; ++i)
+	{
+		iptable.Insert(addresses[i].Host, now_ms + i);
+	}
+
+	LogPhase("IPTable", "insert", count, Core::QueryUS() - start_us, iptable.GetCount());
+
+	start_us = Core::QueryUS();
+	uint32 blocked = 0;
+	for (uint32 round = 0; round < LOOKUP_ROUNDS; ++round)
+	{
+		for (uint32 i = 0; i < count; ++i)
+		{
+			blocked += iptable.Blocked(addresses[i].Host);
+		}
+	}
+
+	LogPhase("IPTable", "lookup", count * LOOKUP_ROUNDS, Core::QueryUS() - start_us, iptable.GetCount());
+
+	// The time-out period of every host ended, new hosts replace the oldest ones.
+	now_ms += count + 600000;
+	start_us = Core::QueryUS();
+	for (uint32 i = 0; i < count; ++i)
+	{
+		iptable.Insert(addresses[(i * 7919ull) % count].Host, now_ms + i);
+	}
+
+	LogPhase("IPTable", "insert after the time-out", count, Core::QueryUS() - start_us, iptable.GetCount());
+}
+
+int main(int argc, char *argv[])
+{
+	Core::Init();
+
+	uint32 count = argc > 1 ? (uint32)std::stoul(argv[1]) : DEFAULT_ADDRESSES;
+
+	// The same random addresses on every run, so that the runs can be compared.
+	std::mt19937_64 random(1);
+	std::vector<Core::addr_t> addresses(count);
+	for (Core::addr_t &addr : addresses)
+	{
+		addr.Host = (uint32)random();
+		addr.Port = (uint32)(random() % 65536);
+	}
+
+	CAM_LOG_INFO("Inserting {} random addresses.", count);
+	BenchmarkClients(addresses);
+	BenchmarkIPTable(addresses);
+
+	Core::Shutdown();
+	return 0;
+}
@@ -0,0 +1,257 @@
+#include <Cam-Core.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Core/Log.h"
+
+#ifdef CAM_PLATFORM_LINUX
+#include <dlfcn.h>
+#include <poll.h>
+#include <sys/socket.h>
+#endif
+
+/// <summary>
+/// Pushes raw camera frames over a loopback connection, once through the old 256 byte chunks and once through SendBulk/RecvBulk,
+/// and reports the throughput and the system calls per frame.
+/// Usage: SocketBench [frames] [frame bytes] [port]
+/// </summary>
+
+// A 1280x720 BGR frame, the size CamClient sends uncompressed.
+static constexpr uint32 DEFAULT_FRAME_BYTES = 1280 * 720 * 3;
+static constexpr uint32 DEFAULT_FRAMES = 100;
+static constexpr uint16 DEFAULT_PORT = 44300;
+
+// The chunk size SendLarge and RecvLarge used before the bulk calls replaced them.
+static constexpr int32 CHUNK_BYTES = 256;
+
+struct FrameHeader
+{
+	uint32 Index;
+	uint32 FrameSize;
+};
+
+static std::atomic<uint64> s_SystemCalls = 0;
+
+#ifdef CAM_PLATFORM_LINUX
+
+// The socket calls of Cam-Core resolve to these definitions first, they count the call and forward it to the C library.
+template<typename Function>
+static Function GetNext(Function, const char *name)
+{
+	return (Function)dlsym(RTLD_NEXT, name);
+}
+
+extern "C"
+{
+	ssize_t sendto(int fd, const void *buf, size_t len, int flags, const struct sockaddr *addr, socklen_t addr_len)
+	{
+		static auto next = GetNext(&sendto, "sendto");
+		++s_SystemCalls;
+		return next(fd, buf, len, flags, addr, addr_len);
+	}
+
+	ssize_t recvfrom(int fd, void *buf, size_t len, int flags, struct sockaddr *addr, socklen_t *addr_len)
+	{
+		static auto next = GetNext(&recvfrom, "recvfrom");
+		++s_SystemCalls;
+		return next(fd, buf, len, flags, addr, addr_len);
+	}
+
+	ssize_t sendmsg(int fd, const struct msghdr *msg, int flags)
+	{
+		static auto next = GetNext(&sendmsg, "sendmsg");
+		++s_SystemCalls;
+		return next(fd, msg, flags);
+	}
+
+	ssize_t recvmsg(int fd, struct msghdr *msg, int flags)
+	{
+		static auto next = GetNext(&recvmsg, "recvmsg");
+		++s_SystemCalls;
+		return next(fd, msg, flags);
+	}
+
+	int poll(struct pollfd *fds, nfds_t count, int timeout)
+	{
+		static auto next = GetNext(&poll, "poll");
+		++s_SystemCalls;
+		return next(fds, count, timeout);
+	}
+}
+
+#endif // CAM_PLATFORM_LINUX
+
+// The path before SendBulk: the header with its own call, then the frame in chunks of CHUNK_BYTES.
+static bool SendChunked(Core::Socket *socket, const FrameHeader &header, const Byte *frame, Core::addr_t addr)
+{
+	if (socket->Send(&header, sizeof(header), addr) != sizeof(header))
+	{
+		return false;
+	}
+
+	for (uint32 pos = 0; pos < header.FrameSize;)
+	{
+		int32 n = socket->Send(frame + pos, Core::utils::Min<int32>(CHUNK_BYTES, header.FrameSize - pos), addr);
+		if (n <= 0)
+		{
+			return false;
+		}
+
+		pos += n;
+	}
+
+	return true;
+}
+
+static bool RecvChunked(Core::Socket *socket, Byte *dst, uint32 size)
+{
+	Core::addr_t addr;
+	for (uint32 pos = 0; pos < size;)
+	{
+		int32 n = socket->Recv(dst + pos, Core::utils::Min<int32>(CHUNK_BYTES, size - pos), &addr);
+		if (n <= 0)
+		{
+			return false;
+		}
+
+		pos += n;
+	}
+
+	return true;
+}
+
+static bool SendBulk(Core::Socket *socket, const FrameHeader &header, const Byte *frame, Core::addr_t addr)
+{
+	Core::io_buffer_t buffers[] = {
+		{ (void *)&header, sizeof(header) },
+		{ (void *)frame, header.FrameSize }
+	};
+
+	return socket->SendBulk(buffers, 2, addr) == (int32)(sizeof(header) + header.FrameSize);
+}
+
+static bool RecvBulk(Core::Socket *socket, Byte *dst, uint32 size)
+{
+	Core::addr_t addr;
+	Core::io_buffer_t buffer = { dst, size };
+	return socket->RecvBulk(&buffer, 1, &addr) == (int32)size;
+}
+
+/// <summary>
+/// Sends the frames from this thread to a receiver on its own thread and returns false, if a frame got lost or damaged.
+/// </summary>
+static bool RunBenchmark(const char *name, bool bulk, uint32 frame_count, uint32 frame_bytes, uint16 port)
+{
+	std::vector<Byte> frame(frame_bytes);
+	for (uint32 i = 0; i < frame_bytes; ++i)
+	{
+		frame[i] = (Byte)(i * 31 + 7);
+	}
+
+	std::atomic<bool> received_all = false;
+	std::thread receiver([&]()
+	{
+		Core::Socket *socket = Core::Socket::Create(Core::SocketType::Stream);
+		if (!socket->Open() || !socket->Bind(port))
+		{
+			CAM_LOG_ERROR("Could not accept a connection on port {}!", port);
+			delete socket;
+			return;
+		}
+
+		std::vector<Byte> data(frame_bytes);
+		uint32 frames = 0;
+		for (; frames < frame_count; ++frames)
+		{
+			FrameHeader header;
+			bool header_received = bulk ? RecvBulk(socket, (Byte *)&header, sizeof(header)) : RecvChunked(socket, (Byte *)&header, sizeof(header));
+			if (!header_received || header.Index != frames || header.FrameSize != frame_bytes)
+			{
+				break;
+			}
+
+			bool frame_received = bulk ? RecvBulk(socket, data.data(), frame_bytes) : RecvChunked(socket, data.data(), frame_bytes);
+			if (!frame_received)
+			{
+				break;
+			}
+		}
+
+		received_all = frames == frame_count && data == frame;
+		delete socket;
+	});
+
+	// The receiver accepts the connection on its own thread, it may not listen yet.
+	Core::Socket *socket = Core::Socket::Create(Core::SocketType::Stream);
+	bool connected = false;
+	for (uint32 attempt = 0; attempt < 500 && !connected; ++attempt)
+	{
+		connected = socket->Open(true, "127.0.0.1", port);
+		if (!connected)
+		{
+			Core::SleepMS(10);
+		}
+	}
+
+	if (!connected)
+	{
+		CAM_LOG_ERROR("Could not connect to port {}!", port);
+		socket->Close();
+		receiver.detach();
+		delete socket;
+		return false;
+	}
+
+	Core::addr_t addr = socket->Lookup("127.0.0.1", port);
+	uint64 system_calls = s_SystemCalls;
+	int64 start_us = Core::QueryUS();
+
+	bool sent_all = true;
+	for (uint32 i = 0; i < frame_count && sent_all; ++i)
+	{
+		FrameHeader header = { i, frame_bytes };
+		sent_all = bulk ? SendBulk(socket, header, frame.data(), addr) : SendChunked(socket, header, frame.data(), addr);
+	}
+
+	receiver.join();
+	int64 elapsed_us = Core::utils::Max<int64>(Core::QueryUS() - start_us, 1);
+	system_calls = s_SystemCalls - system_calls;
+
+	socket->Close();
+	delete socket;
+
+	if (!sent_all || !received_all)
+	{
+		CAM_LOG_ERROR("{}: the frames did not arrive intact!", name);
+		return false;
+	}
+
+	double megabytes = (double)frame_count * frame_bytes / (1024.0 * 1024.0);
+#ifdef CAM_PLATFORM_LINUX
+	CAM_LOG_INFO("{0:<8}: {1:>8.1f} MB/s, {2:>8.1f} ms, {3:>8} system calls per frame (sender and receiver)",
+		name, megabytes * 1000000.0 / elapsed_us, elapsed_us / 1000.0, system_calls / frame_count);
+#else
+	CAM_LOG_INFO("{0:<8}: {1:>8.1f} MB/s, {2:>8.1f} ms", name, megabytes * 1000000.0 / elapsed_us, elapsed_us / 1000.0);
+#endif
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	Core::Init();
+
+	uint32 frame_count = argc > 1 ? (uint32)std::stoul(argv[1]) : DEFAULT_FRAMES;
+	uint32 frame_bytes = argc > 2 ? (uint32)std::stoul(argv[2]) : DEFAULT_FRAME_BYTES;
+	uint16 port = argc > 3 ? (uint16)std::stoul(argv[3]) : DEFAULT_PORT;
+
+	CAM_LOG_INFO("Sending {0} frames of {1} bytes over loopback.", frame_count, frame_bytes);
+
+	bool success = RunBenchmark("chunked", false, frame_count, frame_bytes, port);
+	success = RunBenchmark("bulk", true, frame_count, frame_bytes, port + 1) && success;
+
+	Core::Shutdown();
+	return success ? 0 : -1;
+}
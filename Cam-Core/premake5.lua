@@ -42,7 +42,8 @@ project "Cam-Core"
 
 		links
 		{
-			"Ws2_32.lib"
+			"Ws2_32.lib",
+			"Iphlpapi.lib"
 		}
 
 	filter "system:macosx"
@@ -1,12 +1,17 @@
 #pragma once
 
 #include "Core/Buffer.h"
+#include "Core/BufferPool.h"
+#include "Core/FramePool.h"
 #include "Core/RingBuffer.h"
 #include "Core/Defines.h"
 #include "Core/Core.h"
 #include "Core/ThreadSafeQueue.h"
+#include "Core/SPSCQueue.h"
 #include "Core/FileSystem.h"
 #include "Core/FileSystemWatcher.h"
+#include "Core/MappedFile.h"
+#include "Core/ThreadPool.h"
 #include "Core/Crypto.h"
 #include "Core/Timer.h"
 #include "Core/Hash.h"
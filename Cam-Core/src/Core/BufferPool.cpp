@@ -0,0 +1,223 @@
+#include "BufferPool.h"
+
+#include <assert.h>
+#include <new>
+
+namespace Core
+{
+	BufferRef::BufferRef(PooledBuffer *buffer)
+		: m_Buffer(buffer)
+	{
+	}
+
+	BufferRef::BufferRef(const BufferRef &other)
+		: m_Buffer(other.m_Buffer)
+	{
+		if (m_Buffer)
+		{
+			m_Buffer->RefCount.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	BufferRef::BufferRef(BufferRef &&other) noexcept
+		: m_Buffer(other.m_Buffer)
+	{
+		other.m_Buffer = nullptr;
+	}
+
+	BufferRef::~BufferRef()
+	{
+		Reset();
+	}
+
+	BufferRef &BufferRef::operator=(const BufferRef &other)
+	{
+		if (m_Buffer != other.m_Buffer)
+		{
+			Reset();
+			m_Buffer = other.m_Buffer;
+			if (m_Buffer)
+			{
+				m_Buffer->RefCount.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		return *this;
+	}
+
+	BufferRef &BufferRef::operator=(BufferRef &&other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+			m_Buffer = other.m_Buffer;
+			other.m_Buffer = nullptr;
+		}
+
+		return *this;
+	}
+
+	void BufferRef::Reset()
+	{
+		if (!m_Buffer)
+		{
+			return;
+		}
+
+		// The last owner returns the buffer, acquire makes all writes of the other owners visible to it.
+		if (m_Buffer->RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			m_Buffer->Allocator->Release(m_Buffer);
+		}
+
+		m_Buffer = nullptr;
+	}
+
+	void BufferRef::SetSize(uint64 size)
+	{
+		assert(m_Buffer);
+		assert(size <= m_Buffer->Capacity);
+		m_Buffer->Size = size;
+	}
+
+	PooledBuffer *BufferAllocator::AllocateBuffer(uint64 capacity, uint32 size_class)
+	{
+		void *memory = ::operator new(sizeof(PooledBuffer) + capacity);
+		PooledBuffer *buffer = new(memory) PooledBuffer();
+		buffer->SizeClass = size_class;
+		buffer->Capacity = capacity;
+		buffer->Size = 0;
+		buffer->Allocator = this;
+		return buffer;
+	}
+
+	void BufferAllocator::FreeBuffer(PooledBuffer *buffer)
+	{
+		buffer->~PooledBuffer();
+		::operator delete(buffer);
+	}
+
+	BufferRef BufferAllocator::MakeRef(PooledBuffer *buffer, uint64 size)
+	{
+		buffer->RefCount.store(1, std::memory_order_relaxed);
+		buffer->Size = size;
+		return BufferRef(buffer);
+	}
+
+	BufferPool::BufferPool(uint64 max_cached_bytes)
+		: m_MaxCachedBytes(max_cached_bytes)
+	{
+	}
+
+	BufferPool::~BufferPool()
+	{
+		assert(m_OutstandingBytes == 0);
+		Trim();
+	}
+
+	BufferRef BufferPool::Acquire(uint64 size)
+	{
+		uint32 size_class = GetSizeClass(size);
+		uint64 capacity = size_class == CAM_INVALID_ID ? size : GetClassCapacity(size_class);
+
+		PooledBuffer *buffer = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (size_class != CAM_INVALID_ID && !m_FreeLists[size_class].empty())
+			{
+				buffer = m_FreeLists[size_class].back();
+				m_FreeLists[size_class].pop_back();
+				m_CachedBytes -= capacity;
+			}
+
+			m_OutstandingBytes += capacity;
+		}
+
+		if (!buffer)
+		{
+			buffer = AllocateBuffer(capacity, size_class);
+		}
+
+		return MakeRef(buffer, size);
+	}
+
+	void BufferPool::Trim()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (uint32 i = 0; i < SIZE_CLASS_COUNT; ++i)
+		{
+			for (PooledBuffer *buffer : m_FreeLists[i])
+			{
+				FreeBuffer(buffer);
+			}
+
+			m_FreeLists[i].clear();
+		}
+
+		m_CachedBytes = 0;
+	}
+
+	uint64 BufferPool::GetCachedBytes() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_CachedBytes;
+	}
+
+	uint64 BufferPool::GetOutstandingBytes() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_OutstandingBytes;
+	}
+
+	void BufferPool::Release(PooledBuffer *buffer)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_OutstandingBytes -= buffer->Capacity;
+
+			if (buffer->SizeClass != CAM_INVALID_ID && m_CachedBytes + buffer->Capacity <= m_MaxCachedBytes)
+			{
+				m_FreeLists[buffer->SizeClass].push_back(buffer);
+				m_CachedBytes += buffer->Capacity;
+				return;
+			}
+		}
+
+		FreeBuffer(buffer);
+	}
+
+	uint32 BufferPool::GetSizeClass(uint64 size)
+	{
+		if (size <= MIN_CLASS_SIZE)
+		{
+			return 0;
+		}
+
+		// Every power of two is split into four classes: p + 1/4 p, p + 2/4 p, p + 3/4 p and 2p.
+		uint32 exponent = 0;
+		for (uint64 value = size - 1; value > 1; value >>= 1)
+		{
+			++exponent;
+		}
+
+		uint64 base = 1ull << exponent;
+		uint64 step = base >> 2;
+		uint64 quarter = (size - base + step - 1) / step;
+
+		uint32 size_class = (exponent - 8) * 4 + (uint32)quarter;
+		return size_class < SIZE_CLASS_COUNT ? size_class : CAM_INVALID_ID;
+	}
+
+	uint64 BufferPool::GetClassCapacity(uint32 size_class)
+	{
+		if (size_class == 0)
+		{
+			return MIN_CLASS_SIZE;
+		}
+
+		uint32 exponent = 8 + (size_class - 1) / 4;
+		uint64 quarter = (size_class - 1) % 4 + 1;
+		uint64 base = 1ull << exponent;
+		return base + quarter * (base >> 2);
+	}
+}
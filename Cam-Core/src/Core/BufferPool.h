@@ -0,0 +1,128 @@
+#pragma once
+
+#include "Core.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace Core
+{
+	class BufferAllocator;
+
+	// Header of a pooled buffer, the data directly follows it in the same allocation.
+	struct PooledBuffer
+	{
+		std::atomic<uint32> RefCount;
+		uint32 SizeClass;
+		uint64 Capacity;
+		uint64 Size;
+		BufferAllocator *Allocator;
+
+		Byte *Data() { return (Byte *)(this + 1); }
+	};
+
+	// Reference counted handle to a pooled buffer. The buffer goes back to its pool, when the last handle is released.
+	// Copying a handle only increases the reference count, the data is never copied.
+	class BufferRef
+	{
+	public:
+
+		BufferRef() = default;
+		BufferRef(const BufferRef &other);
+		BufferRef(BufferRef &&other) noexcept;
+		~BufferRef();
+
+		BufferRef &operator=(const BufferRef &other);
+		BufferRef &operator=(BufferRef &&other) noexcept;
+
+		// Releases the reference, the handle is empty afterwards.
+		void Reset();
+
+		Byte *Data() const { return m_Buffer ? m_Buffer->Data() : nullptr; }
+
+		// The number of used bytes, can be changed up to the capacity without reallocating.
+		uint64 Size() const { return m_Buffer ? m_Buffer->Size : 0; }
+		void SetSize(uint64 size);
+
+		uint64 GetCapacity() const { return m_Buffer ? m_Buffer->Capacity : 0; }
+		uint32 GetRefCount() const { return m_Buffer ? m_Buffer->RefCount.load(std::memory_order_relaxed) : 0; }
+
+		bool IsValid() const { return m_Buffer != nullptr; }
+		explicit operator bool() const { return m_Buffer != nullptr; }
+
+	private:
+
+		friend class BufferAllocator;
+		explicit BufferRef(PooledBuffer *buffer);
+
+		PooledBuffer *m_Buffer = nullptr;
+	};
+
+	// Base of the pools, which hand out buffers. A buffer is given back to the allocator, which created it.
+	class BufferAllocator
+	{
+	public:
+
+		virtual ~BufferAllocator() {}
+
+	protected:
+
+		friend class BufferRef;
+
+		// Is called when the last handle to the buffer has been released.
+		virtual void Release(PooledBuffer *buffer) = 0;
+
+		// Allocates the header and the data of a buffer in one block, the buffer belongs to this allocator.
+		PooledBuffer *AllocateBuffer(uint64 capacity, uint32 size_class);
+		static void FreeBuffer(PooledBuffer *buffer);
+
+		// Returns the first handle to a buffer, which is handed out.
+		static BufferRef MakeRef(PooledBuffer *buffer, uint64 size);
+	};
+
+	// Recycles large buffers, so that steady state network and frame processing does not allocate.
+	// Requests are rounded up to size classes with at most 25% overhead, released buffers are kept per size class.
+	// All functions are thread safe. The pool has to outlive all buffers it handed out.
+	class BufferPool : public BufferAllocator
+	{
+	public:
+
+		BufferPool(uint64 max_cached_bytes = 256ull * 1024 * 1024);
+		~BufferPool();
+
+		// Returns a buffer with at least the given capacity, its size is set to the requested size.
+		BufferRef Acquire(uint64 size);
+
+		// Frees all cached buffers.
+		void Trim();
+
+		// The bytes of released buffers, which are kept for reuse.
+		uint64 GetCachedBytes() const;
+
+		// The bytes of buffers, which are currently handed out.
+		uint64 GetOutstandingBytes() const;
+
+	private:
+
+		virtual void Release(PooledBuffer *buffer) override;
+
+		static uint32 GetSizeClass(uint64 size);
+		static uint64 GetClassCapacity(uint32 size_class);
+
+	private:
+
+		// The smallest size class, smaller requests are rounded up.
+		static constexpr uint64 MIN_CLASS_SIZE = 256;
+
+		// Enough classes for buffers up to 1 GB, larger buffers are allocated without pooling.
+		static constexpr uint32 SIZE_CLASS_COUNT = 89;
+
+		uint64 m_MaxCachedBytes;
+		uint64 m_CachedBytes = 0;
+		uint64 m_OutstandingBytes = 0;
+
+		std::vector<PooledBuffer *> m_FreeLists[SIZE_CLASS_COUNT];
+		mutable std::mutex m_Mutex;
+	};
+}
@@ -30,6 +30,22 @@ namespace Core
 		bool RemoveFile(const std::string &filePath) const;
 		bool RemoveDirectoy(const std::string &filePath) const;
 
+		// Creates the directory and all missing parent directories, returns true if it exists afterwards.
+		bool CreateDirectories(const std::string &filePath) const;
+
+		// Removes the directory with everything inside it.
+		bool RemoveDirectoryTree(const std::string &filePath) const;
+
+		// Moves a file or directory, an existing file at the target is replaced.
+		bool RenameFile(const std::string &from, const std::string &to) const;
+
+		// Replaces the directory target with the directory source, source does not exist afterwards.
+		// Where the platform allows it, both are exchanged in one step, so target is never missing or half written.
+		bool ReplaceDirectory(const std::string &source, const std::string &target) const;
+
+		// Sets the Unix permission bits of a file. Does nothing on platforms without them.
+		bool SetFileMode(const std::string &filePath, uint32 mode) const;
+
 		bool StartProgram(const std::string &executable);
 	};
 
@@ -56,7 +72,8 @@ namespace Core
 
 		inline void Free()
 		{
-			free(Data);
+			// Alloc and FileSystem::ReadFile both allocate with new[].
+			delete[] Data;
 			Data = nullptr;
 			Size = 0;
 		}
@@ -0,0 +1,110 @@
+#include "FramePool.h"
+
+#include <assert.h>
+
+namespace Core
+{
+	FramePool::FramePool(uint64 frame_size, uint32 frame_count)
+	{
+		Resize(frame_size, frame_count);
+	}
+
+	FramePool::~FramePool()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		assert(m_Outstanding == 0);
+
+		for (PooledBuffer *buffer : m_FreeFrames)
+		{
+			FreeBuffer(buffer);
+		}
+
+		m_FreeFrames.clear();
+	}
+
+	void FramePool::Resize(uint64 frame_size, uint32 frame_count)
+	{
+		std::vector<PooledBuffer *> frames;
+		frames.reserve(frame_count);
+
+		for (uint32 i = 0; i < frame_count; ++i)
+		{
+			frames.push_back(AllocateBuffer(frame_size, CAM_INVALID_ID));
+		}
+
+		std::vector<PooledBuffer *> previous_frames;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			previous_frames.swap(m_FreeFrames);
+
+			m_FrameSize = frame_size;
+			m_FrameCount = frame_count;
+
+			// Outstanding frames of the old size are freed on release, so they do not count against the new frames.
+			m_Outstanding = 0;
+
+			m_FreeFrames.swap(frames);
+			m_FreeFrames.reserve(frame_count);
+		}
+
+		for (PooledBuffer *buffer : previous_frames)
+		{
+			FreeBuffer(buffer);
+		}
+	}
+
+	BufferRef FramePool::Acquire()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (m_FreeFrames.empty())
+		{
+			++m_ExhaustedCount;
+			return {};
+		}
+
+		PooledBuffer *buffer = m_FreeFrames.back();
+		m_FreeFrames.pop_back();
+		++m_Outstanding;
+
+		return MakeRef(buffer, m_FrameSize);
+	}
+
+	uint64 FramePool::GetFrameSize() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_FrameSize;
+	}
+
+	uint32 FramePool::GetFrameCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_FrameCount;
+	}
+
+	uint32 FramePool::GetFreeCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return (uint32)m_FreeFrames.size();
+	}
+
+	uint64 FramePool::GetExhaustedCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_ExhaustedCount;
+	}
+
+	void FramePool::Release(PooledBuffer *buffer)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (buffer->Capacity == m_FrameSize && m_Outstanding > 0 && m_FreeFrames.size() < m_FrameCount)
+			{
+				m_FreeFrames.push_back(buffer);
+				--m_Outstanding;
+				return;
+			}
+		}
+
+		FreeBuffer(buffer);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Core.h"
+#include "BufferPool.h"
+
+#include <mutex>
+#include <vector>
+
+namespace Core
+{
+	// A fixed number of equally sized buffers, which are all allocated up front, e.g. one per captured frame in flight.
+	// Acquire never allocates, it fails if all frames are handed out, so the memory used for frames is bounded.
+	// All functions are thread safe. The pool has to outlive all buffers it handed out.
+	class FramePool : public BufferAllocator
+	{
+	public:
+
+		FramePool() = default;
+		FramePool(uint64 frame_size, uint32 frame_count);
+		~FramePool();
+
+		// Allocates frame_count buffers of frame_size bytes and frees the previous ones.
+		// Buffers, which are still handed out, stay valid and are freed once they are released, if their size does not match anymore.
+		void Resize(uint64 frame_size, uint32 frame_count);
+
+		// Returns a free frame buffer, or an empty handle if all frames are in use.
+		BufferRef Acquire();
+
+		uint64 GetFrameSize() const;
+		uint32 GetFrameCount() const;
+
+		// The number of frames, which can be acquired right now.
+		uint32 GetFreeCount() const;
+
+		// The number of calls to Acquire, which failed because all frames were in use.
+		uint64 GetExhaustedCount() const;
+
+	private:
+
+		virtual void Release(PooledBuffer *buffer) override;
+
+	private:
+
+		uint64 m_FrameSize = 0;
+		uint32 m_FrameCount = 0;
+		uint32 m_Outstanding = 0;
+		uint64 m_ExhaustedCount = 0;
+
+		// Reserved for all frames, so that releasing a frame never allocates.
+		std::vector<PooledBuffer *> m_FreeFrames;
+		mutable std::mutex m_Mutex;
+	};
+}
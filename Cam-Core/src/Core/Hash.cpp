@@ -1,6 +1,7 @@
 #include "Hash.h"
 
 #include <assert.h>
+#include <string.h>
 
 namespace Core
 {
@@ -102,5 +103,116 @@ namespace Core
 
 		return x;
 	}
+
+	static uint32 Rotr32(uint32 x, uint32 n)
+	{
+		return (x >> n) | (x << (32 - n));
+	}
+
+	static void Sha256Block(uint32 *state, Byte const *block)
+	{
+		static uint32 const k[64] =
+		{
+			0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+			0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+			0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+			0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+			0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+			0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+			0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+			0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+		};
+
+		uint32 w[64];
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			w[i] = ((uint32)block[i * 4] << 24) | ((uint32)block[i * 4 + 1] << 16) | ((uint32)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+		}
+
+		for (uint32 i = 16; i < 64; ++i)
+		{
+			uint32 s0 = Rotr32(w[i - 15], 7) ^ Rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			uint32 s1 = Rotr32(w[i - 2], 17) ^ Rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		uint32 a = state[0], b = state[1], c = state[2], d = state[3];
+		uint32 e = state[4], f = state[5], g = state[6], h = state[7];
+
+		for (uint32 i = 0; i < 64; ++i)
+		{
+			uint32 t1 = h + (Rotr32(e, 6) ^ Rotr32(e, 11) ^ Rotr32(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+			uint32 t2 = (Rotr32(a, 2) ^ Rotr32(a, 13) ^ Rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+	}
+
+	void Sha256(void const *src, uint32 bytes, Byte *out_digest)
+	{
+		assert(src || bytes == 0);
+		assert(out_digest);
+
+		uint32 state[8] =
+		{
+			0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+			0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+		};
+
+		Byte const *ptr = (Byte const *)src;
+		uint32 remaining = bytes;
+
+		while (remaining >= 64)
+		{
+			Sha256Block(state, ptr);
+			ptr += 64;
+			remaining -= 64;
+		}
+
+		// The last block is padded with a single 1 bit, zeros and the message length in bits.
+		Byte tail[128] = {};
+		if (remaining > 0)
+		{
+			memcpy(tail, ptr, remaining);
+		}
+
+		tail[remaining] = 0x80;
+
+		uint32 tail_bytes = remaining < 56 ? 64 : 128;
+		uint64 bits = (uint64)bytes * 8;
+		for (uint32 i = 0; i < 8; ++i)
+		{
+			tail[tail_bytes - 1 - i] = (Byte)(bits >> (i * 8));
+		}
+
+		for (uint32 i = 0; i < tail_bytes; i += 64)
+		{
+			Sha256Block(state, tail + i);
+		}
+
+		for (uint32 i = 0; i < 8; ++i)
+		{
+			out_digest[i * 4] = (Byte)(state[i] >> 24);
+			out_digest[i * 4 + 1] = (Byte)(state[i] >> 16);
+			out_digest[i * 4 + 2] = (Byte)(state[i] >> 8);
+			out_digest[i * 4 + 3] = (Byte)state[i];
+		}
+	}
 }
 
@@ -9,5 +9,11 @@ namespace Core
 	uint64 Mix64(uint64 x);
 	uint64 Raw64(void const *src, uint32 bytes);
 	uint32 Text(char const *src);
+
+	// The size of a SHA-256 digest.
+	constexpr uint32 SHA256_BYTES = 32;
+
+	// Cryptographic hash, for data which has to be identified reliably, like the chunks of an update.
+	void Sha256(void const *src, uint32 bytes, Byte *out_digest);
 }
 
@@ -0,0 +1,19 @@
+#include "MappedFile.h"
+
+#ifdef CAM_PLATFORM_WINDOWS
+#include "Platform/Windows/WindowsMappedFile.h"
+#elif CAM_PLATFORM_LINUX
+#include "Platform/Linux/LinuxMappedFile.h"
+#endif
+
+namespace Core
+{
+	MappedFile *MappedFile::Create()
+	{
+#ifdef CAM_PLATFORM_WINDOWS
+		return new WindowsMappedFile();
+#elif CAM_PLATFORM_LINUX
+		return new LinuxMappedFile();
+#endif
+	}
+}
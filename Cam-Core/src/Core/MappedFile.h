@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+#include "Core.h"
+
+namespace Core
+{
+	// A file, which is mapped into memory for reading and writing. Changes to the memory end up in the file,
+	// the operating system writes them back in the background and keeps them, if the process dies.
+	class MappedFile
+	{
+	public:
+
+		virtual ~MappedFile() {}
+
+		// Opens or creates the file and maps the first size bytes of it. The file is resized to size,
+		// existing contents are kept and new bytes are zero. Returns false, if the file could not be mapped.
+		virtual bool Open(const std::string &path, uint64 size) = 0;
+
+		// Unmaps and closes the file, pending changes are still written back.
+		virtual void Close() = 0;
+
+		// Starts writing the changed pages back to the file, without waiting for the disk.
+		virtual bool Flush() = 0;
+
+		bool IsOpen() const { return m_Data != nullptr; }
+		Byte *GetData() const { return m_Data; }
+		uint64 GetSize() const { return m_Size; }
+
+		static MappedFile *Create();
+
+	protected:
+
+		Byte *m_Data = nullptr;
+		uint64 m_Size = 0;
+	};
+}
@@ -0,0 +1,335 @@
+#pragma once
+
+#include "Core.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+
+namespace Core
+{
+	// Decides what happens, when a value is pushed into a full queue.
+	enum class QueueOverflowPolicy
+	{
+		// The oldest queued value is dropped, the consumer always gets the most recent values.
+		DropOldest = 0,
+
+		// The pushed value is dropped, the queued values stay untouched.
+		DropNewest,
+
+		// The producer waits until the consumer made room for the value.
+		Block
+	};
+
+	struct QueueStats
+	{
+		uint64 Pushed = 0;
+		uint64 Popped = 0;
+		uint64 Dropped = 0;
+		uint32 Size = 0;
+		uint32 Capacity = 0;
+
+		// The highest number of values, which have been queued at the same time.
+		uint32 HighWatermark = 0;
+	};
+
+	// Bounded lock free queue between exactly one producer thread and exactly one consumer thread.
+	// All slots are allocated up front, so the memory used by the queue never grows, regardless of how slow the consumer is.
+	// A mutex is only touched, if one side has to sleep because the queue is empty or full.
+	template<typename T>
+	class SPSCQueue
+	{
+	public:
+
+		SPSCQueue(uint32 capacity, QueueOverflowPolicy policy = QueueOverflowPolicy::DropOldest)
+			: m_Capacity(capacity ? capacity : 1), m_Policy(policy)
+		{
+			m_Slots = new Slot[m_Capacity];
+			for (uint32 i = 0; i < m_Capacity; ++i)
+			{
+				m_Slots[i].Sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		~SPSCQueue()
+		{
+			uint64 write_pos = m_WritePos.load(std::memory_order_acquire);
+			for (uint64 pos = m_ReadPos.load(std::memory_order_acquire); pos < write_pos; ++pos)
+			{
+				m_Slots[pos % m_Capacity].Get()->~T();
+			}
+
+			delete[] m_Slots;
+		}
+
+		SPSCQueue(const SPSCQueue &) = delete;
+		SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+		// Pushes a value, may only be called from the producer thread.
+		// Returns false, if the value has been dropped or the queue has been closed.
+		bool Push(const T &value)
+		{
+			T copy = value;
+			return Push(std::move(copy));
+		}
+
+		bool Push(T &&value)
+		{
+			if (m_Closed.load(std::memory_order_acquire))
+			{
+				return false;
+			}
+
+			uint64 pos = m_WritePos.load(std::memory_order_relaxed);
+			Slot &slot = m_Slots[pos % m_Capacity];
+
+			while (slot.Sequence.load(std::memory_order_acquire) != pos)
+			{
+				// The slot still holds the value, which was pushed one lap earlier.
+				if (m_Policy == QueueOverflowPolicy::DropNewest)
+				{
+					m_Dropped.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+
+				if (m_Policy == QueueOverflowPolicy::DropOldest)
+				{
+					// Take the oldest value away from the consumer. If the consumer was faster, it is just moving
+					// the value out of the slot, and the slot is free in a moment.
+					uint64 oldest = pos - m_Capacity;
+					if (m_ReadPos.compare_exchange_strong(oldest, oldest + 1, std::memory_order_acq_rel))
+					{
+						slot.Get()->~T();
+						slot.Sequence.store(pos, std::memory_order_release);
+						m_Dropped.fetch_add(1, std::memory_order_relaxed);
+						break;
+					}
+
+					std::this_thread::yield();
+					continue;
+				}
+
+				if (!WaitForSlot(slot, pos))
+				{
+					return false;
+				}
+			}
+
+			new(slot.Storage) T(std::move(value));
+			slot.Sequence.store(pos + 1, std::memory_order_release);
+			m_WritePos.store(pos + 1, std::memory_order_relaxed);
+
+			m_Pushed.fetch_add(1, std::memory_order_relaxed);
+			UpdateHighWatermark();
+
+			Notify(m_ConsumerWaiting, m_NotEmptyMutex, m_NotEmpty);
+			return true;
+		}
+
+		// Pops the oldest value without waiting, may only be called from the consumer thread.
+		// Returns false, if the queue is empty.
+		bool TryPop(T &out_value)
+		{
+			uint64 pos = m_ReadPos.load(std::memory_order_acquire);
+			for (;;)
+			{
+				Slot &slot = m_Slots[pos % m_Capacity];
+				if (slot.Sequence.load(std::memory_order_acquire) != pos + 1)
+				{
+					return false;
+				}
+
+				// Claim the value first, the producer may drop it in the meantime.
+				if (!m_ReadPos.compare_exchange_weak(pos, pos + 1, std::memory_order_acq_rel))
+				{
+					continue;
+				}
+
+				T *value = slot.Get();
+				out_value = std::move(*value);
+				value->~T();
+				slot.Sequence.store(pos + m_Capacity, std::memory_order_release);
+
+				m_Popped.fetch_add(1, std::memory_order_relaxed);
+				Notify(m_ProducerWaiting, m_NotFullMutex, m_NotFull);
+				return true;
+			}
+		}
+
+		// Pops the oldest value and waits up to timeout_ms milliseconds (-1 waits forever) for one to arrive.
+		// Returns false, if no value arrived in time or the queue has been closed and is empty.
+		bool Pop(T &out_value, int32 timeout_ms = -1)
+		{
+			if (TryPop(out_value))
+			{
+				return true;
+			}
+
+			if (timeout_ms == 0)
+			{
+				return false;
+			}
+
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+			std::unique_lock<std::mutex> lock(m_NotEmptyMutex);
+
+			for (;;)
+			{
+				m_ConsumerWaiting.store(true, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (TryPop(out_value))
+				{
+					m_ConsumerWaiting.store(false, std::memory_order_relaxed);
+					return true;
+				}
+
+				if (m_Closed.load(std::memory_order_acquire))
+				{
+					m_ConsumerWaiting.store(false, std::memory_order_relaxed);
+					return false;
+				}
+
+				if (timeout_ms < 0)
+				{
+					m_NotEmpty.wait(lock);
+				}
+				else if (m_NotEmpty.wait_until(lock, deadline) == std::cv_status::timeout)
+				{
+					m_ConsumerWaiting.store(false, std::memory_order_relaxed);
+					return TryPop(out_value);
+				}
+			}
+		}
+
+		// Wakes up all waiting threads. Values pushed afterwards are rejected, values already queued can still be popped.
+		void Close()
+		{
+			m_Closed.store(true, std::memory_order_release);
+
+			{
+				std::lock_guard<std::mutex> lock(m_NotEmptyMutex);
+				m_NotEmpty.notify_all();
+			}
+
+			std::lock_guard<std::mutex> lock(m_NotFullMutex);
+			m_NotFull.notify_all();
+		}
+
+		// Allows pushing values again after Close.
+		void Reopen()
+		{
+			m_Closed.store(false, std::memory_order_release);
+		}
+
+		bool IsClosed() const { return m_Closed.load(std::memory_order_acquire); }
+
+		// Returns the number of queued values. Only a snapshot, if called while the other thread is working on the queue.
+		uint32 Size() const
+		{
+			uint64 read_pos = m_ReadPos.load(std::memory_order_acquire);
+			uint64 write_pos = m_WritePos.load(std::memory_order_acquire);
+			return write_pos > read_pos ? (uint32)(write_pos - read_pos) : 0;
+		}
+
+		uint32 Capacity() const { return m_Capacity; }
+		QueueOverflowPolicy GetPolicy() const { return m_Policy; }
+
+		QueueStats GetStats() const
+		{
+			QueueStats stats;
+			stats.Pushed = m_Pushed.load(std::memory_order_relaxed);
+			stats.Popped = m_Popped.load(std::memory_order_relaxed);
+			stats.Dropped = m_Dropped.load(std::memory_order_relaxed);
+			stats.Size = Size();
+			stats.Capacity = m_Capacity;
+			stats.HighWatermark = m_HighWatermark.load(std::memory_order_relaxed);
+			return stats;
+		}
+
+	private:
+
+		struct Slot
+		{
+			// Equals the write position, if the slot is free for that position, and the write position + 1, if it holds its value.
+			std::atomic<uint64> Sequence;
+			alignas(T) Byte Storage[sizeof(T)];
+
+			T *Get() { return std::launder(reinterpret_cast<T *>(Storage)); }
+		};
+
+		// Only used by the Block policy, returns false if the queue has been closed while waiting.
+		bool WaitForSlot(Slot &slot, uint64 pos)
+		{
+			std::unique_lock<std::mutex> lock(m_NotFullMutex);
+			for (;;)
+			{
+				m_ProducerWaiting.store(true, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (slot.Sequence.load(std::memory_order_acquire) == pos)
+				{
+					m_ProducerWaiting.store(false, std::memory_order_relaxed);
+					return true;
+				}
+
+				if (m_Closed.load(std::memory_order_acquire))
+				{
+					m_ProducerWaiting.store(false, std::memory_order_relaxed);
+					return false;
+				}
+
+				m_NotFull.wait(lock);
+			}
+		}
+
+		void Notify(std::atomic<bool> &waiting, std::mutex &mutex, std::condition_variable &condition)
+		{
+			// Pairs with the store of the waiting flag, so that either the waiter sees the new value or the flag is seen here.
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (waiting.load(std::memory_order_relaxed))
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				waiting.store(false, std::memory_order_relaxed);
+				condition.notify_one();
+			}
+		}
+
+		void UpdateHighWatermark()
+		{
+			uint32 size = Size();
+			uint32 high_watermark = m_HighWatermark.load(std::memory_order_relaxed);
+			while (size > high_watermark && !m_HighWatermark.compare_exchange_weak(high_watermark, size, std::memory_order_relaxed))
+			{
+			}
+		}
+
+	private:
+
+		// The read and write positions only grow, the slot of a position is position % capacity.
+		// They are kept on separate cache lines, so that the producer and the consumer do not slow each other down.
+		alignas(64) std::atomic<uint64> m_WritePos = 0;
+		alignas(64) std::atomic<uint64> m_ReadPos = 0;
+
+		alignas(64) Slot *m_Slots = nullptr;
+		uint32 m_Capacity;
+		QueueOverflowPolicy m_Policy;
+		std::atomic<bool> m_Closed = false;
+
+		std::atomic<uint64> m_Pushed = 0;
+		std::atomic<uint64> m_Popped = 0;
+		std::atomic<uint64> m_Dropped = 0;
+		std::atomic<uint32> m_HighWatermark = 0;
+
+		// The consumer sleeps on m_NotEmpty and the producer on m_NotFull. Separate mutexes, because the consumer notifies the
+		// producer while it holds its own mutex.
+		std::mutex m_NotEmptyMutex;
+		std::mutex m_NotFullMutex;
+		std::condition_variable m_NotEmpty;
+		std::condition_variable m_NotFull;
+		std::atomic<bool> m_ConsumerWaiting = false;
+		std::atomic<bool> m_ProducerWaiting = false;
+	};
+}
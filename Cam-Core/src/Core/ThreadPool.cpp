@@ -0,0 +1,95 @@
+#include "ThreadPool.h"
+
+namespace Core
+{
+	ThreadPool::ThreadPool(uint32 thread_count)
+	{
+		if (thread_count == 0)
+		{
+			uint32 cores = std::thread::hardware_concurrency();
+			thread_count = cores > 1 ? cores - 1 : 0;
+		}
+
+		m_Threads.reserve(thread_count);
+		for (uint32 i = 0; i < thread_count; ++i)
+		{
+			m_Threads.emplace_back(&ThreadPool::WorkerLoop, this);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Stop = true;
+		}
+
+		m_WakeCondition.notify_all();
+		for (std::thread &thread : m_Threads)
+		{
+			thread.join();
+		}
+	}
+
+	void ThreadPool::ParallelFor(uint32 count, const std::function<void(uint32)> &job)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> job_lock(m_JobMutex);
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Job = &job;
+			m_JobCount = count;
+			m_NextIndex = 0;
+			m_BusyWorkers = (uint32)m_Threads.size();
+			++m_Generation;
+		}
+
+		m_WakeCondition.notify_all();
+		RunJob();
+
+		// The job may only be released, once no worker can call it anymore.
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_DoneCondition.wait(lock, [this]() { return m_BusyWorkers == 0; });
+		m_Job = nullptr;
+	}
+
+	void ThreadPool::WorkerLoop()
+	{
+		uint64 generation = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_WakeCondition.wait(lock, [&]() { return m_Stop || m_Generation != generation; });
+
+				if (m_Stop)
+				{
+					return;
+				}
+
+				generation = m_Generation;
+			}
+
+			RunJob();
+
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (--m_BusyWorkers == 0)
+			{
+				m_DoneCondition.notify_one();
+			}
+		}
+	}
+
+	void ThreadPool::RunJob()
+	{
+		for (uint32 index = m_NextIndex++; index < m_JobCount; index = m_NextIndex++)
+		{
+			(*m_Job)(index);
+		}
+	}
+}
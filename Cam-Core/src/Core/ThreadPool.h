@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Core.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Core
+{
+	// A fixed set of worker threads for jobs, which can be split into independent parts.
+	// The threads are started once and sleep between the jobs.
+	class ThreadPool
+	{
+	public:
+
+		// Starts thread_count workers, 0 starts one less than the number of cores, the calling thread works as well.
+		ThreadPool(uint32 thread_count = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool &) = delete;
+		ThreadPool &operator=(const ThreadPool &) = delete;
+
+		// Calls job once for every index from 0 to count - 1 on the workers and the calling thread, and returns once all calls returned.
+		// The calls run in any order and at the same time, only one job runs at once.
+		void ParallelFor(uint32 count, const std::function<void(uint32)> &job);
+
+		// The number of threads, which work on a job, including the calling thread.
+		uint32 GetThreadCount() const { return (uint32)m_Threads.size() + 1; }
+
+	private:
+
+		void WorkerLoop();
+		void RunJob();
+
+	private:
+
+		std::vector<std::thread> m_Threads;
+
+		// Serializes the calls to ParallelFor.
+		std::mutex m_JobMutex;
+
+		std::mutex m_Mutex;
+		std::condition_variable m_WakeCondition;
+		std::condition_variable m_DoneCondition;
+
+		const std::function<void(uint32)> *m_Job = nullptr;
+		uint32 m_JobCount = 0;
+		std::atomic<uint32> m_NextIndex = 0;
+
+		// Incremented for every job, a sleeping worker wakes up, once it changes.
+		uint64 m_Generation = 0;
+		uint32 m_BusyWorkers = 0;
+		bool m_Stop = false;
+	};
+}
@@ -7,6 +7,9 @@ namespace Core
 	// Returns the current time in milliseconds.
 	int64 QueryMS();
 
+	// Returns the current time in microseconds, for measuring short durations.
+	int64 QueryUS();
+
 	// Sleeps for the given number of milliseconds.
 	void SleepMS(uint32 ms);
 }
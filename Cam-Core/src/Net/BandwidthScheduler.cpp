@@ -0,0 +1,164 @@
+#include "BandwidthScheduler.h"
+
+#include "Utils/Utils.h"
+
+namespace Core
+{
+	static constexpr int64 TOKEN_SCALE = 1000000;
+
+	BandwidthScheduler::BandwidthScheduler(const BandwidthLimits &limits)
+		: m_NextLimits(limits), m_Limits(limits)
+	{
+	}
+
+	void BandwidthScheduler::SetLimits(const BandwidthLimits &limits)
+	{
+		std::lock_guard<std::mutex> lock(m_LimitsMutex);
+		m_NextLimits = limits;
+		m_LimitsChanged = true;
+	}
+
+	BandwidthLimits BandwidthScheduler::GetLimits()
+	{
+		std::lock_guard<std::mutex> lock(m_LimitsMutex);
+		return m_NextLimits;
+	}
+
+	void BandwidthScheduler::ReportLive(uint32 bytes)
+	{
+		m_PendingLiveBytes += bytes;
+	}
+
+	bool BandwidthScheduler::IsAvailable(BandwidthLeaf *leaf, int64 now_us)
+	{
+		Refill(now_us);
+		RefillLeaf(leaf, now_us);
+
+		if (m_RootTokens <= 0 || m_ClassTokens <= 0)
+		{
+			return false;
+		}
+
+		if (leaf->Tokens > 0)
+		{
+			return true;
+		}
+
+		// The class bucket only fills up, if the other clients leave their shares unused, the client may borrow them.
+		return m_ClassTokens * 2 > m_ClassBurst;
+	}
+
+	void BandwidthScheduler::Consume(BandwidthLeaf *leaf, uint32 bytes)
+	{
+		int64 tokens = (int64)bytes * TOKEN_SCALE;
+
+		// Borrowed bandwidth is only charged to the class, the client keeps its own share.
+		if (leaf->Tokens > 0)
+		{
+			leaf->Tokens -= tokens;
+		}
+
+		m_ClassTokens -= tokens;
+		m_RootTokens -= tokens;
+	}
+
+	bool BandwidthScheduler::IsClassAvailable(int64 now_us)
+	{
+		Refill(now_us);
+		return m_RootTokens > 0 && m_ClassTokens > 0;
+	}
+
+	void BandwidthScheduler::ConsumeClass(uint32 bytes)
+	{
+		int64 tokens = (int64)bytes * TOKEN_SCALE;
+		m_ClassTokens -= tokens;
+		m_RootTokens -= tokens;
+	}
+
+	int64 BandwidthScheduler::GetClassWaitUS(int64 now_us) const
+	{
+		if (m_RootTokens > 0 && m_ClassTokens > 0)
+		{
+			return 0;
+		}
+
+		// Without a rate for the update class, it waits for the live traffic to end.
+		if (m_ClassRate == 0)
+		{
+			return utils::Max<int64>(m_LastLiveUS + LIVE_HOLD_US - now_us, 1);
+		}
+
+		// The buckets were refilled last at m_TimeUS.
+		int64 root_wait_us = m_RootTokens > 0 || m_Limits.EgressBytesPerSecond == 0 ? 0 : -m_RootTokens / (int64)m_Limits.EgressBytesPerSecond + 1;
+		int64 class_wait_us = m_ClassTokens > 0 ? 0 : -m_ClassTokens / (int64)m_ClassRate + 1;
+		return utils::Max<int64>(utils::Max<int64>(root_wait_us, class_wait_us) - (now_us - m_TimeUS), 1);
+	}
+
+	void BandwidthScheduler::Refill(int64 now_us)
+	{
+		if (m_LimitsChanged)
+		{
+			std::lock_guard<std::mutex> lock(m_LimitsMutex);
+			m_Limits = m_NextLimits;
+			m_LimitsChanged = false;
+		}
+
+		int64 burst_us = (int64)m_Limits.BurstMS * 1000;
+		int64 root_burst = (int64)m_Limits.EgressBytesPerSecond * burst_us;
+
+		// The live traffic has been sent already, it is charged to the egress budget and the update traffic waits, until it is paid off.
+		uint64 live_bytes = m_PendingLiveBytes.exchange(0);
+		if (live_bytes > 0)
+		{
+			m_LastLiveUS = now_us;
+			m_RootTokens = utils::Max<int64>(m_RootTokens - (int64)live_bytes * TOKEN_SCALE, -(int64)m_Limits.EgressBytesPerSecond * TOKEN_SCALE);
+		}
+
+		m_LivePresent = m_LastLiveUS != 0 && now_us - m_LastLiveUS < LIVE_HOLD_US;
+		m_ClassRate = m_LivePresent ? utils::Min<uint64>(m_Limits.UpdateBytesPerSecondWhileLive, m_Limits.EgressBytesPerSecond) : m_Limits.EgressBytesPerSecond;
+		m_ClassBurst = (int64)m_ClassRate * burst_us;
+
+		// A new scheduler starts with full buckets.
+		int64 elapsed_us = m_TimeUS == 0 ? burst_us : utils::Min<int64>(now_us - m_TimeUS, burst_us);
+		if (elapsed_us > 0)
+		{
+			m_RootTokens += (int64)m_Limits.EgressBytesPerSecond * elapsed_us;
+			m_ClassTokens += (int64)m_ClassRate * elapsed_us;
+			m_TimeUS = now_us;
+		}
+
+		m_RootTokens = utils::Min<int64>(m_RootTokens, root_burst);
+		m_ClassTokens = utils::Min<int64>(m_ClassTokens, m_ClassBurst);
+
+		if (now_us - m_EpochStartUS >= EPOCH_US)
+		{
+			m_ActiveWeight = utils::Max<uint64>(m_EpochWeight, 1);
+			m_EpochWeight = 0;
+			m_EpochStartUS = now_us;
+			++m_Epoch;
+		}
+	}
+
+	void BandwidthScheduler::RefillLeaf(BandwidthLeaf *leaf, int64 now_us)
+	{
+		uint64 weight = leaf->Weight > 0 ? leaf->Weight : 1;
+		if (leaf->Epoch != m_Epoch)
+		{
+			leaf->Epoch = m_Epoch;
+			m_EpochWeight += weight;
+		}
+
+		// The share is taken from the clients, which were active in the last epoch, a new client gets the whole class at most.
+		uint64 share = m_ClassRate * utils::Min<uint64>(weight, m_ActiveWeight) / m_ActiveWeight;
+		int64 burst_us = (int64)m_Limits.BurstMS * 1000;
+
+		int64 elapsed_us = leaf->TimeUS == 0 ? burst_us : utils::Min<int64>(now_us - leaf->TimeUS, burst_us);
+		if (elapsed_us > 0)
+		{
+			leaf->Tokens += (int64)share * elapsed_us;
+			leaf->TimeUS = now_us;
+		}
+
+		leaf->Tokens = utils::Min<int64>(leaf->Tokens, (int64)share * burst_us);
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Core/Core.h"
+
+#include <atomic>
+#include <mutex>
+
+namespace Core
+{
+	struct BandwidthLimits
+	{
+		// The budget for all outgoing traffic, including the live traffic, in bytes per second.
+		uint64 EgressBytesPerSecond = 8 * 1024 * 1024;
+
+		// The update traffic, which is still sent while live traffic is present, in bytes per second. 0 stops it completely.
+		uint64 UpdateBytesPerSecondWhileLive = 128 * 1024;
+
+		// How much bandwidth a bucket may save up, while it is not used.
+		uint32 BurstMS = 50;
+	};
+
+	// The bandwidth state of a single client. It starts zeroed, a zero weight counts as 1.
+	struct BandwidthLeaf
+	{
+		// In bytes * 1000000, so that a bucket refilled every microsecond does not lose the fractions.
+		int64 Tokens;
+		int64 TimeUS;
+
+		// The share of the client, relative to the other active clients.
+		uint32 Weight;
+		uint32 Epoch;
+	};
+
+	// A hierarchical token bucket. The root bucket enforces the egress budget, the live traffic is charged to it first,
+	// the update class gets the rest. Inside the update class the active clients share the bandwidth by their weight,
+	// a client may borrow the share of clients, which do not use it.
+	// Everything except SetLimits and ReportLive has to be called from the same thread.
+	class BandwidthScheduler
+	{
+	public:
+
+		BandwidthScheduler(const BandwidthLimits &limits = {});
+
+		// Changes the limits, they are picked up by the next call on the sending thread. Can be called from any thread.
+		void SetLimits(const BandwidthLimits &limits);
+		BandwidthLimits GetLimits();
+
+		// Charges live traffic, which was sent somewhere else. Can be called from any thread.
+		void ReportLive(uint32 bytes);
+
+		// Returns true, if the client may send now.
+		bool IsAvailable(BandwidthLeaf *leaf, int64 now_us);
+
+		// Charges the bytes, which were sent to the client.
+		void Consume(BandwidthLeaf *leaf, uint32 bytes);
+
+		// Returns true, if the update class may send traffic, which belongs to no single client.
+		bool IsClassAvailable(int64 now_us);
+
+		// Charges update traffic, which belongs to no single client.
+		void ConsumeClass(uint32 bytes);
+
+		// Returns the microseconds until the update class has bandwidth again, 0 if it has some now.
+		int64 GetClassWaitUS(int64 now_us) const;
+
+		// Returns true, if live traffic was reported recently.
+		bool IsLivePresent() const { return m_LivePresent; }
+
+	private:
+
+		void Refill(int64 now_us);
+		void RefillLeaf(BandwidthLeaf *leaf, int64 now_us);
+
+	private:
+
+		// Update traffic stays limited for this long after the last live traffic.
+		static constexpr int64 LIVE_HOLD_US = 500000;
+
+		// The clients, which asked for bandwidth within one epoch, share it in the next one.
+		static constexpr int64 EPOCH_US = 100000;
+
+		std::mutex m_LimitsMutex;
+		BandwidthLimits m_NextLimits;
+		std::atomic<bool> m_LimitsChanged = false;
+		std::atomic<uint64> m_PendingLiveBytes = 0;
+
+		BandwidthLimits m_Limits;
+		int64 m_TimeUS = 0;
+		int64 m_LastLiveUS = 0;
+		bool m_LivePresent = false;
+
+		// The buckets count bytes * 1000000, the rate in bytes per second times the microseconds.
+		int64 m_RootTokens = 0;
+		int64 m_ClassTokens = 0;
+		int64 m_ClassBurst = 0;
+		uint64 m_ClassRate = 0;
+
+		uint32 m_Epoch = 1;
+		int64 m_EpochStartUS = 0;
+		uint64 m_EpochWeight = 0;
+		uint64 m_ActiveWeight = 1;
+	};
+}
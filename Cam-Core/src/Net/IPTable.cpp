@@ -1,68 +1,66 @@
 #include "IPTable.h"
 
+#include <algorithm>
 #include <string.h>
 #include "Core/Hash.h"
 #include "Utils/Utils.h"
 
 namespace Core
 {
-	IPTable::IPTable()
+	IPTable::IPTable(uint32 capacity)
+		: m_Num(0)
 	{
+		// A quarter as many hash slots as nodes.
+		m_Data.resize(utils::Max<uint32>(capacity, 1));
+		m_Table.resize(utils::NextPowerOfTwo(utils::Max<uint32>(capacity / 4, 1)));
+		m_TableMask = (uint32)m_Table.size() - 1;
 		Reset();
 	}
-	
+
 	void IPTable::Reset()
 	{
 		m_Num = 0;
-		memset(m_Table, 0, sizeof(m_Table));
-	}
-	
-	void IPTable::Insert(uint32 host, int64 now_ms)
-	{
-		auto slot = Core::Mix32(host) % utils::Count(m_Table);
-		auto node = m_Table[slot];
+		std::fill(m_Table.begin(), m_Table.end(), nullptr);
 
-		while (node)
+		m_Free = nullptr;
+		for (uint32 i = (uint32)m_Data.size(); i > 0; --i)
 		{
-			if (node->Host == host)
-			{
-				break;
-			}
-
-			node = node->Next;
+			m_Data[i - 1].Next = m_Free;
+			m_Free = &m_Data[i - 1];
 		}
 
+		m_Oldest = nullptr;
+		m_Newest = nullptr;
+	}
+
+	void IPTable::Insert(uint32 host, int64 now_ms)
+	{
+		Node *node = Find(host);
 		if (!node)
 		{
-			if (m_Num < utils::Count(m_Data))
+			// The oldest host is the first one, whose time-out period ends.
+			if (!m_Free)
 			{
-				node = &m_Data[m_Num++];
-			}
-			else
-			{
-				for (auto &iter : m_Data)
-				{
-					if (now_ms - iter.TimeMS > TIMEOUT_MS)
-					{
-						node = &iter;
-						break;
-					}
-				}
-
-				if (!node)
+				if (!m_Oldest || now_ms - m_Oldest->TimeMS <= TIMEOUT_MS)
 				{
 					return;
 				}
 
-				Remove(node->Host);
+				Remove(m_Oldest->Host);
 			}
 
+			node = m_Free;
+			m_Free = node->Next;
+			++m_Num;
+
+			Node **slot = &m_Table[Core::Mix32(host) & m_TableMask];
 			node->Host = host;
 			node->Count = 1;
 			node->TimeMS = now_ms;
-			node->Next = m_Table[slot];
-			m_Table[slot] = node;
+			node->Next = *slot;
+			*slot = node;
 
+			LinkNewest(node);
 			return;
 		}
 
@@ -70,50 +68,96 @@ namespace Core
 		{
 			node->Count = 1;
 			node->TimeMS = now_ms;
+
+			// The list stays sorted by TimeMS.
+			Unlink(node);
+			LinkNewest(node);
 		}
 		else
 		{
 			node->Count += 1;
 		}
 	}
-	
+
 	void IPTable::Remove(uint32 host)
 	{
-		auto slot = Core::Mix32(host) % utils::Count(m_Table);
-		Node *node = m_Table[slot];
-		Node *prev = nullptr;
-
-		while (node) {
-			if (node->Host == host) {
-				if (prev) {
-					prev->Next = node->Next;
-				}
-				else {
-					m_Table[slot] = node->Next;
-				}
+		Node **slot = &m_Table[Core::Mix32(host) & m_TableMask];
+		while (Node *node = *slot)
+		{
+			if (node->Host == host)
+			{
+				*slot = node->Next;
+				Unlink(node);
 
+				node->Next = m_Free;
+				m_Free = node;
+				--m_Num;
 				return;
 			}
 
-			prev = node;
-			node = node->Next;
+			slot = &node->Next;
 		}
 	}
 
 	bool IPTable::Blocked(uint32 host)
 	{
-		auto node = m_Table[Core::Mix32(host) % utils::Count(m_Table)];
+		Node *node = Find(host);
+		return node && node->Count >= MAX_CONNECTIONS_PER_IP;
+	}
+
+	IPTable::Node *IPTable::Find(uint32 host)
+	{
+		Node *node = m_Table[Core::Mix32(host) & m_TableMask];
 		while (node)
 		{
 			if (node->Host == host)
 			{
-				return node->Count >= MAX_CONNECTIONS_PER_IP;
+				return node;
 			}
 
 			node = node->Next;
 		}
 
-		return false;
+		return nullptr;
 	}
-}
 
+	void IPTable::Unlink(Node *node)
+	{
+		if (node->Older)
+		{
+			node->Older->Newer = node->Newer;
+		}
+		else
+		{
+			m_Oldest = node->Newer;
+		}
+
+		if (node->Newer)
+		{
+			node->Newer->Older = node->Older;
+		}
+		else
+		{
+			m_Newest = node->Older;
+		}
+
+		node->Older = nullptr;
+		node->Newer = nullptr;
+	}
+
+	void IPTable::LinkNewest(Node *node)
+	{
+		node->Older = m_Newest;
+		node->Newer = nullptr;
+		if (m_Newest)
+		{
+			m_Newest->Newer = node;
+		}
+		else
+		{
+			m_Oldest = node;
+		}
+
+		m_Newest = node;
+	}
+}
@@ -2,6 +2,8 @@
 
 #include "Core/Core.h"
 
+#include <vector>
+
 namespace Core
 {
 	class IPTable
@@ -10,18 +12,25 @@ namespace Core
 
 		struct Node
 		{
+			// The next node in the same hash slot, or in the free list.
 			Node *Next;
+
+			// Ordered by TimeMS, Older is replaced first once the table is full.
+			Node *Older;
+			Node *Newer;
+
 			uint32 Host;
 			uint32 Count;
 			int64 TimeMS;
 		};
 
-		IPTable();
+		IPTable(uint32 capacity = DEFAULT_CAPACITY);
 
 		// Resets the data for the table.
 		void Reset();
 
 		// Inserts a host into the table.
+		// A full table replaces the host with the oldest time-out period, if it ended, otherwise the host is not counted.
 		void Insert(uint32 host, int64 now_ms);
 
 		// Removes a host from the table.
@@ -30,8 +39,18 @@ namespace Core
 		// Returns true if the host should be blocked from connecting.
 		bool Blocked(uint32 host);
 
+		uint32 GetCount() const { return m_Num; }
+
 	private:
 
+		Node *Find(uint32 host);
+		void Unlink(Node *node);
+		void LinkNewest(Node *node);
+
+	private:
+
+		static constexpr uint32 DEFAULT_CAPACITY = 65536;
+
 		// Timeout value.
 		static constexpr uint32 const TIMEOUT_MS = 300000;
 
@@ -39,8 +58,14 @@ namespace Core
 		static constexpr uint32 const MAX_CONNECTIONS_PER_IP = 16;
 
 		uint32 m_Num;
-		Node m_Data[65536];
-		Node *m_Table[16384];
+
+		// The nodes and the hash slots live on the heap, the table is sized once.
+		std::vector<Node> m_Data;
+		std::vector<Node *> m_Table;
+		uint32 m_TableMask = 0;
+
+		Node *m_Free = nullptr;
+		Node *m_Oldest = nullptr;
+		Node *m_Newest = nullptr;
 	};
 }
-
@@ -0,0 +1,19 @@
+#include "InterfaceCounters.h"
+
+#ifdef CAM_PLATFORM_WINDOWS
+#include "Platform/Windows/WindowsInterfaceCounters.h"
+#elif CAM_PLATFORM_LINUX
+#include "Platform/Linux/LinuxInterfaceCounters.h"
+#endif
+
+namespace Core
+{
+	InterfaceCounters *InterfaceCounters::Create()
+	{
+#ifdef CAM_PLATFORM_WINDOWS
+		return new WindowsInterfaceCounters();
+#elif CAM_PLATFORM_LINUX
+		return new LinuxInterfaceCounters();
+#endif
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Core/Core.h"
+
+#include <string>
+
+namespace Core
+{
+	// Reads the traffic counters of the network interfaces. They count the bytes of all processes on the host,
+	// so that traffic of other applications on the same uplink can be measured.
+	class InterfaceCounters
+	{
+	public:
+
+		virtual ~InterfaceCounters() {}
+
+		// Selects the interface by its name, e.g. "eth0". An empty name sums up all interfaces except the loopback interface.
+		// Returns false, if the counters can not be read.
+		virtual bool Open(const std::string &interface_name) = 0;
+
+		// Returns the bytes, which were sent on the selected interfaces so far, or false if the counters can not be read.
+		virtual bool GetSentBytes(uint64 *out_bytes) = 0;
+
+		static InterfaceCounters *Create();
+	};
+}
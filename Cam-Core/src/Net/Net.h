@@ -1,6 +1,9 @@
 #pragma once
 
 #include "Socket.h"
+#include "StreamServer.h"
 #include "IPTable.h"
+#include "BandwidthScheduler.h"
+#include "InterfaceCounters.h"
 #include "ServerClients.h"
 
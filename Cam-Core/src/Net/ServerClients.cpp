@@ -3,58 +3,49 @@
 #include "Core/Hash.h"
 #include "Utils/Utils.h"
 
+#include <algorithm>
+
 #ifdef CAM_PLATFORM_LINUX
 #include <cstring>
 #endif
 
 namespace Core
 {
-	bool Clients::Node::IsBandwidthAvailable(int64 now_ms)
-	{
-		int64 decrease = (now_ms - TimeMS);
-		TimeMS = now_ms;
-
-		if (decrease > 0)
-		{
-			decrease *= DECREASE_RATE; // bytes/ms
-
-			if ((int64)Bandwidth > decrease)
-			{
-				Bandwidth -= (uint32)decrease;
-			}
-			else
-			{
-				Bandwidth = 0;
-			}
-		}
-
-		return (Bandwidth < MAX_BANDWIDTH);
-	}
-
 	Clients::Clients()
+		: Clients(nullptr, nullptr)
 	{
-		m_Crypto = nullptr;
-		m_IPTable = nullptr;
-		m_Num = 0;
-		Reset();
 	}
 
-	Clients::Clients(Crypto *crypto, IPTable *iptable)
+	Clients::Clients(Crypto *crypto, IPTable *iptable, uint32 capacity)
 		: m_Crypto(crypto), m_IPTable(iptable), m_Num(0)
 	{
+		// Half as many hash slots as nodes, the chains stay short with the mixed addresses.
+		m_Data.resize(utils::Max<uint32>(capacity, 1));
+		m_Table.resize(utils::NextPowerOfTwo(utils::Max<uint32>(capacity / 2, 1)));
+		m_TableMask = m_Table.size() - 1;
 		Reset();
 	}
-	
+
 	void Clients::Reset()
 	{
 		m_Num = 0;
-		memset(m_Table, 0, sizeof(m_Table));
+		std::fill(m_Table.begin(), m_Table.end(), nullptr);
+
+		m_Free = nullptr;
+		for (uint32 i = (uint32)m_Data.size(); i > 0; --i)
+		{
+			m_Data[i - 1].Next = m_Free;
+			m_Free = &m_Data[i - 1];
+		}
+
+		m_Oldest = nullptr;
+		m_Newest = nullptr;
 	}
-	
+
 	Clients::Node *Clients::Insert(addr_t addr, int64 now_ms)
 	{
-		uint64 slot = Core::Mix64(addr.Value) % utils::Count(m_Table);
-		Node *node = m_Table[slot];
+		Node **slot = &m_Table[Core::Mix64(addr.Value) & m_TableMask];
+		Node *node = *slot;
 
 		while (node)
 		{
@@ -68,72 +59,105 @@ namespace Core
 
 		if (!node)
 		{
-			if (m_IPTable->Blocked(addr.Host))
+			if (m_IPTable && m_IPTable->Blocked(addr.Host))
 			{
 				return nullptr;
 			}
 
-			if (m_Num < utils::Count(m_Data))
-			{
-				node = &m_Data[m_Num++];
-			}
-			else
+			// A full table replaces the least recently used client, as long as it was idle long enough.
+			if (!m_Free)
 			{
-				for (Node &iter : m_Data)
-				{
-					if (now_ms - iter.TimeMS > 30000)
-					{
-						node = &iter;
-						break;
-					}
-				}
-
-				if (!node)
+				if (!m_Oldest || now_ms - m_Oldest->TimeMS <= CLIENT_TIMEOUT_MS)
 				{
 					return nullptr;
 				}
 
-				Remove(addr);
+				Remove(m_Oldest->Addr);
 			}
 
+			node = m_Free;
+			m_Free = node->Next;
+			++m_Num;
+
 			memset(node, 0, sizeof(*node));
 			node->Addr = addr;
 			node->ServerToken = m_Crypto->GenToken();
-			node->TimeMS = now_ms;
-			node->Next = m_Table[slot];
-			m_Table[slot] = node;
+			node->Next = *slot;
+			*slot = node;
 
-			m_IPTable->Insert(addr.Host, now_ms);
+			if (m_IPTable)
+			{
+				m_IPTable->Insert(addr.Host, now_ms);
+			}
+		}
+		else
+		{
+			Unlink(node);
 		}
 
+		// Clients, which did not send anything for a while, are replaced first.
+		node->TimeMS = now_ms;
+		LinkNewest(node);
 		return node;
 	}
-	
+
 	void Clients::Remove(addr_t addr)
 	{
-		auto slot = Core::Mix64(addr.Value) % utils::Count(m_Table);
-		Node *node = m_Table[slot];
-		Node *prev = nullptr;
-
-		while (node)
+		Node **slot = &m_Table[Core::Mix64(addr.Value) & m_TableMask];
+		while (Node *node = *slot)
 		{
 			if (node->Addr.Value == addr.Value)
 			{
-				if (prev)
-				{
-					prev->Next = node->Next;
-				}
-				else
-				{
-					m_Table[slot] = node->Next;
-				}
+				*slot = node->Next;
+				Unlink(node);
 
+				node->Next = m_Free;
+				m_Free = node;
+				--m_Num;
 				return;
 			}
 
-			prev = node;
-			node = node->Next;
+			slot = &node->Next;
 		}
 	}
-}
 
+	void Clients::Unlink(Node *node)
+	{
+		if (node->Older)
+		{
+			node->Older->Newer = node->Newer;
+		}
+		else
+		{
+			m_Oldest = node->Newer;
+		}
+
+		if (node->Newer)
+		{
+			node->Newer->Older = node->Older;
+		}
+		else
+		{
+			m_Newest = node->Older;
+		}
+
+		node->Older = nullptr;
+		node->Newer = nullptr;
+	}
+
+	void Clients::LinkNewest(Node *node)
+	{
+		node->Older = m_Newest;
+		node->Newer = nullptr;
+		if (m_Newest)
+		{
+			m_Newest->Newer = node;
+		}
+		else
+		{
+			m_Oldest = node;
+		}
+
+		m_Newest = node;
+	}
+}
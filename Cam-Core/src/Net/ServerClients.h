@@ -5,6 +5,9 @@
 
 #include "Socket.h"
 #include "IPTable.h"
+#include "BandwidthScheduler.h"
+
+#include <vector>
 
 namespace Core
 {
@@ -15,44 +18,58 @@ namespace Core
 		class Node
 		{
 		public:
+			// The next node in the same hash slot, or in the free list.
 			Node *Next;
+
+			// The least recently used list, Older is removed first once the table is full.
+			Node *Older;
+			Node *Newer;
+
 			addr_t Addr;
 			uint64 ServerToken;
 			int64 TimeMS;
-			uint32 Bandwidth;
-
-			// Updates current bandwidth limits. Returns true if node has bandwidth available to it.
-			bool IsBandwidthAvailable(int64 now_ms);
-
-		protected:
-			// Rate to decrease bandwidth usage, bytes/ms.
-			// Best set to a fraction of your maximum expected speed and to increase max_bandwidth instead.
-			static constexpr int64 DECREASE_RATE = 100;
-
-			// Maximum expected bandwidth to transfer, bytes.
-			static constexpr uint32 MAX_BANDWIDTH = 2000000;
+			BandwidthLeaf Bandwidth;
 		};
 
 		// Initializes the clients table.
 		Clients();
-		Clients(Crypto *crypto, IPTable *iptable);
+		Clients(Crypto *crypto, IPTable *iptable, uint32 capacity = DEFAULT_CAPACITY);
 
 		// Resets the clients table.
 		void Reset();
 
 		// Inserts or returns the client for the given address.
+		// A full table replaces the least recently used client, if it was idle for CLIENT_TIMEOUT_MS, otherwise nullptr is returned.
 		Node *Insert(addr_t addr, int64 now_ms);
 
 		// Removes the client associated with the given address.
 		void Remove(addr_t addr);
 
+		uint32 GetCount() const { return m_Num; }
+
 	protected:
 
+		void Unlink(Node *node);
+		void LinkNewest(Node *node);
+
+	protected:
+
+		static constexpr uint32 DEFAULT_CAPACITY = 65536;
+
+		// A client, which was idle for this long, can be replaced by a new one.
+		static constexpr int64 CLIENT_TIMEOUT_MS = 30000;
+
 		Crypto *m_Crypto = nullptr;
 		IPTable *m_IPTable = nullptr;
 		uint32 m_Num;
-		Node m_Data[65536];
-		Node *m_Table[32768];
+
+		// The nodes and the hash slots live on the heap, the table is sized once.
+		std::vector<Node> m_Data;
+		std::vector<Node *> m_Table;
+		uint64 m_TableMask = 0;
+
+		Node *m_Free = nullptr;
+		Node *m_Oldest = nullptr;
+		Node *m_Newest = nullptr;
 	};
 }
-
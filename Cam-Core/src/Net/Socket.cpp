@@ -8,12 +8,21 @@
 
 namespace Core
 {
-	Socket *Socket::Create()
+	Socket *Socket::Create(SocketType type)
 	{
 #ifdef CAM_PLATFORM_WINDOWS
-		return new WindowsSocket();
+		return new WindowsSocket(type);
 #elif CAM_PLATFORM_LINUX
-		return new LinuxSocket();
+		return new LinuxSocket(type);
+#endif
+	}
+
+	bool Socket::WaitAny(Socket *const *sockets, uint32 count, int32 timeout_ms)
+	{
+#ifdef CAM_PLATFORM_WINDOWS
+		return WindowsSocket::WaitAny(sockets, count, timeout_ms);
+#elif CAM_PLATFORM_LINUX
+		return LinuxSocket::WaitAny(sockets, count, timeout_ms);
 #endif
 	}
 }
@@ -15,10 +15,49 @@ namespace Core
 		};
 	};
 
+	enum class SocketType
+	{
+		// Reliable byte stream (TCP), a client is connected to exactly one server.
+		Stream = 0,
+
+		// Independent messages (UDP), every message carries the address of its sender.
+		Datagram
+	};
+
+	// A single memory block of a vectored send or receive.
+	struct io_buffer_t
+	{
+		void *Data;
+		uint32 Size;
+	};
+
+	// A single datagram of a batched send or receive.
+	struct datagram_t
+	{
+		// The memory blocks, which form the datagram. Received datagrams are scattered over them in order.
+		io_buffer_t const *Buffers;
+		uint32 BufferCount;
+
+		// The receiver of a sent datagram, or the sender of a received one.
+		addr_t Addr;
+
+		// Set to the number of bytes of the received datagram.
+		uint32 Size;
+	};
+
 	class Socket
 	{
 	public:
 
+		// The maximum number of buffers, which can be passed to SendBulk and RecvBulk at once.
+		static constexpr uint32 MAX_IO_BUFFERS = 16;
+
+		// The maximum number of datagrams, which can be passed to SendBatch and RecvBatch at once.
+		static constexpr uint32 MAX_BATCH = 64;
+
+		// The maximum number of sockets, which can be passed to WaitAny at once.
+		static constexpr uint32 MAX_WAIT_SOCKETS = 8;
+
 		virtual ~Socket() {}
 
 		virtual bool Open(bool is_client = false, const std::string &ip = "", uint16 port = 0) = 0;
@@ -32,10 +71,45 @@ namespace Core
 		virtual int32 SendLarge(void const *src, int32 src_bytes, addr_t addr) = 0;
 		virtual int32 RecvLarge(void *dst, int32 dst_bytes, addr_t *addr) = 0;
 
+		// Sends all buffers in order as one contiguous byte stream, with as few system calls as possible.
+		// On datagram sockets all buffers together form exactly one datagram.
+		// Returns the number of bytes sent, or -1 if not all bytes could be sent.
+		virtual int32 SendBulk(io_buffer_t const *buffers, uint32 count, addr_t addr) = 0;
+
+		// Fills all buffers completely in order, blocks until enough bytes arrived.
+		// On datagram sockets exactly one datagram is scattered over the buffers, it may be smaller than the buffers.
+		// Returns the number of bytes received, or -1 if the connection failed before all buffers were filled.
+		virtual int32 RecvBulk(io_buffer_t const *buffers, uint32 count, addr_t *addr) = 0;
+
+		// Sends several datagrams with as few system calls as possible, only for datagram sockets.
+		// Datagrams, which can not be sent, are skipped. Returns the number of datagrams sent, or -1 if the socket failed.
+		virtual int32 SendBatch(datagram_t const *datagrams, uint32 count) = 0;
+
+		// Blocks until at least one datagram arrived, then receives all further datagrams, which are already queued, up to count.
+		// Only for datagram sockets. Returns the number of datagrams received, or -1 if the socket failed.
+		virtual int32 RecvBatch(datagram_t *datagrams, uint32 count) = 0;
+
+		// Waits up to timeout_ms milliseconds (-1 waits forever) until data can be received without blocking.
+		// Also returns true, if the connection has been closed or failed, Recv reports that right away.
+		// Returns false, if the timeout expired.
+		virtual bool Wait(int32 timeout_ms) = 0;
+
+		// Binds an opened datagram socket to the port of a multicast group and joins the group. Sockets of several processes can join the same group.
+		// interface_ip selects the network interface to receive on, an empty string lets the system choose.
+		virtual bool BindMulticast(const std::string &group, uint16 port, const std::string &interface_ip = "") = 0;
+
+		// Selects the network interface multicast datagrams are sent on, how many routers they may pass,
+		// and if they are delivered to receivers on this host as well.
+		virtual bool SetMulticastSender(const std::string &interface_ip, uint8 ttl, bool loopback) = 0;
+
 		virtual bool SetNonBlocking(bool enabled) = 0;
 		virtual addr_t Lookup(const std::string &host, uint16 port) = 0;
 
-		static Socket *Create();
+		// Waits up to timeout_ms milliseconds (-1 waits forever) until any of the sockets can receive without blocking.
+		// Returns false, if the timeout expired.
+		static bool WaitAny(Socket *const *sockets, uint32 count, int32 timeout_ms);
+
+		static Socket *Create(SocketType type = SocketType::Stream);
 	};
 }
 
@@ -0,0 +1,178 @@
+#include "StreamServer.h"
+
+#ifdef CAM_PLATFORM_WINDOWS
+#include "Platform/Windows/WindowsStreamServer.h"
+#elif CAM_PLATFORM_LINUX
+#include "Platform/Linux/LinuxStreamServer.h"
+#endif
+
+#include <string.h>
+
+namespace Core
+{
+	StreamServer::StreamServer()
+		: m_DefaultBufferPool(std::make_unique<BufferPool>())
+	{
+		m_BufferPool = m_DefaultBufferPool.get();
+	}
+
+	StreamServer *StreamServer::Create()
+	{
+#ifdef CAM_PLATFORM_WINDOWS
+		return new WindowsStreamServer();
+#elif CAM_PLATFORM_LINUX
+		return new LinuxStreamServer();
+#endif
+	}
+
+	io_buffer_t StreamServer::GetReadBuffer(StreamConnection &connection)
+	{
+		// Only read the rest of an in place message, the next message starts in the staging buffer again.
+		if (connection.Message)
+		{
+			return { connection.Message.Data() + connection.MessageReceived, (uint32)connection.Message.Size() - connection.MessageReceived };
+		}
+
+		uint32 capacity = (uint32)connection.Buffer.size();
+		if (capacity == 0)
+		{
+			connection.Buffer.resize(INITIAL_BUFFER_SIZE);
+		}
+		else if (connection.Expected > capacity)
+		{
+			connection.Buffer.resize(connection.Expected);
+		}
+		else if (connection.Size == capacity)
+		{
+			connection.Buffer.resize((size_t)capacity * 2);
+		}
+
+		return { connection.Buffer.data() + connection.Size, (uint32)connection.Buffer.size() - connection.Size };
+	}
+
+	bool StreamServer::OnReceived(StreamConnection &connection, uint32 bytes)
+	{
+		if (connection.Message)
+		{
+			connection.MessageReceived += bytes;
+			if (connection.MessageReceived < connection.Message.Size())
+			{
+				return true;
+			}
+
+			BufferRef message = std::move(connection.Message);
+			connection.MessageReceived = 0;
+			connection.Expected = 0;
+
+			DispatchMessage(connection, message);
+			return true;
+		}
+
+		if (!m_MessageSizeCallback)
+		{
+			return false;
+		}
+
+		connection.Size += bytes;
+
+		// The read is only complete, once the pending message is complete.
+		if (connection.Expected > connection.Size)
+		{
+			return true;
+		}
+
+		uint32 offset = 0;
+		connection.Expected = 0;
+
+		while (offset < connection.Size && !connection.Closing)
+		{
+			Byte *data = connection.Buffer.data() + offset;
+			uint32 available = connection.Size - offset;
+
+			int32 message_size = m_MessageSizeCallback(data, available);
+			if (message_size < 0)
+			{
+				return false;
+			}
+
+			if (message_size == 0)
+			{
+				break;
+			}
+
+			if ((uint32)message_size > available)
+			{
+				if ((uint32)message_size >= IN_PLACE_MESSAGE_SIZE)
+				{
+					// Move the start of the message into its final buffer, the rest is received directly into it.
+					connection.Message = m_BufferPool->Acquire((uint32)message_size);
+					memcpy(connection.Message.Data(), data, available);
+					connection.MessageReceived = available;
+					offset += available;
+				}
+				else
+				{
+					connection.Expected = (uint32)message_size;
+				}
+
+				break;
+			}
+
+			BufferRef message = m_BufferPool->Acquire((uint32)message_size);
+			memcpy(message.Data(), data, message_size);
+			DispatchMessage(connection, message);
+
+			offset += (uint32)message_size;
+		}
+
+		// Only the start of the next message is left, move it to the front of the buffer.
+		if (offset > 0)
+		{
+			memmove(connection.Buffer.data(), connection.Buffer.data() + offset, connection.Size - offset);
+			connection.Size -= offset;
+		}
+
+		return true;
+	}
+
+	bool StreamServer::QueueOutput(StreamConnection &connection, Byte const *src, uint32 bytes)
+	{
+		// Drop the sent bytes, before the output grows.
+		if (connection.OutputSent > 0)
+		{
+			connection.Output.erase(connection.Output.begin(), connection.Output.begin() + connection.OutputSent);
+			connection.OutputSent = 0;
+		}
+
+		if (connection.Output.size() + bytes > MAX_OUTPUT_SIZE)
+		{
+			return false;
+		}
+
+		connection.Output.insert(connection.Output.end(), src, src + bytes);
+		return true;
+	}
+
+	void StreamServer::OnOutputSent(StreamConnection &connection, uint32 bytes)
+	{
+		connection.OutputSent += bytes;
+		if (connection.OutputSent == connection.Output.size())
+		{
+			connection.Output.clear();
+			connection.OutputSent = 0;
+		}
+	}
+
+	void StreamServer::DispatchMessage(StreamConnection &connection, const BufferRef &message)
+	{
+		if (!m_MessageCallback)
+		{
+			return;
+		}
+
+		// Message handlers may disconnect clients, so closing is deferred until the dispatch is finished.
+		m_Dispatching = true;
+		m_MessageCallback(connection.Addr, message);
+		m_Dispatching = false;
+	}
+}
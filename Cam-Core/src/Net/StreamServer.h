@@ -0,0 +1,129 @@
+#pragma once
+
+#include "Core/Core.h"
+#include "Core/BufferPool.h"
+#include "Socket.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace Core
+{
+	// Returns the total size of the message, which starts at the given bytes.
+	// Returns 0 if more bytes are needed to tell the size, or -1 if the bytes can not be the start of a valid message.
+	using StreamMessageSizeFn = std::function<int32(Byte const *data, uint32 size)>;
+
+	// Is called for every complete message. The message is a pooled buffer, the callback may keep a reference to it.
+	using StreamMessageFn = std::function<void(addr_t client, const BufferRef &message)>;
+
+	// Is called when a client connected or disconnected.
+	using StreamConnectionFn = std::function<void(addr_t client)>;
+
+	// Accepts any number of stream clients and reads all of them from a single thread.
+	// Incoming bytes are collected per connection, until the message size callback reports a complete message.
+	// Large messages are received directly into a pooled buffer, which is handed to the message callback without another copy.
+	class StreamServer
+	{
+	public:
+
+		StreamServer();
+		virtual ~StreamServer() {}
+
+		// Starts listening for connections on the given port.
+		virtual bool Listen(uint16 port, uint32 backlog = 128) = 0;
+
+		// Closes the listening socket and all client connections.
+		virtual void Close() = 0;
+
+		// Waits up to timeout_ms milliseconds (-1 waits forever) for network events and handles all of them.
+		// Accepts new clients, reads all available bytes and dispatches all complete messages.
+		// Returns false, if the listening socket failed.
+		virtual bool Poll(int32 timeout_ms) = 0;
+
+		// Sends all bytes to the client without blocking. Bytes, which the socket does not accept right away, are kept
+		// in the output of the connection and sent once it is writable again.
+		// Returns the number of bytes sent or queued, or -1 on failure. A client, whose output overflows, is disconnected.
+		virtual int32 Send(addr_t client, void const *src, int32 src_bytes) = 0;
+
+		// Closes the connection to the client, the disconnect callback is called.
+		virtual void Disconnect(addr_t client) = 0;
+
+		// Returns the number of connected clients.
+		virtual uint32 GetConnectionCount() const = 0;
+
+		void SetMessageSizeCallback(const StreamMessageSizeFn &callback) { m_MessageSizeCallback = callback; }
+		void SetMessageCallback(const StreamMessageFn &callback) { m_MessageCallback = callback; }
+		void SetConnectCallback(const StreamConnectionFn &callback) { m_ConnectCallback = callback; }
+		void SetDisconnectCallback(const StreamConnectionFn &callback) { m_DisconnectCallback = callback; }
+
+		// Sets the pool for the message buffers. The pool has to outlive all messages, which are kept by the message callback.
+		// By default the stream server uses its own pool.
+		void SetBufferPool(BufferPool *pool) { m_BufferPool = pool ? pool : m_DefaultBufferPool.get(); }
+
+		static StreamServer *Create();
+
+	protected:
+
+		struct StreamConnection
+		{
+			addr_t Addr = {};
+
+			// Staging buffer for received bytes, which do not form a complete message yet.
+			std::vector<Byte> Buffer;
+			uint32 Size = 0;
+
+			// The size of the incomplete message at the start of the buffer, 0 if it is not known yet.
+			uint32 Expected = 0;
+
+			// The large message, which is currently received in place, and the number of its bytes received so far.
+			BufferRef Message;
+			uint32 MessageReceived = 0;
+
+			// Bytes, which the socket did not accept yet, and the number of them sent so far.
+			std::vector<Byte> Output;
+			uint32 OutputSent = 0;
+
+			bool Closing = false;
+		};
+
+		// Returns the memory, which the next read of the connection has to fill.
+		io_buffer_t GetReadBuffer(StreamConnection &connection);
+
+		// Handles the bytes, which have been read into the memory returned by GetReadBuffer, and dispatches all complete messages.
+		// Returns false, if the connection has to be closed.
+		bool OnReceived(StreamConnection &connection, uint32 bytes);
+
+		// Appends the bytes to the output of the connection.
+		// Returns false, if the output would exceed MAX_OUTPUT_SIZE, the client does not read its responses then.
+		bool QueueOutput(StreamConnection &connection, Byte const *src, uint32 bytes);
+
+		// Removes the bytes, which have been sent, from the output of the connection.
+		void OnOutputSent(StreamConnection &connection, uint32 bytes);
+
+		bool HasOutput(const StreamConnection &connection) const { return connection.OutputSent < connection.Output.size(); }
+
+	private:
+
+		void DispatchMessage(StreamConnection &connection, const BufferRef &message);
+
+	protected:
+
+		static constexpr uint32 INITIAL_BUFFER_SIZE = 64 * 1024;
+
+		// Messages of at least this size are received directly into their pooled buffer instead of the staging buffer.
+		static constexpr uint32 IN_PLACE_MESSAGE_SIZE = 16 * 1024;
+
+		// The most bytes, which are kept for a client, which does not read its responses.
+		static constexpr uint32 MAX_OUTPUT_SIZE = 256 * 1024;
+
+		std::unique_ptr<BufferPool> m_DefaultBufferPool;
+		BufferPool *m_BufferPool = nullptr;
+		bool m_Dispatching = false;
+
+		StreamMessageSizeFn m_MessageSizeCallback;
+		StreamMessageFn m_MessageCallback;
+		StreamConnectionFn m_ConnectCallback;
+		StreamConnectionFn m_DisconnectCallback;
+	};
+}
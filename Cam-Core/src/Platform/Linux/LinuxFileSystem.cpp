@@ -8,12 +8,33 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+
+extern char **environ;
 
 namespace Core
 {
 	int64 FileSystem::Seek(const std::string &filePath, int64 offset, int64 origin)
 	{
-		return 0;
+		FILE *f = fopen(filePath.c_str(), "rb");
+		if (!f)
+		{
+			return 0;
+		}
+
+		int64 result = 0;
+		if (fseeko(f, (off_t)offset, (int32)origin) == 0)
+		{
+			result = ftello(f);
+		}
+
+		fclose(f);
+		return result;
 	}
 
 	int64 FileSystem::Size(const std::string &filePath)
@@ -40,7 +61,6 @@ namespace Core
 			return 0;
 		}
 
-		char *buffer = 0;
 		uint32 length = 0;
 		FILE *f = fopen(filePath.c_str(), "r");
 
@@ -50,16 +70,13 @@ namespace Core
 			length = ftell(f);
 			fseek(f, 0, SEEK_SET);
 
-			buffer = (char*)malloc(length);
-			fread(buffer, 1, length, f);
+			// The file is not null terminated, so the string gets the exact length.
+			out_str->resize(length);
+			length = (uint32)fread(&(*out_str)[0], 1, length, f);
+			out_str->resize(length);
 			fclose(f);
 
-			if (buffer)
-			{
-				*out_str = std::string(buffer);
-				free(buffer);
-				return length;
-			}
+			return length;
 		}
 
 		std::cout << "Could not open file " << filePath.c_str() << std::endl;
@@ -74,23 +91,75 @@ namespace Core
 	bool FileSystem::WriteFile(const std::string &filePath, void *src, uint32 bytes)
 	{
 		FILE *f = fopen(filePath.c_str(), "wb");
-		if (f)
+		if (!f)
 		{
-
-			fclose(f);
+			return false;
 		}
 
-		return false;
+		size_t written = bytes > 0 ? fwrite(src, 1, bytes, f) : 0;
+		bool flushed = fclose(f) == 0;
+		return flushed && written == bytes;
 	}
 
 	Byte *FileSystem::ReadFile(const std::string &filePath, uint32 *outSize)
 	{
-		return nullptr;
+		if (!outSize)
+		{
+			return nullptr;
+		}
+
+		FILE *f = fopen(filePath.c_str(), "rb");
+		if (!f)
+		{
+			return nullptr;
+		}
+
+		fseeko(f, 0, SEEK_END);
+		int64 size = ftello(f);
+		fseeko(f, 0, SEEK_SET);
+
+		if (size < 0 || size > UINT32_MAX)
+		{
+			fclose(f);
+			return nullptr;
+		}
+
+		// Allocated like on Windows, the caller frees it with delete[].
+		Byte *buffer = new Byte[size > 0 ? size : 1];
+		size_t read = fread(buffer, 1, (size_t)size, f);
+		fclose(f);
+
+		if (read != (size_t)size)
+		{
+			delete[] buffer;
+			return nullptr;
+		}
+
+		*outSize = (uint32)size;
+		return buffer;
 	}
 
 	uint32 FileSystem::Print(const std::string &filePath, const char *fmt, ...)
 	{
-		return 0;
+		va_list args;
+		va_start(args, fmt);
+
+		char buf[4096];
+		int32 res = vsnprintf(buf, sizeof(buf), fmt, args);
+		if (res >= (int32)sizeof(buf))
+		{
+			// truncation
+			res = sizeof(buf) - 1;
+		}
+
+		va_end(args);
+
+		if (res <= 0)
+		{
+			return 0;
+		}
+
+		return WriteFile(filePath, buf, (uint32)res);
 	}
 
 	bool FileSystem::SetCurrentWorkingDirectory(const std::string &directory)
@@ -120,27 +189,114 @@ namespace Core
 
 	bool FileSystem::DirectoryExists(const std::string &filePath) const
 	{
-		return false;
+		struct stat info;
+		return !filePath.empty() && stat(filePath.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
 	}
 
 	bool FileSystem::FileExists(const std::string &filePath) const
 	{
-		return false;
+		struct stat info;
+		return !filePath.empty() && stat(filePath.c_str(), &info) == 0;
 	}
 
 	bool FileSystem::RemoveFile(const std::string &filePath) const
 	{
-		return false;
+		return unlink(filePath.c_str()) == 0;
 	}
 
 	bool FileSystem::RemoveDirectoy(const std::string &filePath) const
 	{
-		return false;
+		return rmdir(filePath.c_str()) == 0;
+	}
+
+	bool FileSystem::CreateDirectories(const std::string &filePath) const
+	{
+		if (filePath.empty())
+		{
+			return false;
+		}
+
+		// Every parent is created in turn, parents created at the same time by another process are fine.
+		for (size_t pos = filePath.find('/', 1); pos != std::string::npos; pos = filePath.find('/', pos + 1))
+		{
+			std::string parent = filePath.substr(0, pos);
+			if (mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST)
+			{
+				return false;
+			}
+		}
+
+		return (mkdir(filePath.c_str(), 0755) == 0 || errno == EEXIST) && DirectoryExists(filePath);
+	}
+
+	bool FileSystem::RemoveDirectoryTree(const std::string &filePath) const
+	{
+		// Children are visited before their directory, symbolic links are removed and not followed.
+		auto remove_entry = [](const char *path, const struct stat *, int32, struct FTW *) -> int32
+		{
+			return remove(path);
+		};
+
+		return nftw(filePath.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS) == 0;
+	}
+
+	bool FileSystem::RenameFile(const std::string &from, const std::string &to) const
+	{
+		return rename(from.c_str(), to.c_str()) == 0;
+	}
+
+	bool FileSystem::ReplaceDirectory(const std::string &source, const std::string &target) const
+	{
+		if (!DirectoryExists(target))
+		{
+			return RenameFile(source, target);
+		}
+
+		// The exchange is atomic, the old contents end up at source. File systems without it fall back to two renames.
+		if (renameat2(AT_FDCWD, source.c_str(), AT_FDCWD, target.c_str(), RENAME_EXCHANGE) != 0)
+		{
+			std::string old = target + ".old";
+			if (DirectoryExists(old) && !RemoveDirectoryTree(old))
+			{
+				return false;
+			}
+
+			if (!RenameFile(target, old))
+			{
+				return false;
+			}
+
+			if (!RenameFile(source, target))
+			{
+				RenameFile(old, target);
+				return false;
+			}
+
+			return RemoveDirectoryTree(old);
+		}
+
+		return RemoveDirectoryTree(source);
+	}
+
+	bool FileSystem::SetFileMode(const std::string &filePath, uint32 mode) const
+	{
+		return chmod(filePath.c_str(), (mode_t)mode) == 0;
 	}
 
 	bool FileSystem::StartProgram(const std::string &executable)
 	{
-		return false;
+		// posix_spawn reports, if the program could not be executed, unlike fork and exec.
+		char *argv[] = { (char *)executable.c_str(), nullptr };
+		pid_t pid;
+
+		int32 result = posix_spawn(&pid, executable.c_str(), nullptr, nullptr, argv, environ);
+		if (result != 0)
+		{
+			std::cout << "Failed to start the process " << executable << ": " << strerror(result) << std::endl;
+			return false;
+		}
+
+		return true;
 	}
 }
 
@@ -2,28 +2,429 @@
 
 #ifdef CAM_PLATFORM_LINUX
 
+#include "Core/Core.h"
+#include "Core/Log.h"
+#include "Core/Timer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
 namespace Core
 {
-	static bool s_Watching = false;
-	static bool s_IgnoreNextChange = false;
-	static FileSystemWatcherCallbackFn s_Callback;
+	// Writes to a file are reported once per quiet period, instead of once per write call.
+	static constexpr int64 COALESCE_QUIET_MS = 50;
+
+	// The kernel queues both halves of a rename together, a lonely IN_MOVED_FROM is a file leaving the watched tree.
+	static constexpr int64 MOVE_PAIR_MS = 5;
+
+	static constexpr uint32 WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+	struct PendingChange
+	{
+		// None, once the change was reported and only the quiet period is left.
+		FileSystemWatcherAction Action = FileSystemWatcherAction::None;
+		int64 DueMS = 0;
+		int64 LastCallbackMS = 0;
+	};
+
+	struct PendingMove
+	{
+		uint32 Cookie = 0;
+		std::string Path;
+		bool IsDirectory = false;
+		int64 DueMS = 0;
+	};
+
+	static std::atomic<bool> s_Watching = false;
+	static std::atomic<bool> s_IgnoreNextChange = false;
+	static bool s_SuppressCallbacks = false;
+	static std::thread s_WatcherThread;
+	static int32 s_NotifyFd = -1;
+	static int32 s_StopFd = -1;
 	static std::string s_WatchPath = "";
-	static std::string s_OldName = "";
+	static FileSystemWatcherCallbackFn s_Callback;
+
+	// Maps every watch descriptor to its directory, relative to the watch path.
+	static std::unordered_map<int32, std::string> s_WatchDirectories;
+	static std::unordered_map<std::string, PendingChange> s_PendingChanges;
+	static PendingMove s_PendingMove;
+	static bool s_HasPendingMove = false;
+
+	static std::string JoinPath(const std::string &directory, const char *name)
+	{
+		return directory.empty() ? std::string(name) : directory + "/" + name;
+	}
+
+	static std::string GetFullPath(const std::string &relativePath)
+	{
+		return relativePath.empty() ? s_WatchPath : s_WatchPath + "/" + relativePath;
+	}
+
+	static bool IsInDirectory(const std::string &path, const std::string &directory)
+	{
+		return path.size() > directory.size()
+			&& path.compare(0, directory.size(), directory) == 0
+			&& path[directory.size()] == '/';
+	}
+
+	static void Notify(FileSystemWatcherAction action, const std::string &filePath, const std::string &oldName = "")
+	{
+		if (s_SuppressCallbacks)
+		{
+			return;
+		}
+
+		FileSystemWatcherContext context = {};
+		context.Action = action;
+		context.FilePath = filePath;
+		context.OldName = oldName;
+		s_Callback(context);
+	}
+
+	// Watches the directory and every directory below it, the files found on the way are appended to out_files.
+	static bool AddWatches(const std::string &relativePath, std::vector<std::string> *out_files)
+	{
+		std::string fullPath = GetFullPath(relativePath);
+		int32 wd = inotify_add_watch(s_NotifyFd, fullPath.c_str(), WATCH_MASK);
+		if (wd < 0)
+		{
+			CAM_LOG_WARN("Could not watch directory {}: {}", fullPath, strerror(errno));
+			return false;
+		}
+
+		s_WatchDirectories[wd] = relativePath;
+
+		DIR *dir = opendir(fullPath.c_str());
+		if (!dir)
+		{
+			return true;
+		}
+
+		while (struct dirent *entry = readdir(dir))
+		{
+			if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			{
+				continue;
+			}
+
+			std::string entryPath = JoinPath(relativePath, entry->d_name);
+			bool isDirectory = entry->d_type == DT_DIR;
+			if (entry->d_type == DT_UNKNOWN)
+			{
+				struct stat info;
+				isDirectory = lstat(GetFullPath(entryPath).c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+			}
+
+			if (isDirectory)
+			{
+				AddWatches(entryPath, out_files);
+			}
+			else if (out_files)
+			{
+				out_files->push_back(entryPath);
+			}
+		}
+
+		closedir(dir);
+		return true;
+	}
+
+	static void RemoveWatches(const std::string &relativePath)
+	{
+		for (auto it = s_WatchDirectories.begin(); it != s_WatchDirectories.end();)
+		{
+			if (it->second == relativePath || IsInDirectory(it->second, relativePath))
+			{
+				inotify_rm_watch(s_NotifyFd, it->first);
+				it = s_WatchDirectories.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	static void RenameWatches(const std::string &oldPath, const std::string &newPath)
+	{
+		for (auto &[wd, directory] : s_WatchDirectories)
+		{
+			if (directory == oldPath || IsInDirectory(directory, oldPath))
+			{
+				directory = newPath + directory.substr(oldPath.size());
+			}
+		}
+	}
+
+	static void QueueChange(const std::string &filePath, FileSystemWatcherAction action, int64 now)
+	{
+		if (s_SuppressCallbacks)
+		{
+			return;
+		}
+
+		PendingChange &change = s_PendingChanges[filePath];
+		if (change.Action == FileSystemWatcherAction::None)
+		{
+			// Reported at the end of the quiet period at the latest, even if the writer keeps the file open.
+			change.Action = action;
+			change.DueMS = now + COALESCE_QUIET_MS;
+		}
+	}
+
+	static void CloseChange(const std::string &filePath, int64 now)
+	{
+		auto it = s_PendingChanges.find(filePath);
+		if (it != s_PendingChanges.end() && it->second.Action != FileSystemWatcherAction::None)
+		{
+			// The writer is done, so the change is reported right away, unless one was reported within the quiet period.
+			it->second.DueMS = std::max(now, it->second.LastCallbackMS + COALESCE_QUIET_MS);
+		}
+	}
+
+	// Reports the changes, which are due, and returns the time of the next one or -1.
+	static int64 FlushChanges(int64 now)
+	{
+		int64 nextDueMS = -1;
+		for (auto it = s_PendingChanges.begin(); it != s_PendingChanges.end();)
+		{
+			PendingChange &change = it->second;
+			if (change.Action != FileSystemWatcherAction::None && change.DueMS <= now)
+			{
+				Notify(change.Action, it->first);
+				change.Action = FileSystemWatcherAction::None;
+				change.LastCallbackMS = now;
+			}
+
+			if (change.Action == FileSystemWatcherAction::None && change.LastCallbackMS + COALESCE_QUIET_MS <= now)
+			{
+				it = s_PendingChanges.erase(it);
+				continue;
+			}
+
+			int64 dueMS = change.Action != FileSystemWatcherAction::None ? change.DueMS : change.LastCallbackMS + COALESCE_QUIET_MS;
+			nextDueMS = nextDueMS < 0 ? dueMS : std::min(nextDueMS, dueMS);
+			++it;
+		}
+
+		return nextDueMS;
+	}
+
+	static void DropChanges(const std::string &path)
+	{
+		for (auto it = s_PendingChanges.begin(); it != s_PendingChanges.end();)
+		{
+			if (it->first == path || IsInDirectory(it->first, path))
+			{
+				it = s_PendingChanges.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	static void AddTree(const std::string &relativePath, int64 now)
+	{
+		// Files created before the watch was in place do not have events, so they are reported from the scan.
+		std::vector<std::string> files;
+		AddWatches(relativePath, &files);
+		Notify(FileSystemWatcherAction::Added, relativePath);
+
+		for (const std::string &file : files)
+		{
+			QueueChange(file, FileSystemWatcherAction::Added, now);
+			CloseChange(file, now);
+		}
+	}
+
+	static void RemovePendingMove()
+	{
+		if (!s_HasPendingMove)
+		{
+			return;
+		}
+
+		if (s_PendingMove.IsDirectory)
+		{
+			RemoveWatches(s_PendingMove.Path);
+		}
+
+		DropChanges(s_PendingMove.Path);
+		Notify(FileSystemWatcherAction::Removed, s_PendingMove.Path);
+		s_HasPendingMove = false;
+	}
+
+	static void HandleEvent(const struct inotify_event *event, int64 now)
+	{
+		if (event->mask & IN_Q_OVERFLOW)
+		{
+			// Events were lost, so all that is known is that something in the tree changed.
+			CAM_LOG_WARN("The file system watcher queue overflowed for {}", s_WatchPath);
+			Notify(FileSystemWatcherAction::Modified, "");
+			return;
+		}
+
+		auto it = s_WatchDirectories.find(event->wd);
+		if (it == s_WatchDirectories.end())
+		{
+			return;
+		}
+
+		if (event->mask & IN_IGNORED)
+		{
+			s_WatchDirectories.erase(it);
+			return;
+		}
+
+		if (event->len == 0)
+		{
+			return;
+		}
+
+		std::string path = JoinPath(it->second, event->name);
+		bool isDirectory = (event->mask & IN_ISDIR) != 0;
+
+		if ((event->mask & IN_MOVED_TO) && s_HasPendingMove && s_PendingMove.Cookie == event->cookie)
+		{
+			std::string oldPath = s_PendingMove.Path;
+			s_HasPendingMove = false;
+
+			if (isDirectory)
+			{
+				RenameWatches(oldPath, path);
+			}
+
+			DropChanges(oldPath);
+			Notify(FileSystemWatcherAction::Renamed, path, oldPath);
+			return;
+		}
+
+		// Any other event means the previous rename has no second half anymore.
+		RemovePendingMove();
+
+		if (event->mask & IN_MOVED_TO)
+		{
+			// Moved in from outside of the watched tree.
+			if (isDirectory)
+			{
+				AddTree(path, now);
+			}
+			else
+			{
+				Notify(FileSystemWatcherAction::Added, path);
+			}
+		}
+		else if (event->mask & IN_MOVED_FROM)
+		{
+			s_PendingMove.Cookie = event->cookie;
+			s_PendingMove.Path = path;
+			s_PendingMove.IsDirectory = isDirectory;
+			s_PendingMove.DueMS = now + MOVE_PAIR_MS;
+			s_HasPendingMove = true;
+		}
+		else if (event->mask & IN_CREATE)
+		{
+			if (isDirectory)
+			{
+				AddTree(path, now);
+			}
+			else
+			{
+				QueueChange(path, FileSystemWatcherAction::Added, now);
+			}
+		}
+		else if (event->mask & IN_DELETE)
+		{
+			DropChanges(path);
+			Notify(FileSystemWatcherAction::Removed, path);
+		}
+		else if (event->mask & IN_MODIFY)
+		{
+			QueueChange(path, FileSystemWatcherAction::Modified, now);
+		}
+		else if (event->mask & IN_CLOSE_WRITE)
+		{
+			CloseChange(path, now);
+		}
+	}
+
+	static void CloseDescriptors()
+	{
+		if (s_NotifyFd >= 0)
+		{
+			close(s_NotifyFd);
+			s_NotifyFd = -1;
+		}
+
+		if (s_StopFd >= 0)
+		{
+			close(s_StopFd);
+			s_StopFd = -1;
+		}
+
+		s_WatchDirectories.clear();
+		s_PendingChanges.clear();
+		s_HasPendingMove = false;
+	}
 
 	void FileSystemWatcher::Start(const std::string &filePath, const FileSystemWatcherCallbackFn &callback)
 	{
+		Stop();
+
 		s_WatchPath = filePath;
 		s_Callback = callback;
-		s_Watching = true;
 
+		s_NotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		s_StopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (s_NotifyFd < 0 || s_StopFd < 0)
+		{
+			CAM_LOG_ERROR("Could not create the file system watcher: {}", strerror(errno));
+			CloseDescriptors();
+			return;
+		}
+
+		if (!AddWatches("", nullptr))
+		{
+			CloseDescriptors();
+			return;
+		}
 
+		s_Watching = true;
+		s_WatcherThread = std::thread(Watch, nullptr);
+		pthread_setname_np(s_WatcherThread.native_handle(), "CamFSWatcher");
 	}
 
 	void FileSystemWatcher::Stop()
 	{
+		if (!s_WatcherThread.joinable())
+		{
+			return;
+		}
+
 		s_Watching = false;
 
+		uint64 wake = 1;
+		if (write(s_StopFd, &wake, sizeof(wake)) < 0)
+		{
+			CAM_LOG_WARN("Could not wake the file system watcher: {}", strerror(errno));
+		}
 
+		s_WatcherThread.join();
+		CloseDescriptors();
 	}
 
 	void FileSystemWatcher::SetWatchPath(const std::string &filePath)
@@ -41,9 +442,69 @@ namespace Core
 
 	unsigned long FileSystemWatcher::Watch(void *param)
 	{
+		alignas(struct inotify_event) char buffer[4096];
+		struct pollfd fds[2] = {};
+		fds[0].fd = s_NotifyFd;
+		fds[0].events = POLLIN;
+		fds[1].fd = s_StopFd;
+		fds[1].events = POLLIN;
+
+		int64 nextDueMS = -1;
+		while (s_Watching)
+		{
+			if (s_HasPendingMove)
+			{
+				nextDueMS = nextDueMS < 0 ? s_PendingMove.DueMS : std::min(nextDueMS, s_PendingMove.DueMS);
+			}
+
+			int32 timeout = nextDueMS < 0 ? -1 : (int32)std::max<int64>(nextDueMS - QueryMS(), 0);
+			if (poll(fds, 2, timeout) < 0 && errno != EINTR)
+			{
+				CAM_LOG_ERROR("The file system watcher stopped: {}", strerror(errno));
+				break;
+			}
+
+			if (fds[1].revents & POLLIN)
+			{
+				break;
+			}
+
+			int64 now = QueryMS();
+			if (fds[0].revents & POLLIN)
+			{
+				// The whole batch is skipped, the watches for new directories are added anyway.
+				s_SuppressCallbacks = s_IgnoreNextChange.exchange(false);
+
+				for (;;)
+				{
+					ssize_t length = read(s_NotifyFd, buffer, sizeof(buffer));
+					if (length <= 0)
+					{
+						break;
+					}
+
+					for (char *ptr = buffer; ptr < buffer + length;)
+					{
+						const struct inotify_event *event = (const struct inotify_event *)ptr;
+						HandleEvent(event, now);
+						ptr += sizeof(struct inotify_event) + event->len;
+					}
+				}
+
+				s_SuppressCallbacks = false;
+				now = QueryMS();
+			}
+
+			if (s_HasPendingMove && s_PendingMove.DueMS <= now)
+			{
+				RemovePendingMove();
+			}
+
+			nextDueMS = FlushChanges(now);
+		}
+
 		return 0ul;
 	}
 }
 
 #endif // CAM_PLATFORM_LINUX
-
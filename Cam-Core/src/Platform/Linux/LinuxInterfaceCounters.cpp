@@ -0,0 +1,69 @@
+#include "LinuxInterfaceCounters.h"
+
+#ifdef CAM_PLATFORM_LINUX
+
+#include <stdio.h>
+#include <string.h>
+
+namespace Core
+{
+	bool LinuxInterfaceCounters::Open(const std::string &interface_name)
+	{
+		m_InterfaceName = interface_name;
+
+		uint64 bytes = 0;
+		return GetSentBytes(&bytes);
+	}
+
+	bool LinuxInterfaceCounters::GetSentBytes(uint64 *out_bytes)
+	{
+		FILE *file = fopen("/proc/net/dev", "r");
+		if (!file)
+		{
+			return false;
+		}
+
+		// Two header lines, then one line per interface: "name: 8 receive counters, 8 transmit counters".
+		char line[512];
+		uint64 sent_bytes = 0;
+		bool found = false;
+		while (fgets(line, sizeof(line), file))
+		{
+			char *colon = strchr(line, ':');
+			if (!colon)
+			{
+				continue;
+			}
+
+			*colon = '\0';
+			char *name = line + strspn(line, " ");
+			if (m_InterfaceName.empty() ? strcmp(name, "lo") == 0 : m_InterfaceName != name)
+			{
+				continue;
+			}
+
+			unsigned long long counters[9];
+			if (sscanf(colon + 1, "%llu %llu %llu %llu %llu %llu %llu %llu %llu",
+				&counters[0], &counters[1], &counters[2], &counters[3], &counters[4], &counters[5], &counters[6], &counters[7], &counters[8]) != 9)
+			{
+				continue;
+			}
+
+			sent_bytes += counters[8];
+			found = true;
+		}
+
+		fclose(file);
+
+		// Without a name the host may have no other interface than loopback, which still counts as nothing sent.
+		if (!found && !m_InterfaceName.empty())
+		{
+			return false;
+		}
+
+		*out_bytes = sent_bytes;
+		return true;
+	}
+}
+
+#endif // CAM_PLATFORM_LINUX
@@ -0,0 +1,76 @@
+#include "LinuxMappedFile.h"
+
+#ifdef CAM_PLATFORM_LINUX
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace Core
+{
+	LinuxMappedFile::LinuxMappedFile()
+	{
+	}
+
+	LinuxMappedFile::~LinuxMappedFile()
+	{
+		Close();
+	}
+
+	bool LinuxMappedFile::Open(const std::string &path, uint64 size)
+	{
+		Close();
+
+		if (size == 0)
+		{
+			return false;
+		}
+
+		m_File = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		if (m_File < 0)
+		{
+			return false;
+		}
+
+		// Growing the file leaves a hole, which reads as zero and takes no space on disk until it is written.
+		if (ftruncate(m_File, (off_t)size) != 0)
+		{
+			Close();
+			return false;
+		}
+
+		void *data = mmap(nullptr, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, m_File, 0);
+		if (data == MAP_FAILED)
+		{
+			Close();
+			return false;
+		}
+
+		m_Data = (Byte *)data;
+		m_Size = size;
+		return true;
+	}
+
+	void LinuxMappedFile::Close()
+	{
+		if (m_Data)
+		{
+			munmap(m_Data, (size_t)m_Size);
+			m_Data = nullptr;
+			m_Size = 0;
+		}
+
+		if (m_File >= 0)
+		{
+			close(m_File);
+			m_File = -1;
+		}
+	}
+
+	bool LinuxMappedFile::Flush()
+	{
+		return m_Data && msync(m_Data, (size_t)m_Size, MS_ASYNC) == 0;
+	}
+}
+
+#endif // CAM_PLATFORM_LINUX
@@ -0,0 +1,26 @@
+#pragma once
+
+#ifdef CAM_PLATFORM_LINUX
+
+#include "Core/MappedFile.h"
+
+namespace Core
+{
+	class LinuxMappedFile : public MappedFile
+	{
+	public:
+
+		LinuxMappedFile();
+		~LinuxMappedFile();
+
+		virtual bool Open(const std::string &path, uint64 size) override;
+		virtual void Close() override;
+		virtual bool Flush() override;
+
+	private:
+
+		int32 m_File = -1;
+	};
+}
+
+#endif // CAM_PLATFORM_LINUX
@@ -8,18 +8,51 @@
 #include <netinet/in.h>
 #include <fcntl.h>
 #include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <linux/errqueue.h>
 
 namespace Core
 {
-	// get sockaddr, IPv4 or IPv6:
-	static void *GetInAddr(struct sockaddr *sa)
+	// Connected stream sockets do not report the sender, use the peer of the connection instead.
+	static void GetSenderAddr(int32 handle, struct sockaddr_in *sender, socklen_t sender_len, addr_t *addr)
 	{
-    	if (sa->sa_family == AF_INET)
-        	return &(((struct sockaddr_in*)sa)->sin_addr);
-    	return &(((struct sockaddr_in6*)sa)->sin6_addr);
+		if (sender_len < sizeof(struct sockaddr_in))
+		{
+			sender_len = sizeof(struct sockaddr_in);
+			if (getpeername(handle, (struct sockaddr *)sender, &sender_len) < 0)
+			{
+				return;
+			}
+		}
+
+		addr->Host = sender->sin_addr.s_addr;
+		addr->Port = sender->sin_port;
 	}
 
-	LinuxSocket::LinuxSocket()
+	// Advances the iovec array by the number of transferred bytes, fully transferred entries are skipped.
+	static void AdvanceIOVec(struct msghdr *msg, uint64 bytes)
+	{
+		while (bytes > 0 && msg->msg_iovlen > 0)
+		{
+			if (bytes >= msg->msg_iov->iov_len)
+			{
+				bytes -= msg->msg_iov->iov_len;
+				++msg->msg_iov;
+				--msg->msg_iovlen;
+			}
+			else
+			{
+				msg->msg_iov->iov_base = (Byte *)msg->msg_iov->iov_base + bytes;
+				msg->msg_iov->iov_len -= bytes;
+				bytes = 0;
+			}
+		}
+	}
+
+	LinuxSocket::LinuxSocket(SocketType type)
+		: m_Type(type)
 	{
 		m_Socket = -1;
 		m_Connection = -1;
@@ -37,7 +70,7 @@ namespace Core
 		int32 opt = 1;
 
 		// Creating socket file descriptor
-		if ((m_Socket = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		if ((m_Socket = socket(AF_INET, m_Type == SocketType::Stream ? SOCK_STREAM : SOCK_DGRAM, 0)) < 0)
 		{
 			return false;
 		}
@@ -48,7 +81,8 @@ namespace Core
 			return false;
 		}
 
-		if (is_client)
+		// Datagram clients do not connect, every message is sent to the given address.
+		if (is_client && m_Type == SocketType::Stream)
 		{
 			struct sockaddr_in serv_addr;
 			int32 status;
@@ -66,6 +100,8 @@ namespace Core
 			{
 				return false;
 			}
+
+			EnableZeroCopy(m_Socket);
 		}
 
 		return true;
@@ -101,6 +137,12 @@ namespace Core
 			return false;
 		}
 
+		if (m_Type == SocketType::Datagram)
+		{
+			return true;
+		}
+
+		// Stream sockets accept exactly one connection, StreamServer handles multiple clients.
 		if (listen(m_Socket, 3) < 0)
 		{
 			return false;
@@ -111,20 +153,18 @@ namespace Core
 			return false;
 		}
 
+		EnableZeroCopy(m_Connection);
 		return true;
 	}
 	
 	int32 LinuxSocket::Recv(void *dst, int32 dst_bytes, addr_t *addr)
 	{
 		int32 handle = m_Connection == -1 ? m_Socket : m_Connection;
-		struct sockaddr dest_addr;
+		struct sockaddr_in dest_addr = {};
 		socklen_t addrLen = sizeof(dest_addr);
 
-		int32 bytes_received = recvfrom(handle, dst, dst_bytes, 0, &dest_addr, &addrLen);
-		struct sockaddr_in *dest_conn_info = (struct sockaddr_in*)GetInAddr(&dest_addr);
-
-		addr->Host = dest_conn_info->sin_addr.s_addr;
-		addr->Port = dest_conn_info->sin_port;
+		int32 bytes_received = recvfrom(handle, dst, dst_bytes, 0, (struct sockaddr *)&dest_addr, &addrLen);
+		GetSenderAddr(handle, &dest_addr, addrLen, addr);
 		return bytes_received;
 	}
 	
@@ -143,11 +183,25 @@ namespace Core
 
 	int32 LinuxSocket::SendLarge(void const *src, int32 src_bytes, addr_t addr)
 	{
-		int32 send_pos = 0;
-		int32 buffer_size = 256;
-		int32 bytes_left = src_bytes;
-		int32 n = -1;
-		
+		io_buffer_t buffer = { (void *)src, (uint32)src_bytes };
+		return SendBulk(&buffer, 1, addr);
+	}
+
+	int32 LinuxSocket::RecvLarge(void *dst, int32 dst_bytes, addr_t *addr)
+	{
+		assert(dst);
+		assert(dst_bytes);
+		assert(addr);
+
+		io_buffer_t buffer = { dst, (uint32)dst_bytes };
+		return RecvBulk(&buffer, 1, addr);
+	}
+
+	int32 LinuxSocket::SendBulk(io_buffer_t const *buffers, uint32 count, addr_t addr)
+	{
+		assert(buffers);
+		assert(count <= MAX_IO_BUFFERS);
+
 		int32 handle = m_Connection == -1 ? m_Socket : m_Connection;
 		struct sockaddr_in dest_addr;
 
@@ -156,73 +210,454 @@ namespace Core
 		dest_addr.sin_addr.s_addr = addr.Host;
 		dest_addr.sin_port = addr.Port;
 
-		while (send_pos < src_bytes)
+		struct iovec iov[MAX_IO_BUFFERS];
+		uint64 total_bytes = 0;
+		for (uint32 i = 0; i < count; ++i)
 		{
-			int32 chunk_size = bytes_left > buffer_size ? buffer_size : bytes_left;
-			n = sendto(handle, src + send_pos, chunk_size, 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+			iov[i].iov_base = buffers[i].Data;
+			iov[i].iov_len = buffers[i].Size;
+			total_bytes += buffers[i].Size;
+		}
 
-			if (-1 == n)
+		if (total_bytes > INT32_MAX)
+		{
+			return -1;
+		}
+
+		struct msghdr msg = {};
+		msg.msg_name = &dest_addr;
+		msg.msg_namelen = sizeof(dest_addr);
+		msg.msg_iov = iov;
+		msg.msg_iovlen = count;
+
+		int32 flags = MSG_NOSIGNAL;
+#ifdef MSG_ZEROCOPY
+		if (m_ZeroCopy && total_bytes >= ZEROCOPY_THRESHOLD)
+		{
+			flags |= MSG_ZEROCOPY;
+		}
+#endif
+
+		// Each call is given the whole remaining length, the kernel only returns early if the send buffer is full.
+		uint64 bytes_sent = 0;
+		uint32 zerocopy_sends = 0;
+		while (bytes_sent < total_bytes)
+		{
+			ssize_t n = sendmsg(handle, &msg, flags);
+			if (n < 0)
 			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					struct pollfd pfd = { handle, POLLOUT, 0 };
+					poll(&pfd, 1, -1);
+					continue;
+				}
+
+#ifdef MSG_ZEROCOPY
+				// The socket ran out of option memory to pin pages, send the rest as a regular copy.
+				if (errno == ENOBUFS && (flags & MSG_ZEROCOPY))
+				{
+					flags &= ~MSG_ZEROCOPY;
+					continue;
+				}
+#endif
+
 				break;
 			}
 
-			if (n != chunk_size)
+#ifdef MSG_ZEROCOPY
+			if (flags & MSG_ZEROCOPY)
 			{
-				// if less bytes were send, increase/decrease only by that amount
-				chunk_size = n;
+				++zerocopy_sends;
 			}
+#endif
 
-			send_pos += chunk_size;
-			bytes_left -= chunk_size;
+			bytes_sent += n;
+			AdvanceIOVec(&msg, n);
 		}
 
-		return send_pos == src_bytes ? send_pos : -1;
+		// The kernel still references the pages of zero copy sends, the caller may only reuse them after the completion.
+		if (zerocopy_sends > 0 && !WaitForZeroCopy(handle, zerocopy_sends))
+		{
+			return -1;
+		}
+
+		return bytes_sent == total_bytes ? (int32)bytes_sent : -1;
 	}
 
-	int32 LinuxSocket::RecvLarge(void *dst, int32 dst_bytes, addr_t *addr)
+	int32 LinuxSocket::RecvBulk(io_buffer_t const *buffers, uint32 count, addr_t *addr)
 	{
-		assert(dst);
-		assert(dst_bytes);
+		assert(buffers);
+		assert(count <= MAX_IO_BUFFERS);
 		assert(addr);
 
 		int32 handle = m_Connection == -1 ? m_Socket : m_Connection;
-		struct sockaddr dest_addr;
-		socklen_t addrLen = sizeof(dest_addr);
+		struct sockaddr_in src_addr = {};
 
-		int32 buffer_size = 256;
-		int32 read_pos = 0;
-		int32 bytes_received = 0;
-		
-		while (bytes_received != dst_bytes)
+		struct iovec iov[MAX_IO_BUFFERS];
+		uint64 total_bytes = 0;
+		for (uint32 i = 0; i < count; ++i)
+		{
+			iov[i].iov_base = buffers[i].Data;
+			iov[i].iov_len = buffers[i].Size;
+			total_bytes += buffers[i].Size;
+		}
+
+		if (total_bytes > INT32_MAX)
+		{
+			return -1;
+		}
+
+		struct msghdr msg = {};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = count;
+
+		uint64 bytes_received = 0;
+		while (bytes_received < total_bytes)
 		{
-			if (read_pos >= dst_bytes)
+			msg.msg_name = &src_addr;
+			msg.msg_namelen = sizeof(src_addr);
+
+			ssize_t n = recvmsg(handle, &msg, MSG_WAITALL);
+			if (n < 0)
 			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					struct pollfd pfd = { handle, POLLIN, 0 };
+					poll(&pfd, 1, -1);
+					continue;
+				}
+
 				break;
 			}
-	
-			uint32 chunk_size = dst_bytes > buffer_size ? buffer_size : dst_bytes;
-			bytes_received = recvfrom(handle, dst + read_pos, chunk_size, 0, &dest_addr, &addrLen);
 
-			if (bytes_received == -1)
+			if (n == 0)
 			{
+				// Connection closed by the peer.
 				break;
 			}
-			
-			if (chunk_size != bytes_received)
+
+			bytes_received += n;
+			AdvanceIOVec(&msg, n);
+			GetSenderAddr(handle, &src_addr, msg.msg_namelen, addr);
+
+			if (m_Type == SocketType::Datagram)
 			{
-				chunk_size = bytes_received;
+				return (int32)bytes_received;
 			}
+		}
+
+		return bytes_received == total_bytes ? (int32)bytes_received : -1;
+	}
+
+	int32 LinuxSocket::SendBatch(datagram_t const *datagrams, uint32 count)
+	{
+		assert(datagrams);
+		assert(count <= MAX_BATCH);
+
+		int32 handle = m_Connection == -1 ? m_Socket : m_Connection;
 
-			read_pos += chunk_size;
+		struct mmsghdr msgs[MAX_BATCH];
+		struct sockaddr_in dest_addrs[MAX_BATCH];
+		struct iovec iov[MAX_BATCH * MAX_IO_BUFFERS];
 
-			struct sockaddr_in *dest_conn_info = (struct sockaddr_in*)GetInAddr(&dest_addr);
-			addr->Host = dest_conn_info->sin_addr.s_addr;
-			addr->Port = dest_conn_info->sin_port;
+		uint32 iov_count = 0;
+		for (uint32 i = 0; i < count; ++i)
+		{
+			const datagram_t &datagram = datagrams[i];
+			assert(datagram.BufferCount <= MAX_IO_BUFFERS);
+
+			memset(&dest_addrs[i], 0, sizeof(dest_addrs[i]));
+			dest_addrs[i].sin_family = AF_INET;
+			dest_addrs[i].sin_addr.s_addr = datagram.Addr.Host;
+			dest_addrs[i].sin_port = datagram.Addr.Port;
+
+			for (uint32 j = 0; j < datagram.BufferCount; ++j)
+			{
+				iov[iov_count + j].iov_base = datagram.Buffers[j].Data;
+				iov[iov_count + j].iov_len = datagram.Buffers[j].Size;
+			}
+
+			memset(&msgs[i], 0, sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_name = &dest_addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(dest_addrs[i]);
+			msgs[i].msg_hdr.msg_iov = &iov[iov_count];
+			msgs[i].msg_hdr.msg_iovlen = datagram.BufferCount;
+			iov_count += datagram.BufferCount;
+		}
+
+		// sendmmsg stops at the first datagram, which can not be sent, and only reports an error if that is the first one.
+		uint32 done = 0;
+		uint32 sent = 0;
+		while (done < count)
+		{
+			int32 n = sendmmsg(handle, msgs + done, count - done, MSG_NOSIGNAL);
+			if (n < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					struct pollfd pfd = { handle, POLLOUT, 0 };
+					poll(&pfd, 1, -1);
+					continue;
+				}
+
+				if (errno == EBADF || errno == ENOTSOCK)
+				{
+					return -1;
+				}
+
+				// e.g. the receiver is unreachable, skip the datagram and send the rest.
+				++done;
+				continue;
+			}
+
+			done += n;
+			sent += n;
 		}
 
-		return bytes_received == dst_bytes ? bytes_received : -1;
+		return (int32)sent;
 	}
-	
+
+	int32 LinuxSocket::RecvBatch(datagram_t *datagrams, uint32 count)
+	{
+		assert(datagrams);
+		assert(count <= MAX_BATCH);
+
+		int32 handle = m_Connection == -1 ? m_Socket : m_Connection;
+
+		struct mmsghdr msgs[MAX_BATCH];
+		struct sockaddr_in src_addrs[MAX_BATCH];
+		struct iovec iov[MAX_BATCH * MAX_IO_BUFFERS];
+
+		uint32 iov_count = 0;
+		for (uint32 i = 0; i < count; ++i)
+		{
+			const datagram_t &datagram = datagrams[i];
+			assert(datagram.BufferCount <= MAX_IO_BUFFERS);
+
+			for (uint32 j = 0; j < datagram.BufferCount; ++j)
+			{
+				iov[iov_count + j].iov_base = datagram.Buffers[j].Data;
+				iov[iov_count + j].iov_len = datagram.Buffers[j].Size;
+			}
+
+			memset(&src_addrs[i], 0, sizeof(src_addrs[i]));
+			memset(&msgs[i], 0, sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_name = &src_addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(src_addrs[i]);
+			msgs[i].msg_hdr.msg_iov = &iov[iov_count];
+			msgs[i].msg_hdr.msg_iovlen = datagram.BufferCount;
+			iov_count += datagram.BufferCount;
+		}
+
+		for (;;)
+		{
+			// Waits for the first datagram only, the following ones are taken if they are already queued.
+			int32 n = recvmmsg(handle, msgs, count, MSG_WAITFORONE, nullptr);
+			if (n < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					struct pollfd pfd = { handle, POLLIN, 0 };
+					poll(&pfd, 1, -1);
+					continue;
+				}
+
+				return -1;
+			}
+
+			for (int32 i = 0; i < n; ++i)
+			{
+				datagrams[i].Size = msgs[i].msg_len;
+				GetSenderAddr(handle, &src_addrs[i], msgs[i].msg_hdr.msg_namelen, &datagrams[i].Addr);
+			}
+
+			return n;
+		}
+	}
+
+	void LinuxSocket::EnableZeroCopy(int32 handle)
+	{
+		m_ZeroCopy = false;
+
+#ifdef SO_ZEROCOPY
+		int32 opt = 1;
+		m_ZeroCopy = setsockopt(handle, SOL_SOCKET, SO_ZEROCOPY, &opt, sizeof(opt)) == 0;
+#endif
+	}
+
+	bool LinuxSocket::WaitForZeroCopy(int32 handle, uint32 pending_sends)
+	{
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+		while (pending_sends > 0)
+		{
+			// POLLERR is always reported, it is set as soon as a completion is queued on the error queue.
+			struct pollfd pfd = { handle, 0, 0 };
+			if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+			{
+				return false;
+			}
+
+			Byte control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in))];
+			struct msghdr msg = {};
+			msg.msg_control = control;
+			msg.msg_controllen = sizeof(control);
+
+			if (recvmsg(handle, &msg, MSG_ERRQUEUE) < 0)
+			{
+				if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				{
+					if (pfd.revents & POLLHUP)
+					{
+						return false;
+					}
+
+					continue;
+				}
+
+				return false;
+			}
+
+			for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+			{
+				if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR)
+				{
+					continue;
+				}
+
+				struct sock_extended_err *err = (struct sock_extended_err *)CMSG_DATA(cmsg);
+				if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				{
+					continue;
+				}
+
+				// The completion covers the range of sends [ee_info, ee_data].
+				uint32 completed = err->ee_data - err->ee_info + 1;
+				pending_sends = completed >= pending_sends ? 0 : pending_sends - completed;
+
+#ifdef SO_EE_CODE_ZEROCOPY_COPIED
+				// The kernel had to copy the data anyway (e.g. on loopback), so zero copy only adds overhead on this connection.
+				if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				{
+					m_ZeroCopy = false;
+				}
+#endif
+			}
+		}
+#endif
+
+		return true;
+	}
+
+	bool LinuxSocket::Wait(int32 timeout_ms)
+	{
+		int32 handle = m_Connection == -1 ? m_Socket : m_Connection;
+		struct pollfd pfd = { handle, POLLIN, 0 };
+
+		int32 result;
+		do
+		{
+			result = poll(&pfd, 1, timeout_ms);
+		}
+		while (result < 0 && errno == EINTR);
+
+		return result > 0;
+	}
+
+	bool LinuxSocket::WaitAny(Socket *const *sockets, uint32 count, int32 timeout_ms)
+	{
+		assert(count <= MAX_WAIT_SOCKETS);
+
+		struct pollfd pfds[MAX_WAIT_SOCKETS];
+		for (uint32 i = 0; i < count; ++i)
+		{
+			const LinuxSocket *socket = (const LinuxSocket *)sockets[i];
+			pfds[i].fd = socket->m_Connection == -1 ? socket->m_Socket : socket->m_Connection;
+			pfds[i].events = POLLIN;
+			pfds[i].revents = 0;
+		}
+
+		int32 result;
+		do
+		{
+			result = poll(pfds, count, timeout_ms);
+		}
+		while (result < 0 && errno == EINTR);
+
+		return result > 0;
+	}
+
+	bool LinuxSocket::BindMulticast(const std::string &group, uint16 port, const std::string &interface_ip)
+	{
+		struct ip_mreq request = {};
+		if (inet_pton(AF_INET, group.c_str(), &request.imr_multiaddr) != 1 || !IN_MULTICAST(ntohl(request.imr_multiaddr.s_addr)))
+		{
+			return false;
+		}
+
+		request.imr_interface.s_addr = htonl(INADDR_ANY);
+		if (!interface_ip.empty() && inet_pton(AF_INET, interface_ip.c_str(), &request.imr_interface) != 1)
+		{
+			return false;
+		}
+
+		int32 opt = 1;
+		if (setsockopt(m_Socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
+		{
+			return false;
+		}
+
+		// Bound to the group address, the socket only receives the datagrams of the group.
+		struct sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_addr = request.imr_multiaddr;
+		address.sin_port = htons(port);
+
+		if (bind(m_Socket, (struct sockaddr *)&address, sizeof(address)) < 0)
+		{
+			return false;
+		}
+
+		return setsockopt(m_Socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) == 0;
+	}
+
+	bool LinuxSocket::SetMulticastSender(const std::string &interface_ip, uint8 ttl, bool loopback)
+	{
+		struct in_addr interface_addr = {};
+		interface_addr.s_addr = htonl(INADDR_ANY);
+		if (!interface_ip.empty() && inet_pton(AF_INET, interface_ip.c_str(), &interface_addr) != 1)
+		{
+			return false;
+		}
+
+		Byte ttl_value = ttl;
+		Byte loop_value = loopback ? 1 : 0;
+
+		return setsockopt(m_Socket, IPPROTO_IP, IP_MULTICAST_IF, &interface_addr, sizeof(interface_addr)) == 0 &&
+			setsockopt(m_Socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl_value, sizeof(ttl_value)) == 0 &&
+			setsockopt(m_Socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop_value, sizeof(loop_value)) == 0;
+	}
+
 	bool LinuxSocket::SetNonBlocking(bool enabled)
 	{
 		return fcntl(m_Socket, F_SETFL, SOCK_NONBLOCK) != -1;
@@ -237,9 +672,14 @@ namespace Core
 
 		addr_t addr = {};
 
+		struct addrinfo hints = {};
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_DGRAM;
+
 		reqs[0] = (gaicb*)malloc(sizeof(*reqs[0]));
 		memset(reqs[0], 0, sizeof(*reqs[0]));
 		reqs[0]->ar_name = host.c_str();
+		reqs[0]->ar_request = &hints;
 
 		int32 ret = getaddrinfo_a(GAI_WAIT, reqs, 1, NULL);
 		if (ret != 0)
@@ -255,6 +695,8 @@ namespace Core
 			res = reqs[0]->ar_result;
 
 			ret = getnameinfo(res->ai_addr, res->ai_addrlen, hbuf, sizeof(hbuf), NULL, 0, NI_NUMERICHOST);
+			freeaddrinfo(res);
+
 			if (ret != 0)
 			{
 				free(reqs[0]);
@@ -262,7 +704,8 @@ namespace Core
 				return {};
 			}
 
-    		sockaddr_in addr4 = {};
+			// inet_pton writes the plain address, not a whole sockaddr_in.
+			struct in_addr addr4 = {};
 			if (inet_pton(AF_INET, hbuf, (void*)(&addr4)) < 1)
 			{
 				free(reqs[0]);
@@ -270,8 +713,8 @@ namespace Core
 				return {};
 			}
 
-			addr.Host = addr4.sin_addr.s_addr;
-			addr.Port = port;
+			addr.Host = addr4.s_addr;
+			addr.Port = htons(port);
 		}
 
 		free(reqs[0]);
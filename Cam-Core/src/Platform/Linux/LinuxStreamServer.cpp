@@ -0,0 +1,354 @@
+#include "LinuxStreamServer.h"
+
+#ifdef CAM_PLATFORM_LINUX
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+namespace Core
+{
+	LinuxStreamServer::LinuxStreamServer()
+	{
+	}
+
+	LinuxStreamServer::~LinuxStreamServer()
+	{
+		Close();
+	}
+
+	bool LinuxStreamServer::Listen(uint16 port, uint32 backlog)
+	{
+		Close();
+
+		m_Listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (m_Listener < 0)
+		{
+			return false;
+		}
+
+		int32 opt = 1;
+		setsockopt(m_Listener, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+		struct sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = INADDR_ANY;
+		address.sin_port = htons(port);
+
+		if (bind(m_Listener, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(m_Listener, (int32)backlog) < 0)
+		{
+			Close();
+			return false;
+		}
+
+		m_Epoll = epoll_create1(EPOLL_CLOEXEC);
+		if (m_Epoll < 0)
+		{
+			Close();
+			return false;
+		}
+
+		struct epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.fd = m_Listener;
+		if (epoll_ctl(m_Epoll, EPOLL_CTL_ADD, m_Listener, &event) < 0)
+		{
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void LinuxStreamServer::Close()
+	{
+		while (!m_Connections.empty())
+		{
+			CloseConnection(m_Connections.begin()->first);
+		}
+
+		if (m_Epoll != -1)
+		{
+			close(m_Epoll);
+			m_Epoll = -1;
+		}
+
+		if (m_Listener != -1)
+		{
+			close(m_Listener);
+			m_Listener = -1;
+		}
+	}
+
+	bool LinuxStreamServer::Poll(int32 timeout_ms)
+	{
+		if (m_Epoll == -1)
+		{
+			return false;
+		}
+
+		struct epoll_event events[MAX_EVENTS];
+		int32 count = epoll_wait(m_Epoll, events, MAX_EVENTS, timeout_ms);
+		if (count < 0)
+		{
+			return errno == EINTR;
+		}
+
+		for (int32 i = 0; i < count; ++i)
+		{
+			int32 handle = events[i].data.fd;
+			if (handle == m_Listener)
+			{
+				if (events[i].events & (EPOLLERR | EPOLLHUP))
+				{
+					return false;
+				}
+
+				AcceptConnections();
+				continue;
+			}
+
+			auto it = m_Connections.find(handle);
+			if (it == m_Connections.end())
+			{
+				continue;
+			}
+
+			uint32 flags = events[i].events;
+			bool keep = !(flags & EPOLLERR);
+			if (keep && (flags & EPOLLOUT))
+			{
+				keep = FlushOutput(it->second);
+			}
+
+			// Read before handling hang ups, the peer may have sent its last messages right before closing.
+			if (keep && (flags & ~EPOLLOUT))
+			{
+				keep = ReadConnection(it->second);
+			}
+
+			if (!keep || it->second.Closing)
+			{
+				CloseConnection(handle);
+			}
+		}
+
+		// Connections, which have been disconnected by a message handler of another connection.
+		std::vector<int32> closing;
+		for (auto &[handle, connection] : m_Connections)
+		{
+			if (connection.Closing)
+			{
+				closing.push_back(handle);
+			}
+		}
+
+		for (int32 handle : closing)
+		{
+			CloseConnection(handle);
+		}
+
+		return true;
+	}
+
+	int32 LinuxStreamServer::Send(addr_t client, void const *src, int32 src_bytes)
+	{
+		auto handle_it = m_Handles.find(client.Value);
+		if (handle_it == m_Handles.end())
+		{
+			return -1;
+		}
+
+		Connection &connection = m_Connections[handle_it->second];
+		bool has_output = HasOutput(connection);
+
+		// Nothing is sent directly, while older bytes are waiting, they have to reach the client first.
+		int32 bytes_sent = 0;
+		while (!has_output && bytes_sent < src_bytes)
+		{
+			ssize_t n = send(connection.Handle, (Byte const *)src + bytes_sent, src_bytes - bytes_sent, MSG_NOSIGNAL);
+			if (n < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					break;
+				}
+
+				Disconnect(client);
+				return -1;
+			}
+
+			bytes_sent += (int32)n;
+		}
+
+		if (bytes_sent == src_bytes)
+		{
+			return bytes_sent;
+		}
+
+		// The rest is sent, once the connection is writable. A client, which does not read its responses, must not block the others.
+		if (!QueueOutput(connection, (Byte const *)src + bytes_sent, (uint32)(src_bytes - bytes_sent)) || (!has_output && !WatchOutput(connection, true)))
+		{
+			Disconnect(client);
+			return -1;
+		}
+
+		return src_bytes;
+	}
+
+	void LinuxStreamServer::Disconnect(addr_t client)
+	{
+		auto handle_it = m_Handles.find(client.Value);
+		if (handle_it == m_Handles.end())
+		{
+			return;
+		}
+
+		// Message handlers may disconnect clients, so closing is deferred until the dispatch is finished.
+		if (m_Dispatching)
+		{
+			m_Connections[handle_it->second].Closing = true;
+			return;
+		}
+
+		CloseConnection(handle_it->second);
+	}
+
+	void LinuxStreamServer::AcceptConnections()
+	{
+		for (;;)
+		{
+			struct sockaddr_in address = {};
+			socklen_t address_len = sizeof(address);
+
+			int32 handle = accept4(m_Listener, (struct sockaddr *)&address, &address_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (handle < 0)
+			{
+				if (errno == EINTR || errno == ECONNABORTED)
+				{
+					continue;
+				}
+
+				// EAGAIN if all pending connections are accepted, otherwise out of resources. Both are retried on the next event.
+				break;
+			}
+
+			// Responses are small, do not delay them.
+			int32 opt = 1;
+			setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+			struct epoll_event event = {};
+			event.events = EPOLLIN | EPOLLRDHUP;
+			event.data.fd = handle;
+			if (epoll_ctl(m_Epoll, EPOLL_CTL_ADD, handle, &event) < 0)
+			{
+				close(handle);
+				continue;
+			}
+
+			Connection &connection = m_Connections[handle];
+			connection.Handle = handle;
+			connection.Addr.Host = address.sin_addr.s_addr;
+			connection.Addr.Port = address.sin_port;
+			m_Handles[connection.Addr.Value] = handle;
+
+			if (m_ConnectCallback)
+			{
+				m_ConnectCallback(connection.Addr);
+			}
+		}
+	}
+
+	bool LinuxStreamServer::ReadConnection(Connection &connection)
+	{
+		for (uint32 i = 0; i < MAX_READS_PER_EVENT; ++i)
+		{
+			io_buffer_t buffer = GetReadBuffer(connection);
+			ssize_t n = recv(connection.Handle, buffer.Data, buffer.Size, 0);
+			if (n < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				return errno == EAGAIN || errno == EWOULDBLOCK;
+			}
+
+			if (n == 0)
+			{
+				// Connection closed by the peer.
+				return false;
+			}
+
+			if (!OnReceived(connection, (uint32)n) || connection.Closing)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool LinuxStreamServer::FlushOutput(Connection &connection)
+	{
+		while (HasOutput(connection))
+		{
+			ssize_t n = send(connection.Handle, connection.Output.data() + connection.OutputSent, connection.Output.size() - connection.OutputSent, MSG_NOSIGNAL);
+			if (n < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				return errno == EAGAIN || errno == EWOULDBLOCK;
+			}
+
+			OnOutputSent(connection, (uint32)n);
+		}
+
+		// Everything is sent, stop waiting for the connection to become writable.
+		return WatchOutput(connection, false);
+	}
+
+	bool LinuxStreamServer::WatchOutput(Connection &connection, bool watch)
+	{
+		struct epoll_event event = {};
+		event.events = EPOLLIN | EPOLLRDHUP | (watch ? EPOLLOUT : 0);
+		event.data.fd = connection.Handle;
+		return epoll_ctl(m_Epoll, EPOLL_CTL_MOD, connection.Handle, &event) == 0;
+	}
+
+	void LinuxStreamServer::CloseConnection(int32 handle)
+	{
+		auto it = m_Connections.find(handle);
+		if (it == m_Connections.end())
+		{
+			return;
+		}
+
+		addr_t addr = it->second.Addr;
+
+		epoll_ctl(m_Epoll, EPOLL_CTL_DEL, handle, nullptr);
+		close(handle);
+
+		m_Handles.erase(addr.Value);
+		m_Connections.erase(it);
+
+		if (m_DisconnectCallback)
+		{
+			m_DisconnectCallback(addr);
+		}
+	}
+}
+
+#endif // CAM_PLATFORM_LINUX
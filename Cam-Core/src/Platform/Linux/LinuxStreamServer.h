@@ -0,0 +1,57 @@
+#pragma once
+
+#ifdef CAM_PLATFORM_LINUX
+
+#include "Net/StreamServer.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace Core
+{
+	class LinuxStreamServer : public StreamServer
+	{
+	public:
+
+		LinuxStreamServer();
+		~LinuxStreamServer();
+
+		virtual bool Listen(uint16 port, uint32 backlog = 128) override;
+		virtual void Close() override;
+
+		virtual bool Poll(int32 timeout_ms) override;
+
+		virtual int32 Send(addr_t client, void const *src, int32 src_bytes) override;
+		virtual void Disconnect(addr_t client) override;
+
+		virtual uint32 GetConnectionCount() const override { return (uint32)m_Connections.size(); }
+
+	private:
+
+		struct Connection : public StreamConnection
+		{
+			int32 Handle = -1;
+		};
+
+		void AcceptConnections();
+		bool ReadConnection(Connection &connection);
+		bool FlushOutput(Connection &connection);
+		bool WatchOutput(Connection &connection, bool watch);
+		void CloseConnection(int32 handle);
+
+	private:
+
+		static constexpr uint32 MAX_EVENTS = 256;
+
+		// Limits the reads per connection and Poll call, so that a single fast client can not starve the others.
+		static constexpr uint32 MAX_READS_PER_EVENT = 16;
+
+		int32 m_Listener = -1;
+		int32 m_Epoll = -1;
+
+		std::unordered_map<int32, Connection> m_Connections;
+		std::unordered_map<uint64, int32> m_Handles;
+	};
+}
+
+#endif // CAM_PLATFORM_LINUX
@@ -2,18 +2,37 @@
 
 #ifdef CAM_PLATFORM_LINUX
 
+#include <time.h>
+#include <errno.h>
+
 namespace Core
 {
 	int64 QueryMS()
 	{
-		return 0;
+		// Monotonic, so that changes of the wall clock do not affect time differences.
+		struct timespec now = {};
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return (int64)now.tv_sec * 1000 + (int64)now.tv_nsec / 1000000;
+	}
+
+	int64 QueryUS()
+	{
+		struct timespec now = {};
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return (int64)now.tv_sec * 1000000 + (int64)now.tv_nsec / 1000;
 	}
 
 	void SleepMS(uint32 ms)
 	{
+		struct timespec remaining = {};
+		remaining.tv_sec = ms / 1000;
+		remaining.tv_nsec = (long)(ms % 1000) * 1000000;
 
+		// Continue sleeping, if a signal interrupted the sleep.
+		while (nanosleep(&remaining, &remaining) != 0 && errno == EINTR)
+		{
+		}
 	}
 }
 
 #endif // CAM_PLATFORM_LINUX
-
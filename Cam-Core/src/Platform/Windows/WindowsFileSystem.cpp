@@ -238,6 +238,59 @@ namespace Core
 		return RemoveDirectoryA(filePath.c_str());
 	}
 
+	bool FileSystem::CreateDirectories(const std::string &filePath) const
+	{
+		std::error_code error;
+		std::filesystem::create_directories(filePath, error);
+		return !error && DirectoryExists(filePath);
+	}
+
+	bool FileSystem::RemoveDirectoryTree(const std::string &filePath) const
+	{
+		std::error_code error;
+		std::filesystem::remove_all(filePath, error);
+		return !error;
+	}
+
+	bool FileSystem::RenameFile(const std::string &from, const std::string &to) const
+	{
+		return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING);
+	}
+
+	bool FileSystem::ReplaceDirectory(const std::string &source, const std::string &target) const
+	{
+		if (!DirectoryExists(target))
+		{
+			return RenameFile(source, target);
+		}
+
+		// Directories can not be exchanged in one step, target is moved aside and put back, if source can not take its place.
+		std::string old = target + ".old";
+		if (DirectoryExists(old) && !RemoveDirectoryTree(old))
+		{
+			return false;
+		}
+
+		if (!MoveFileExA(target.c_str(), old.c_str(), 0))
+		{
+			return false;
+		}
+
+		if (!MoveFileExA(source.c_str(), target.c_str(), 0))
+		{
+			MoveFileExA(old.c_str(), target.c_str(), 0);
+			return false;
+		}
+
+		return RemoveDirectoryTree(old);
+	}
+
+	bool FileSystem::SetFileMode(const std::string &filePath, uint32 mode) const
+	{
+		// Windows decides by the extension, whether a file can be executed.
+		return true;
+	}
+
 	bool FileSystem::StartProgram(const std::string &executable)
 	{
 		STARTUPINFOA startInfo;
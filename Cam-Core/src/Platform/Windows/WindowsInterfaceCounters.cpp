@@ -0,0 +1,73 @@
+#include "WindowsInterfaceCounters.h"
+
+#ifdef CAM_PLATFORM_WINDOWS
+
+#include <WinSock2.h>
+#include <Windows.h>
+#include <iphlpapi.h>
+#include <netioapi.h>
+
+namespace Core
+{
+	bool WindowsInterfaceCounters::Open(const std::string &interface_name)
+	{
+		m_InterfaceName = interface_name;
+
+		uint64 bytes = 0;
+		return GetSentBytes(&bytes);
+	}
+
+	bool WindowsInterfaceCounters::GetSentBytes(uint64 *out_bytes)
+	{
+		MIB_IF_TABLE2 *table = nullptr;
+		if (GetIfTable2(&table) != NO_ERROR)
+		{
+			return false;
+		}
+
+		uint64 sent_bytes = 0;
+		bool found = false;
+		for (ULONG i = 0; i < table->NumEntries; ++i)
+		{
+			const MIB_IF_ROW2 &row = table->Table[i];
+
+			// Filter drivers show up as interfaces of their own, their traffic is already counted by the interface below them.
+			if (row.InterfaceAndOperStatusFlags.FilterInterface)
+			{
+				continue;
+			}
+
+			if (m_InterfaceName.empty())
+			{
+				if (row.Type == IF_TYPE_SOFTWARE_LOOPBACK || !row.InterfaceAndOperStatusFlags.HardwareInterface)
+				{
+					continue;
+				}
+			}
+			else
+			{
+				char alias[sizeof(row.Alias)] = {};
+				WideCharToMultiByte(CP_UTF8, 0, row.Alias, -1, alias, sizeof(alias) - 1, NULL, NULL);
+				if (m_InterfaceName != alias)
+				{
+					continue;
+				}
+			}
+
+			sent_bytes += row.OutOctets;
+			found = true;
+		}
+
+		FreeMibTable(table);
+
+		if (!found && !m_InterfaceName.empty())
+		{
+			return false;
+		}
+
+		*out_bytes = sent_bytes;
+		return true;
+	}
+}
+
+#endif // CAM_PLATFORM_WINDOWS
@@ -0,0 +1,22 @@
+#pragma once
+
+#ifdef CAM_PLATFORM_WINDOWS
+
+#include "Net/InterfaceCounters.h"
+
+namespace Core
+{
+	class WindowsInterfaceCounters : public InterfaceCounters
+	{
+	public:
+
+		virtual bool Open(const std::string &interface_name) override;
+		virtual bool GetSentBytes(uint64 *out_bytes) override;
+
+	private:
+
+		std::string m_InterfaceName;
+	};
+}
+
+#endif // CAM_PLATFORM_WINDOWS
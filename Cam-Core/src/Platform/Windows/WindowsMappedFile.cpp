@@ -0,0 +1,85 @@
+#include "WindowsMappedFile.h"
+
+#ifdef CAM_PLATFORM_WINDOWS
+
+namespace Core
+{
+	WindowsMappedFile::WindowsMappedFile()
+	{
+	}
+
+	WindowsMappedFile::~WindowsMappedFile()
+	{
+		Close();
+	}
+
+	bool WindowsMappedFile::Open(const std::string &path, uint64 size)
+	{
+		Close();
+
+		if (size == 0)
+		{
+			return false;
+		}
+
+		m_File = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (m_File == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER file_size;
+		file_size.QuadPart = (LONGLONG)size;
+		if (!SetFilePointerEx(m_File, file_size, NULL, FILE_BEGIN) || !SetEndOfFile(m_File))
+		{
+			Close();
+			return false;
+		}
+
+		m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READWRITE, file_size.HighPart, file_size.LowPart, NULL);
+		if (!m_Mapping)
+		{
+			Close();
+			return false;
+		}
+
+		m_Data = (Byte *)MapViewOfFile(m_Mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+		if (!m_Data)
+		{
+			Close();
+			return false;
+		}
+
+		m_Size = size;
+		return true;
+	}
+
+	void WindowsMappedFile::Close()
+	{
+		if (m_Data)
+		{
+			UnmapViewOfFile(m_Data);
+			m_Data = nullptr;
+			m_Size = 0;
+		}
+
+		if (m_Mapping)
+		{
+			CloseHandle(m_Mapping);
+			m_Mapping = NULL;
+		}
+
+		if (m_File != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(m_File);
+			m_File = INVALID_HANDLE_VALUE;
+		}
+	}
+
+	bool WindowsMappedFile::Flush()
+	{
+		return m_Data && FlushViewOfFile(m_Data, (SIZE_T)m_Size);
+	}
+}
+
+#endif // CAM_PLATFORM_WINDOWS
@@ -0,0 +1,29 @@
+#pragma once
+
+#ifdef CAM_PLATFORM_WINDOWS
+
+#include "Core/MappedFile.h"
+
+#include <Windows.h>
+
+namespace Core
+{
+	class WindowsMappedFile : public MappedFile
+	{
+	public:
+
+		WindowsMappedFile();
+		~WindowsMappedFile();
+
+		virtual bool Open(const std::string &path, uint64 size) override;
+		virtual void Close() override;
+		virtual bool Flush() override;
+
+	private:
+
+		HANDLE m_File = INVALID_HANDLE_VALUE;
+		HANDLE m_Mapping = NULL;
+	};
+}
+
+#endif // CAM_PLATFORM_WINDOWS
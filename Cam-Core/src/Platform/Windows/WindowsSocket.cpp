@@ -8,8 +8,44 @@
 
 namespace Core
 {
-	WindowsSocket::WindowsSocket()
-		: m_Socket(INVALID), m_IsWsaInitialized(false)
+	// Connected stream sockets do not report the sender, use the peer of the connection instead.
+	static void GetSenderAddr(SOCKET handle, struct sockaddr_in *sender, int32 sender_len, addr_t *addr)
+	{
+		if (sender->sin_family != AF_INET)
+		{
+			sender_len = sizeof(struct sockaddr_in);
+			if (getpeername(handle, (struct sockaddr *)sender, &sender_len) != 0)
+			{
+				return;
+			}
+		}
+
+		addr->Host = sender->sin_addr.s_addr;
+		addr->Port = sender->sin_port;
+	}
+
+	// Advances the WSABUF array by the number of transferred bytes, fully transferred entries are skipped.
+	static void AdvanceWSABuffers(WSABUF **buffers, DWORD *count, uint64 bytes)
+	{
+		while (bytes > 0 && *count > 0)
+		{
+			if (bytes >= (*buffers)->len)
+			{
+				bytes -= (*buffers)->len;
+				++(*buffers);
+				--(*count);
+			}
+			else
+			{
+				(*buffers)->buf += bytes;
+				(*buffers)->len -= (ULONG)bytes;
+				bytes = 0;
+			}
+		}
+	}
+
+	WindowsSocket::WindowsSocket(SocketType type)
+		: m_Type(type), m_Socket(INVALID), m_IsWsaInitialized(false)
 	{
 		WSADATA wsadata;
 		if (WSAStartup(MAKEWORD(2, 2), &wsadata) != 0)
@@ -33,8 +69,31 @@ namespace Core
 	bool WindowsSocket::Open(bool is_client, const std::string &ip, uint16 port)
 	{
 		Close();
-		m_Socket = socket(AF_INET, SOCK_DGRAM, 0);
-		return (m_Socket != INVALID);
+		m_Socket = socket(AF_INET, m_Type == SocketType::Stream ? SOCK_STREAM : SOCK_DGRAM, 0);
+		if (m_Socket == INVALID)
+		{
+			return false;
+		}
+
+		// Datagram clients do not connect, every message is sent to the given address.
+		if (is_client && m_Type == SocketType::Stream)
+		{
+			struct sockaddr_in si = {};
+			si.sin_family = AF_INET;
+			si.sin_port = htons(port);
+
+			if (inet_pton(AF_INET, ip.c_str(), &si.sin_addr) != 1)
+			{
+				return false;
+			}
+
+			if (connect(m_Socket, (struct sockaddr *)&si, sizeof(si)) != 0)
+			{
+				return false;
+			}
+		}
+
+		return true;
 	}
 	
 	void WindowsSocket::Close()
@@ -53,7 +112,31 @@ namespace Core
 		si.sin_addr.s_addr = INADDR_ANY;
 		si.sin_port = htons(port);
 
-		return (::bind(m_Socket, (struct sockaddr *)&si, sizeof(si)) == 0);
+		if (::bind(m_Socket, (struct sockaddr *)&si, sizeof(si)) != 0)
+		{
+			return false;
+		}
+
+		if (m_Type == SocketType::Datagram)
+		{
+			return true;
+		}
+
+		// Stream sockets accept exactly one connection, StreamServer handles multiple clients.
+		if (listen(m_Socket, 3) != 0)
+		{
+			return false;
+		}
+
+		SOCKET connection = accept(m_Socket, nullptr, nullptr);
+		if (connection == INVALID)
+		{
+			return false;
+		}
+
+		closesocket(m_Socket);
+		m_Socket = connection;
+		return true;
 	}
 	
 	int32 WindowsSocket::Recv(void *dst, int32 dst_bytes, addr_t *addr)
@@ -70,10 +153,7 @@ namespace Core
 		struct sockaddr_in si = {};
 		int32 sil = sizeof(si);
 		int32 len = recvfrom(m_Socket, (char *)dst, dst_bytes, 0, (struct sockaddr *)&si, &sil);
-
-		addr->Host = si.sin_addr.s_addr;
-		addr->Port = si.sin_port;
-
+		GetSenderAddr(m_Socket, &si, sil, addr);
 		return len;
 	}
 	
@@ -111,43 +191,81 @@ namespace Core
 
 	int32 WindowsSocket::SendLarge(void const *src, int32 src_bytes, addr_t addr)
 	{
-		int32 send_pos = 0;
-		int32 buffer_size = 256;
-		int32 bytes_left = src_bytes;
-		int32 n = -1;
-		
+		io_buffer_t buffer = { (void *)src, (uint32)src_bytes };
+		return SendBulk(&buffer, 1, addr);
+	}
+
+	int32 WindowsSocket::RecvLarge(void *dst, int32 dst_bytes, addr_t *addr)
+	{
+		assert(dst);
+		assert(dst_bytes);
+		assert(addr);
+
+		io_buffer_t buffer = { dst, (uint32)dst_bytes };
+		return RecvBulk(&buffer, 1, addr);
+	}
+
+	int32 WindowsSocket::SendBulk(io_buffer_t const *buffers, uint32 count, addr_t addr)
+	{
+		assert(buffers);
+		assert(count <= MAX_IO_BUFFERS);
+
+		if (m_Socket == INVALID)
+		{
+			return -1;
+		}
+
 		SOCKADDR_IN si = {};
 		si.sin_family = AF_INET;
 		si.sin_addr.s_addr = addr.Host;
 		si.sin_port = (uint16)addr.Port;
 
-		while (send_pos < src_bytes)
+		WSABUF wsa_buffers[MAX_IO_BUFFERS];
+		uint64 total_bytes = 0;
+		for (uint32 i = 0; i < count; ++i)
 		{
-			int32 chunk_size = bytes_left > buffer_size ? buffer_size : bytes_left;
-			n = sendto(m_Socket, (CHAR const *)src + send_pos, chunk_size, 0, (SOCKADDR *)&si, sizeof(si));
-			
-			if (-1 == n)
-			{
-				break;
-			}
+			wsa_buffers[i].buf = (CHAR *)buffers[i].Data;
+			wsa_buffers[i].len = buffers[i].Size;
+			total_bytes += buffers[i].Size;
+		}
 
-			if (n != chunk_size)
+		if (total_bytes > INT32_MAX)
+		{
+			return -1;
+		}
+
+		// Each call is given the whole remaining length, the kernel only returns early if the send buffer is full.
+		WSABUF *pending = wsa_buffers;
+		DWORD pending_count = count;
+		uint64 bytes_sent = 0;
+		while (bytes_sent < total_bytes)
+		{
+			DWORD n = 0;
+			if (WSASendTo(m_Socket, pending, pending_count, &n, 0, (SOCKADDR *)&si, sizeof(si), nullptr, nullptr) == SOCKET_ERROR)
 			{
-				// if less bytes were send, increase/decrease only by that amount
-				chunk_size = n;
+				int32 errorCode = WSAGetLastError();
+				if (errorCode == WSAEWOULDBLOCK)
+				{
+					WSAPOLLFD pfd = { m_Socket, POLLWRNORM, 0 };
+					WSAPoll(&pfd, 1, -1);
+					continue;
+				}
+
+				std::cerr << "Socket error: " << errorCode << std::endl;
+				break;
 			}
 
-			send_pos += chunk_size;
-			bytes_left -= chunk_size;
+			bytes_sent += n;
+			AdvanceWSABuffers(&pending, &pending_count, n);
 		}
 
-		return send_pos == src_bytes ? send_pos : -1;
+		return bytes_sent == total_bytes ? (int32)bytes_sent : -1;
 	}
 
-	int32 WindowsSocket::RecvLarge(void *dst, int32 dst_bytes, addr_t *addr)
+	int32 WindowsSocket::RecvBulk(io_buffer_t const *buffers, uint32 count, addr_t *addr)
 	{
-		assert(dst);
-		assert(dst_bytes);
+		assert(buffers);
+		assert(count <= MAX_IO_BUFFERS);
 		assert(addr);
 
 		if (m_Socket == INVALID)
@@ -155,41 +273,195 @@ namespace Core
 			return -1;
 		}
 
-		struct sockaddr_in si = {};
-		int32 sil = sizeof(si);
-		int32 buffer_size = 256;
-		int32 read_pos = 0;
-		int32 bytes_received = 0;
-		
-		while (bytes_received != dst_bytes)
+		WSABUF wsa_buffers[MAX_IO_BUFFERS];
+		uint64 total_bytes = 0;
+		for (uint32 i = 0; i < count; ++i)
 		{
-			if (read_pos >= dst_bytes)
+			wsa_buffers[i].buf = (CHAR *)buffers[i].Data;
+			wsa_buffers[i].len = buffers[i].Size;
+			total_bytes += buffers[i].Size;
+		}
+
+		if (total_bytes > INT32_MAX)
+		{
+			return -1;
+		}
+
+		WSABUF *pending = wsa_buffers;
+		DWORD pending_count = count;
+		uint64 bytes_received = 0;
+		while (bytes_received < total_bytes)
+		{
+			struct sockaddr_in si = {};
+			INT sil = sizeof(si);
+			DWORD n = 0;
+			DWORD flags = 0;
+
+			if (WSARecvFrom(m_Socket, pending, pending_count, &n, &flags, (struct sockaddr *)&si, &sil, nullptr, nullptr) == SOCKET_ERROR)
 			{
+				if (WSAGetLastError() == WSAEWOULDBLOCK)
+				{
+					WSAPOLLFD pfd = { m_Socket, POLLRDNORM, 0 };
+					WSAPoll(&pfd, 1, -1);
+					continue;
+				}
+
 				break;
 			}
-	
-			uint32 chunk_size = dst_bytes > buffer_size ? buffer_size : dst_bytes;
-			bytes_received = recvfrom(m_Socket, (char*)dst + read_pos, chunk_size, 0, (struct sockaddr *)&si, &sil);
-			
-			if (bytes_received == -1)
+
+			if (n == 0)
 			{
+				// Connection closed by the peer.
 				break;
 			}
-			
-			if (chunk_size != bytes_received)
+
+			bytes_received += n;
+			AdvanceWSABuffers(&pending, &pending_count, n);
+			GetSenderAddr(m_Socket, &si, sil, addr);
+
+			if (m_Type == SocketType::Datagram)
+			{
+				return (int32)bytes_received;
+			}
+		}
+
+		return bytes_received == total_bytes ? (int32)bytes_received : -1;
+	}
+
+	int32 WindowsSocket::SendBatch(datagram_t const *datagrams, uint32 count)
+	{
+		assert(datagrams);
+		assert(count <= MAX_BATCH);
+
+		if (m_Socket == INVALID)
+		{
+			return -1;
+		}
+
+		// Winsock has no batched send, each datagram is still a single gather write.
+		int32 sent = 0;
+		for (uint32 i = 0; i < count; ++i)
+		{
+			if (SendBulk(datagrams[i].Buffers, datagrams[i].BufferCount, datagrams[i].Addr) >= 0)
+			{
+				++sent;
+			}
+		}
+
+		return sent;
+	}
+
+	int32 WindowsSocket::RecvBatch(datagram_t *datagrams, uint32 count)
+	{
+		assert(datagrams);
+		assert(count <= MAX_BATCH);
+
+		int32 received = 0;
+		while (received < (int32)count)
+		{
+			// Only the first receive may block, afterwards only datagrams, which are already queued, are taken.
+			if (received > 0)
 			{
-				chunk_size = bytes_received;
+				u_long pending = 0;
+				if (ioctlsocket(m_Socket, FIONREAD, &pending) != 0 || pending == 0)
+				{
+					break;
+				}
 			}
 
-			read_pos += chunk_size;
+			datagram_t &datagram = datagrams[received];
+			int32 bytes = RecvBulk(datagram.Buffers, datagram.BufferCount, &datagram.Addr);
+			if (bytes < 0)
+			{
+				return received > 0 ? received : -1;
+			}
 
-			addr->Host = si.sin_addr.s_addr;
-			addr->Port = si.sin_port;
+			datagram.Size = (uint32)bytes;
+			++received;
 		}
 
-		return bytes_received == dst_bytes ? bytes_received : -1;
+		return received;
 	}
-	
+
+	bool WindowsSocket::Wait(int32 timeout_ms)
+	{
+		if (m_Socket == INVALID)
+		{
+			return false;
+		}
+
+		WSAPOLLFD pfd = {};
+		pfd.fd = m_Socket;
+		pfd.events = POLLRDNORM;
+		return WSAPoll(&pfd, 1, timeout_ms) > 0;
+	}
+
+	bool WindowsSocket::WaitAny(Socket *const *sockets, uint32 count, int32 timeout_ms)
+	{
+		assert(count <= MAX_WAIT_SOCKETS);
+
+		WSAPOLLFD pfds[MAX_WAIT_SOCKETS] = {};
+		for (uint32 i = 0; i < count; ++i)
+		{
+			pfds[i].fd = ((const WindowsSocket *)sockets[i])->m_Socket;
+			pfds[i].events = POLLRDNORM;
+		}
+
+		return WSAPoll(pfds, count, timeout_ms) > 0;
+	}
+
+	bool WindowsSocket::BindMulticast(const std::string &group, uint16 port, const std::string &interface_ip)
+	{
+		struct ip_mreq request = {};
+		if (inet_pton(AF_INET, group.c_str(), &request.imr_multiaddr) != 1 || !IN_MULTICAST(ntohl(request.imr_multiaddr.s_addr)))
+		{
+			return false;
+		}
+
+		request.imr_interface.s_addr = htonl(INADDR_ANY);
+		if (!interface_ip.empty() && inet_pton(AF_INET, interface_ip.c_str(), &request.imr_interface) != 1)
+		{
+			return false;
+		}
+
+		// Several clients on the same host share the port, each of them receives the datagrams of the group.
+		BOOL reuse = TRUE;
+		if (setsockopt(m_Socket, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse)) != 0)
+		{
+			return false;
+		}
+
+		// Windows does not allow to bind to the group address.
+		struct sockaddr_in si = {};
+		si.sin_family = AF_INET;
+		si.sin_addr.s_addr = INADDR_ANY;
+		si.sin_port = htons(port);
+
+		if (::bind(m_Socket, (struct sockaddr *)&si, sizeof(si)) != 0)
+		{
+			return false;
+		}
+
+		return setsockopt(m_Socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char *)&request, sizeof(request)) == 0;
+	}
+
+	bool WindowsSocket::SetMulticastSender(const std::string &interface_ip, uint8 ttl, bool loopback)
+	{
+		struct in_addr interface_addr = {};
+		interface_addr.s_addr = htonl(INADDR_ANY);
+		if (!interface_ip.empty() && inet_pton(AF_INET, interface_ip.c_str(), &interface_addr) != 1)
+		{
+			return false;
+		}
+
+		DWORD ttl_value = ttl;
+		DWORD loop_value = loopback ? 1 : 0;
+
+		return setsockopt(m_Socket, IPPROTO_IP, IP_MULTICAST_IF, (const char *)&interface_addr, sizeof(interface_addr)) == 0 &&
+			setsockopt(m_Socket, IPPROTO_IP, IP_MULTICAST_TTL, (const char *)&ttl_value, sizeof(ttl_value)) == 0 &&
+			setsockopt(m_Socket, IPPROTO_IP, IP_MULTICAST_LOOP, (const char *)&loop_value, sizeof(loop_value)) == 0;
+	}
+
 	bool WindowsSocket::SetNonBlocking(bool enabled)
 	{
 		if (m_Socket == INVALID)
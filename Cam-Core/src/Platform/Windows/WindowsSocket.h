@@ -11,7 +11,7 @@ namespace Core
 	{
 	public:
 
-		WindowsSocket();
+		WindowsSocket(SocketType type);
 		~WindowsSocket();
 
 		virtual bool Open(bool is_client = false, const std::string &ip = "", uint16 port = 0) override;
@@ -25,11 +25,25 @@ namespace Core
 		virtual int32 SendLarge(void const *src, int32 src_bytes, addr_t addr) override;
 		virtual int32 RecvLarge(void *dst, int32 dst_bytes, addr_t *addr) override;
 
+		virtual int32 SendBulk(io_buffer_t const *buffers, uint32 count, addr_t addr) override;
+		virtual int32 RecvBulk(io_buffer_t const *buffers, uint32 count, addr_t *addr) override;
+
+		virtual int32 SendBatch(datagram_t const *datagrams, uint32 count) override;
+		virtual int32 RecvBatch(datagram_t *datagrams, uint32 count) override;
+
+		virtual bool Wait(int32 timeout_ms) override;
+
+		virtual bool BindMulticast(const std::string &group, uint16 port, const std::string &interface_ip = "") override;
+		virtual bool SetMulticastSender(const std::string &interface_ip, uint8 ttl, bool loopback) override;
+
 		virtual bool SetNonBlocking(bool enabled) override;
 		virtual addr_t Lookup(const std::string &host, uint16 port) override;
 
+		static bool WaitAny(Socket *const *sockets, uint32 count, int32 timeout_ms);
+
 	private:
 
+		SocketType m_Type;
 		SOCKET m_Socket;
 		static constexpr SOCKET INVALID = INVALID_SOCKET;
 
@@ -0,0 +1,316 @@
+#include "WindowsStreamServer.h"
+
+#ifdef CAM_PLATFORM_WINDOWS
+
+#include <WS2tcpip.h>
+
+namespace Core
+{
+	WindowsStreamServer::WindowsStreamServer()
+	{
+		WSADATA wsadata;
+		if (WSAStartup(MAKEWORD(2, 2), &wsadata) != 0)
+		{
+			return;
+		}
+
+		m_IsWsaInitialized = true;
+	}
+
+	WindowsStreamServer::~WindowsStreamServer()
+	{
+		Close();
+
+		if (m_IsWsaInitialized)
+		{
+			WSACleanup();
+		}
+	}
+
+	bool WindowsStreamServer::Listen(uint16 port, uint32 backlog)
+	{
+		Close();
+
+		m_Listener = socket(AF_INET, SOCK_STREAM, 0);
+		if (m_Listener == INVALID_SOCKET)
+		{
+			return false;
+		}
+
+		u_long non_blocking = 1;
+		ioctlsocket(m_Listener, FIONBIO, &non_blocking);
+
+		struct sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = INADDR_ANY;
+		address.sin_port = htons(port);
+
+		if (::bind(m_Listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(m_Listener, (int32)backlog) != 0)
+		{
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void WindowsStreamServer::Close()
+	{
+		while (!m_Connections.empty())
+		{
+			CloseConnection(m_Connections.begin()->first);
+		}
+
+		if (m_Listener != INVALID_SOCKET)
+		{
+			closesocket(m_Listener);
+			m_Listener = INVALID_SOCKET;
+		}
+	}
+
+	bool WindowsStreamServer::Poll(int32 timeout_ms)
+	{
+		if (m_Listener == INVALID_SOCKET)
+		{
+			return false;
+		}
+
+		m_PollHandles.clear();
+		m_PollHandles.push_back({ m_Listener, POLLRDNORM, 0 });
+		for (auto &[handle, connection] : m_Connections)
+		{
+			// Only wait for the connection to become writable, while bytes are waiting for it.
+			SHORT events = HasOutput(connection) ? POLLRDNORM | POLLWRNORM : POLLRDNORM;
+			m_PollHandles.push_back({ handle, events, 0 });
+		}
+
+		int32 count = WSAPoll(m_PollHandles.data(), (ULONG)m_PollHandles.size(), timeout_ms);
+		if (count == SOCKET_ERROR)
+		{
+			return false;
+		}
+
+		for (uint32 i = 0; i < m_PollHandles.size() && count > 0; ++i)
+		{
+			const WSAPOLLFD &poll_handle = m_PollHandles[i];
+			if (poll_handle.revents == 0)
+			{
+				continue;
+			}
+
+			--count;
+
+			if (poll_handle.fd == m_Listener)
+			{
+				if (poll_handle.revents & (POLLERR | POLLHUP | POLLNVAL))
+				{
+					return false;
+				}
+
+				AcceptConnections();
+				continue;
+			}
+
+			auto it = m_Connections.find(poll_handle.fd);
+			if (it == m_Connections.end())
+			{
+				continue;
+			}
+
+			bool keep = !(poll_handle.revents & (POLLERR | POLLNVAL));
+			if (keep && (poll_handle.revents & POLLWRNORM))
+			{
+				keep = FlushOutput(it->second);
+			}
+
+			// Read before handling hang ups, the peer may have sent its last messages right before closing.
+			if (keep && (poll_handle.revents & ~POLLWRNORM))
+			{
+				keep = ReadConnection(it->second);
+			}
+
+			if (!keep || it->second.Closing)
+			{
+				CloseConnection(poll_handle.fd);
+			}
+		}
+
+		// Connections, which have been disconnected by a message handler of another connection.
+		std::vector<SOCKET> closing;
+		for (auto &[handle, connection] : m_Connections)
+		{
+			if (connection.Closing)
+			{
+				closing.push_back(handle);
+			}
+		}
+
+		for (SOCKET handle : closing)
+		{
+			CloseConnection(handle);
+		}
+
+		return true;
+	}
+
+	int32 WindowsStreamServer::Send(addr_t client, void const *src, int32 src_bytes)
+	{
+		auto handle_it = m_Handles.find(client.Value);
+		if (handle_it == m_Handles.end())
+		{
+			return -1;
+		}
+
+		Connection &connection = m_Connections[handle_it->second];
+		bool has_output = HasOutput(connection);
+
+		// Nothing is sent directly, while older bytes are waiting, they have to reach the client first.
+		int32 bytes_sent = 0;
+		while (!has_output && bytes_sent < src_bytes)
+		{
+			int32 n = send(connection.Handle, (CHAR const *)src + bytes_sent, src_bytes - bytes_sent, 0);
+			if (n == SOCKET_ERROR)
+			{
+				if (WSAGetLastError() == WSAEWOULDBLOCK)
+				{
+					break;
+				}
+
+				Disconnect(client);
+				return -1;
+			}
+
+			bytes_sent += n;
+		}
+
+		if (bytes_sent == src_bytes)
+		{
+			return bytes_sent;
+		}
+
+		// The rest is sent by Poll, once the connection is writable. A client, which does not read its responses, must not block the others.
+		if (!QueueOutput(connection, (Byte const *)src + bytes_sent, (uint32)(src_bytes - bytes_sent)))
+		{
+			Disconnect(client);
+			return -1;
+		}
+
+		return src_bytes;
+	}
+
+	void WindowsStreamServer::Disconnect(addr_t client)
+	{
+		auto handle_it = m_Handles.find(client.Value);
+		if (handle_it == m_Handles.end())
+		{
+			return;
+		}
+
+		// Message handlers may disconnect clients, so closing is deferred until the dispatch is finished.
+		if (m_Dispatching)
+		{
+			m_Connections[handle_it->second].Closing = true;
+			return;
+		}
+
+		CloseConnection(handle_it->second);
+	}
+
+	void WindowsStreamServer::AcceptConnections()
+	{
+		for (;;)
+		{
+			struct sockaddr_in address = {};
+			int32 address_len = sizeof(address);
+
+			SOCKET handle = accept(m_Listener, (struct sockaddr *)&address, &address_len);
+			if (handle == INVALID_SOCKET)
+			{
+				// WSAEWOULDBLOCK if all pending connections are accepted, otherwise out of resources. Both are retried on the next event.
+				break;
+			}
+
+			u_long non_blocking = 1;
+			ioctlsocket(handle, FIONBIO, &non_blocking);
+
+			// Responses are small, do not delay them.
+			BOOL no_delay = TRUE;
+			setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char *)&no_delay, sizeof(no_delay));
+
+			Connection &connection = m_Connections[handle];
+			connection.Handle = handle;
+			connection.Addr.Host = address.sin_addr.s_addr;
+			connection.Addr.Port = address.sin_port;
+			m_Handles[connection.Addr.Value] = handle;
+
+			if (m_ConnectCallback)
+			{
+				m_ConnectCallback(connection.Addr);
+			}
+		}
+	}
+
+	bool WindowsStreamServer::ReadConnection(Connection &connection)
+	{
+		for (uint32 i = 0; i < MAX_READS_PER_EVENT; ++i)
+		{
+			io_buffer_t buffer = GetReadBuffer(connection);
+			int32 n = recv(connection.Handle, (char *)buffer.Data, (int32)buffer.Size, 0);
+			if (n == SOCKET_ERROR)
+			{
+				return WSAGetLastError() == WSAEWOULDBLOCK;
+			}
+
+			if (n == 0)
+			{
+				// Connection closed by the peer.
+				return false;
+			}
+
+			if (!OnReceived(connection, (uint32)n) || connection.Closing)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool WindowsStreamServer::FlushOutput(Connection &connection)
+	{
+		while (HasOutput(connection))
+		{
+			int32 n = send(connection.Handle, (CHAR const *)connection.Output.data() + connection.OutputSent, (int32)(connection.Output.size() - connection.OutputSent), 0);
+			if (n == SOCKET_ERROR)
+			{
+				return WSAGetLastError() == WSAEWOULDBLOCK;
+			}
+
+			OnOutputSent(connection, (uint32)n);
+		}
+
+		return true;
+	}
+
+	void WindowsStreamServer::CloseConnection(SOCKET handle)
+	{
+		auto it = m_Connections.find(handle);
+		if (it == m_Connections.end())
+		{
+			return;
+		}
+
+		addr_t addr = it->second.Addr;
+		closesocket(handle);
+
+		m_Handles.erase(addr.Value);
+		m_Connections.erase(it);
+
+		if (m_DisconnectCallback)
+		{
+			m_DisconnectCallback(addr);
+		}
+	}
+}
+
+#endif // CAM_PLATFORM_WINDOWS
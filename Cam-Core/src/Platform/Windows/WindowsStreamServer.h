@@ -0,0 +1,58 @@
+#pragma once
+
+#ifdef CAM_PLATFORM_WINDOWS
+
+#include "Net/StreamServer.h"
+#include <WinSock2.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace Core
+{
+	class WindowsStreamServer : public StreamServer
+	{
+	public:
+
+		WindowsStreamServer();
+		~WindowsStreamServer();
+
+		virtual bool Listen(uint16 port, uint32 backlog = 128) override;
+		virtual void Close() override;
+
+		virtual bool Poll(int32 timeout_ms) override;
+
+		virtual int32 Send(addr_t client, void const *src, int32 src_bytes) override;
+		virtual void Disconnect(addr_t client) override;
+
+		virtual uint32 GetConnectionCount() const override { return (uint32)m_Connections.size(); }
+
+	private:
+
+		struct Connection : public StreamConnection
+		{
+			SOCKET Handle = INVALID_SOCKET;
+		};
+
+		void AcceptConnections();
+		bool ReadConnection(Connection &connection);
+		bool FlushOutput(Connection &connection);
+		void CloseConnection(SOCKET handle);
+
+	private:
+
+		// Limits the reads per connection and Poll call, so that a single fast client can not starve the others.
+		static constexpr uint32 MAX_READS_PER_EVENT = 16;
+
+		SOCKET m_Listener = INVALID_SOCKET;
+		bool m_IsWsaInitialized = false;
+
+		std::unordered_map<SOCKET, Connection> m_Connections;
+		std::unordered_map<uint64, SOCKET> m_Handles;
+
+		// Rebuilt from the connections before every WSAPoll call.
+		std::vector<WSAPOLLFD> m_PollHandles;
+	};
+}
+
+#endif // CAM_PLATFORM_WINDOWS
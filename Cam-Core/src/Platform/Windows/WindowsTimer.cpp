@@ -11,6 +11,23 @@ namespace Core
 		return (int64)GetTickCount64();
 	}
 
+	int64 QueryUS()
+	{
+		static LARGE_INTEGER frequency = {};
+		if (frequency.QuadPart == 0)
+		{
+			QueryPerformanceFrequency(&frequency);
+		}
+
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+
+		// Split the conversion, so that the multiplication does not overflow.
+		int64 seconds = counter.QuadPart / frequency.QuadPart;
+		int64 rest = counter.QuadPart % frequency.QuadPart;
+		return seconds * 1000000 + rest * 1000000 / frequency.QuadPart;
+	}
+
 	void SleepMS(uint32 ms)
 	{
 		Sleep(ms);
@@ -0,0 +1,274 @@
+#include "BinaryDelta.h"
+
+#include <miniz/miniz.h>
+#include <string.h>
+
+#include "Core/Hash.h"
+
+namespace Core
+{
+	namespace utils
+	{
+		// Multiplier of the rolling hash.
+		static constexpr uint32 ROLLING_PRIME = 0x01000193;
+
+		static uint32 HashBlock(const Byte *data, uint32 size)
+		{
+			uint32 hash = 0;
+			for (uint32 i = 0; i < size; ++i)
+			{
+				hash = hash * ROLLING_PRIME + data[i];
+			}
+
+			return hash;
+		}
+
+		static void WriteVarint(std::vector<Byte> *out, uint64 value)
+		{
+			while (value >= 0x80)
+			{
+				out->push_back((Byte)(value | 0x80));
+				value >>= 7;
+			}
+
+			out->push_back((Byte)value);
+		}
+
+		static bool ReadVarint(const Byte **ptr, const Byte *end, uint64 *out_value)
+		{
+			uint64 value = 0;
+			for (uint32 shift = 0; shift < 64; shift += 7)
+			{
+				if (*ptr >= end)
+				{
+					return false;
+				}
+
+				Byte b = *(*ptr)++;
+				value |= (uint64)(b & 0x7F) << shift;
+
+				if (!(b & 0x80))
+				{
+					*out_value = value;
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		// Copies are stored relative to the end of the previous copy, which keeps the numbers small for data that did not move.
+		static uint64 ZigZag(int64 value)
+		{
+			return ((uint64)value << 1) ^ (uint64)(value >> 63);
+		}
+
+		static int64 UnZigZag(uint64 value)
+		{
+			return (int64)(value >> 1) ^ -(int64)(value & 1);
+		}
+	}
+
+	bool BinaryDelta::Create(const Byte *source, uint32 source_size, const Byte *target, uint32 target_size, std::vector<Byte> *out_patch)
+	{
+		if (!out_patch)
+		{
+			return false;
+		}
+
+		// Index every block of the source. On collisions the first block is kept, earlier data is matched first.
+		uint32 block_count = source_size / BLOCK_BYTES;
+		uint32 table_size = 1;
+		while (table_size < block_count * 2)
+		{
+			table_size <<= 1;
+		}
+
+		std::vector<uint32> table(table_size, CAM_INVALID_ID);
+		for (uint32 i = 0; i < block_count; ++i)
+		{
+			uint32 slot = Mix32(utils::HashBlock(source + i * BLOCK_BYTES, BLOCK_BYTES)) & (table_size - 1);
+			if (table[slot] == CAM_INVALID_ID)
+			{
+				table[slot] = i * BLOCK_BYTES;
+			}
+		}
+
+		// Weight of the byte, which leaves the rolling window.
+		uint32 out_weight = 1;
+		for (uint32 i = 1; i < BLOCK_BYTES; ++i)
+		{
+			out_weight *= utils::ROLLING_PRIME;
+		}
+
+		std::vector<Byte> instructions;
+		instructions.reserve(target_size / 8 + 64);
+
+		uint32 literal_start = 0;
+		uint64 last_copy_end = 0;
+		auto emit = [&](uint32 literal_end, uint32 copy_pos, uint32 copy_len)
+		{
+			utils::WriteVarint(&instructions, literal_end - literal_start);
+			instructions.insert(instructions.end(), target + literal_start, target + literal_end);
+
+			utils::WriteVarint(&instructions, copy_len);
+			if (copy_len > 0)
+			{
+				utils::WriteVarint(&instructions, utils::ZigZag((int64)copy_pos - (int64)last_copy_end));
+				last_copy_end = (uint64)copy_pos + copy_len;
+			}
+		};
+
+		uint32 pos = 0;
+		uint32 hash = block_count > 0 && target_size >= BLOCK_BYTES ? utils::HashBlock(target, BLOCK_BYTES) : 0;
+		while (block_count > 0 && pos + BLOCK_BYTES <= target_size)
+		{
+			uint32 candidate = table[Mix32(hash) & (table_size - 1)];
+			if (candidate != CAM_INVALID_ID && memcmp(source + candidate, target + pos, BLOCK_BYTES) == 0)
+			{
+				uint32 length = BLOCK_BYTES;
+				while (candidate + length < source_size && pos + length < target_size && source[candidate + length] == target[pos + length])
+				{
+					++length;
+				}
+
+				// The match may also start before the block, inside the pending literal bytes.
+				uint32 back = 0;
+				while (back < pos - literal_start && back < candidate && source[candidate - back - 1] == target[pos - back - 1])
+				{
+					++back;
+				}
+
+				emit(pos - back, candidate - back, length + back);
+
+				pos += length;
+				literal_start = pos;
+
+				if (pos + BLOCK_BYTES <= target_size)
+				{
+					hash = utils::HashBlock(target + pos, BLOCK_BYTES);
+				}
+
+				continue;
+			}
+
+			if (pos + BLOCK_BYTES < target_size)
+			{
+				hash = (hash - target[pos] * out_weight) * utils::ROLLING_PRIME + target[pos + BLOCK_BYTES];
+			}
+
+			++pos;
+		}
+
+		emit(target_size, 0, 0);
+
+		mz_ulong compressed_size = mz_compressBound((mz_ulong)instructions.size());
+		out_patch->resize(sizeof(PatchHeader) + compressed_size);
+
+		if (mz_compress2(out_patch->data() + sizeof(PatchHeader), &compressed_size, instructions.data(), (mz_ulong)instructions.size(), MZ_BEST_COMPRESSION) != MZ_OK)
+		{
+			out_patch->clear();
+			return false;
+		}
+
+		out_patch->resize(sizeof(PatchHeader) + compressed_size);
+
+		PatchHeader header = {};
+		header.Magic = MAGIC;
+		header.SourceSize = source_size;
+		header.TargetSize = target_size;
+		header.InstructionSize = (uint32)instructions.size();
+		header.SourceHash = source_size > 0 ? Raw64(source, source_size) : 0;
+		header.TargetHash = target_size > 0 ? Raw64(target, target_size) : 0;
+		memcpy(out_patch->data(), &header, sizeof(header));
+		return true;
+	}
+
+	bool BinaryDelta::Apply(const Byte *source, uint32 source_size, const Byte *patch, uint32 patch_size, std::vector<Byte> *out_target)
+	{
+		if (!out_target || !IsPatch(patch, patch_size))
+		{
+			return false;
+		}
+
+		PatchHeader header;
+		memcpy(&header, patch, sizeof(header));
+
+		if (header.SourceSize != source_size || header.SourceHash != (source_size > 0 ? Raw64(source, source_size) : 0))
+		{
+			return false;
+		}
+
+		std::vector<Byte> instructions(header.InstructionSize);
+		mz_ulong instruction_size = header.InstructionSize;
+		if (mz_uncompress(instructions.data(), &instruction_size, patch + sizeof(header), patch_size - sizeof(header)) != MZ_OK ||
+			instruction_size != header.InstructionSize)
+		{
+			return false;
+		}
+
+		out_target->clear();
+		out_target->reserve(header.TargetSize);
+
+		const Byte *ptr = instructions.data();
+		const Byte *end = ptr + instructions.size();
+		uint64 last_copy_end = 0;
+
+		while (ptr < end)
+		{
+			uint64 literal_len = 0;
+			if (!utils::ReadVarint(&ptr, end, &literal_len) || literal_len > (uint64)(end - ptr) || out_target->size() + literal_len > header.TargetSize)
+			{
+				return false;
+			}
+
+			out_target->insert(out_target->end(), ptr, ptr + literal_len);
+			ptr += literal_len;
+
+			uint64 copy_len = 0;
+			if (!utils::ReadVarint(&ptr, end, &copy_len))
+			{
+				return false;
+			}
+
+			if (copy_len == 0)
+			{
+				continue;
+			}
+
+			uint64 delta = 0;
+			if (!utils::ReadVarint(&ptr, end, &delta))
+			{
+				return false;
+			}
+
+			int64 copy_pos = (int64)last_copy_end + utils::UnZigZag(delta);
+			if (copy_pos < 0 || (uint64)copy_pos + copy_len > source_size || out_target->size() + copy_len > header.TargetSize)
+			{
+				return false;
+			}
+
+			out_target->insert(out_target->end(), source + copy_pos, source + copy_pos + copy_len);
+			last_copy_end = (uint64)copy_pos + copy_len;
+		}
+
+		if (out_target->size() != header.TargetSize)
+		{
+			return false;
+		}
+
+		return header.TargetSize == 0 || Raw64(out_target->data(), header.TargetSize) == header.TargetHash;
+	}
+
+	bool BinaryDelta::IsPatch(const Byte *data, uint32 size)
+	{
+		if (!data || size < sizeof(PatchHeader))
+		{
+			return false;
+		}
+
+		uint32 magic = 0;
+		memcpy(&magic, data, sizeof(magic));
+		return magic == MAGIC;
+	}
+}
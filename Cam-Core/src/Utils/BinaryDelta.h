@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Core/Core.h"
+
+#include <vector>
+
+namespace Core
+{
+	// Binary patches between two versions of a file, in the style of VCDIFF.
+	// The target is described as literal bytes and copies of ranges of the source, the instructions are deflated.
+	// Matches are found with a rolling hash over blocks of the source, so moved and shifted data is found as well.
+	class BinaryDelta
+	{
+	public:
+
+		// Creates a patch, which turns source into target. Returns false, if the patch could not be compressed.
+		static bool Create(const Byte *source, uint32 source_size, const Byte *target, uint32 target_size, std::vector<Byte> *out_patch);
+
+		// Applies a patch to the source it was created for.
+		// Returns false, if the patch is damaged or was created for a different source.
+		static bool Apply(const Byte *source, uint32 source_size, const Byte *patch, uint32 patch_size, std::vector<Byte> *out_target);
+
+		// Returns true, if the data starts like a patch created by Create.
+		static bool IsPatch(const Byte *data, uint32 size);
+
+	private:
+
+		struct PatchHeader
+		{
+			uint32 Magic;
+			uint32 SourceSize;
+			uint32 TargetSize;
+
+			// The size of the instructions before they were deflated.
+			uint32 InstructionSize;
+
+			uint64 SourceHash;
+			uint64 TargetHash;
+		};
+
+		// 'CAMD'
+		static constexpr uint32 MAGIC = 0x444D4143;
+
+		// Matches are searched for blocks of this size, shorter matches are stored as literal bytes.
+		static constexpr uint32 BLOCK_BYTES = 32;
+	};
+}
@@ -0,0 +1,83 @@
+#include "Chunker.h"
+
+#include "Core/Hash.h"
+
+namespace Core
+{
+	namespace utils
+	{
+		struct GearTable
+		{
+			uint64 Values[256];
+
+			GearTable()
+			{
+				// Any random table works, as long as both sides use the same one.
+				for (uint32 i = 0; i < 256; ++i)
+				{
+					Values[i] = Mix64(0x9E3779B97F4A7C15llu * (i + 1));
+				}
+			}
+		};
+
+		// The gear hash shifts older bytes out to the top, so only the top bits depend on the whole window.
+		static constexpr uint64 HighBits(uint32 count)
+		{
+			return ~0llu << (64 - count);
+		}
+
+		// Normalized chunking: a harder condition before the average size and an easier one after it,
+		// which keeps most chunks close to the average size.
+		static constexpr uint64 MASK_SMALL = HighBits(16);
+		static constexpr uint64 MASK_LARGE = HighBits(12);
+	}
+
+	void Chunker::Split(const Byte *data, uint32 size, std::vector<chunk_t> *out_chunks)
+	{
+		out_chunks->clear();
+
+		uint32 offset = 0;
+		while (offset < size)
+		{
+			uint32 chunk_size = FindBoundary(data + offset, size - offset);
+			out_chunks->push_back({ offset, chunk_size });
+			offset += chunk_size;
+		}
+	}
+
+	uint32 Chunker::FindBoundary(const Byte *data, uint32 size)
+	{
+		static const utils::GearTable gear;
+
+		if (size <= MIN_CHUNK_BYTES)
+		{
+			return size;
+		}
+
+		uint32 end = size < MAX_CHUNK_BYTES ? size : MAX_CHUNK_BYTES;
+		uint32 normal = end < AVG_CHUNK_BYTES ? end : AVG_CHUNK_BYTES;
+		uint64 hash = 0;
+
+		// The bytes before the minimum size can not end a chunk, so they are skipped.
+		uint32 i = MIN_CHUNK_BYTES;
+		for (; i < normal; ++i)
+		{
+			hash = (hash << 1) + gear.Values[data[i]];
+			if (!(hash & utils::MASK_SMALL))
+			{
+				return i + 1;
+			}
+		}
+
+		for (; i < end; ++i)
+		{
+			hash = (hash << 1) + gear.Values[data[i]];
+			if (!(hash & utils::MASK_LARGE))
+			{
+				return i + 1;
+			}
+		}
+
+		return end;
+	}
+}
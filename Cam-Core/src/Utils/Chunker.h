@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Core/Core.h"
+
+#include <vector>
+
+namespace Core
+{
+	struct chunk_t
+	{
+		uint32 Offset;
+		uint32 Size;
+	};
+
+	// Content defined chunking (FastCDC). The chunk boundaries depend only on the bytes around them,
+	// so an insertion or a removal changes the chunks near the edit, but not the chunks after it.
+	class Chunker
+	{
+	public:
+
+		// Splits the data into chunks, which cover it completely and in order.
+		static void Split(const Byte *data, uint32 size, std::vector<chunk_t> *out_chunks);
+
+	public:
+
+		static constexpr uint32 MIN_CHUNK_BYTES = 4 * 1024;
+		static constexpr uint32 AVG_CHUNK_BYTES = 16 * 1024;
+		static constexpr uint32 MAX_CHUNK_BYTES = 64 * 1024;
+
+	private:
+
+		// Returns the size of the chunk at the start of the data.
+		static uint32 FindBoundary(const Byte *data, uint32 size);
+	};
+}
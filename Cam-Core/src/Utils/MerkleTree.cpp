@@ -0,0 +1,79 @@
+#include "MerkleTree.h"
+
+#include <string.h>
+
+#include "Core/Hash.h"
+
+namespace Core
+{
+	void MerkleTree::HashPieces(const Byte *data, uint32 size, uint32 piece_size, std::vector<Byte> *out_hashes)
+	{
+		uint32 piece_count = GetPieceCount(size, piece_size);
+		out_hashes->resize((size_t)piece_count * SHA256_BYTES);
+
+		for (uint32 i = 0; i < piece_count; ++i)
+		{
+			uint32 pos = i * piece_size;
+			uint32 length = size - pos < piece_size ? size - pos : piece_size;
+			Sha256(data + pos, length, out_hashes->data() + (size_t)i * SHA256_BYTES);
+		}
+	}
+
+	void MerkleTree::ComputeRoot(const Byte *hashes, uint32 piece_count, Byte *out_root)
+	{
+		if (piece_count == 0)
+		{
+			Sha256(nullptr, 0, out_root);
+			return;
+		}
+
+		std::vector<Byte> level(hashes, hashes + (size_t)piece_count * SHA256_BYTES);
+		uint32 count = piece_count;
+
+		// Each level is reduced in place, the parent of the nodes 2i and 2i + 1 is written to node i.
+		Byte pair[2 * SHA256_BYTES];
+		while (count > 1)
+		{
+			uint32 parents = 0;
+			for (uint32 i = 0; i < count; i += 2, ++parents)
+			{
+				Byte *parent = level.data() + (size_t)parents * SHA256_BYTES;
+				const Byte *left = level.data() + (size_t)i * SHA256_BYTES;
+
+				if (i + 1 == count)
+				{
+					memmove(parent, left, SHA256_BYTES);
+					continue;
+				}
+
+				memcpy(pair, left, 2 * SHA256_BYTES);
+				Sha256(pair, sizeof(pair), parent);
+			}
+
+			count = parents;
+		}
+
+		memcpy(out_root, level.data(), SHA256_BYTES);
+	}
+
+	void MerkleTree::ComputeLevel(const Byte *hashes, uint32 piece_count, uint32 leaves_per_node, std::vector<Byte> *out_nodes)
+	{
+		uint32 node_count = (piece_count + leaves_per_node - 1) / leaves_per_node;
+		out_nodes->resize((size_t)node_count * SHA256_BYTES);
+
+		// Pairs never cross the boundary of an aligned group of leaves, so the root of each group is a node of the tree.
+		for (uint32 i = 0; i < node_count; ++i)
+		{
+			uint32 first = i * leaves_per_node;
+			uint32 count = piece_count - first < leaves_per_node ? piece_count - first : leaves_per_node;
+			ComputeRoot(hashes + (size_t)first * SHA256_BYTES, count, out_nodes->data() + (size_t)i * SHA256_BYTES);
+		}
+	}
+
+	bool MerkleTree::VerifyPiece(const Byte *piece, uint32 size, const Byte *hash)
+	{
+		Byte actual[SHA256_BYTES];
+		Sha256(piece, size, actual);
+		return memcmp(actual, hash, SHA256_BYTES) == 0;
+	}
+}
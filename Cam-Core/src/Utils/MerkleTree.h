@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Core/Core.h"
+
+#include <vector>
+
+namespace Core
+{
+	// Hash tree over the pieces of a payload. The leaves are the SHA-256 hashes of the pieces, every inner node hashes its two children,
+	// a node without a sibling is passed up unchanged. Signing the root covers every piece, and a piece can be checked against its leaf
+	// as soon as it arrives. The number of leaves has to be signed together with the root, it fixes the shape of the tree.
+	// Node i of a level covers the leaves [i * 2^level, (i + 1) * 2^level), so each level can be checked on its own against the root.
+	class MerkleTree
+	{
+	public:
+
+		// Hashes every piece of the data into out_hashes, SHA256_BYTES per piece. The last piece may be shorter.
+		static void HashPieces(const Byte *data, uint32 size, uint32 piece_size, std::vector<Byte> *out_hashes);
+
+		// Computes the root over piece_count leaf hashes.
+		static void ComputeRoot(const Byte *hashes, uint32 piece_count, Byte *out_root);
+
+		// Computes the nodes of the level, in which each node covers leaves_per_node leaves. leaves_per_node has to be a power of two.
+		// The root over these nodes is the root of the whole tree.
+		static void ComputeLevel(const Byte *hashes, uint32 piece_count, uint32 leaves_per_node, std::vector<Byte> *out_nodes);
+
+		// Returns true, if the piece matches its leaf hash.
+		static bool VerifyPiece(const Byte *piece, uint32 size, const Byte *hash);
+
+		// Returns the number of pieces of the given size, which cover a payload.
+		static uint32 GetPieceCount(uint32 size, uint32 piece_size) { return (size + piece_size - 1) / piece_size; }
+	};
+}
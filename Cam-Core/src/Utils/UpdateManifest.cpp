@@ -0,0 +1,286 @@
+#include "UpdateManifest.h"
+
+#include <miniz/miniz.h>
+#include <string.h>
+
+#include "Utils/Chunker.h"
+
+namespace Core
+{
+	namespace utils
+	{
+		static void WriteU32(std::vector<Byte> *out, uint32 value)
+		{
+			for (uint32 i = 0; i < 4; ++i)
+			{
+				out->push_back((Byte)(value >> (i * 8)));
+			}
+		}
+
+		static bool ReadU32(const Byte **ptr, const Byte *end, uint32 *out_value)
+		{
+			if (end - *ptr < 4)
+			{
+				return false;
+			}
+
+			*out_value = (uint32)(*ptr)[0] | ((uint32)(*ptr)[1] << 8) | ((uint32)(*ptr)[2] << 16) | ((uint32)(*ptr)[3] << 24);
+			*ptr += 4;
+			return true;
+		}
+
+		static uint64 HashKey(const Byte *hash)
+		{
+			uint64 key;
+			memcpy(&key, hash, sizeof(key));
+			return key;
+		}
+	}
+
+	bool UpdateManifest::Build(uint32 version, const std::vector<ZipFile> &files, std::vector<Byte> *out_store)
+	{
+		m_Version = version;
+		m_Files.clear();
+		m_Chunks.clear();
+		m_Lookup.clear();
+		out_store->clear();
+
+		std::vector<chunk_t> chunks;
+		std::vector<Byte> compressed;
+
+		for (const ZipFile &file : files)
+		{
+			if (file.BufferSize > CAM_MAX_UINT32)
+			{
+				return false;
+			}
+
+			ManifestFile entry;
+			entry.Name = file.Name;
+			entry.Size = (uint32)file.BufferSize;
+			entry.Mode = file.Mode;
+
+			const Byte *data = (const Byte *)file.Buffer;
+			Chunker::Split(data, entry.Size, &chunks);
+
+			for (const chunk_t &chunk : chunks)
+			{
+				ManifestChunk info = {};
+				Sha256(data + chunk.Offset, chunk.Size, info.Hash);
+				info.Size = chunk.Size;
+
+				uint32 idx = FindChunk(info.Hash);
+				if (idx == CAM_INVALID_ID)
+				{
+					// Chunks are deflated one by one, so each of them can be restored on its own.
+					mz_ulong compressed_size = mz_compressBound(chunk.Size);
+					compressed.resize(compressed_size);
+
+					bool deflated = mz_compress2(compressed.data(), &compressed_size, data + chunk.Offset, chunk.Size, MZ_DEFAULT_LEVEL) == MZ_OK &&
+						compressed_size < chunk.Size;
+
+					info.StoredOffset = (uint32)out_store->size();
+					info.StoredSize = deflated ? (uint32)compressed_size : chunk.Size;
+
+					if (deflated)
+					{
+						out_store->insert(out_store->end(), compressed.begin(), compressed.begin() + compressed_size);
+					}
+					else
+					{
+						out_store->insert(out_store->end(), data + chunk.Offset, data + chunk.Offset + chunk.Size);
+					}
+
+					idx = (uint32)m_Chunks.size();
+					m_Chunks.push_back(info);
+					m_Lookup.emplace(utils::HashKey(info.Hash), idx);
+				}
+
+				entry.Chunks.push_back(idx);
+			}
+
+			m_Files.push_back(std::move(entry));
+		}
+
+		if (out_store->size() > CAM_MAX_UINT32)
+		{
+			return false;
+		}
+
+		m_StoreSize = (uint32)out_store->size();
+		return true;
+	}
+
+	void UpdateManifest::Write(std::vector<Byte> *out_data) const
+	{
+		out_data->clear();
+
+		utils::WriteU32(out_data, MAGIC);
+		utils::WriteU32(out_data, m_Version);
+		utils::WriteU32(out_data, m_StoreSize);
+		utils::WriteU32(out_data, (uint32)m_Chunks.size());
+		utils::WriteU32(out_data, (uint32)m_Files.size());
+
+		for (const ManifestChunk &chunk : m_Chunks)
+		{
+			out_data->insert(out_data->end(), chunk.Hash, chunk.Hash + SHA256_BYTES);
+			utils::WriteU32(out_data, chunk.Size);
+			utils::WriteU32(out_data, chunk.StoredOffset);
+			utils::WriteU32(out_data, chunk.StoredSize);
+		}
+
+		for (const ManifestFile &file : m_Files)
+		{
+			utils::WriteU32(out_data, (uint32)file.Name.size());
+			out_data->insert(out_data->end(), file.Name.begin(), file.Name.end());
+			utils::WriteU32(out_data, file.Size);
+			utils::WriteU32(out_data, file.Mode);
+			utils::WriteU32(out_data, (uint32)file.Chunks.size());
+
+			for (uint32 chunk : file.Chunks)
+			{
+				utils::WriteU32(out_data, chunk);
+			}
+		}
+	}
+
+	bool UpdateManifest::Read(const Byte *data, uint32 size)
+	{
+		m_Files.clear();
+		m_Chunks.clear();
+		m_Lookup.clear();
+
+		const Byte *ptr = data;
+		const Byte *end = data + size;
+
+		uint32 magic = 0, chunk_count = 0, file_count = 0;
+		if (!utils::ReadU32(&ptr, end, &magic) || magic != MAGIC ||
+			!utils::ReadU32(&ptr, end, &m_Version) ||
+			!utils::ReadU32(&ptr, end, &m_StoreSize) ||
+			!utils::ReadU32(&ptr, end, &chunk_count) ||
+			!utils::ReadU32(&ptr, end, &file_count))
+		{
+			return false;
+		}
+
+		// Every chunk entry takes at least 44 bytes, which limits the counts before anything is allocated.
+		if (chunk_count > (uint32)(end - ptr) / (SHA256_BYTES + 12))
+		{
+			return false;
+		}
+
+		m_Chunks.resize(chunk_count);
+		for (ManifestChunk &chunk : m_Chunks)
+		{
+			memcpy(chunk.Hash, ptr, SHA256_BYTES);
+			ptr += SHA256_BYTES;
+
+			utils::ReadU32(&ptr, end, &chunk.Size);
+			utils::ReadU32(&ptr, end, &chunk.StoredOffset);
+			utils::ReadU32(&ptr, end, &chunk.StoredSize);
+
+			if (chunk.Size == 0 || chunk.Size > Chunker::MAX_CHUNK_BYTES || chunk.StoredSize > chunk.Size ||
+				(uint64)chunk.StoredOffset + chunk.StoredSize > m_StoreSize)
+			{
+				return false;
+			}
+		}
+
+		for (uint32 i = 0; i < file_count; ++i)
+		{
+			ManifestFile file;
+			uint32 name_size = 0, file_chunk_count = 0;
+			if (!utils::ReadU32(&ptr, end, &name_size) || name_size == 0 || name_size > (uint32)(end - ptr))
+			{
+				return false;
+			}
+
+			file.Name.assign((const char *)ptr, name_size);
+			ptr += name_size;
+
+			// The files are written next to the client, names must not leave that directory.
+			if (file.Name.find_first_of("/\\:") != std::string::npos || file.Name == "." || file.Name == ".." || file.Name.find('\0') != std::string::npos)
+			{
+				return false;
+			}
+
+			// Only the permission bits are taken over, no set-user-ID or other special bits.
+			if (!utils::ReadU32(&ptr, end, &file.Size) ||
+				!utils::ReadU32(&ptr, end, &file.Mode) || file.Mode > 0777 ||
+				!utils::ReadU32(&ptr, end, &file_chunk_count) ||
+				file_chunk_count > (uint32)(end - ptr) / 4)
+			{
+				return false;
+			}
+
+			uint64 total = 0;
+			file.Chunks.resize(file_chunk_count);
+			for (uint32 &chunk : file.Chunks)
+			{
+				utils::ReadU32(&ptr, end, &chunk);
+				if (chunk >= chunk_count)
+				{
+					return false;
+				}
+
+				total += m_Chunks[chunk].Size;
+			}
+
+			if (total != file.Size)
+			{
+				return false;
+			}
+
+			m_Files.push_back(std::move(file));
+		}
+
+		if (ptr != end)
+		{
+			return false;
+		}
+
+		BuildLookup();
+		return true;
+	}
+
+	uint32 UpdateManifest::FindChunk(const Byte *hash) const
+	{
+		auto it = m_Lookup.find(utils::HashKey(hash));
+		if (it == m_Lookup.end() || memcmp(m_Chunks[it->second].Hash, hash, SHA256_BYTES) != 0)
+		{
+			return CAM_INVALID_ID;
+		}
+
+		return it->second;
+	}
+
+	bool UpdateManifest::ExtractChunk(uint32 chunk, const Byte *stored, Byte *out_data) const
+	{
+		const ManifestChunk &info = m_Chunks[chunk];
+		if (info.StoredSize < info.Size)
+		{
+			mz_ulong size = info.Size;
+			if (mz_uncompress(out_data, &size, stored, info.StoredSize) != MZ_OK || size != info.Size)
+			{
+				return false;
+			}
+		}
+		else
+		{
+			memcpy(out_data, stored, info.Size);
+		}
+
+		Byte hash[SHA256_BYTES];
+		Sha256(out_data, info.Size, hash);
+		return memcmp(hash, info.Hash, SHA256_BYTES) == 0;
+	}
+
+	void UpdateManifest::BuildLookup()
+	{
+		m_Lookup.reserve(m_Chunks.size());
+		for (uint32 i = 0; i < m_Chunks.size(); ++i)
+		{
+			m_Lookup.emplace(utils::HashKey(m_Chunks[i].Hash), i);
+		}
+	}
+}
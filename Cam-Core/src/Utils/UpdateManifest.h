@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Core/Core.h"
+#include "Core/Hash.h"
+#include "Utils/ZipArchive.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace Core
+{
+	struct ManifestChunk
+	{
+		Byte Hash[SHA256_BYTES];
+		uint32 Size;
+
+		// The range of the chunk in the chunk store. The chunk is deflated, if it is stored with less than Size bytes.
+		uint32 StoredOffset;
+		uint32 StoredSize;
+	};
+
+	struct ManifestFile
+	{
+		std::string Name;
+		uint32 Size;
+
+		// The Unix permission bits of the file, 0 if they are not known.
+		uint32 Mode;
+
+		// Indices into the chunk list, in file order.
+		std::vector<uint32> Chunks;
+	};
+
+	// Describes an update as a list of files, which are made of content defined chunks.
+	// Every distinct chunk is stored once in a chunk store, so a client only has to download the chunks it does not have yet.
+	class UpdateManifest
+	{
+	public:
+
+		// Splits the files into chunks and writes every distinct chunk once to the chunk store.
+		bool Build(uint32 version, const std::vector<ZipFile> &files, std::vector<Byte> *out_store);
+
+		// Serializes the manifest, the result is what gets signed and sent to the clients.
+		void Write(std::vector<Byte> *out_data) const;
+
+		// Parses a manifest. Returns false, if it is damaged or names a file outside of the update directory.
+		bool Read(const Byte *data, uint32 size);
+
+		// Returns the index of the chunk with the given hash, or CAM_INVALID_ID.
+		uint32 FindChunk(const Byte *hash) const;
+
+		// Restores a chunk from its stored bytes and checks it against the hash. out_data has to hold the chunk size.
+		bool ExtractChunk(uint32 chunk, const Byte *stored, Byte *out_data) const;
+
+		uint32 GetVersion() const { return m_Version; }
+		uint32 GetStoreSize() const { return m_StoreSize; }
+		const std::vector<ManifestFile> &GetFiles() const { return m_Files; }
+		const std::vector<ManifestChunk> &GetChunks() const { return m_Chunks; }
+
+	private:
+
+		void BuildLookup();
+
+	private:
+
+		// 'CAMM'
+		static constexpr uint32 MAGIC = 0x4D4D4143;
+
+		uint32 m_Version = 0;
+		uint32 m_StoreSize = 0;
+		std::vector<ManifestFile> m_Files;
+		std::vector<ManifestChunk> m_Chunks;
+
+		// The first bytes of the hash, to find chunks by their contents.
+		std::unordered_map<uint64, uint32> m_Lookup;
+	};
+}
@@ -27,6 +27,18 @@ namespace Core::utils
 		return (y < x) ? y : x;
 	}
 
+	// Returns the smallest power of two, which is not smaller than x.
+	constexpr uint64 NextPowerOfTwo(uint64 x)
+	{
+		uint64 result = 1;
+		while (result < x)
+		{
+			result <<= 1;
+		}
+
+		return result;
+	}
+
 	static bool HasMacroInText(const std::string &str, const std::string &macro)
 	{
 		size_t pos = str.find("#define " + macro);
@@ -1,12 +1,51 @@
 #include "ZipArchive.h"
 
 #include <miniz/miniz.h>
+#include <atomic>
 #include <iostream>
+#include <stdio.h>
+#include <time.h>
 
 #include "Core/FileSystem.h"
+#include "Core/Hash.h"
+#include "Core/MappedFile.h"
+#include "Core/ThreadPool.h"
 
 namespace Core
 {
+	namespace utils
+	{
+		struct ZipEntry
+		{
+			uint32 Index;
+			std::string Name;
+			uint64 Size;
+			uint32 Mode;
+		};
+
+		// The host system in the upper byte of "version made by", and the file type kept in the upper bits of the external attributes.
+		static constexpr uint16 ZIP_HOST_UNIX = 3;
+		static constexpr uint16 ZIP_VERSION = 20;
+		static constexpr uint32 ZIP_UNIX_REGULAR_FILE = 0100000;
+		static constexpr uint32 ZIP_UNIX_PERMISSIONS = 0777;
+
+		// The offsets of both fields in a central directory header.
+		static constexpr uint32 ZIP_CDH_VERSION_MADE_BY_OFS = 4;
+		static constexpr uint32 ZIP_CDH_EXTERNAL_ATTR_OFS = 38;
+
+		static size_t WriteToMappedFile(void *opaque, mz_uint64 offset, const void *data, size_t size)
+		{
+			MappedFile *file = (MappedFile *)opaque;
+			if (offset + size > file->GetSize())
+			{
+				return 0;
+			}
+
+			memcpy(file->GetData() + offset, data, size);
+			return size;
+		}
+	}
+
 	ZipArchive::ZipArchive()
 	{
 	}
@@ -57,6 +96,7 @@ namespace Core
 			file.BufferSize = uncomp_size;
 			file.Name = file_stat.m_filename;
 			file.Path = file_stat.m_filename;
+			file.Mode = GetEntryMode(file_stat.m_version_made_by, file_stat.m_external_attr);
 			result.push_back(file);
 		}
 
@@ -65,8 +105,217 @@ namespace Core
 		return result;
 	}
 
-	bool ZipArchive::Store(const std::vector<ZipFile> &inZipfiles, const std::string &inFilepath)
+	bool ZipArchive::Extract(const std::string &inFilepath, const std::string &inDirectory, ThreadPool *pool)
+	{
+		mz_zip_archive archive;
+		memset(&archive, 0, sizeof(mz_zip_archive));
+
+		if (!mz_zip_reader_init_file(&archive, inFilepath.c_str(), 0))
+		{
+			std::cerr << "Failed to open zip archive " << inFilepath << std::endl;
+			return false;
+		}
+
+		// The directories are created up front, the entries are written in any order.
+		std::vector<utils::ZipEntry> entries;
+		bool success = true;
+
+		uint32 file_count = mz_zip_reader_get_num_files(&archive);
+		for (uint32 i = 0; i < file_count; ++i)
+		{
+			mz_zip_archive_file_stat file_stat;
+			if (!mz_zip_reader_file_stat(&archive, i, &file_stat) || !IsSafeEntryName(file_stat.m_filename))
+			{
+				std::cerr << "Failed to get file stat for index " << i << std::endl;
+				success = false;
+				break;
+			}
+
+			std::string path = inDirectory + "/" + file_stat.m_filename;
+			std::string directory = file_stat.m_is_directory ? path : path.substr(0, path.find_last_of('/'));
+			if (!FileSystem::Get()->CreateDirectories(directory))
+			{
+				std::cerr << "Failed to create directory " << directory << std::endl;
+				success = false;
+				break;
+			}
+
+			if (!file_stat.m_is_directory)
+			{
+				entries.push_back({ i, file_stat.m_filename, file_stat.m_uncomp_size, GetEntryMode(file_stat.m_version_made_by, file_stat.m_external_attr) });
+			}
+		}
+
+		mz_zip_reader_end(&archive);
+
+		if (!success)
+		{
+			return false;
+		}
+
+		// Every entry gets its own reader, a reader can only decompress one entry at a time.
+		std::atomic<bool> failed = false;
+		auto extract_entry = [&](uint32 i)
+		{
+			const utils::ZipEntry &entry = entries[i];
+			std::string path = inDirectory + "/" + entry.Name;
+			std::cout << "Extracting " << entry.Name << std::endl;
+
+			bool extracted = false;
+			if (entry.Size == 0)
+			{
+				extracted = FileSystem::Get()->WriteFile(path, nullptr, 0);
+			}
+			else
+			{
+				mz_zip_archive reader;
+				memset(&reader, 0, sizeof(mz_zip_archive));
+
+				MappedFile *file = MappedFile::Create();
+				extracted = mz_zip_reader_init_file(&reader, inFilepath.c_str(), 0) &&
+					file->Open(path, entry.Size) &&
+					mz_zip_reader_extract_to_callback(&reader, entry.Index, utils::WriteToMappedFile, file, 0);
+
+				mz_zip_reader_end(&reader);
+				delete file;
+			}
+
+			// The file is created new, it only gets the mode of the entry, executables would not be executable otherwise.
+			if (extracted && entry.Mode != 0)
+			{
+				extracted = FileSystem::Get()->SetFileMode(path, entry.Mode);
+			}
+
+			if (!extracted)
+			{
+				std::cerr << "Failed to extract file " << entry.Name << std::endl;
+				failed = true;
+			}
+		};
+
+		if (pool)
+		{
+			pool->ParallelFor((uint32)entries.size(), extract_entry);
+		}
+		else
+		{
+			for (uint32 i = 0; i < entries.size(); ++i)
+			{
+				extract_entry(i);
+			}
+		}
+
+		return !failed;
+	}
+
+	bool ZipArchive::IsSafeEntryName(const std::string &name)
 	{
+		if (name.empty() || name[0] == '/' || name[0] == '\\' || name.find(':') != std::string::npos)
+		{
+			return false;
+		}
+
+		// No part of the path may lead to the parent directory.
+		size_t start = 0;
+		while (start <= name.size())
+		{
+			size_t end = name.find_first_of("/\\", start);
+			if (end == std::string::npos)
+			{
+				end = name.size();
+			}
+
+			if (name.compare(start, end - start, "..") == 0)
+			{
+				return false;
+			}
+
+			start = end + 1;
+		}
+
+		return true;
+	}
+
+	bool ZipArchive::Store(const std::vector<ZipFile> &inZipfiles, const std::string &inFilepath, ThreadPool *pool, ZipEntryCache *cache)
+	{
+		ZipEntryCache local_cache;
+		if (!cache)
+		{
+			cache = &local_cache;
+		}
+
+		// Only the contents are hashed, renamed files are found as well. Equal files are compressed once.
+		std::vector<uint64> keys(inZipfiles.size());
+		std::vector<uint32> missing;
+		std::unordered_map<uint64, ZipCompressedEntry> used;
+
+		cache->m_HitCount = 0;
+		cache->m_MissCount = 0;
+
+		for (uint32 i = 0; i < inZipfiles.size(); ++i)
+		{
+			const ZipFile &zip_file = inZipfiles[i];
+			keys[i] = Mix64(zip_file.BufferSize > 0 ? Raw64(zip_file.Buffer, (uint32)zip_file.BufferSize) : 0) ^ zip_file.BufferSize;
+
+			if (used.find(keys[i]) != used.end())
+			{
+				continue;
+			}
+
+			auto it = cache->m_Entries.find(keys[i]);
+			if (it != cache->m_Entries.end())
+			{
+				used[keys[i]] = std::move(it->second);
+				++cache->m_HitCount;
+			}
+			else
+			{
+				used[keys[i]] = ZipCompressedEntry();
+				missing.push_back(i);
+				++cache->m_MissCount;
+			}
+		}
+
+		// The compressors only write to their own entries, the map is not touched while they run.
+		std::vector<ZipCompressedEntry *> targets(missing.size());
+		for (uint32 i = 0; i < missing.size(); ++i)
+		{
+			targets[i] = &used[keys[missing[i]]];
+		}
+
+		int64 now = (int64)time(nullptr);
+		std::atomic<bool> failed = false;
+		auto compress_file = [&](uint32 i)
+		{
+			ZipCompressedEntry &entry = *targets[i];
+			if (!Compress(inZipfiles[missing[i]], &entry))
+			{
+				std::cerr << "Failed to compress file " << inZipfiles[missing[i]].Path << std::endl;
+				failed = true;
+			}
+
+			entry.Time = now;
+		};
+
+		if (pool)
+		{
+			pool->ParallelFor((uint32)missing.size(), compress_file);
+		}
+		else
+		{
+			for (uint32 i = 0; i < missing.size(); ++i)
+			{
+				compress_file(i);
+			}
+		}
+
+		// Entries of files, which are no longer part of the archive, are dropped.
+		cache->m_Entries.clear();
+		if (failed)
+		{
+			return false;
+		}
+
 		mz_zip_archive zip_archive;
 		memset(&zip_archive, 0, sizeof(mz_zip_archive));
 		mz_bool status = mz_zip_writer_init_file(&zip_archive, inFilepath.c_str(), 0);
@@ -76,28 +325,139 @@ namespace Core
 			return false;
 		}
 
-		for (const Core::ZipFile &zip_file : inZipfiles)
+		bool success = true;
+		for (uint32 i = 0; i < inZipfiles.size(); ++i)
 		{
-			if (!mz_zip_writer_add_mem(&zip_archive, zip_file.Name.c_str(), zip_file.Buffer, zip_file.BufferSize, MZ_BEST_COMPRESSION))
-			{
-				std::cerr << "Failed to add file " << zip_file.Path << " to archive " << inFilepath << std::endl;
+			const ZipCompressedEntry &entry = used[keys[i]];
+			MZ_TIME_T time = (MZ_TIME_T)entry.Time;
 
-				if (!mz_zip_writer_finalize_archive(&zip_archive))
-				{
-					std::cerr << "Failed to finalize zip archive." << std::endl;
-				}
-				mz_zip_writer_end(&zip_archive);
-
-				return false;
+			// Empty files are stored, miniz does not take compressed data without contents.
+			mz_uint flags = entry.Size > 0 ? (MZ_BEST_COMPRESSION | MZ_ZIP_FLAG_COMPRESSED_DATA) : 0;
+			if (!mz_zip_writer_add_mem_ex_v2(&zip_archive, inZipfiles[i].Name.c_str(), entry.Data.data(), entry.Data.size(), nullptr, 0, flags, entry.Size, entry.Crc32, &time, nullptr, 0, nullptr, 0))
+			{
+				std::cerr << "Failed to add file " << inZipfiles[i].Path << " to archive " << inFilepath << std::endl;
+				success = false;
+				break;
 			}
 		}
 
 		if (!mz_zip_writer_finalize_archive(&zip_archive))
 		{
 			std::cerr << "Failed to finalize zip archive." << std::endl;
+			success = false;
 		}
 		mz_zip_writer_end(&zip_archive);
 
+		if (success && !WriteEntryModes(inFilepath, inZipfiles))
+		{
+			std::cerr << "Failed to write the file modes to archive " << inFilepath << std::endl;
+			success = false;
+		}
+
+		if (success)
+		{
+			cache->m_Entries = std::move(used);
+		}
+
+		return success;
+	}
+
+	uint32 ZipArchive::GetEntryMode(uint16 version_made_by, uint32 external_attributes)
+	{
+		if ((version_made_by >> 8) != utils::ZIP_HOST_UNIX)
+		{
+			return 0;
+		}
+
+		return (external_attributes >> 16) & utils::ZIP_UNIX_PERMISSIONS;
+	}
+
+	bool ZipArchive::WriteEntryModes(const std::string &inFilepath, const std::vector<ZipFile> &inZipfiles)
+	{
+		bool has_modes = false;
+		for (const ZipFile &zip_file : inZipfiles)
+		{
+			has_modes |= zip_file.Mode != 0;
+		}
+
+		if (!has_modes)
+		{
+			return true;
+		}
+
+		// The reader finds the central directory header of every entry, the entries are in the order they were added.
+		mz_zip_archive reader;
+		memset(&reader, 0, sizeof(mz_zip_archive));
+		if (!mz_zip_reader_init_file(&reader, inFilepath.c_str(), 0))
+		{
+			return false;
+		}
+
+		std::vector<uint64> offsets(inZipfiles.size());
+		bool success = mz_zip_reader_get_num_files(&reader) == inZipfiles.size();
+		for (uint32 i = 0; success && i < inZipfiles.size(); ++i)
+		{
+			mz_zip_archive_file_stat file_stat;
+			success = mz_zip_reader_file_stat(&reader, i, &file_stat);
+			offsets[i] = reader.m_central_directory_file_ofs + file_stat.m_central_dir_ofs;
+		}
+
+		mz_zip_reader_end(&reader);
+		if (!success)
+		{
+			return false;
+		}
+
+		FILE *f = fopen(inFilepath.c_str(), "r+b");
+		if (!f)
+		{
+			return false;
+		}
+
+		for (uint32 i = 0; success && i < inZipfiles.size(); ++i)
+		{
+			if (inZipfiles[i].Mode == 0)
+			{
+				continue;
+			}
+
+			uint16 version_made_by = (utils::ZIP_HOST_UNIX << 8) | utils::ZIP_VERSION;
+			uint32 attributes = (utils::ZIP_UNIX_REGULAR_FILE | (inZipfiles[i].Mode & utils::ZIP_UNIX_PERMISSIONS)) << 16;
+
+			Byte version_bytes[2] = { (Byte)version_made_by, (Byte)(version_made_by >> 8) };
+			Byte attribute_bytes[4] = { (Byte)attributes, (Byte)(attributes >> 8), (Byte)(attributes >> 16), (Byte)(attributes >> 24) };
+
+			success = fseek(f, (long)(offsets[i] + utils::ZIP_CDH_VERSION_MADE_BY_OFS), SEEK_SET) == 0 &&
+				fwrite(version_bytes, 1, sizeof(version_bytes), f) == sizeof(version_bytes) &&
+				fseek(f, (long)(offsets[i] + utils::ZIP_CDH_EXTERNAL_ATTR_OFS), SEEK_SET) == 0 &&
+				fwrite(attribute_bytes, 1, sizeof(attribute_bytes), f) == sizeof(attribute_bytes);
+		}
+
+		return fclose(f) == 0 && success;
+	}
+
+	bool ZipArchive::Compress(const ZipFile &file, ZipCompressedEntry *out_entry)
+	{
+		out_entry->Size = file.BufferSize;
+		out_entry->Crc32 = (uint32)mz_crc32(MZ_CRC32_INIT, (const Byte *)file.Buffer, file.BufferSize);
+		out_entry->Data.clear();
+
+		if (file.BufferSize == 0)
+		{
+			return true;
+		}
+
+		// Zip entries hold a raw deflate stream, without the zlib header.
+		mz_uint flags = tdefl_create_comp_flags_from_zip_params(MZ_BEST_COMPRESSION, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY);
+		size_t compressed_size = 0;
+		void *compressed = tdefl_compress_mem_to_heap(file.Buffer, file.BufferSize, &compressed_size, (int)flags);
+		if (!compressed)
+		{
+			return false;
+		}
+
+		out_entry->Data.assign((const Byte *)compressed, (const Byte *)compressed + compressed_size);
+		mz_free(compressed);
 		return true;
 	}
 }
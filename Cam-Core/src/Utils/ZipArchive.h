@@ -2,15 +2,53 @@
 
 #include <vector>
 #include <string>
+#include <unordered_map>
+
+#include "Core/Core.h"
 
 namespace Core
 {
+	class ThreadPool;
+
 	struct ZipFile
 	{
 		std::string Name;
 		std::string Path; //!< @deprecated
 		void *Buffer;
 		size_t BufferSize;
+
+		// The Unix permission bits of the file, 0 if they are not known.
+		uint32 Mode = 0;
+	};
+
+	// The deflated contents of a zip entry, with everything the zip headers need.
+	struct ZipCompressedEntry
+	{
+		std::vector<Byte> Data;
+		uint64 Size = 0;
+		uint32 Crc32 = 0;
+
+		// The entry keeps the time it was first compressed, an unchanged file gives the same archive bytes.
+		int64 Time = 0;
+	};
+
+	// Keeps the compressed entries of the last stored archive, keyed by a hash of their contents.
+	// Storing the next archive only compresses the files, which changed in between.
+	class ZipEntryCache
+	{
+	public:
+
+		// The number of entries taken from the cache and compressed by the last Store.
+		uint32 GetHitCount() const { return m_HitCount; }
+		uint32 GetMissCount() const { return m_MissCount; }
+
+	private:
+
+		friend class ZipArchive;
+
+		std::unordered_map<uint64, ZipCompressedEntry> m_Entries;
+		uint32 m_HitCount = 0;
+		uint32 m_MissCount = 0;
 	};
 
 	class ZipArchive
@@ -21,10 +59,28 @@ namespace Core
 		virtual ~ZipArchive();
 
 		std::vector<ZipFile> Load(const std::string &inFilepath);
-		bool Store(const std::vector<ZipFile> &inZipfiles, const std::string &inFilepath);
+
+		// Extracts all entries of the archive into the directory. Every entry is decompressed straight into its file,
+		// without holding the archive or the entry in memory. The entries are spread across the threads of the pool,
+		// which may be null to extract them one after another. Entries with a Unix mode get it on their file.
+		// Returns false, if any entry could not be extracted.
+		bool Extract(const std::string &inFilepath, const std::string &inDirectory, ThreadPool *pool);
+		// Compresses the files on the threads of the pool and writes them to the archive in their order. Files found in the cache
+		// are not compressed again, the cache only keeps the entries of this archive afterwards. pool and cache may be null.
+		// The Mode of every file is stored with its entry, as zip tools on Unix do.
+		bool Store(const std::vector<ZipFile> &inZipfiles, const std::string &inFilepath, ThreadPool *pool = nullptr, ZipEntryCache *cache = nullptr);
 
 	private:
 
+		// Returns false for entry names, which would end up outside of the target directory.
+		static bool IsSafeEntryName(const std::string &name);
+
+		static bool Compress(const ZipFile &file, ZipCompressedEntry *out_entry);
+
+		// Returns the Unix mode of an entry, or 0 if the entry was not made on Unix.
+		static uint32 GetEntryMode(uint16 version_made_by, uint32 external_attributes);
 
+		// miniz writes every entry as made on MS-DOS, the modes are written into the central directory of the finished archive.
+		static bool WriteEntryModes(const std::string &inFilepath, const std::vector<ZipFile> &inZipfiles);
 	};
 }
@@ -1,36 +1,22 @@
 #include "Camera.h"
 
-#include <thread>
+#include <string.h>
 
 #define MAX_RETRIES 5
 
-Camera::Camera(bool flipImage, uint32 width, uint32 height)
-	: m_FlipImage(flipImage), m_Width(width), m_Height(height)
+Camera::Camera(const CaptureSourceConfig &source, bool flipImage, uint32 width, uint32 height, uint32 queueCapacity, Core::QueueOverflowPolicy queuePolicy)
+	: m_FlipImage(flipImage), m_Width(width), m_Height(height), m_ImageQueue(queueCapacity, queuePolicy)
 {
-	m_CameraStream = cv::VideoCapture(0);
-
-	if (m_Width == 0 || m_Height == 0)
-	{
-		// If no specific width or height is provided, use the width and the height of the camera stream.
-		m_Width = (uint32)m_CameraStream.get(cv::CAP_PROP_FRAME_WIDTH);
-		m_Height = (uint32)m_CameraStream.get(cv::CAP_PROP_FRAME_HEIGHT);
-	}
-	else
-	{
-		m_CameraStream.set(cv::CAP_PROP_FRAME_WIDTH, (double)m_Width);
-		m_CameraStream.set(cv::CAP_PROP_FRAME_HEIGHT, (double)m_Height);
-	}
-
-	m_CenterX = (float)m_Width / 2;
-	m_CenterY = (float)m_Height / 2;
-	m_Format = (int32)m_CameraStream.get(cv::CAP_PROP_FORMAT);
-
-	std::this_thread::sleep_for(std::chrono::seconds(2));
+	m_Source = CaptureSource::Create(source);
+	OpenSource();
 }
 
 Camera::~Camera()
 {
 	Release();
+
+	delete m_Source;
+	m_Source = nullptr;
 }
 
 void Camera::Invalidate()
@@ -38,35 +24,46 @@ void Camera::Invalidate()
 	Release();
 
 	m_CameraRunning = true;
-	m_CameraStream = cv::VideoCapture(0);
+	OpenSource();
+}
 
-	if (m_Width == 0 || m_Height == 0)
-	{
-		// If no specific width or height is provided, use the width and the height of the camera stream.
-		m_Width = (uint32)m_CameraStream.get(cv::CAP_PROP_FRAME_WIDTH);
-		m_Height = (uint32)m_CameraStream.get(cv::CAP_PROP_FRAME_HEIGHT);
-	}
-	else
+void Camera::OpenSource()
+{
+	if (!m_Source->Open(m_Width, m_Height))
 	{
-		m_CameraStream.set(cv::CAP_PROP_FRAME_WIDTH, (double)m_Width);
-		m_CameraStream.set(cv::CAP_PROP_FRAME_HEIGHT, (double)m_Height);
+		// Reading fails as well, which invalidates the camera again until it gives up.
+		return;
 	}
 
+	// The source may not support the requested resolution, use the one it actually delivers.
+	m_Width = m_Source->GetWidth();
+	m_Height = m_Source->GetHeight();
+
 	m_CenterX = (float)m_Width / 2;
 	m_CenterY = (float)m_Height / 2;
-	m_Format = (int32)m_CameraStream.get(cv::CAP_PROP_FORMAT);
+	m_Format = m_Source->GetFormat();
 
-	std::this_thread::sleep_for(std::chrono::seconds(2));
+	// The pool is resized again on the first frame, if the source delivers another resolution or format.
+	ResizeFramePool(m_Width, m_Height, m_Format);
 }
 
-
-void Camera::GenerateFrames()
+bool Camera::GenerateFrames()
 {
-	cv::Mat frame;
 	static uint32 failed_retries = 0;
 	static uint32 invalidate_count = 0;
 
-	bool success = m_CameraStream.read(frame);
+	CameraFrame frame;
+	frame.Buffer = m_FramePool.Acquire();
+	if (!frame.Buffer)
+	{
+		// All pooled frames are still queued or in use, skip this frame instead of allocating another one.
+		m_Source->Skip();
+		return false;
+	}
+
+	// The camera writes straight into the pooled buffer, as long as the resolution and the format match it.
+	cv::Mat image((int32)m_PoolHeight, (int32)m_PoolWidth, m_PoolFormat, frame.GetData());
+	bool success = m_Source->Read(image);
 	if (!success)
 	{
 		++failed_retries;
@@ -75,112 +72,88 @@ void Camera::GenerateFrames()
 			if (invalidate_count >= MAX_RETRIES)
 			{
 				Release();
-				return;
+				return false;
 			}
 
 			Invalidate();
 			++invalidate_count;
 		}
 		
-		return;
+		return false;
+	}
+
+	frame.CaptureUS = Core::QueryUS();
+
+	if (image.data != frame.GetData())
+	{
+		// The camera delivered another resolution or format than expected, or the backend handed out its own memory.
+		// The pool is only resized on the first frame after the camera has been (re)opened, afterwards this is a plain copy.
+		ResizeFramePool((uint32)image.cols, (uint32)image.rows, image.type());
+
+		frame.Buffer = m_FramePool.Acquire();
+		if (!frame.Buffer)
+		{
+			return false;
+		}
+
+		cv::Mat pooled(image.rows, image.cols, image.type(), frame.GetData());
+		image.copyTo(pooled);
+		image = pooled;
 	}
 
-	m_Format = frame.type();
+	m_Format = image.type();
+	frame.Width = (uint32)image.cols;
+	frame.Height = (uint32)image.rows;
+	frame.Format = m_Format;
 	
 	if (m_FlipImage)
 	{
-		cv::flip(frame, frame, 0);
-		cv::flip(frame, frame, 1);
+		// Flipping around both axes at once, in place.
+		cv::flip(image, image, -1);
 	}
 
 	if (m_TouchedZoom)
 	{
-		frame = Zoom(frame, { m_CenterX, m_CenterY });
+		Compact(Zoom(image, { m_CenterX, m_CenterY }), frame);
 	}
 	else
 	{
 		if (m_Scale != 1)
-			frame = Zoom(frame, { 0.0f, 0.0f });
-	}
-
-	m_ImageQueue.Enqueue(frame);
-	++m_FrameCount;
-}
-
-Byte *Camera::GetFrame(uint32 frameIndex, uint32 *out_frame_size, uint32 *out_frame_width, uint32 *out_frame_height)
-{
-	if (!out_frame_size || !out_frame_width || !out_frame_height)
-	{
-		return nullptr;
+			Compact(Zoom(image, { 0.0f, 0.0f }), frame);
 	}
 
-	if (frameIndex >= m_ImageQueue.Size())
+	// With a slow consumer, the queue drops frames or waits depending on its policy instead of growing.
+	if (!m_ImageQueue.Push(std::move(frame)))
 	{
-		*out_frame_size = 0;
-		*out_frame_width = 0;
-		*out_frame_height = 0;
-		return nullptr;
+		return false;
 	}
 
-	cv::Mat frame = m_ImageQueue.Get(frameIndex);
-
-	*out_frame_size = (uint32)(frame.total() * frame.elemSize());
-	*out_frame_width = frame.cols;
-	*out_frame_height = frame.rows;
-
-	Byte *frame_data = new Byte[*out_frame_size];
-	memcpy(frame_data, frame.data, *out_frame_size);
-	return frame_data;
+	++m_FrameCount;
+	return true;
 }
 
-Byte *Camera::GetCurrentFrame(uint32 *out_frame_size, uint32 *out_frame_width, uint32 *out_frame_height)
+bool Camera::GetCurrentFrame(CameraFrame *out_frame)
 {
-	if (!out_frame_size || !out_frame_width || !out_frame_height)
+	if (!out_frame)
 	{
-		return nullptr;
+		return false;
 	}
 
-	cv::Mat frame = m_ImageQueue.Dequeue();
-
-	*out_frame_size = (uint32)(frame.total() * frame.elemSize());
-	*out_frame_width = frame.cols;
-	*out_frame_height = frame.rows;
-
-	Byte *frame_data = new Byte[*out_frame_size];
-	memcpy(frame_data, frame.data, *out_frame_size);
-	return frame_data;
+	return m_ImageQueue.Pop(*out_frame, FRAME_WAIT_TIMEOUT_MS);
 }
 
 void Camera::Release()
 {
 	m_CameraRunning = false;
-	m_CameraStream.release();
+	m_Source->Close();
 	cv::destroyAllWindows();
 }
 
-Byte *Camera::Show(uint32 frameIndex, uint32 *out_frame_size, uint32 *out_frame_width, uint32 *out_frame_height)
+void Camera::Show(const CameraFrame &frame)
 {
-	if (!out_frame_size || !out_frame_width || !out_frame_height)
-	{
-		return nullptr;
-	}
-
-	if (frameIndex >= m_ImageQueue.Size())
-	{
-		*out_frame_size = 0;
-		*out_frame_width = 0;
-		*out_frame_height = 0;
-		return nullptr;
-	}
-
-	cv::Mat frame = m_ImageQueue.Get(frameIndex);
 	cv::namedWindow("Frame", cv::WND_PROP_FULLSCREEN);
 	cv::setWindowProperty("Frame", cv::WND_PROP_FULLSCREEN, cv::WND_PROP_FULLSCREEN);
-	cv::imshow("Frame", frame);
-
-	*out_frame_size = (uint32)(frame.total() * frame.elemSize());
-	*out_frame_width = frame.cols;
-	*out_frame_height = frame.rows;
+	cv::imshow("Frame", frame.ToMat());
 
 	char key = cv::waitKey(1);
 	if (key == 'q')
@@ -195,46 +168,29 @@ Byte *Camera::Show(uint32 frameIndex, uint32 *out_frame_size, uint32 *out_frame_
 	{
 		ZoomOut();
 	}
-
-	Byte *frame_data = new Byte[*out_frame_size];
-	memcpy(frame_data, frame.data, *out_frame_size);
-	return frame_data;
 }
 
-Byte *Camera::ShowLive(uint32 *out_frame_size, uint32 *out_frame_width, uint32 *out_frame_height)
+void Camera::ReserveFrames(uint32 count)
 {
-	if (!out_frame_size || !out_frame_width || !out_frame_height)
-	{
-		return nullptr;
-	}
-
-	cv::Mat frame = m_ImageQueue.Dequeue();
-
-	*out_frame_size = (uint32)(frame.total() * frame.elemSize());
-	*out_frame_width = frame.cols;
-	*out_frame_height = frame.rows;
+	m_ReservedFrames = count;
 
-	cv::namedWindow("Frame", cv::WND_PROP_FULLSCREEN);
-	cv::setWindowProperty("Frame", cv::WND_PROP_FULLSCREEN, cv::WND_PROP_FULLSCREEN);
-	cv::imshow("Frame", frame);
+	uint64 frame_size = (uint64)m_PoolWidth * m_PoolHeight * CV_ELEM_SIZE(m_PoolFormat);
+	m_FramePool.Resize(frame_size, m_ImageQueue.Capacity() + EXTRA_POOL_FRAMES + m_ReservedFrames);
+}
 
-	char key = cv::waitKey(1);
-	if (key == 'q')
-	{
-		Release();
-	}
-	else if (key == 'z')
-	{
-		ZoomIn();
-	}
-	else if (key == 'x')
+void Camera::ResizeFramePool(uint32 width, uint32 height, int32 format)
+{
+	if (width == m_PoolWidth && height == m_PoolHeight && format == m_PoolFormat)
 	{
-		ZoomOut();
+		return;
 	}
 
-	Byte *frame_data = new Byte[*out_frame_size];
-	memcpy(frame_data, frame.data, *out_frame_size);
-	return frame_data;
+	m_PoolWidth = width;
+	m_PoolHeight = height;
+	m_PoolFormat = format;
+
+	uint64 frame_size = (uint64)width * height * CV_ELEM_SIZE(format);
+	m_FramePool.Resize(frame_size, m_ImageQueue.Capacity() + EXTRA_POOL_FRAMES + m_ReservedFrames);
 }
 
 cv::Mat Camera::Zoom(cv::Mat frame, std::pair<float, float> center)
@@ -290,10 +246,26 @@ cv::Mat Camera::Zoom(cv::Mat frame, std::pair<float, float> center)
 	float min_y = m_CenterY - m_RadiusY;
 	float max_y = m_CenterY + m_RadiusY;
 
-	cv::Rect rect((int32)min_x, (int32)min_y, (int32)max_x, (int32)max_y);
+	cv::Rect rect((int32)min_x, (int32)min_y, (int32)(max_x - min_x), (int32)(max_y - min_y));
 	return frame(rect);
 }
 
+void Camera::Compact(const cv::Mat &area, CameraFrame &frame)
+{
+	uint32 row_size = (uint32)(area.cols * area.elemSize());
+	Byte *data = frame.GetData();
+
+	// Every row moves towards the start of the buffer, so no row is overwritten before it has been moved itself.
+	for (int32 y = 0; y < area.rows; ++y)
+	{
+		memmove(data + (size_t)y * row_size, area.ptr(y), row_size);
+	}
+
+	frame.Width = (uint32)area.cols;
+	frame.Height = (uint32)area.rows;
+	frame.Buffer.SetSize((uint64)row_size * area.rows);
+}
+
 void Camera::ZoomIn()
 {
 	if (m_Scale > 0.2f)
@@ -4,11 +4,40 @@
 
 #include <opencv2/opencv.hpp>
 
+#include "CaptureSource.h"
+
+/// <summary>
+/// A captured frame. The pixels live in a buffer of the frame pool of the camera, copying the frame only copies the reference.
+/// The buffer goes back to the pool, once the last copy is gone.
+/// </summary>
+struct CameraFrame
+{
+	Core::BufferRef Buffer;
+	uint32 Width = 0;
+	uint32 Height = 0;
+	int32 Format = 0;
+
+	/// <summary>
+	/// The time in microseconds (Core::QueryUS), at which the frame has been captured.
+	/// </summary>
+	int64 CaptureUS = 0;
+
+	Byte *GetData() const { return Buffer.Data(); }
+	uint32 GetSize() const { return (uint32)Buffer.Size(); }
+
+	/// <summary>
+	/// Wraps the pixels into a Mat header without copying them. The Mat must not outlive the frame.
+	/// </summary>
+	cv::Mat ToMat() const { return cv::Mat((int32)Height, (int32)Width, Format, Buffer.Data()); }
+
+	bool IsValid() const { return Buffer.IsValid(); }
+};
+
 class Camera
 {
 public:
 
-	Camera(bool flipImage, uint32 width = 0, uint32 height = 0);
+	Camera(const CaptureSourceConfig &source, bool flipImage, uint32 width = 0, uint32 height = 0, uint32 queueCapacity = DEFAULT_QUEUE_CAPACITY, Core::QueueOverflowPolicy queuePolicy = Core::QueueOverflowPolicy::DropOldest);
 	~Camera();
 
 	/// <summary>
@@ -24,45 +53,29 @@ public:
 	/// <summary>
 	/// Generates the most current frame. Must be called in a loop, to generate continuesly new images.
 	/// </summary>
-	void GenerateFrames();
+	/// <returns>Returns true, if a frame has been captured and queued.</returns>
+	bool GenerateFrames();
 
 	/// <summary>
-	/// Gets a specific frame, which was captured before by GenerateFrames. Must be called in a loop, to retrieve a specific frame continuesly.
+	/// Adds pooled frames for consumers, which keep frames after taking them from the camera, e.g. in further queues.
+	/// Must be called before frames are generated.
 	/// </summary>
-	/// <param name="frameIndex">The frameIndex, from which the image should be extracted.</param>
-	/// <param name="out_frame_size">The total size of the frame data in bytes.</param>
-	/// <param name="out_frame_width">The width of the resulting frame data.</param>
-	/// <param name="out_frame_height">The height of the resulting frame data.</param>
-	/// <returns>Returns the pixel data of the requested frame number if successful, otherwise nullptr. The caller is responsible for deleting the buffer when not used anymore.</returns>
-	Byte *GetFrame(uint32 frameIndex, uint32 *out_frame_size, uint32 *out_frame_width, uint32 *out_frame_height);
+	/// <param name="count">The number of frames, which the consumers may keep at the same time.</param>
+	void ReserveFrames(uint32 count);
 
 	/// <summary>
 	/// Gets every current frame, must be called continuesly, to retrieve each current frame (aka. live video feed)
 	/// </summary>
-	/// <param name="out_frame_size">The total size of the frame data in bytes.</param>
-	/// <param name="out_frame_width">The width of the resulting frame data.</param>
-	/// <param name="out_frame_height">The height of the resulting frame data.</param>
-	/// <returns>Returns the pixel data of the most current frame if successful, otherwise nullptr. The caller is responsible for deleting the buffer when not used anymore.</returns>
-	Byte *GetCurrentFrame(uint32 *out_frame_size, uint32 *out_frame_width, uint32 *out_frame_height);
-
-	/// <summary>
-	/// Shows a specific frame, which was captured before by GenerateFrames. Must be called in a loop, to display a specific frame continuesly.
-	/// </summary>
-	/// <param name="frameIndex">The frameIndex, from which the image should be extracted.</param>
-	/// <param name="out_frame_size">The total size of the frame data in bytes.</param>
-	/// <param name="out_frame_width">The width of the resulting frame data.</param>
-	/// <param name="out_frame_height">The height of the resulting frame data.</param>
-	/// <returns>Returns the pixel data of the requested frame number if successful, otherwise nullptr. The caller is responsible for deleting the buffer when not used anymore.</returns>
-	Byte *Show(uint32 frameIndex, uint32 *out_frame_size, uint32 *out_frame_width, uint32 *out_frame_height);
+	/// <param name="out_frame">The oldest queued frame. It references the pooled pixels, which are not copied.</param>
+	/// <returns>Returns true if successful, otherwise false if no frame arrived within FRAME_WAIT_TIMEOUT_MS.</returns>
+	bool GetCurrentFrame(CameraFrame *out_frame);
 
 	/// <summary>
-	/// Shows every current frame, must be called continuesly, to display each current frame (aka. live video feed)
+	/// Shows a frame, which has been taken from the camera before, and handles the key input of the window.
+	/// Must be called from the main thread.
 	/// </summary>
-	/// <param name="out_frame_size">The total size of the frame data in bytes.</param>
-	/// <param name="out_frame_width">The width of the resulting frame data.</param>
-	/// <param name="out_frame_height">The height of the resulting frame data.</param>
-	/// <returns>Returns the pixel data of the most current frame if successful, otherwise nullptr. The caller is responsible for deleting the buffer when not used anymore.</returns>
-	Byte *ShowLive(uint32 *out_frame_size, uint32 *out_frame_width, uint32 *out_frame_height);
+	/// <param name="frame">The frame to show.</param>
+	void Show(const CameraFrame &frame);
 
 	/// <summary>
 	/// Determines, if the camera was closed by the user or is currently running.
@@ -82,17 +95,61 @@ public:
 	/// <returns>Returns the current color format</returns>
 	uint32 GetFormat() const { return m_Format; }
 
+	/// <summary>
+	/// Returns the counters of the queue between GenerateFrames and the frame consumers.
+	/// </summary>
+	/// <returns>Returns the number of queued, dropped and currently waiting frames.</returns>
+	Core::QueueStats GetQueueStats() const { return m_ImageQueue.GetStats(); }
+
+	/// <summary>
+	/// Returns the number of frames, which have been skipped because all pooled frame buffers were in use.
+	/// </summary>
+	uint64 GetSkippedFrameCount() const { return m_FramePool.GetExhaustedCount(); }
+
+public:
+
+	/// <summary>
+	/// The number of captured frames, which may wait for a consumer. Depending on the overflow policy, further frames are dropped or the capture waits.
+	/// </summary>
+	static constexpr uint32 DEFAULT_QUEUE_CAPACITY = 4;
+
+	/// <summary>
+	/// The time GetCurrentFrame waits for a new frame, before they give up.
+	/// </summary>
+	static constexpr int32 FRAME_WAIT_TIMEOUT_MS = 1000;
+
+	/// <summary>
+	/// The number of pooled frames besides the queued ones: the frame, which is currently captured, and the one the consumer works on.
+	/// </summary>
+	static constexpr uint32 EXTRA_POOL_FRAMES = 2;
+
 private:
 
+	/// <summary>
+	/// Opens the capture source and takes over its resolution and format.
+	/// </summary>
+	void OpenSource();
+
+	/// <summary>
+	/// Allocates the pooled frame buffers for the given resolution and format. Does nothing, if the pool already matches.
+	/// </summary>
+	void ResizeFramePool(uint32 width, uint32 height, int32 format);
+
 	/// <summary>
 	/// Zooms in- or out in the current frame, calculates the view area based on the center parameter. 
-	/// Copies the Mat object into a new one, without modifying the parameter.
 	/// </summary>
 	/// <param name="frame">The frame to be used for the zoom.</param>
 	/// <param name="center">The position, where the frame should be zoomed to.</param>
-	/// <returns>Returns a new, zoomed copy of the frame.</returns>
+	/// <returns>Returns the zoomed area of the frame, which still references the pixels of the frame.</returns>
 	cv::Mat Zoom(cv::Mat frame, std::pair<float, float> center);
 
+	/// <summary>
+	/// Moves the rows of a sub area of the frame to the start of its buffer, so that it is continuous in memory again.
+	/// </summary>
+	/// <param name="area">The sub area, which references the pixels of the frame buffer.</param>
+	/// <param name="frame">The frame, which owns the buffer. Gets the size of the area.</param>
+	void Compact(const cv::Mat &area, CameraFrame &frame);
+
 	/// <summary>
 	/// Sets the zoom parameter to be zoomed in for the next call of Zoom.
 	/// </summary>
@@ -118,7 +175,15 @@ private:
 	float m_CenterX = 0, m_CenterY = 0;
 	float m_RadiusX = 0, m_RadiusY = 0;
 
-	cv::VideoCapture m_CameraStream;
-	Core::ThreadSafeQueue<cv::Mat> m_ImageQueue;
+	CaptureSource *m_Source = nullptr;
+
+	// The pool has to outlive all frames, so it is declared before the queue.
+	Core::FramePool m_FramePool;
+	uint32 m_PoolWidth = 0;
+	uint32 m_PoolHeight = 0;
+	int32 m_PoolFormat = -1;
+	uint32 m_ReservedFrames = 0;
+
+	Core::SPSCQueue<CameraFrame> m_ImageQueue;
 };
 
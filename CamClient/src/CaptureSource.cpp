@@ -0,0 +1,45 @@
+#include "CaptureSource.h"
+
+#include "DeviceCaptureSource.h"
+#include "FileCaptureSource.h"
+#include "SyntheticCaptureSource.h"
+
+CaptureSource *CaptureSource::Create(const CaptureSourceConfig &config)
+{
+	switch (config.Type)
+	{
+		case CaptureSourceType::File:
+			return new FileCaptureSource(config);
+
+		case CaptureSourceType::Synthetic:
+			return new SyntheticCaptureSource(config);
+
+		case CaptureSourceType::Device:
+			break;
+	}
+
+	return new DeviceCaptureSource(config);
+}
+
+void CaptureSource::Throttle(float fps)
+{
+	if (fps <= 0.0f)
+	{
+		return;
+	}
+
+	double now = (double)Core::QueryMS();
+	double interval = 1000.0 / fps;
+
+	// After a stall (or on the first frame) start over instead of delivering the missed frames as fast as possible.
+	if (m_NextFrameMS == 0.0 || now - m_NextFrameMS > interval)
+	{
+		m_NextFrameMS = now;
+	}
+	else if (m_NextFrameMS > now)
+	{
+		Core::SleepMS((uint32)(m_NextFrameMS - now));
+	}
+
+	m_NextFrameMS += interval;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <Cam-Core.h>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+enum class CaptureSourceType
+{
+	/// <summary>
+	/// A connected camera.
+	/// </summary>
+	Device = 0,
+
+	/// <summary>
+	/// A recorded video file, which is replayed in a loop.
+	/// </summary>
+	File,
+
+	/// <summary>
+	/// A generated test pattern with a moving object, needs no camera at all.
+	/// </summary>
+	Synthetic
+};
+
+struct CaptureSourceConfig
+{
+	CaptureSourceType Type = CaptureSourceType::Device;
+
+	/// <summary>
+	/// The index of the camera, used by the device source.
+	/// </summary>
+	int32 DeviceIndex = 0;
+
+	/// <summary>
+	/// The video file, used by the file source.
+	/// </summary>
+	std::string FilePath;
+
+	/// <summary>
+	/// Restart the file from the beginning, once its end is reached. Otherwise the source reports a read failure at the end.
+	/// </summary>
+	bool Loop = true;
+
+	/// <summary>
+	/// The frame rate of the file and the synthetic source. 0 delivers frames as fast as they can be produced.
+	/// </summary>
+	float FPS = 30.0f;
+
+	/// <summary>
+	/// The distance in pixels, the synthetic object moves per frame.
+	/// </summary>
+	float MotionSpeed = 8.0f;
+
+	/// <summary>
+	/// The edge length of the synthetic object in pixels.
+	/// </summary>
+	uint32 ObjectSize = 96;
+
+	/// <summary>
+	/// The number of frames, in which the synthetic object moves.
+	/// </summary>
+	uint32 MotionFrames = 90;
+
+	/// <summary>
+	/// The number of frames, in which the synthetic object stands still after it moved. 0 keeps it moving all the time.
+	/// </summary>
+	uint32 StillFrames = 90;
+};
+
+/// <summary>
+/// Delivers the frames, which are captured by the camera. Hides, whether they come from a real camera, a file or are generated.
+/// </summary>
+class CaptureSource
+{
+public:
+
+	virtual ~CaptureSource() {}
+
+	/// <summary>
+	/// Opens the source.
+	/// </summary>
+	/// <param name="width">The requested frame width, 0 uses the width of the source.</param>
+	/// <param name="height">The requested frame height, 0 uses the height of the source.</param>
+	/// <returns>Returns true, if the source could be opened.</returns>
+	virtual bool Open(uint32 width, uint32 height) = 0;
+
+	/// <summary>
+	/// Closes the source, it can be opened again afterwards.
+	/// </summary>
+	virtual void Close() = 0;
+
+	/// <summary>
+	/// Reads the next frame. Blocks until the frame is due, if the source is throttled.
+	/// </summary>
+	/// <param name="frame">Receives the frame. The pixels are written into the existing memory of the Mat, if its size and format match.</param>
+	/// <returns>Returns true, if a frame has been read.</returns>
+	virtual bool Read(cv::Mat &frame) = 0;
+
+	/// <summary>
+	/// Skips the next frame without decoding it.
+	/// </summary>
+	/// <returns>Returns true, if a frame has been skipped.</returns>
+	virtual bool Skip() = 0;
+
+	/// <summary>
+	/// The width of the delivered frames, only valid while the source is open.
+	/// </summary>
+	virtual uint32 GetWidth() const = 0;
+
+	/// <summary>
+	/// The height of the delivered frames, only valid while the source is open.
+	/// </summary>
+	virtual uint32 GetHeight() const = 0;
+
+	/// <summary>
+	/// The OpenCV pixel format of the delivered frames.
+	/// </summary>
+	virtual int32 GetFormat() const { return CV_8UC3; }
+
+	/// <summary>
+	/// Creates the source, which is selected by the config.
+	/// </summary>
+	static CaptureSource *Create(const CaptureSourceConfig &config);
+
+protected:
+
+	/// <summary>
+	/// Waits until the next frame is due. Does nothing, if fps is 0.
+	/// </summary>
+	void Throttle(float fps);
+
+	/// <summary>
+	/// Restarts the frame timing, the next frame is due immediately.
+	/// </summary>
+	void ResetThrottle() { m_NextFrameMS = 0.0; }
+
+private:
+
+	double m_NextFrameMS = 0.0;
+};
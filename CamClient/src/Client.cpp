@@ -1,13 +1,41 @@
 #include "Client.h"
 
+#include <chrono>
 #include <iostream>
+#include <string.h>
 
 #include "Core/Log.h"
 
-#define MAX_NETWORK_READ_RETRIES 200
+// Returns the size of the message at the start of data, 0 if its header is not complete yet, or -1 for an unknown message.
+static int32 GetMessageSize(Byte const *data, uint32 size)
+{
+	if (size < sizeof(header_t))
+	{
+		return 0;
+	}
+
+	header_t const *header = (header_t const *)data;
+	switch (header->Type)
+	{
+		case SERVER_CONNECTION_START:
+			return sizeof(ServerConnectionStartResponse);
+
+		case SERVER_CONNECTION_CLOSE:
+			return sizeof(ServerConnectionCloseResponse);
+
+		case SERVER_FRAME:
+			return sizeof(ServerFrameResponse);
+	}
+
+	CAM_LOG_ERROR("Received unknown message type {}!", header->Type);
+	return -1;
+}
 
 Client::Client(const ClientConfig &config)
-	: m_Config(config), m_Camera(false, 1280, 720)
+	: m_Config(config), m_Camera(config.Capture, false, 1280, 720), m_MotionDetector(config.Motion), m_Encoder(config.Encoder),
+	m_EncodeQueue(ENCODE_QUEUE_CAPACITY, Core::QueueOverflowPolicy::DropOldest),
+	m_DisplayQueue(DISPLAY_QUEUE_CAPACITY, Core::QueueOverflowPolicy::DropOldest),
+	m_SendQueue(SEND_QUEUE_CAPACITY, Core::QueueOverflowPolicy::DropOldest)
 {
 	std::string cwd = "";
 	Core::FileSystem::Get()->GetCurrentWorkingDirectory(&cwd);
@@ -16,6 +44,9 @@ Client::Client(const ClientConfig &config)
 	CAM_LOG_INFO("===================== CONFIG ===================================");
 	CAM_LOG_INFO("IP                    : {}", config.ServerIP);
 	CAM_LOG_INFO("Port                  : {}", config.Port);
+	CAM_LOG_INFO("Motion sensitivity    : {}", config.Motion.Sensitivity);
+	CAM_LOG_INFO("Frame codec           : {0} (quality {1})", (uint32)config.Encoder.Codec, config.Encoder.Quality);
+	CAM_LOG_INFO("Capture source        : {}", GetCaptureSourceName(config.Capture));
 	CAM_LOG_INFO("Current Client version: {}", m_Version);
 	CAM_LOG_INFO("Current CWD           : {}", cwd);
 	CAM_LOG_INFO("================================================================");
@@ -42,14 +73,30 @@ void Client::Release()
 {
 	CAM_LOG_INFO("Releasing all resources.");
 
+	// Each stage stops once the previous one closed its queue, so they are joined in pipeline order.
 	if (m_CameraThread.joinable())
 		m_CameraThread.join();
 
+	if (m_AnalyzeThread.joinable())
+		m_AnalyzeThread.join();
+
+	if (m_EncodeThread.joinable())
+		m_EncodeThread.join();
+
+	if (m_SendThread.joinable())
+		m_SendThread.join();
+
 	if (m_NetworkThread.joinable())
 		m_NetworkThread.join();
 
 	m_Camera.Release();
 
+	if (m_StartMS != 0)
+	{
+		LogPipelineStats();
+		m_StartMS = 0;
+	}
+
 	if (m_Socket)
 	{
 		CAM_LOG_INFO("Releasing socket");
@@ -60,8 +107,19 @@ void Client::Release()
 
 void Client::Run(bool shouldShowFrames)
 {
+	m_ShowFrames = shouldShowFrames;
+	m_StartMS = Core::QueryMS();
+	m_NextStatsMS = m_StartMS + STATS_INTERVAL_MS;
+
+	// Besides the queues, each of the analyze, encode and display stages keeps the frame it works on.
+	uint32 display_frames = m_ShowFrames ? DISPLAY_QUEUE_CAPACITY + 1 : 0;
+	m_Camera.ReserveFrames(ENCODE_QUEUE_CAPACITY + 1 + SEND_QUEUE_CAPACITY + 1 + display_frames);
+
 	m_NetworkThread = std::thread(&Client::NetworkLoop, std::ref(*this));
 	m_CameraThread = std::thread(&Client::CameraLoop, std::ref(*this));
+	m_AnalyzeThread = std::thread(&Client::AnalyzeLoop, std::ref(*this));
+	m_EncodeThread = std::thread(&Client::EncodeLoop, std::ref(*this));
+	m_SendThread = std::thread(&Client::SendLoop, std::ref(*this));
 
 	if (shouldShowFrames)
 	{
@@ -69,15 +127,12 @@ void Client::Run(bool shouldShowFrames)
 	}
 	else
 	{
-		while (m_Running)
-		{
-		}
+		Process();
 	}
 
-	// wait until the network thread is finished
-	while (!m_NetworkThreadFinished)
-	{
-	}
+	// The network thread finishes, once the server confirmed the close request or the connection failed.
+	if (m_NetworkThread.joinable())
+		m_NetworkThread.join();
 }
 
 void Client::NetworkLoop()
@@ -88,104 +143,152 @@ void Client::NetworkLoop()
 	msg.Header.Version = m_Version;
 	msg.FrameName = "Client #1";
 	msg.FPS = 30;
-	m_Socket->Send(&msg, sizeof(msg), m_Host);
 
-	while (true)
 	{
-		static Byte BUF[65536];
-		static uint32 current_connection_retry = 0;
+		std::lock_guard<std::mutex> lock(m_SendMutex);
+		m_Socket->Send(&msg, sizeof(msg), m_Host);
+	}
+
+	m_ReceiveBuffer.resize(RECEIVE_BUFFER_SIZE);
+	m_ReceivedBytes = 0;
 
-		if (!m_Running && !m_SentConnectionCloseRequest)
+	int64 connect_start_ms = Core::QueryMS();
+	while (true)
+	{
+		// Covers a connection, which was accepted only after the send stage finished.
+		if (m_SendStageFinished)
 		{
-			// send request to server, that we want to close the connection
-			CAM_LOG_DEBUG("Sending connection close request to server...");
-			ClientConnectionCloseMessage close_msg = {};
-			close_msg.Header.Type = CLIENT_CONNECTION_CLOSE;
-			close_msg.Header.Version = m_Version;
-			m_Socket->Send(&close_msg, sizeof(close_msg), m_Host);
-			m_SentConnectionCloseRequest = true;
+			SendConnectionCloseRequest();
 		}
 
-		Core::addr_t addr;
-		int32 len = m_Socket->Recv(BUF, sizeof(BUF), &addr);
-		if (len < 0)
+		int64 now_ms = Core::QueryMS();
+		if (!m_ConnectedToServer)
 		{
-			++current_connection_retry;
-			if (current_connection_retry >= MAX_NETWORK_READ_RETRIES && !m_ConnectedToServer)
+			if (!m_Running)
 			{
-				CAM_LOG_ERROR("Fatal error: Could not connect to server!");
-				m_Running = false;
-				m_NetworkThreadFinished = true;
-				return;
+				CAM_LOG_INFO("Stopped before the server accepted the connection.");
+				break;
 			}
-			else if (current_connection_retry >= 100 * MAX_NETWORK_READ_RETRIES && m_ConnectedToServer)
+
+			if (now_ms - connect_start_ms >= CONNECT_TIMEOUT_MS)
 			{
-				CAM_LOG_ERROR("Fatal error: Lost connection to server!");
-				m_Running = false;
-				m_NetworkThreadFinished = true;
-				return;
+				CAM_LOG_ERROR("Fatal error: Could not connect to server!");
+				break;
 			}
-
-			CAM_LOG_ERROR("Failed to receive data from network layer!");
-			continue;
 		}
-		else
+		else if (m_CloseRequestMS != 0 && now_ms - m_CloseRequestMS >= CLOSE_TIMEOUT_MS)
 		{
-			current_connection_retry = 0;
+			CAM_LOG_ERROR("The server did not confirm the connection close request, closing the connection anyway.");
+			break;
 		}
 
-		// ignore all messages from unknown senders
-		if (addr.Value != m_Host.Value)
+		// Sleeps until the server sends something, wakes up regularly to check the timeouts above.
+		if (!m_Socket->Wait(NETWORK_WAIT_TIMEOUT_MS))
 		{
-			CAM_LOG_ERROR("Unknown sender!");
 			continue;
 		}
 
-		if (len < sizeof(header_t))
+		// The server answers every frame, so a single read may contain several responses or only a part of one.
+		Core::addr_t addr;
+		int32 len = m_Socket->Recv(&m_ReceiveBuffer[m_ReceivedBytes], (int32)(m_ReceiveBuffer.size() - m_ReceivedBytes), &addr);
+		if (len == 0)
 		{
-			CAM_LOG_ERROR("Unexpected header size!");
-			continue;
+			CAM_LOG_ERROR("Fatal error: Lost connection to server!");
+			break;
 		}
 
-		header_t *header = (header_t *)BUF;
-
-		if (header->Version != m_Version)
+		if (len < 0)
 		{
-			CAM_LOG_ERROR("Unexpected version encountered.");
+			CAM_LOG_ERROR("Failed to receive data from network layer!");
 			continue;
+		}
 
+		// ignore all messages from unknown senders
+		if (addr.Value != m_Host.Value)
+		{
+			CAM_LOG_ERROR("Unknown sender!");
+			continue;
 		}
 
-		bool message_success = false;
-		switch (header->Type)
+		m_ReceivedBytes += len;
+
+		// Only complete messages are dispatched, the rest stays in the buffer until the next read.
+		bool keep_running = true;
+		uint32 offset = 0;
+		while (keep_running)
 		{
-			case SERVER_CONNECTION_START:
-				message_success = OnConnectionAccepted(BUF, len);
+			uint32 available = m_ReceivedBytes - offset;
+			int32 message_size = GetMessageSize(&m_ReceiveBuffer[offset], available);
+			if (message_size < 0)
+			{
+				keep_running = false;
 				break;
+			}
 
-			case SERVER_CONNECTION_CLOSE:
-				message_success = OnConnectionClosed(BUF, len);
+			if (message_size == 0 || available < (uint32)message_size)
+			{
 				break;
+			}
 
-			case SERVER_FRAME:
-				message_success = OnFrameResponse(BUF, len);
-				break;
+			keep_running = OnMessage(&m_ReceiveBuffer[offset], (uint32)message_size);
+			offset += (uint32)message_size;
 		}
 
-		if (!message_success)
+		if (offset > 0)
 		{
-			CAM_LOG_ERROR("Specific message handler failed. Aborting.");
-			break;
+			memmove(m_ReceiveBuffer.data(), &m_ReceiveBuffer[offset], m_ReceivedBytes - offset);
+			m_ReceivedBytes -= offset;
 		}
 
-		// If we handled the server connecection close request successfully, quit from the network thread.
-		if (header->Type == SERVER_CONNECTION_CLOSE && message_success)
+		if (!keep_running)
 		{
-			m_NetworkThreadFinished = true;
-			CAM_LOG_INFO("We got the connection close response from the server and it was successful. Closing Connection.");
 			break;
 		}
 	}
+
+	// Without a connection the pipeline has nothing to do anymore.
+	Stop();
+}
+
+bool Client::OnMessage(Byte *message, uint32 length)
+{
+	header_t *header = (header_t *)message;
+	if (header->Version != m_Version)
+	{
+		CAM_LOG_ERROR("Unexpected version encountered.");
+		return true;
+	}
+
+	bool message_success = false;
+	switch (header->Type)
+	{
+		case SERVER_CONNECTION_START:
+			message_success = OnConnectionAccepted(message, length);
+			break;
+
+		case SERVER_CONNECTION_CLOSE:
+			message_success = OnConnectionClosed(message, length);
+			break;
+
+		case SERVER_FRAME:
+			message_success = OnFrameResponse(message, length);
+			break;
+	}
+
+	if (!message_success)
+	{
+		CAM_LOG_ERROR("Specific message handler failed. Aborting.");
+		return false;
+	}
+
+	// If we handled the server connecection close request successfully, quit from the network thread.
+	if (header->Type == SERVER_CONNECTION_CLOSE)
+	{
+		CAM_LOG_INFO("We got the connection close response from the server and it was successful. Closing Connection.");
+		return false;
+	}
+
+	return true;
 }
 
 void Client::CameraLoop()
@@ -194,40 +297,196 @@ void Client::CameraLoop()
 	{
 		if (!m_Camera.IsRunning())
 		{
-			m_Running = false;
+			Stop();
 			break;
 		}
 
-		m_Camera.GenerateFrames();
+		int64 start_us = Core::QueryUS();
+		if (m_Camera.GenerateFrames())
+		{
+			int64 end_us = Core::QueryUS();
+			m_CaptureStats.Record(start_us, end_us, end_us);
+		}
 	}
 }
 
+void Client::AnalyzeLoop()
+{
+	// The frame is reused, so that the previous frame goes back to the pool when the next one is taken.
+	CameraFrame frame;
+	while (m_Running)
+	{
+		if (!m_Camera.GetCurrentFrame(&frame))
+		{
+			if (m_Camera.IsRunning())
+			{
+				CAM_LOG_ERROR("Could not read image from camera!");
+			}
+
+			continue;
+		}
+
+		int64 start_us = Core::QueryUS();
+		bool motion = ProcessFrame(frame);
+
+		// The following stages only get another reference to the pooled frame, the pixels are not copied.
+		if (m_ShowFrames)
+		{
+			m_DisplayQueue.Push(frame);
+		}
+
+		// Only frames with movement are sent to the server.
+		if (motion)
+		{
+			m_EncodeQueue.Push(frame);
+		}
+
+		m_AnalyzeStats.Record(start_us, Core::QueryUS(), frame.CaptureUS);
+	}
+
+	// The following stages finish their queued frames and stop afterwards.
+	m_EncodeQueue.Close();
+	m_DisplayQueue.Close();
+}
+
+void Client::EncodeLoop()
+{
+	CameraFrame frame;
+	EncodedFrame encoded;
+	while (m_EncodeQueue.Pop(frame))
+	{
+		int64 start_us = Core::QueryUS();
+		if (EncodeFrame(frame, &encoded))
+		{
+			m_SendQueue.Push(std::move(encoded));
+		}
+
+		m_EncodeStats.Record(start_us, Core::QueryUS(), frame.CaptureUS);
+	}
+
+	m_SendQueue.Close();
+}
+
+void Client::SendLoop()
+{
+	EncodedFrame encoded;
+	while (m_SendQueue.Pop(encoded))
+	{
+		int64 start_us = Core::QueryUS();
+		SendFrameToServer(encoded);
+		m_SendStats.Record(start_us, Core::QueryUS(), encoded.CaptureUS);
+	}
+
+	// The close request is sent after the last frame, so that it can not overtake any of them.
+	m_SendStageFinished = true;
+	SendConnectionCloseRequest();
+}
+
 void Client::Show()
 {
+	CameraFrame frame;
 	while (m_Running)
 	{
-		if (!m_Camera.IsRunning())
+		if (m_DisplayQueue.Pop(frame, Camera::FRAME_WAIT_TIMEOUT_MS))
 		{
-			m_Running = false;
-			break;
+			int64 start_us = Core::QueryUS();
+			m_Camera.Show(frame);
+			m_DisplayStats.Record(start_us, Core::QueryUS(), frame.CaptureUS);
 		}
 
-		uint32 frame_size = 0;
-		uint32 frame_width = 0;
-		uint32 frame_height = 0;
-		Byte *frame = m_Camera.ShowLive(&frame_size, &frame_width, &frame_height);
+		LogStatsPeriodically();
+	}
+}
 
-		if (!frame)
+void Client::Process()
+{
+	std::unique_lock<std::mutex> lock(m_StateMutex);
+	while (m_Running)
+	{
+		int64 wait_ms = m_NextStatsMS - Core::QueryMS();
+		if (wait_ms > 0 && m_StateChanged.wait_for(lock, std::chrono::milliseconds(wait_ms), [this]() { return !m_Running; }))
 		{
-			CAM_LOG_ERROR("Could not read image from camera!");
-			continue;
+			break;
 		}
 
-		ProcessFrame(frame, frame_size, frame_width, frame_height);
-		SendFrameToServer(frame, frame_size, frame_width, frame_height);
+		lock.unlock();
+		LogStatsPeriodically();
+		lock.lock();
+	}
+}
+
+void Client::Stop()
+{
+	std::lock_guard<std::mutex> lock(m_StateMutex);
+	m_Running = false;
+	m_StateChanged.notify_all();
+}
 
-		delete[] frame;
+void Client::SendConnectionCloseRequest()
+{
+	if (!m_ConnectedToServer || m_SentConnectionCloseRequest.exchange(true))
+	{
+		return;
+	}
+
+	// send request to server, that we want to close the connection
+	CAM_LOG_DEBUG("Sending connection close request to server...");
+	ClientConnectionCloseMessage close_msg = {};
+	close_msg.Header.Type = CLIENT_CONNECTION_CLOSE;
+	close_msg.Header.Version = m_Version;
+
+	{
+		std::lock_guard<std::mutex> lock(m_SendMutex);
+		m_Socket->Send(&close_msg, sizeof(close_msg), m_Host);
 	}
+
+	m_CloseRequestMS = Core::QueryMS();
+}
+
+void Client::LogStatsPeriodically()
+{
+	int64 now = Core::QueryMS();
+	if (now < m_NextStatsMS)
+	{
+		return;
+	}
+
+	m_NextStatsMS = now + STATS_INTERVAL_MS;
+	LogPipelineStats();
+}
+
+void Client::LogPipelineStats()
+{
+	double seconds = (double)(Core::QueryMS() - m_StartMS) / 1000.0;
+
+	Core::QueueStats camera_queue = m_Camera.GetQueueStats();
+	CAM_LOG_INFO("Pipeline after {0:.1f} s, {1} frames skipped because all camera frames were in use:", seconds, m_Camera.GetSkippedFrameCount());
+
+	LogStageStats("capture", m_CaptureStats, {}, seconds);
+	LogStageStats("analyze", m_AnalyzeStats, camera_queue, seconds);
+	LogStageStats("encode", m_EncodeStats, m_EncodeQueue.GetStats(), seconds);
+	LogStageStats("send", m_SendStats, m_SendQueue.GetStats(), seconds);
+
+	if (m_ShowFrames)
+	{
+		LogStageStats("display", m_DisplayStats, m_DisplayQueue.GetStats(), seconds);
+	}
+}
+
+void Client::LogStageStats(const char *name, const StageStats &stats, const Core::QueueStats &input, double seconds)
+{
+	double fps = seconds > 0.0 ? (double)stats.GetFrameCount() / seconds : 0.0;
+
+	if (input.Capacity == 0)
+	{
+		CAM_LOG_INFO("  {0:<8} {1} frames ({2:.1f} fps), {3:.2f} ms avg, {4:.2f} ms max",
+			name, stats.GetFrameCount(), fps, stats.GetAverageMS(), stats.GetMaxMS());
+		return;
+	}
+
+	CAM_LOG_INFO("  {0:<8} {1} frames ({2:.1f} fps), {3:.2f} ms avg, {4:.2f} ms max, {5:.2f} ms since capture, queue {6}/{7} (max {8}, {9} dropped)",
+		name, stats.GetFrameCount(), fps, stats.GetAverageMS(), stats.GetMaxMS(), stats.GetAverageLatencyMS(),
+		input.Size, input.Capacity, input.HighWatermark, input.Dropped);
 }
 
 bool Client::OnConnectionAccepted(Byte *message, uint32 length)
@@ -294,27 +553,103 @@ bool Client::OnFrameResponse(Byte *message, uint32 length)
 	return true;
 }
 
-void Client::ProcessFrame(Byte *frame, uint32 frame_size, uint32 frame_width, uint32 frame_height)
+bool Client::ProcessFrame(const CameraFrame &frame)
 {
-	// TODO
+	if (frame.GetSize() != frame.Width * frame.Height * CV_ELEM_SIZE(frame.Format))
+	{
+		CAM_LOG_ERROR("Frame size {0} does not match {1}x{2} pixels!", frame.GetSize(), frame.Width, frame.Height);
+		return false;
+	}
+
+	bool had_motion = m_MotionDetector.HasMotion();
+	cv::Mat image = frame.ToMat();
+	bool motion = m_MotionDetector.Process(image);
+
+	if (motion != had_motion)
+	{
+		CAM_LOG_INFO("Motion {0} ({1:.2f}% of the image changed).", motion ? "started" : "stopped", m_MotionDetector.GetChangedRatio() * 100.0f);
+	}
+
+	return motion;
 }
 
-void Client::SendFrameToServer(Byte *frame, uint32 frame_size, uint32 frame_width, uint32 frame_height)
+bool Client::EncodeFrame(const CameraFrame &frame, EncodedFrame *out_encoded)
 {
+	cv::Mat image = frame.ToMat();
+
+	Byte *encoded = nullptr;
+	uint32 encoded_size = 0;
+	if (!m_Encoder.Encode(image, &encoded, &encoded_size))
+	{
+		CAM_LOG_ERROR("Could not encode frame, skipping it.");
+		return false;
+	}
+
+	if (m_Encoder.GetCodec() == FRAME_CODEC_RAW)
+	{
+		// Raw frames are sent straight from the pooled camera buffer.
+		out_encoded->Data = frame.Buffer;
+	}
+	else
+	{
+		// The encoder reuses its output buffer for the next frame, the send stage needs its own copy.
+		out_encoded->Data = m_EncodedPool.Acquire(encoded_size);
+		memcpy(out_encoded->Data.Data(), encoded, encoded_size);
+	}
+
+	out_encoded->Width = frame.Width;
+	out_encoded->Height = frame.Height;
+	out_encoded->Format = frame.Format;
+	out_encoded->Codec = m_Encoder.GetCodec();
+	out_encoded->Quality = (uint16)m_Encoder.GetQuality();
+	out_encoded->RawSize = frame.GetSize();
+	out_encoded->CaptureUS = frame.CaptureUS;
+	return true;
+}
+
+void Client::SendFrameToServer(const EncodedFrame &frame)
+{
+	uint32 encoded_size = (uint32)frame.Data.Size();
+
 	ClientFrameMessage msg = {};
 	msg.Header.Type = CLIENT_FRAME;
 	msg.Header.Version = m_Version;
 	msg.Frame = {};
-	msg.Frame.FrameSize = frame_size;
-	msg.Frame.FrameWidth = frame_width;
-	msg.Frame.FrameHeight = frame_height;
-	msg.Frame.Format = m_Camera.GetFormat();
+	msg.Frame.FrameSize = encoded_size;
+	msg.Frame.FrameWidth = frame.Width;
+	msg.Frame.FrameHeight = frame.Height;
+	msg.Frame.Format = frame.Format;
+	msg.Frame.Codec = frame.Codec;
+	msg.Frame.Quality = frame.Quality;
+
+	// Header and frame data go out in a single gather write.
+	Core::io_buffer_t buffers[] = {
+		{ &msg, sizeof(msg) },
+		{ frame.Data.Data(), encoded_size }
+	};
+
+	int32 bytesSent = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_SendMutex);
+		bytesSent = m_Socket->SendBulk(buffers, 2, m_Host);
+	}
+
+	CAM_LOG_DEBUG("Sending frame with {0} bytes ({1} bytes raw). Actual message size: {2}", sizeof(msg) + encoded_size, frame.RawSize, bytesSent);
+}
+
+const char *Client::GetCaptureSourceName(const CaptureSourceConfig &config)
+{
+	switch (config.Type)
+	{
+		case CaptureSourceType::File:
+			return config.FilePath.c_str();
 
-	int32 bytesSent = m_Socket->Send(&msg, sizeof(msg), m_Host);
-	CAM_LOG_INFO("Sending frame with {0} bytes. Actual message size: {1}", sizeof(msg), bytesSent);
+		case CaptureSourceType::Synthetic:
+			return "synthetic";
 
-	//std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		case CaptureSourceType::Device:
+			break;
+	}
 
-	bytesSent = m_Socket->SendLarge(frame, frame_size, m_Host);
-	CAM_LOG_INFO("Sending frame data with {0} bytes. Actual message size: {1}", frame_size, bytesSent);
+	return "camera";
 }
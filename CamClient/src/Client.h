@@ -1,17 +1,53 @@
 #pragma once
 
 #include <Cam-Core.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
 #include "Camera.h"
+#include "FrameEncoder.h"
 #include "Messages.h"
+#include "MotionDetector.h"
+#include "StageStats.h"
 
 struct ClientConfig
 {
 	std::string ServerIP;
 	uint16 Port;
+	MotionDetectorConfig Motion;
+	FrameEncoderConfig Encoder;
+	CaptureSourceConfig Capture;
+};
+
+/// <summary>
+/// A frame, which has been encoded and waits to be sent to the server.
+/// </summary>
+struct EncodedFrame
+{
+	/// <summary>
+	/// The encoded bytes. For raw frames this is the pooled buffer of the camera frame itself.
+	/// </summary>
+	Core::BufferRef Data;
+
+	uint32 Width = 0;
+	uint32 Height = 0;
+	int32 Format = 0;
+	FrameCodec Codec = FRAME_CODEC_RAW;
+	uint16 Quality = 0;
+
+	/// <summary>
+	/// The size of the frame before it was encoded.
+	/// </summary>
+	uint32 RawSize = 0;
+
+	/// <summary>
+	/// The time in microseconds, at which the frame has been captured.
+	/// </summary>
+	int64 CaptureUS = 0;
 };
 
 class Client
@@ -44,17 +80,76 @@ public:
 	void NetworkLoop();
 
 	/// <summary>
-	/// Handles receiving the frames from the connected camera.
+	/// Capture stage: handles receiving the frames from the connected camera.
 	/// </summary>
 	void CameraLoop();
 
 	/// <summary>
-	/// Shows all current frames of the camera.
+	/// Analyze stage: runs the motion detection on all captured frames, passes the ones with movement to the encode stage
+	/// and all of them to the display, if it is shown.
+	/// </summary>
+	void AnalyzeLoop();
+
+	/// <summary>
+	/// Encode stage: compresses the frames with movement with the configured codec.
+	/// </summary>
+	void EncodeLoop();
+
+	/// <summary>
+	/// Send stage: sends the encoded frames to the server.
+	/// </summary>
+	void SendLoop();
+
+	/// <summary>
+	/// Shows all analyzed frames on the main thread, until the client stops.
 	/// </summary>
 	void Show();
 
+	/// <summary>
+	/// Waits on the main thread without showing the frames, until the client stops.
+	/// </summary>
+	void Process();
+
 private:
 
+	/// <summary>
+	/// Stops all worker threads and wakes up the main thread, if it waits in Process.
+	/// </summary>
+	void Stop();
+
+	/// <summary>
+	/// Sends the connection close request to the server, once the client is connected and the send stage sent its last frame.
+	/// Does nothing, if the request has already been sent.
+	/// </summary>
+	void SendConnectionCloseRequest();
+
+	/// <summary>
+	/// Logs the statistics of all pipeline stages, if STATS_INTERVAL_MS passed since they were logged the last time.
+	/// </summary>
+	void LogStatsPeriodically();
+
+	/// <summary>
+	/// Logs the frame count, the processing time and the input queue of all pipeline stages.
+	/// </summary>
+	void LogPipelineStats();
+
+	/// <summary>
+	/// Logs the statistics of a single pipeline stage.
+	/// </summary>
+	/// <param name="name">The name of the stage.</param>
+	/// <param name="stats">The counters of the stage.</param>
+	/// <param name="input">The counters of the queue, from which the stage takes its frames.</param>
+	/// <param name="seconds">The time the pipeline is running.</param>
+	static void LogStageStats(const char *name, const StageStats &stats, const Core::QueueStats &input, double seconds);
+
+	/// <summary>
+	/// Dispatches a complete message from the server to its handler.
+	/// </summary>
+	/// <param name="message">The message received from the server.</param>
+	/// <param name="length">The length of the message in bytes.</param>
+	/// <returns>Returns false, if the network thread should stop, because a handler failed or the connection has been closed.</returns>
+	bool OnMessage(Byte *message, uint32 length);
+
 	/// <summary>
 	/// Handles the connection begin response from the server.
 	/// </summary>
@@ -83,35 +178,109 @@ private:
 	/// Processes the frame data (image analytics).
 	/// </summary>
 	/// <param name="frame">The frame to analyze.</param>
-	/// <param name="frame_size">The size of the frame in bytes.</param>
-	/// <param name="frame_width">The frame width.</param>
-	/// <param name="frame_height">The frame height.</param>
-	void ProcessFrame(Byte *frame, uint32 frame_size, uint32 frame_width, uint32 frame_height);
+	/// <returns>Returns true, if movement was detected and the frame should be sent to the server.</returns>
+	bool ProcessFrame(const CameraFrame &frame);
 
 	/// <summary>
-	/// Sends the provided frame data to the connected server.
+	/// Encodes the provided frame data with the configured codec.
+	/// </summary>
+	/// <param name="frame">The frame to encode.</param>
+	/// <param name="out_encoded">The encoded frame, which keeps its own reference to the encoded bytes.</param>
+	/// <returns>Returns true, if the frame has been encoded successfully.</returns>
+	bool EncodeFrame(const CameraFrame &frame, EncodedFrame *out_encoded);
+
+	/// <summary>
+	/// Sends the encoded frame to the connected server.
 	/// </summary>
 	/// <param name="frame">The frame to send to the server.</param>
-	/// <param name="frame_size">The size of the frame in bytes.</param>
-	/// <param name="frame_width">The frame width.</param>
-	/// <param name="frame_height">The frame height.</param>
-	void SendFrameToServer(Byte *frame, uint32 frame_size, uint32 frame_width, uint32 frame_height);
+	void SendFrameToServer(const EncodedFrame &frame);
+
+	/// <summary>
+	/// Returns a readable name of the capture source for the log.
+	/// </summary>
+	static const char *GetCaptureSourceName(const CaptureSourceConfig &config);
+
+public:
+
+	/// <summary>
+	/// The capacities of the queues between the pipeline stages. Each queue drops its oldest frame, if the next stage can not keep up.
+	/// </summary>
+	static constexpr uint32 ENCODE_QUEUE_CAPACITY = 4;
+	static constexpr uint32 SEND_QUEUE_CAPACITY = 4;
+	static constexpr uint32 DISPLAY_QUEUE_CAPACITY = 2;
+
+	/// <summary>
+	/// The interval, in which the pipeline statistics are logged.
+	/// </summary>
+	static constexpr int64 STATS_INTERVAL_MS = 10000;
+
+	/// <summary>
+	/// The time, the client waits for the server to accept the connection.
+	/// </summary>
+	static constexpr int64 CONNECT_TIMEOUT_MS = 5000;
+
+	/// <summary>
+	/// The time, the client waits for the server to confirm the connection close request.
+	/// </summary>
+	static constexpr int64 CLOSE_TIMEOUT_MS = 2000;
+
+	/// <summary>
+	/// The longest time, the network thread waits for a message before it checks, if the client stopped.
+	/// </summary>
+	static constexpr int32 NETWORK_WAIT_TIMEOUT_MS = 500;
+
+	/// <summary>
+	/// The size of the buffer, in which the responses of the server are reassembled.
+	/// </summary>
+	static constexpr uint32 RECEIVE_BUFFER_SIZE = 65536;
 
 private:
 
 	ClientConfig m_Config;
 	Core::Socket *m_Socket = nullptr;
 	Core::addr_t m_Host;
+
+	// Frames and control messages are sent from different threads, a message must not be interleaved with another one.
+	std::mutex m_SendMutex;
+
+	// Holds the bytes of the server stream, which do not form a complete message yet.
+	std::vector<Byte> m_ReceiveBuffer;
+	uint32 m_ReceivedBytes = 0;
 	
 	uint32 m_Version;
-	bool m_Running = true;
-	bool m_NetworkThreadFinished = false;
-	bool m_SentConnectionCloseRequest = false;
-	bool m_ConnectedToServer = false;
+	std::atomic<bool> m_Running = true;
+	std::atomic<bool> m_SendStageFinished = false;
+	std::atomic<bool> m_SentConnectionCloseRequest = false;
+	std::atomic<bool> m_ConnectedToServer = false;
+	std::atomic<int64> m_CloseRequestMS = 0;
+	bool m_ShowFrames = true;
+
+	// Process sleeps on m_StateChanged, until the next statistics are due or Stop is called.
+	std::mutex m_StateMutex;
+	std::condition_variable m_StateChanged;
 	Camera m_Camera;
+	MotionDetector m_MotionDetector;
+	FrameEncoder m_Encoder;
+
+	// The queues between the stages hold frames of the camera pool and of the encoded pool, so they are declared after both pools.
+	Core::BufferPool m_EncodedPool;
+	Core::SPSCQueue<CameraFrame> m_EncodeQueue;
+	Core::SPSCQueue<CameraFrame> m_DisplayQueue;
+	Core::SPSCQueue<EncodedFrame> m_SendQueue;
+
+	StageStats m_CaptureStats;
+	StageStats m_AnalyzeStats;
+	StageStats m_EncodeStats;
+	StageStats m_SendStats;
+	StageStats m_DisplayStats;
+	int64 m_StartMS = 0;
+	int64 m_NextStatsMS = 0;
 
 	std::thread m_NetworkThread;
 	std::thread m_CameraThread;
+	std::thread m_AnalyzeThread;
+	std::thread m_EncodeThread;
+	std::thread m_SendThread;
 
 	std::vector<FrameData> m_Frames;
 };
\ No newline at end of file
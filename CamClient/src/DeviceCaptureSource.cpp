@@ -0,0 +1,50 @@
+#include "DeviceCaptureSource.h"
+
+#include <thread>
+
+DeviceCaptureSource::DeviceCaptureSource(const CaptureSourceConfig &config)
+	: m_DeviceIndex(config.DeviceIndex)
+{
+}
+
+DeviceCaptureSource::~DeviceCaptureSource()
+{
+	Close();
+}
+
+bool DeviceCaptureSource::Open(uint32 width, uint32 height)
+{
+	if (!m_Capture.open(m_DeviceIndex))
+	{
+		return false;
+	}
+
+	if (width != 0 && height != 0)
+	{
+		m_Capture.set(cv::CAP_PROP_FRAME_WIDTH, (double)width);
+		m_Capture.set(cv::CAP_PROP_FRAME_HEIGHT, (double)height);
+	}
+
+	// The camera may not support the requested resolution, use the one it actually delivers.
+	m_Width = (uint32)m_Capture.get(cv::CAP_PROP_FRAME_WIDTH);
+	m_Height = (uint32)m_Capture.get(cv::CAP_PROP_FRAME_HEIGHT);
+
+	// Give the sensor time to adjust its exposure.
+	std::this_thread::sleep_for(std::chrono::seconds(2));
+	return true;
+}
+
+void DeviceCaptureSource::Close()
+{
+	m_Capture.release();
+}
+
+bool DeviceCaptureSource::Read(cv::Mat &frame)
+{
+	return m_Capture.read(frame);
+}
+
+bool DeviceCaptureSource::Skip()
+{
+	return m_Capture.grab();
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "CaptureSource.h"
+
+/// <summary>
+/// Captures the frames of a connected camera.
+/// </summary>
+class DeviceCaptureSource : public CaptureSource
+{
+public:
+
+	DeviceCaptureSource(const CaptureSourceConfig &config);
+	~DeviceCaptureSource();
+
+	virtual bool Open(uint32 width, uint32 height) override;
+	virtual void Close() override;
+
+	virtual bool Read(cv::Mat &frame) override;
+	virtual bool Skip() override;
+
+	virtual uint32 GetWidth() const override { return m_Width; }
+	virtual uint32 GetHeight() const override { return m_Height; }
+
+private:
+
+	int32 m_DeviceIndex = 0;
+	uint32 m_Width = 0;
+	uint32 m_Height = 0;
+
+	cv::VideoCapture m_Capture;
+};
@@ -0,0 +1,92 @@
+#include "FileCaptureSource.h"
+
+FileCaptureSource::FileCaptureSource(const CaptureSourceConfig &config)
+	: m_FilePath(config.FilePath), m_Loop(config.Loop), m_FPS(config.FPS)
+{
+}
+
+FileCaptureSource::~FileCaptureSource()
+{
+	Close();
+}
+
+bool FileCaptureSource::Open(uint32 width, uint32 height)
+{
+	if (!m_Capture.open(m_FilePath))
+	{
+		return false;
+	}
+
+	uint32 file_width = (uint32)m_Capture.get(cv::CAP_PROP_FRAME_WIDTH);
+	uint32 file_height = (uint32)m_Capture.get(cv::CAP_PROP_FRAME_HEIGHT);
+
+	if (width != 0 && height != 0)
+	{
+		m_Width = width;
+		m_Height = height;
+	}
+	else
+	{
+		m_Width = file_width;
+		m_Height = file_height;
+	}
+
+	m_Resize = m_Width != file_width || m_Height != file_height;
+	ResetThrottle();
+	return true;
+}
+
+void FileCaptureSource::Close()
+{
+	m_Capture.release();
+}
+
+bool FileCaptureSource::Read(cv::Mat &frame)
+{
+	Throttle(m_FPS);
+
+	if (!m_Resize)
+	{
+		return ReadNext(frame);
+	}
+
+	if (!ReadNext(m_Decoded))
+	{
+		return false;
+	}
+
+	cv::resize(m_Decoded, frame, cv::Size((int32)m_Width, (int32)m_Height), 0.0, 0.0, cv::INTER_AREA);
+	return true;
+}
+
+bool FileCaptureSource::Skip()
+{
+	Throttle(m_FPS);
+
+	if (m_Capture.grab())
+	{
+		return true;
+	}
+
+	if (!m_Loop || !m_Capture.set(cv::CAP_PROP_POS_FRAMES, 0.0))
+	{
+		return false;
+	}
+
+	return m_Capture.grab();
+}
+
+bool FileCaptureSource::ReadNext(cv::Mat &frame)
+{
+	if (m_Capture.read(frame))
+	{
+		return true;
+	}
+
+	if (!m_Loop || !m_Capture.set(cv::CAP_PROP_POS_FRAMES, 0.0))
+	{
+		return false;
+	}
+
+	return m_Capture.read(frame);
+}
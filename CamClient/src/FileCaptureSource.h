@@ -0,0 +1,47 @@
+#pragma once
+
+#include "CaptureSource.h"
+
+/// <summary>
+/// Replays a recorded video file at a fixed frame rate or as fast as it can be decoded.
+/// </summary>
+class FileCaptureSource : public CaptureSource
+{
+public:
+
+	FileCaptureSource(const CaptureSourceConfig &config);
+	~FileCaptureSource();
+
+	virtual bool Open(uint32 width, uint32 height) override;
+	virtual void Close() override;
+
+	virtual bool Read(cv::Mat &frame) override;
+	virtual bool Skip() override;
+
+	virtual uint32 GetWidth() const override { return m_Width; }
+	virtual uint32 GetHeight() const override { return m_Height; }
+
+private:
+
+	/// <summary>
+	/// Reads the next frame of the file and restarts the file at its end, if looping is enabled.
+	/// </summary>
+	bool ReadNext(cv::Mat &frame);
+
+private:
+
+	std::string m_FilePath;
+	bool m_Loop = true;
+	float m_FPS = 0.0f;
+
+	uint32 m_Width = 0;
+	uint32 m_Height = 0;
+
+	// Set, if the file has another resolution than the requested one.
+	bool m_Resize = false;
+
+	cv::VideoCapture m_Capture;
+
+	// Decoded frame before it is resized, kept across frames.
+	cv::Mat m_Decoded;
+};
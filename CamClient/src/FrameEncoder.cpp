@@ -0,0 +1,96 @@
+#include "FrameEncoder.h"
+
+#include "Core/Log.h"
+
+static const char *GetCodecExtension(FrameCodec codec)
+{
+	switch (codec)
+	{
+		// Raw frames are sent as they are, without an extension or encoder parameters.
+		case FRAME_CODEC_RAW:
+			return nullptr;
+
+		case FRAME_CODEC_JPEG:
+			return ".jpg";
+
+		case FRAME_CODEC_PNG:
+			return ".png";
+
+		case FRAME_CODEC_WEBP:
+			return ".webp";
+	}
+
+	return nullptr;
+}
+
+FrameEncoder::FrameEncoder(const FrameEncoderConfig &config)
+{
+	SetConfig(config);
+}
+
+FrameEncoder::~FrameEncoder()
+{
+}
+
+bool FrameEncoder::Encode(const cv::Mat &frame, Byte **out_data, uint32 *out_size)
+{
+	if (!out_data || !out_size || frame.empty())
+	{
+		return false;
+	}
+
+	if (m_Config.Codec == FRAME_CODEC_RAW)
+	{
+		if (!frame.isContinuous())
+		{
+			CAM_LOG_ERROR("Raw frames must be continuous in memory!");
+			return false;
+		}
+
+		*out_data = frame.data;
+		*out_size = (uint32)(frame.total() * frame.elemSize());
+		return true;
+	}
+
+	const char *extension = GetCodecExtension(m_Config.Codec);
+	if (!extension)
+	{
+		CAM_LOG_ERROR("Unknown frame codec {}!", (uint32)m_Config.Codec);
+		return false;
+	}
+
+	// imencode only resizes the buffer, so its capacity is reused across frames.
+	if (!cv::imencode(extension, frame, m_Buffer, m_Params))
+	{
+		CAM_LOG_ERROR("Could not encode frame with {0}x{1} pixels!", frame.cols, frame.rows);
+		return false;
+	}
+
+	*out_data = m_Buffer.data();
+	*out_size = (uint32)m_Buffer.size();
+	return true;
+}
+
+void FrameEncoder::SetConfig(const FrameEncoderConfig &config)
+{
+	m_Config = config;
+	m_Params.clear();
+
+	switch (m_Config.Codec)
+	{
+		case FRAME_CODEC_RAW:
+			break;
+
+		case FRAME_CODEC_JPEG:
+			m_Params = { cv::IMWRITE_JPEG_QUALITY, m_Config.Quality };
+			break;
+
+		case FRAME_CODEC_PNG:
+			m_Params = { cv::IMWRITE_PNG_COMPRESSION, m_Config.Quality };
+			break;
+
+		case FRAME_CODEC_WEBP:
+			m_Params = { cv::IMWRITE_WEBP_QUALITY, m_Config.Quality };
+			break;
+	}
+}
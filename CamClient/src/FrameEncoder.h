@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Cam-Core.h>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "Messages.h"
+
+struct FrameEncoderConfig
+{
+	/// <summary>
+	/// The codec, which is used to compress each frame before it is sent to the server.
+	/// </summary>
+	FrameCodec Codec = FRAME_CODEC_JPEG;
+
+	/// <summary>
+	/// The JPEG/WEBP quality (1-100) or the PNG compression level (0-9). Ignored for raw frames.
+	/// </summary>
+	int32 Quality = 80;
+};
+
+/// <summary>
+/// Compresses frames before they are handed to the socket.
+/// </summary>
+class FrameEncoder
+{
+public:
+
+	FrameEncoder(const FrameEncoderConfig &config = {});
+	~FrameEncoder();
+
+	/// <summary>
+	/// Encodes the frame with the configured codec.
+	/// </summary>
+	/// <param name="frame">The frame to encode.</param>
+	/// <param name="out_data">The encoded data, which stays valid until the next call of Encode. Points into the frame for raw frames.</param>
+	/// <param name="out_size">The size of the encoded data in bytes.</param>
+	/// <returns>Returns true, if the frame has been encoded successfully.</returns>
+	bool Encode(const cv::Mat &frame, Byte **out_data, uint32 *out_size);
+
+	/// <summary>
+	/// Changes the codec and the quality, can be called at any time.
+	/// </summary>
+	void SetConfig(const FrameEncoderConfig &config);
+
+	FrameCodec GetCodec() const { return m_Config.Codec; }
+	int32 GetQuality() const { return m_Config.Quality; }
+
+private:
+
+	FrameEncoderConfig m_Config;
+	std::vector<int32> m_Params;
+	std::vector<uchar> m_Buffer;
+};
@@ -1,4 +1,6 @@
 #include <iostream>
+#include <string.h>
+#include <stdlib.h>
 
 #include "Client.h"
 
@@ -16,18 +18,65 @@ int main(int argc, char *argv[])
 }
 #endif
 
+static void PrintUsage()
+{
+	std::cout << "Usage: CamClient [options]" << std::endl;
+	std::cout << "  --device <index>   Capture from the camera with the given index (default 0)." << std::endl;
+	std::cout << "  --replay <file>    Replay the video file in a loop instead of using a camera." << std::endl;
+	std::cout << "  --synthetic        Generate a test pattern with a moving object instead of using a camera." << std::endl;
+	std::cout << "  --fps <rate>       Frame rate of the replay or the test pattern, 0 runs as fast as possible (default 30)." << std::endl;
+	std::cout << "  --headless         Do not show the frames." << std::endl;
+}
+
 int main(int argc, char *argv[])
 {
+	ClientConfig config;
+	bool show_frames = true;
+
+	for (int32 i = 1; i < argc; ++i)
+	{
+		bool has_value = i + 1 < argc;
+		if (!strcmp(argv[i], "--device") && has_value)
+		{
+			config.Capture.Type = CaptureSourceType::Device;
+			config.Capture.DeviceIndex = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--replay") && has_value)
+		{
+			config.Capture.Type = CaptureSourceType::File;
+			config.Capture.FilePath = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--synthetic"))
+		{
+			config.Capture.Type = CaptureSourceType::Synthetic;
+		}
+		else if (!strcmp(argv[i], "--fps") && has_value)
+		{
+			config.Capture.FPS = (float)atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--headless"))
+		{
+			show_frames = false;
+		}
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
 	Core::Init();
 
-	ClientConfig config;
 	config.ServerIP = "127.0.0.1";
 	config.Port = 45645;
+	config.Motion.Sensitivity = 0.5f;
+	config.Encoder.Codec = FRAME_CODEC_JPEG;
+	config.Encoder.Quality = 80;
 
 	Client c(config);
 
 	// start all worker threads
-	c.Run();
+	c.Run(show_frames);
 
 	Core::Shutdown();
 	return 0;
@@ -13,14 +13,24 @@ enum MessageType : uint16
 	SERVER_FRAME
 };
 
+enum FrameCodec : uint16
+{
+	FRAME_CODEC_RAW = 0,
+	FRAME_CODEC_JPEG,
+	FRAME_CODEC_PNG,
+	FRAME_CODEC_WEBP
+};
+
 #pragma pack(push, 1)
 
 struct FrameData
 {
-	uint32 FrameSize;
+	uint32 FrameSize;	// The number of bytes following the message, encoded with Codec.
 	uint32 FrameWidth;
 	uint32 FrameHeight;
-	int32 Format;
+	int32 Format;		// The OpenCV pixel format of the decoded frame.
+	uint16 Codec;		// FrameCodec
+	uint16 Quality;		// Codec specific quality, informational only.
 };
 
 struct header_t
@@ -0,0 +1,122 @@
+#include "MotionDetector.h"
+
+MotionDetector::MotionDetector(const MotionDetectorConfig &config)
+	: m_Config(config)
+{
+	if (m_Config.DownscaleFactor == 0)
+	{
+		m_Config.DownscaleFactor = 1;
+	}
+
+	SetSensitivity(m_Config.Sensitivity);
+}
+
+MotionDetector::~MotionDetector()
+{
+}
+
+bool MotionDetector::Process(const cv::Mat &frame)
+{
+	if (frame.empty())
+	{
+		return m_Motion;
+	}
+
+	// Downscale first and convert the small image to luma afterwards, INTER_AREA averages the pixels and suppresses sensor noise.
+	// All OpenCV kernels used here are SIMD vectorized and write into the preallocated member buffers.
+	cv::Size small_size(
+		Core::utils::Max<int32>(frame.cols / (int32)m_Config.DownscaleFactor, 1),
+		Core::utils::Max<int32>(frame.rows / (int32)m_Config.DownscaleFactor, 1));
+
+	cv::resize(frame, m_Small, small_size, 0.0, 0.0, cv::INTER_AREA);
+
+	if (m_Small.channels() == 3)
+	{
+		cv::cvtColor(m_Small, m_Luma, cv::COLOR_BGR2GRAY);
+	}
+	else if (m_Small.channels() == 4)
+	{
+		cv::cvtColor(m_Small, m_Luma, cv::COLOR_BGRA2GRAY);
+	}
+	else
+	{
+		m_Small.copyTo(m_Luma);
+	}
+
+	if (!m_HasBackground || m_Background.size() != m_Luma.size())
+	{
+		m_Luma.convertTo(m_BackgroundF, CV_32F);
+		m_Luma.copyTo(m_Background);
+		m_HasBackground = true;
+		m_ChangedRatio = 0.0f;
+		return m_Motion;
+	}
+
+	cv::absdiff(m_Luma, m_Background, m_Diff);
+	cv::threshold(m_Diff, m_Diff, m_PixelThreshold, 255.0, cv::THRESH_BINARY);
+	m_ChangedRatio = (float)cv::countNonZero(m_Diff) / (float)m_Diff.total();
+
+	// Adapt the background much slower while motion is detected, so that a slow moving object does not become part of it,
+	// but a permanent change of the scene (e.g. a parked car) is still absorbed eventually.
+	double rate = m_Motion ? m_Config.BackgroundRate * 0.1 : m_Config.BackgroundRate;
+	cv::accumulateWeighted(m_Luma, m_BackgroundF, rate);
+	m_BackgroundF.convertTo(m_Background, CV_8U);
+
+	// Hysteresis: start after TriggerFrames frames above the trigger ratio,
+	// stop after ReleaseFrames frames below the (lower) release ratio.
+	if (m_ChangedRatio >= m_TriggerRatio)
+	{
+		m_StillFrames = 0;
+		if (++m_MotionFrames >= m_Config.TriggerFrames)
+		{
+			m_Motion = true;
+		}
+	}
+	else if (m_ChangedRatio < m_ReleaseRatio)
+	{
+		m_MotionFrames = 0;
+		if (m_Motion && ++m_StillFrames >= m_Config.ReleaseFrames)
+		{
+			m_Motion = false;
+			m_StillFrames = 0;
+		}
+	}
+	else
+	{
+		// In between both ratios, keep the current state.
+		m_MotionFrames = 0;
+		m_StillFrames = 0;
+	}
+
+	return m_Motion;
+}
+
+void MotionDetector::Reset()
+{
+	m_HasBackground = false;
+	m_Motion = false;
+	m_MotionFrames = 0;
+	m_StillFrames = 0;
+	m_ChangedRatio = 0.0f;
+}
+
+void MotionDetector::SetSensitivity(float sensitivity)
+{
+	if (sensitivity < 0.0f)
+	{
+		sensitivity = 0.0f;
+	}
+	else if (sensitivity > 1.0f)
+	{
+		sensitivity = 1.0f;
+	}
+
+	m_Config.Sensitivity = sensitivity;
+
+	// A sensitivity of 1 reacts to a luma change of 10 on 0.2% of the image,
+	// a sensitivity of 0 needs a luma change of 50 on 5% of the image.
+	float inverse = 1.0f - sensitivity;
+	m_PixelThreshold = 10.0 + 40.0 * inverse;
+	m_TriggerRatio = 0.002f + 0.048f * inverse;
+	m_ReleaseRatio = m_TriggerRatio * 0.5f;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <Cam-Core.h>
+
+#include <opencv2/opencv.hpp>
+
+struct MotionDetectorConfig
+{
+	/// <summary>
+	/// The factor by which each frame is downscaled before it is compared (8 turns 1280x720 into 160x90).
+	/// </summary>
+	uint32 DownscaleFactor = 8;
+
+	/// <summary>
+	/// The sensitivity between 0 and 1. Higher values detect smaller and weaker changes.
+	/// </summary>
+	float Sensitivity = 0.5f;
+
+	/// <summary>
+	/// The number of consecutive frames with movement, before motion is reported.
+	/// </summary>
+	uint32 TriggerFrames = 2;
+
+	/// <summary>
+	/// The number of consecutive frames without movement, before motion is no longer reported.
+	/// </summary>
+	uint32 ReleaseFrames = 30;
+
+	/// <summary>
+	/// How fast the background model adapts to the current frame (0-1), slow changes like daylight are absorbed by it.
+	/// </summary>
+	float BackgroundRate = 0.05f;
+};
+
+/// <summary>
+/// Detects movement by comparing the downscaled luma of each frame against a running background model.
+/// </summary>
+class MotionDetector
+{
+public:
+
+	MotionDetector(const MotionDetectorConfig &config = {});
+	~MotionDetector();
+
+	/// <summary>
+	/// Analyzes the next frame and updates the motion state.
+	/// </summary>
+	/// <param name="frame">The BGR or grayscale frame to analyze.</param>
+	/// <returns>Returns true, if motion is currently detected.</returns>
+	bool Process(const cv::Mat &frame);
+
+	/// <summary>
+	/// Forgets the background model, the next frame becomes the new background.
+	/// </summary>
+	void Reset();
+
+	/// <summary>
+	/// Sets the sensitivity between 0 and 1, can be changed at any time.
+	/// </summary>
+	void SetSensitivity(float sensitivity);
+
+	/// <summary>
+	/// Tells, if motion is currently detected.
+	/// </summary>
+	bool HasMotion() const { return m_Motion; }
+
+	/// <summary>
+	/// Returns the fraction of changed pixels of the last processed frame.
+	/// </summary>
+	float GetChangedRatio() const { return m_ChangedRatio; }
+
+private:
+
+	MotionDetectorConfig m_Config;
+
+	// Derived from the sensitivity.
+	double m_PixelThreshold = 0.0;
+	float m_TriggerRatio = 0.0f;
+	float m_ReleaseRatio = 0.0f;
+
+	// Working buffers, kept across frames so that steady state processing does not allocate.
+	cv::Mat m_Small;
+	cv::Mat m_Luma;
+	cv::Mat m_BackgroundF;
+	cv::Mat m_Background;
+	cv::Mat m_Diff;
+
+	bool m_HasBackground = false;
+	bool m_Motion = false;
+	uint32 m_MotionFrames = 0;
+	uint32 m_StillFrames = 0;
+	float m_ChangedRatio = 0.0f;
+};
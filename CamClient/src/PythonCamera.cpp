@@ -8,7 +8,7 @@ namespace PythonCamera
 {
 
 	Camera::Camera(bool flip, uint32 width, uint32 height)
-		: m_Flip(flip), m_Width(width), m_Height(height)
+		: m_Flip(flip), m_Width(width), m_Height(height), m_StreamQueue(STREAM_QUEUE_CAPACITY, Core::QueueOverflowPolicy::DropOldest)
 	{
 		m_CameraStream = cv::VideoCapture(0);
 		m_CenterX = (float)m_Width / 2;
@@ -49,7 +49,8 @@ namespace PythonCamera
 	{
 		while (true)
 		{
-			cv::Mat frame = m_StreamQueue.Dequeue();
+			cv::Mat frame;
+			m_StreamQueue.Pop(frame);
 			cv::namedWindow("Frame", cv::WND_PROP_FULLSCREEN);
 			cv::setWindowProperty("Frame", cv::WND_PROP_FULLSCREEN, cv::WND_PROP_FULLSCREEN);
 			cv::imshow("Frame", frame);
@@ -184,7 +185,7 @@ namespace PythonCamera
 					frame = Zoom(frame, { 0.0f, 0.0f });
 			}
 
-			m_StreamQueue.Enqueue(frame);
+			m_StreamQueue.Push(std::move(frame));
 
 			//	cv::namedWindow("Frame", cv::WND_PROP_FULLSCREEN);
 			//	cv::setWindowProperty("Frame", cv::WND_PROP_FULLSCREEN, cv::WND_PROP_FULLSCREEN);
@@ -32,6 +32,11 @@ namespace PythonCamera
 
 		void StreamImage();
 
+	private:
+
+		// Only the most recent frames are kept, if Show can not keep up with the camera.
+		static constexpr uint32 STREAM_QUEUE_CAPACITY = 4;
+
 	private:
 
 		bool m_Flip = false;
@@ -47,7 +52,7 @@ namespace PythonCamera
 		float m_RadiusX = 0, m_RadiusY = 0;
 		float m_Scale = 1;
 
-		Core::ThreadSafeQueue<cv::Mat> m_StreamQueue;
+		Core::SPSCQueue<cv::Mat> m_StreamQueue;
 	};
 
 }
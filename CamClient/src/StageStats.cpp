@@ -0,0 +1,34 @@
+#include "StageStats.h"
+
+void StageStats::Record(int64 start_us, int64 end_us, int64 capture_us)
+{
+	uint64 busy_us = end_us > start_us ? (uint64)(end_us - start_us) : 0;
+	uint64 latency_us = end_us > capture_us ? (uint64)(end_us - capture_us) : 0;
+
+	// Only the stage thread writes, so plain loads and stores are enough.
+	m_BusyUS.store(m_BusyUS.load(std::memory_order_relaxed) + busy_us, std::memory_order_relaxed);
+	m_LatencyUS.store(m_LatencyUS.load(std::memory_order_relaxed) + latency_us, std::memory_order_relaxed);
+	if (busy_us > m_MaxBusyUS.load(std::memory_order_relaxed))
+	{
+		m_MaxBusyUS.store(busy_us, std::memory_order_relaxed);
+	}
+
+	m_Frames.store(m_Frames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+double StageStats::GetAverageMS() const
+{
+	uint64 frames = GetFrameCount();
+	return frames > 0 ? (double)m_BusyUS.load(std::memory_order_relaxed) / (double)frames / 1000.0 : 0.0;
+}
+
+double StageStats::GetMaxMS() const
+{
+	return (double)m_MaxBusyUS.load(std::memory_order_relaxed) / 1000.0;
+}
+
+double StageStats::GetAverageLatencyMS() const
+{
+	uint64 frames = GetFrameCount();
+	return frames > 0 ? (double)m_LatencyUS.load(std::memory_order_relaxed) / (double)frames / 1000.0 : 0.0;
+}
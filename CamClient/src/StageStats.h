@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Cam-Core.h>
+
+#include <atomic>
+
+/// <summary>
+/// Counts the frames, which passed one stage of the client pipeline, and the time the stage spent on them.
+/// Written by the thread of the stage, can be read from any thread.
+/// </summary>
+class StageStats
+{
+public:
+
+	/// <summary>
+	/// Records a frame, which the stage has finished.
+	/// </summary>
+	/// <param name="start_us">The time in microseconds, at which the stage started to work on the frame.</param>
+	/// <param name="end_us">The time in microseconds, at which the stage finished the frame.</param>
+	/// <param name="capture_us">The time in microseconds, at which the frame was captured.</param>
+	void Record(int64 start_us, int64 end_us, int64 capture_us);
+
+	/// <summary>
+	/// Returns the number of frames, which passed the stage.
+	/// </summary>
+	uint64 GetFrameCount() const { return m_Frames.load(std::memory_order_relaxed); }
+
+	/// <summary>
+	/// Returns the average time the stage spent on a frame in milliseconds.
+	/// </summary>
+	double GetAverageMS() const;
+
+	/// <summary>
+	/// Returns the longest time the stage spent on a frame in milliseconds.
+	/// </summary>
+	double GetMaxMS() const;
+
+	/// <summary>
+	/// Returns the average time from the capture of a frame until this stage finished it in milliseconds.
+	/// </summary>
+	double GetAverageLatencyMS() const;
+
+private:
+
+	std::atomic<uint64> m_Frames = 0;
+	std::atomic<uint64> m_BusyUS = 0;
+	std::atomic<uint64> m_MaxBusyUS = 0;
+	std::atomic<uint64> m_LatencyUS = 0;
+};
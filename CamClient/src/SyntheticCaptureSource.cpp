@@ -0,0 +1,97 @@
+#include "SyntheticCaptureSource.h"
+
+SyntheticCaptureSource::SyntheticCaptureSource(const CaptureSourceConfig &config)
+	: m_Config(config)
+{
+}
+
+SyntheticCaptureSource::~SyntheticCaptureSource()
+{
+	Close();
+}
+
+bool SyntheticCaptureSource::Open(uint32 width, uint32 height)
+{
+	m_Width = width != 0 ? width : DEFAULT_WIDTH;
+	m_Height = height != 0 ? height : DEFAULT_HEIGHT;
+	m_FrameIndex = 0;
+	m_Distance = 0.0;
+
+	// A gradient with a grid, so that the background is not flat like a real scene.
+	m_Background.create((int32)m_Height, (int32)m_Width, CV_8UC3);
+	for (int32 y = 0; y < m_Background.rows; ++y)
+	{
+		cv::Vec3b *row = m_Background.ptr<cv::Vec3b>(y);
+		for (int32 x = 0; x < m_Background.cols; ++x)
+		{
+			bool grid = (x % 64) == 0 || (y % 64) == 0;
+			row[x] = grid ? cv::Vec3b(40, 40, 40) : cv::Vec3b((uchar)(x * 255 / m_Width), (uchar)(y * 255 / m_Height), 128);
+		}
+	}
+
+	ResetThrottle();
+	m_Opened = true;
+	return true;
+}
+
+void SyntheticCaptureSource::Close()
+{
+	m_Opened = false;
+	m_Background.release();
+}
+
+bool SyntheticCaptureSource::Read(cv::Mat &frame)
+{
+	if (!m_Opened)
+	{
+		return false;
+	}
+
+	Throttle(m_Config.FPS);
+
+	// Reuses the memory of the frame, if it already has the right size and format.
+	m_Background.copyTo(frame);
+
+	int32 size = (int32)Core::utils::Min<uint32>(m_Config.ObjectSize, Core::utils::Min<uint32>(m_Width, m_Height));
+	int32 x = Bounce(m_Distance, (int32)m_Width - size);
+	int32 y = Bounce(m_Distance * 0.5, (int32)m_Height - size);
+	cv::rectangle(frame, cv::Rect(x, y, size, size), cv::Scalar(255, 255, 255), cv::FILLED);
+
+	Advance();
+	return true;
+}
+
+bool SyntheticCaptureSource::Skip()
+{
+	if (!m_Opened)
+	{
+		return false;
+	}
+
+	Throttle(m_Config.FPS);
+	Advance();
+	return true;
+}
+
+void SyntheticCaptureSource::Advance()
+{
+	uint64 cycle = (uint64)m_Config.MotionFrames + m_Config.StillFrames;
+	bool moving = m_Config.StillFrames == 0 || (m_FrameIndex % cycle) < m_Config.MotionFrames;
+	if (moving)
+	{
+		m_Distance += m_Config.MotionSpeed;
+	}
+
+	++m_FrameIndex;
+}
+
+int32 SyntheticCaptureSource::Bounce(double distance, int32 range)
+{
+	if (range <= 0)
+	{
+		return 0;
+	}
+
+	int64 position = (int64)distance % (2 * (int64)range);
+	return (int32)(position <= range ? position : 2 * range - position);
+}
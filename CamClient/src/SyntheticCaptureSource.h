@@ -0,0 +1,52 @@
+#pragma once
+
+#include "CaptureSource.h"
+
+/// <summary>
+/// Generates frames with a textured background and a bouncing square, which alternately moves and stands still.
+/// The output is deterministic, so it can be used to measure the client pipeline without a camera.
+/// </summary>
+class SyntheticCaptureSource : public CaptureSource
+{
+public:
+
+	SyntheticCaptureSource(const CaptureSourceConfig &config);
+	~SyntheticCaptureSource();
+
+	virtual bool Open(uint32 width, uint32 height) override;
+	virtual void Close() override;
+
+	virtual bool Read(cv::Mat &frame) override;
+	virtual bool Skip() override;
+
+	virtual uint32 GetWidth() const override { return m_Width; }
+	virtual uint32 GetHeight() const override { return m_Height; }
+
+private:
+
+	/// <summary>
+	/// Advances the object by one frame.
+	/// </summary>
+	void Advance();
+
+	/// <summary>
+	/// Maps the travelled distance to a position, which bounces between 0 and range.
+	/// </summary>
+	static int32 Bounce(double distance, int32 range);
+
+private:
+
+	static constexpr uint32 DEFAULT_WIDTH = 1280;
+	static constexpr uint32 DEFAULT_HEIGHT = 720;
+
+	CaptureSourceConfig m_Config;
+	uint32 m_Width = 0;
+	uint32 m_Height = 0;
+	bool m_Opened = false;
+
+	uint64 m_FrameIndex = 0;
+	double m_Distance = 0.0;
+
+	// Generated once in Open, every frame starts as a copy of it.
+	cv::Mat m_Background;
+};
@@ -0,0 +1,265 @@
+#include "FrameRing.h"
+
+#include <string.h>
+
+#include "Core/Log.h"
+
+static const char *GetCodecExtension(FrameCodec codec)
+{
+	switch (codec)
+	{
+		// Raw frames are stored as they are, without an extension or encoder parameters.
+		case FRAME_CODEC_RAW:
+			return nullptr;
+
+		case FRAME_CODEC_JPEG:
+			return ".jpg";
+
+		case FRAME_CODEC_PNG:
+			return ".png";
+
+		case FRAME_CODEC_WEBP:
+			return ".webp";
+	}
+
+	return nullptr;
+}
+
+FrameRing::FrameRing(const FrameRingConfig &config)
+	: m_Config(config)
+{
+	if (!m_Config.Pool)
+	{
+		m_OwnPool = std::make_unique<Core::BufferPool>();
+		m_Config.Pool = m_OwnPool.get();
+	}
+
+	switch (m_Config.Codec)
+	{
+		case FRAME_CODEC_RAW:
+			break;
+
+		case FRAME_CODEC_JPEG:
+			m_EncodeParams = { cv::IMWRITE_JPEG_QUALITY, m_Config.Quality };
+			break;
+
+		case FRAME_CODEC_PNG:
+			m_EncodeParams = { cv::IMWRITE_PNG_COMPRESSION, m_Config.Quality };
+			break;
+
+		case FRAME_CODEC_WEBP:
+			m_EncodeParams = { cv::IMWRITE_WEBP_QUALITY, m_Config.Quality };
+			break;
+	}
+}
+
+FrameRing::~FrameRing()
+{
+	Clear();
+}
+
+bool FrameRing::Push(const cv::Mat &frame)
+{
+	if (frame.empty())
+	{
+		return false;
+	}
+
+	// Encode outside of the lock, so that readers are not blocked by the encoder.
+	EncodedFrame encoded;
+	encoded.Width = frame.cols;
+	encoded.Height = frame.rows;
+	encoded.Format = frame.type();
+	encoded.Codec = m_Config.Codec;
+
+	const char *extension = GetCodecExtension(m_Config.Codec);
+	if (!extension)
+	{
+		encoded.Size = (uint32)(frame.total() * frame.elemSize());
+		encoded.Buffer = m_Config.Pool->Acquire(encoded.Size);
+
+		cv::Mat raw(frame.rows, frame.cols, frame.type(), encoded.Buffer.Data());
+		frame.copyTo(raw);
+		return Insert(std::move(encoded));
+	}
+
+	std::vector<Byte> data;
+	if (!cv::imencode(extension, frame, data, m_EncodeParams))
+	{
+		CAM_LOG_ERROR("Could not encode frame with {0}x{1} pixels!", frame.cols, frame.rows);
+		return false;
+	}
+
+	// The encoded size is only known afterwards, so the data is copied into a buffer of the right size class.
+	encoded.Size = (uint32)data.size();
+	encoded.Buffer = m_Config.Pool->Acquire(encoded.Size);
+	memcpy(encoded.Buffer.Data(), data.data(), data.size());
+	return Insert(std::move(encoded));
+}
+
+bool FrameRing::PushEncoded(EncodedFrame &&frame)
+{
+	if (!frame.Buffer || frame.Size == 0 || (uint64)frame.Offset + frame.Size > frame.Buffer.Size())
+	{
+		return false;
+	}
+
+	return Insert(std::move(frame));
+}
+
+bool FrameRing::Latest(cv::Mat *out_frame) const
+{
+	// The frame keeps a reference to its buffer, so it is decoded without holding the lock.
+	EncodedFrame frame;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (m_Frames.empty())
+		{
+			return false;
+		}
+
+		frame = m_Frames.back();
+	}
+
+	return Decode(frame, out_frame);
+}
+
+bool FrameRing::Get(uint32 index, cv::Mat *out_frame) const
+{
+	EncodedFrame frame;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (index >= m_Frames.size())
+		{
+			return false;
+		}
+
+		frame = m_Frames[index];
+	}
+
+	return Decode(frame, out_frame);
+}
+
+uint32 FrameRing::ReadLast(uint32 count, const std::function<void(const cv::Mat&)> &callback) const
+{
+	// Only the references are copied under the lock, decoding thousands of frames must not block the pushes of the network thread.
+	std::vector<EncodedFrame> frames;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		uint32 size = (uint32)m_Frames.size();
+		uint32 first = count < size ? size - count : 0;
+		frames.assign(m_Frames.begin() + first, m_Frames.end());
+	}
+
+	uint32 read = 0;
+	cv::Mat frame;
+	for (const EncodedFrame &encoded : frames)
+	{
+		if (!Decode(encoded, &frame))
+		{
+			continue;
+		}
+
+		callback(frame);
+		++read;
+	}
+
+	return read;
+}
+
+void FrameRing::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Frames.clear();
+	m_Bytes = 0;
+	m_RawBytes = 0;
+}
+
+uint32 FrameRing::Size() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return (uint32)m_Frames.size();
+}
+
+uint64 FrameRing::GetBytes() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Bytes;
+}
+
+uint64 FrameRing::GetRawBytes() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_RawBytes;
+}
+
+uint64 FrameRing::GetSequence() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Sequence;
+}
+
+bool FrameRing::Insert(EncodedFrame &&frame)
+{
+	uint64 encoded_bytes = frame.Buffer.GetCapacity();
+	uint64 raw_bytes = (uint64)frame.Width * frame.Height * CV_ELEM_SIZE(frame.Format);
+
+	if (m_Config.BudgetBytes && encoded_bytes > m_Config.BudgetBytes)
+	{
+		CAM_LOG_ERROR("Encoded frame with {0} bytes is larger than the whole frame budget!", encoded_bytes);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Evict(encoded_bytes);
+
+	m_Frames.push_back(std::move(frame));
+	m_Bytes += encoded_bytes;
+	m_RawBytes += raw_bytes;
+	++m_Sequence;
+	return true;
+}
+
+void FrameRing::Evict(uint64 incoming_bytes)
+{
+	while (!m_Frames.empty())
+	{
+		bool over_budget = m_Config.BudgetBytes && m_Bytes + incoming_bytes > m_Config.BudgetBytes;
+		bool over_count = m_Config.MaxFrames && m_Frames.size() >= m_Config.MaxFrames;
+		if (!over_budget && !over_count)
+		{
+			break;
+		}
+
+		const EncodedFrame &oldest = m_Frames.front();
+		m_Bytes -= oldest.Buffer.GetCapacity();
+		m_RawBytes -= (uint64)oldest.Width * oldest.Height * CV_ELEM_SIZE(oldest.Format);
+		m_Frames.pop_front();
+	}
+}
+
+bool FrameRing::Decode(const EncodedFrame &frame, cv::Mat *out_frame)
+{
+	if (!out_frame)
+	{
+		return false;
+	}
+
+	if (frame.Codec == FRAME_CODEC_RAW)
+	{
+		if (frame.Size != (size_t)frame.Width * frame.Height * CV_ELEM_SIZE(frame.Format))
+		{
+			return false;
+		}
+
+		cv::Mat raw((int32)frame.Height, (int32)frame.Width, frame.Format, frame.GetData());
+		raw.copyTo(*out_frame);
+		return true;
+	}
+
+	// imdecode detects the codec from the data itself.
+	cv::Mat encoded(1, (int32)frame.Size, CV_8UC1, frame.GetData());
+	*out_frame = cv::imdecode(encoded, cv::IMREAD_UNCHANGED);
+	return !out_frame->empty();
+}
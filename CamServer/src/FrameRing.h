@@ -0,0 +1,153 @@
+#pragma once
+
+#include <Cam-Core.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "Messages.h"
+
+struct FrameRingConfig
+{
+	/// <summary>
+	/// The maximum number of bytes, all encoded frames together may occupy. The oldest frames are dropped, if the budget is exceeded.
+	/// </summary>
+	uint64 BudgetBytes = 0;
+
+	/// <summary>
+	/// The maximum number of frames to keep, 0 means that only the byte budget limits the ring.
+	/// </summary>
+	uint32 MaxFrames = 0;
+
+	/// <summary>
+	/// The codec, which is used to store raw frames. JPEG is roughly 15-25x smaller than raw BGR frames at the default quality.
+	/// Frames, which already arrive encoded, are stored as they are.
+	/// </summary>
+	FrameCodec Codec = FRAME_CODEC_JPEG;
+
+	/// <summary>
+	/// The JPEG/WEBP quality (1-100) or the PNG compression level (0-9).
+	/// </summary>
+	int32 Quality = 80;
+
+	/// <summary>
+	/// The pool for the frames, which are encoded by the ring. The ring uses its own pool, if none is set.
+	/// </summary>
+	Core::BufferPool *Pool = nullptr;
+};
+
+struct EncodedFrame
+{
+	/// <summary>
+	/// The buffer, which holds the encoded bytes at the given offset. Frames received from the network keep the whole message buffer,
+	/// so that it can be stored without copying it.
+	/// </summary>
+	Core::BufferRef Buffer;
+	uint32 Offset = 0;
+	uint32 Size = 0;
+
+	uint32 Width = 0;
+	uint32 Height = 0;
+	int32 Format = 0;
+	FrameCodec Codec = FRAME_CODEC_RAW;
+
+	Byte *GetData() const { return Buffer.Data() + Offset; }
+};
+
+/// <summary>
+/// Ring of compressed frames, limited by a byte budget instead of a frame count.
+/// Frames are encoded when they are pushed and only decoded again, when they are read.
+/// All functions are thread safe.
+/// </summary>
+class FrameRing
+{
+public:
+
+	FrameRing(const FrameRingConfig &config);
+	~FrameRing();
+
+	/// <summary>
+	/// Encodes the frame and stores it as the newest entry of the ring.
+	/// </summary>
+	/// <param name="frame">The raw frame to store, the ring does not keep a reference to it.</param>
+	/// <returns>Returns true, if the frame could be encoded and fits into the byte budget.</returns>
+	bool Push(const cv::Mat &frame);
+
+	/// <summary>
+	/// Stores an already encoded frame as the newest entry of the ring, without transcoding or copying it.
+	/// </summary>
+	/// <param name="frame">The encoded frame, the ring keeps a reference to its buffer.</param>
+	/// <returns>Returns true, if the frame fits into the byte budget.</returns>
+	bool PushEncoded(EncodedFrame &&frame);
+
+	/// <summary>
+	/// Decodes the newest frame of the ring.
+	/// </summary>
+	/// <param name="out_frame">The decoded frame.</param>
+	/// <returns>Returns true, if a frame was available and could be decoded.</returns>
+	bool Latest(cv::Mat *out_frame) const;
+
+	/// <summary>
+	/// Decodes a specific frame of the ring, the index 0 is the oldest frame.
+	/// </summary>
+	/// <param name="index">The index of the frame to decode.</param>
+	/// <param name="out_frame">The decoded frame.</param>
+	/// <returns>Returns true, if the index was valid and the frame could be decoded.</returns>
+	bool Get(uint32 index, cv::Mat *out_frame) const;
+
+	/// <summary>
+	/// Decodes the last N frames in recording order, used to save the last N minutes to disk.
+	/// </summary>
+	/// <param name="count">The number of frames to read, counted from the newest frame.</param>
+	/// <param name="callback">Is called for every decoded frame, from the oldest to the newest one.</param>
+	/// <returns>Returns the number of frames, which have been passed to the callback.</returns>
+	uint32 ReadLast(uint32 count, const std::function<void(const cv::Mat&)> &callback) const;
+
+	/// <summary>
+	/// Removes all frames from the ring.
+	/// </summary>
+	void Clear();
+
+	/// <summary>
+	/// Returns the number of frames currently stored.
+	/// </summary>
+	uint32 Size() const;
+
+	/// <summary>
+	/// Returns the number of bytes, the buffers of the stored frames occupy.
+	/// </summary>
+	uint64 GetBytes() const;
+
+	/// <summary>
+	/// Returns the number of bytes the stored frames would occupy uncompressed.
+	/// </summary>
+	uint64 GetRawBytes() const;
+
+	/// <summary>
+	/// Returns a counter, which is increased with every pushed frame. Can be used to detect new frames without decoding.
+	/// </summary>
+	uint64 GetSequence() const;
+
+private:
+
+	bool Insert(EncodedFrame &&frame);
+	void Evict(uint64 incoming_bytes);
+	static bool Decode(const EncodedFrame &frame, cv::Mat *out_frame);
+
+private:
+
+	FrameRingConfig m_Config;
+	std::unique_ptr<Core::BufferPool> m_OwnPool;
+	std::vector<int32> m_EncodeParams;
+	std::deque<EncodedFrame> m_Frames;
+
+	uint64 m_Bytes = 0;
+	uint64 m_RawBytes = 0;
+	uint64 m_Sequence = 0;
+
+	mutable std::mutex m_Mutex;
+};
@@ -34,6 +34,8 @@ int main(int argc, char *argv[])
 	config.ServerIP = "127.0.0.1";
 	config.Port = 45645;
 	config.VideoBackupDuration = 5;
+	config.VideoBackupBudgetMB = 1024;
+	config.VideoBackupQuality = 80;
 
 	Server s(config);
 	s.StartFramePreviews();
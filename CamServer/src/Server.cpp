@@ -6,10 +6,63 @@
 
 #include "Core/Log.h"
 
+// Upper bound for a single encoded frame, protects against allocating garbage sizes from a broken stream.
+static constexpr uint32 MAX_FRAME_SIZE = 64 * 1024 * 1024;
+
+// The camera connections wait at most this long for network events, before the server loop runs again.
+static constexpr int32 POLL_TIMEOUT_MS = 100;
+
+// The preview waits at most this long for a new frame, before it handles the window events again.
+static constexpr int32 PREVIEW_WAIT_MS = 30;
+
+// Returns the size of the complete message at the start of the data, 0 if more bytes are needed and -1 if the data is invalid.
+static int32 GetMessageSize(Byte const *data, uint32 size)
+{
+	if (size < sizeof(header_t))
+	{
+		return 0;
+	}
+
+	header_t const *header = (header_t const *)data;
+	switch (header->Type)
+	{
+		case CLIENT_CONNECTION_START:
+			return sizeof(ClientConnectionStartMessage);
+
+		case CLIENT_CONNECTION_CLOSE:
+			return sizeof(ClientConnectionCloseMessage);
+
+		case CLIENT_FRAME:
+		{
+			if (size < sizeof(ClientFrameMessage))
+			{
+				return sizeof(ClientFrameMessage);
+			}
+
+			// The frame data directly follows the message.
+			ClientFrameMessage const *msg = (ClientFrameMessage const *)data;
+			if (msg->Frame.FrameSize == 0 || msg->Frame.FrameSize > MAX_FRAME_SIZE)
+			{
+				CAM_LOG_ERROR("Frame size of {} bytes is invalid!", msg->Frame.FrameSize);
+				return -1;
+			}
+
+			return (int32)(sizeof(ClientFrameMessage) + msg->Frame.FrameSize);
+		}
+	}
+
+	CAM_LOG_ERROR("Received unknown message type {}!", header->Type);
+	return -1;
+}
+
 Server::Server(const ServerConfig &config)
 	: m_Config(config)
 {
-	m_Socket = Core::Socket::Create();
+	m_Listener = Core::StreamServer::Create();
+	m_Listener->SetMessageSizeCallback(&GetMessageSize);
+	m_Listener->SetBufferPool(&m_BufferPool);
+	m_Listener->SetMessageCallback([this](Core::addr_t client, const Core::BufferRef &message) { OnMessage(client, message); });
+	m_Listener->SetDisconnectCallback([this](Core::addr_t client) { OnConnectionLost(client); });
 
 	std::string cwd = "";
 	Core::FileSystem::Get()->GetCurrentWorkingDirectory(&cwd);
@@ -19,6 +72,7 @@ Server::Server(const ServerConfig &config)
 	CAM_LOG_INFO("IP                    : {}", config.ServerIP);
 	CAM_LOG_INFO("Port                  : {}", config.Port);
 	CAM_LOG_INFO("Video backup duration : {}", config.VideoBackupDuration);
+	CAM_LOG_INFO("Video backup budget   : {} MB", config.VideoBackupBudgetMB);
 	CAM_LOG_INFO("Current Server version: {}", m_Version);
 	CAM_LOG_INFO("Current CWD           : {}", cwd);
 	CAM_LOG_INFO("================================================================");
@@ -26,6 +80,12 @@ Server::Server(const ServerConfig &config)
 
 Server::~Server()
 {
+	{
+		std::lock_guard<std::mutex> lock(m_PreviewMutex);
+		m_Running = false;
+	}
+	m_PreviewCondition.notify_all();
+
 	if (m_FramePreviewThread.joinable())
 	{
 		m_FramePreviewThread.join();
@@ -33,14 +93,14 @@ Server::~Server()
 
 	for (uint32 i = 0; i < m_Clients.size(); ++i)
 	{
-		m_Clients[i].Frames.Clear();
+		m_Clients[i].Frames->Clear();
 	}
 
 	m_Clients.clear();
 	m_Clients.shrink_to_fit();
 
-	delete m_Socket;
-	m_Socket = nullptr;
+	delete m_Listener;
+	m_Listener = nullptr;
 }
 
 void Server::Run()
@@ -50,28 +110,19 @@ void Server::Run()
 
 	for (;;)
 	{
-		if (!m_Socket->Open())
+		// All cameras are served from this thread, every complete message is dispatched to OnMessage.
+		if (!m_Listener->Listen(m_Config.Port))
 		{
-			CAM_LOG_ERROR("Could not open socket!");
+			CAM_LOG_ERROR("Could not listen on port {}!", m_Config.Port);
 			break;
 		}
 
-		if (!m_Socket->Bind(m_Config.Port))
+		while (m_Listener->Poll(POLL_TIMEOUT_MS))
 		{
-			CAM_LOG_ERROR("Could not bind socket");
-			break;
-		}
-
-		for (;;)
-		{
-			if (!Step())
-			{
-				break;
-			}
 		}
 
 		CAM_LOG_ERROR("Network interface failure.");
-		m_Socket->Close();
+		m_Listener->Close();
 
 		Core::SleepMS(10);
 	}
@@ -84,40 +135,46 @@ void Server::StartFramePreviews()
 	m_FramePreviewThread = std::thread(&Server::FramePreview, std::ref(*this));
 }
 
-bool Server::Step()
+void Server::OnMessage(Core::addr_t clientAddr, const Core::BufferRef &message)
 {
-	static Byte BUF[65536];
-
-	Core::addr_t addr;
-	int32 len = m_Socket->Recv(BUF, sizeof(BUF), &addr);
-	if (len < 0)
-	{
-		return false;
-	}
+	Byte *data = message.Data();
+	uint32 length = (uint32)message.Size();
 
-	if (len < sizeof(header_t))
-	{
-		return true;
-	}
-
-	header_t *header = (header_t *)BUF;
+	header_t *header = (header_t *)data;
 	bool message_success = false;
 	switch (header->Type)
 	{
 		case CLIENT_CONNECTION_START:
-			message_success = OnClientConnected(addr, BUF, len);
+			message_success = OnClientConnected(clientAddr, data, length);
 			break;
 
 		case CLIENT_CONNECTION_CLOSE:
-			message_success = OnClientDisconnected(addr, BUF, len);
+			message_success = OnClientDisconnected(clientAddr, data, length);
 			break;
 
 		case CLIENT_FRAME:
-			message_success = OnClientFrame(addr, BUF, len);
+			message_success = OnClientFrame(clientAddr, message);
 			break;
 	}
 
-	return message_success;
+	if (!message_success)
+	{
+		CAM_LOG_ERROR("Message of Client {} could not be handled, closing the connection.", clientAddr.Value);
+		m_Listener->Disconnect(clientAddr);
+	}
+}
+
+void Server::OnConnectionLost(Core::addr_t clientAddr)
+{
+	// The camera went away without a close request.
+	std::lock_guard<std::mutex> lock(m_ClientsMutex);
+	auto it = std::find(m_Clients.begin(), m_Clients.end(), clientAddr);
+	if (it != m_Clients.end())
+	{
+		it->Frames->Clear();
+		m_Clients.erase(it);
+		CAM_LOG_WARN("Lost connection to Client {}!", clientAddr.Value);
+	}
 }
 
 bool Server::OnClientConnected(Core::addr_t &clientAddr, Byte *message, int32 addrLen)
@@ -139,6 +196,7 @@ bool Server::OnClientConnected(Core::addr_t &clientAddr, Byte *message, int32 ad
 	ClientConnectionStartMessage *msg = (ClientConnectionStartMessage *)message;
 
 	bool client_connected = false;
+	std::unique_lock<std::mutex> lock(m_ClientsMutex);
 	auto it = std::find(m_Clients.begin(), m_Clients.end(), clientAddr);
 	if (it == m_Clients.end())
 	{
@@ -151,18 +209,26 @@ bool Server::OnClientConnected(Core::addr_t &clientAddr, Byte *message, int32 ad
 		uint32 frames = seconds * fps;
 		CAM_LOG_DEBUG("Calculated frame count {0} for {1} minutes with {2} fps.", frames, minutes, fps);
 
-		ClientEntry client(frames * sizeof(cv::Mat));
+		FrameRingConfig ring_config;
+		ring_config.BudgetBytes = (uint64)m_Config.VideoBackupBudgetMB * 1024 * 1024;
+		ring_config.MaxFrames = frames;
+		ring_config.Codec = m_Config.VideoBackupCodec;
+		ring_config.Quality = m_Config.VideoBackupQuality;
+		ring_config.Pool = &m_BufferPool;
+
+		ClientEntry client(ring_config);
 		client.Address = clientAddr;
 		client.FrameTitle = msg->FrameName;
 		m_Clients.push_back(client);
 		client_connected = true;
 	}
+	lock.unlock();
 
 	ServerConnectionStartResponse response = {};
 	response.Header.Type = SERVER_CONNECTION_START;
 	response.Header.Version = m_Version;
 	response.ConnectionAccepted = client_connected;
-	m_Socket->Send(&response, sizeof(response), clientAddr);
+	m_Listener->Send(clientAddr, &response, sizeof(response));
 
 	CAM_LOG_INFO("Client {} connected successfully!", clientAddr.Value);
 	return true;
@@ -187,77 +253,105 @@ bool Server::OnClientDisconnected(Core::addr_t &clientAddr, Byte *message, int32
 	ClientConnectionCloseMessage *msg = (ClientConnectionCloseMessage *)message;
 
 	bool client_removed = false;
-	auto it = std::find(m_Clients.begin(), m_Clients.end(), clientAddr);
-	if (it != m_Clients.end())
 	{
-		// Client was found, clear the entry
-		it->Frames.Clear();
+		std::lock_guard<std::mutex> lock(m_ClientsMutex);
+		auto it = std::find(m_Clients.begin(), m_Clients.end(), clientAddr);
+		if (it != m_Clients.end())
+		{
+			// Client was found, clear the entry
+			it->Frames->Clear();
 
-		m_Clients.erase(it);
-		client_removed = true;
+			m_Clients.erase(it);
+			client_removed = true;
+		}
 	}
 
 	ServerConnectionCloseResponse response = {};
 	response.Header.Type = SERVER_CONNECTION_CLOSE;
 	response.Header.Version = m_Version;
 	response.ConnectionClosed = client_removed;
-	m_Socket->Send(&response, sizeof(response), clientAddr);
+	m_Listener->Send(clientAddr, &response, sizeof(response));
 
 	CAM_LOG_INFO("Client {} disconnected successfully!", clientAddr.Value);
 	return true;
 }
 
-bool Server::OnClientFrame(Core::addr_t &clientAddr, Byte *message, int32 addrLen)
+bool Server::OnClientFrame(Core::addr_t &clientAddr, const Core::BufferRef &message)
 {
-	header_t *header = (header_t *)message;
+	header_t *header = (header_t *)message.Data();
 	if (header->Version != m_Version)
 	{
 		CAM_LOG_ERROR("Version did not match with server version!");
 		return false;
 	}
 
-	if (addrLen != sizeof(ClientFrameMessage))
+	if (message.Size() < sizeof(ClientFrameMessage) || message.Size() != sizeof(ClientFrameMessage) + ((ClientFrameMessage *)message.Data())->Frame.FrameSize)
 	{
 		CAM_LOG_ERROR("Request size was not as expected!");
 		return false;
 	}
 
 	CAM_LOG_DEBUG("Client {} tries to send a frame!", clientAddr.Value);
-	ClientFrameMessage *msg = (ClientFrameMessage *)message;
+	ClientFrameMessage *msg = (ClientFrameMessage *)message.Data();
+
+	// The frame data directly follows the message in the same buffer.
+	Byte *frame = message.Data() + sizeof(ClientFrameMessage);
+	uint32 frame_size = msg->Frame.FrameSize;
+
+	// The ring is shared with the preview thread, the lock is only held to look it up.
+	std::shared_ptr<FrameRing> frames;
+	{
+		std::lock_guard<std::mutex> lock(m_ClientsMutex);
+		auto it = std::find(m_Clients.begin(), m_Clients.end(), clientAddr);
+		if (it != m_Clients.end())
+		{
+			it->FrameWidth = msg->Frame.FrameWidth;
+			it->FrameHeight = msg->Frame.FrameHeight;
+			frames = it->Frames;
+		}
+	}
 
 	bool frame_stored = false;
 	uint32 frame_number = 0;
-	auto it = std::find(m_Clients.begin(), m_Clients.end(), clientAddr);
-	if (it != m_Clients.end())
+	if (frames)
 	{
-		Byte *frame = new Byte[msg->Frame.FrameSize];
-		uint32 frame_size = msg->Frame.FrameSize;
-
-		Core::addr_t current_client;
-		int32 bytes_received = m_Socket->RecvLarge(frame, frame_size, &current_client);
-	//	assert(frame_size == bytes_received);
-		
-		it->FrameWidth = msg->Frame.FrameWidth;
-		it->FrameHeight = msg->Frame.FrameHeight;
-
-		cv::Mat image(cv::Size(msg->Frame.FrameWidth, msg->Frame.FrameHeight), msg->Frame.Format, frame, cv::Mat::AUTO_STEP);
-
-	//	cv::Mat image(msg->Frame.FrameHeight, msg->Frame.FrameWidth, msg->Frame.Format);
-	//	cv::Mat image(msg->Frame.FrameHeight, msg->Frame.FrameWidth, CV_8UC3);
-
-		int32 baseIndex = 0;
-		for (int32 i = 0; i < image.rows; i++)
+		if (msg->Frame.Codec == FRAME_CODEC_RAW)
 		{
-			for (int32 j = 0; j < image.cols; j++)
+			uint64 expected_size = (uint64)msg->Frame.FrameWidth * msg->Frame.FrameHeight * CV_ELEM_SIZE(msg->Frame.Format);
+			if (expected_size != frame_size)
 			{
-				image.at<cv::Vec3b>(i, j) = cv::Vec3b(frame[baseIndex + 0], frame[baseIndex + 1], frame[baseIndex + 2]);
-				baseIndex += 3;
+				CAM_LOG_ERROR("Raw frame of Client {0} has {1} bytes, expected {2}!", clientAddr.Value, frame_size, expected_size);
 			}
+			else
+			{
+				cv::Mat image(cv::Size(msg->Frame.FrameWidth, msg->Frame.FrameHeight), msg->Frame.Format, frame, cv::Mat::AUTO_STEP);
+				frame_stored = frames->Push(image);
+			}
+		}
+		else
+		{
+			// The client already compressed the frame, the ring adopts the received buffer without decoding, encoding or copying it.
+			EncodedFrame encoded;
+			encoded.Buffer = message;
+			encoded.Offset = sizeof(ClientFrameMessage);
+			encoded.Size = frame_size;
+			encoded.Width = msg->Frame.FrameWidth;
+			encoded.Height = msg->Frame.FrameHeight;
+			encoded.Format = msg->Frame.Format;
+			encoded.Codec = (FrameCodec)msg->Frame.Codec;
+			frame_stored = frames->PushEncoded(std::move(encoded));
 		}
-		
-		it->Frames.Push(image);
-		frame_stored = true;
-		frame_number = it->Frames.Size();
+
+		frame_number = frames->Size();
+	}
+
+	if (frame_stored)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_PreviewMutex);
+			++m_StoredFrames;
+		}
+		m_PreviewCondition.notify_one();
 	}
 
 	ServerFrameResponse response = {};
@@ -265,7 +359,7 @@ bool Server::OnClientFrame(Core::addr_t &clientAddr, Byte *message, int32 addrLe
 	response.Header.Version = m_Version;
 	response.FrameStored = frame_stored;
 	response.StoredFrameCount = frame_number;
-	m_Socket->Send(&response, sizeof(response), clientAddr);
+	m_Listener->Send(clientAddr, &response, sizeof(response));
 
 	CAM_LOG_INFO("Server received frame from Client {} successfully!", clientAddr.Value);
 	return true;
@@ -273,30 +367,69 @@ bool Server::OnClientFrame(Core::addr_t &clientAddr, Byte *message, int32 addrLe
 
 void Server::FramePreview()
 {
+	std::vector<ClientEntry> clients;
 	while (m_Running)
 	{
-		for (uint32 i = 0; i < m_Clients.size(); ++i)
+		uint64 stored_frames;
 		{
-			ClientEntry &client = m_Clients[i];
+			std::lock_guard<std::mutex> lock(m_PreviewMutex);
+			stored_frames = m_StoredFrames;
+		}
 
-			for (uint32 j = 0; j < client.Frames.Size(); ++j)
+		// The entries share their rings, the network thread may add or remove clients while the frames are decoded.
+		{
+			std::lock_guard<std::mutex> lock(m_ClientsMutex);
+			clients = m_Clients;
+		}
+
+		bool frame_shown = false;
+		for (ClientEntry &client : clients)
+		{
+			// Only decode the newest frame, and only if a new one arrived since the last preview.
+			uint64 sequence = client.Frames->GetSequence();
+			if (sequence == client.PreviewSequence)
 			{
-				cv::Mat frame = client.Frames.Front();
-				std::string &name = client.FrameTitle;
-				uint32 frame_width = client.FrameWidth;
-				uint32 frmae_height = client.FrameHeight;
+				continue;
+			}
 
-				cv::namedWindow(name.c_str(), cv::WND_PROP_FULLSCREEN);
-				cv::setWindowProperty(name.c_str(), cv::WND_PROP_FULLSCREEN, cv::WND_PROP_FULLSCREEN);
-				cv::imshow(name.c_str(), frame);
+			cv::Mat frame;
+			if (!client.Frames->Latest(&frame))
+			{
+				continue;
+			}
 
-				char key = cv::waitKey(1);
-				if (key == 'q')
+			{
+				std::lock_guard<std::mutex> lock(m_ClientsMutex);
+				auto it = std::find(m_Clients.begin(), m_Clients.end(), client.Address);
+				if (it != m_Clients.end() && it->Frames == client.Frames)
 				{
-					cv::destroyWindow(name.c_str());
+					it->PreviewSequence = sequence;
 				}
 			}
+
+			std::string &name = client.FrameTitle;
+
+			cv::namedWindow(name.c_str(), cv::WND_PROP_FULLSCREEN);
+			cv::setWindowProperty(name.c_str(), cv::WND_PROP_FULLSCREEN, cv::WND_PROP_FULLSCREEN);
+			cv::imshow(name.c_str(), frame);
+			frame_shown = true;
+
+			char key = cv::waitKey(1);
+			if (key == 'q')
+			{
+				cv::destroyWindow(name.c_str());
+			}
+		}
+
+		if (!frame_shown)
+		{
+			// Nothing changed, sleep until the next frame is stored. The windows still handle their events in between.
+			{
+				std::unique_lock<std::mutex> lock(m_PreviewMutex);
+				m_PreviewCondition.wait_for(lock, std::chrono::milliseconds(PREVIEW_WAIT_MS), [&]() { return m_StoredFrames != stored_frames || !m_Running; });
+			}
+
+			cv::waitKey(1);
 		}
 	}
 }
-
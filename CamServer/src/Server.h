@@ -5,9 +5,14 @@
 #include <unordered_map>
 #include <vector>
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
 
 #include <opencv2/opencv.hpp>
 
+#include "FrameRing.h"
+
 struct ServerConfig
 {
 	/// <summary>
@@ -24,25 +29,41 @@ struct ServerConfig
 	/// The duration in minutes of each camera feed to be kept in memory for saving to disk after something happened.
 	/// </summary>
 	uint32 VideoBackupDuration;
+
+	/// <summary>
+	/// The maximum memory in megabytes, the compressed frames of each camera feed may occupy.
+	/// </summary>
+	uint32 VideoBackupBudgetMB = 1024;
+
+	/// <summary>
+	/// The codec, which is used to compress the frames kept in memory.
+	/// </summary>
+	FrameCodec VideoBackupCodec = FRAME_CODEC_JPEG;
+
+	/// <summary>
+	/// The JPEG/WEBP quality (1-100) or PNG compression level (0-9) of the frames kept in memory.
+	/// </summary>
+	int32 VideoBackupQuality = 80;
 };
 
 struct ClientEntry
 {
 	Core::addr_t Address;
-	Core::RingBuffer<cv::Mat> Frames;
+	std::shared_ptr<FrameRing> Frames;
 	std::string FrameTitle;
 	uint32 FrameWidth;
 	uint32 FrameHeight;
+	uint64 PreviewSequence = 0;
 
-	ClientEntry(uint32 frame_size)
-		: Frames(Core::RingBuffer<cv::Mat>(frame_size))
+	ClientEntry(const FrameRingConfig &config)
+		: Frames(std::make_shared<FrameRing>(config))
 	{
 		Address = {};
 	}
 
 	inline bool operator==(const ClientEntry &other) const
 	{
-		return Address.Value == other.Address.Value && Frames.Size() == other.Frames.Size();
+		return Address.Value == other.Address.Value && Frames->Size() == other.Frames->Size();
 	}
 
 	inline bool operator!=(const ClientEntry &other) const
@@ -52,7 +73,7 @@ struct ClientEntry
 
 	friend bool operator==(ClientEntry &lhs, const ClientEntry &rhs)
 	{
-		return lhs.Address.Value == rhs.Address.Value && lhs.Frames.Size() == rhs.Frames.Size();
+		return lhs.Address.Value == rhs.Address.Value && lhs.Frames->Size() == rhs.Frames->Size();
 	}
 
 	friend bool operator!=(ClientEntry &lhs, const ClientEntry &rhs)
@@ -83,23 +104,35 @@ public:
 
 private:
 
-	bool Step();
+	void OnMessage(Core::addr_t clientAddr, const Core::BufferRef &message);
+	void OnConnectionLost(Core::addr_t clientAddr);
 
 	bool OnClientConnected(Core::addr_t &clientAddr, Byte *message, int32 addrLen);
 	bool OnClientDisconnected(Core::addr_t &clientAddr, Byte *message, int32 addrLen);
-	bool OnClientFrame(Core::addr_t &clientAddr, Byte *message, int32 addrLen);
+	bool OnClientFrame(Core::addr_t &clientAddr, const Core::BufferRef &message);
 
 	void FramePreview();
 
 private:
 
 	ServerConfig m_Config;
-	Core::Socket *m_Socket = nullptr;
+
+	// Received messages and stored frames share this pool, frames are kept in the message buffer they arrived in.
+	// Declared before the clients, so that it outlives all frames.
+	Core::BufferPool m_BufferPool;
+	Core::StreamServer *m_Listener = nullptr;
 
 	uint32 m_Version;
-	bool m_Running = true;
+	std::atomic<bool> m_Running = true;
 
+	// The network thread adds and removes clients, while the preview thread shows their frames.
+	std::mutex m_ClientsMutex;
 	std::vector<ClientEntry> m_Clients;
 	std::thread m_FramePreviewThread;
+
+	// Counts the stored frames, the preview thread waits for it to change instead of polling the rings.
+	std::mutex m_PreviewMutex;
+	std::condition_variable m_PreviewCondition;
+	uint64 m_StoredFrames = 0;
 };
 
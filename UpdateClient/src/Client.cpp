@@ -5,14 +5,15 @@
 
 #include "Utils/Utils.h"
 #include "Utils/ZipArchive.h"
+#include "Utils/BinaryDelta.h"
+#include "Utils/Chunker.h"
+#include "Utils/MerkleTree.h"
 #include "Core/Log.h"
 
-static uint32 MAX_RECV_ATTEMPTS = 250;
-
 Client::Client(const ClientConfig &config)
 	: m_Config(config)
 {
-	m_Socket = Core::Socket::Create();
+	m_Socket = Core::Socket::Create(Core::SocketType::Datagram);
 	m_Crypto = Core::Crypto::Create();
 
 	std::string cwd = "";
@@ -27,6 +28,7 @@ Client::Client(const ClientConfig &config)
 	CAM_LOG_INFO("Update source path    : {}", config.UpdateTargetPath);
 	CAM_LOG_INFO("Current Client version: {}", m_LocalVersion);
 	CAM_LOG_INFO("Current CWD           : {}", cwd);
+	CAM_LOG_INFO("Multicast group       : {0}:{1}", config.MulticastGroup, config.MulticastPort);
 	CAM_LOG_INFO("================================================================");
 
 	if (!m_Socket->Open(true, m_Config.ServerIP, m_Config.Port))
@@ -40,6 +42,19 @@ Client::Client(const ClientConfig &config)
 	}
 
 	m_Host = m_Socket->Lookup(m_Config.ServerIP, m_Config.Port);
+
+	if (!m_Config.MulticastGroup.empty())
+	{
+		m_CarouselSocket = Core::Socket::Create(Core::SocketType::Datagram);
+		if (!m_CarouselSocket->Open() || !m_CarouselSocket->BindMulticast(m_Config.MulticastGroup, m_Config.MulticastPort, m_Config.MulticastInterface) || !m_CarouselSocket->SetNonBlocking(true))
+		{
+			CAM_LOG_ERROR("Could not join the multicast group {0}:{1}, all pieces are requested from the server.", m_Config.MulticastGroup, m_Config.MulticastPort);
+
+			delete m_CarouselSocket;
+			m_CarouselSocket = nullptr;
+		}
+	}
+
 	Reset();
 }
 
@@ -48,6 +63,9 @@ Client::~Client()
 	delete m_Crypto;
 	m_Crypto = nullptr;
 
+	delete m_CarouselSocket;
+	m_CarouselSocket = nullptr;
+
 	delete m_Socket;
 	m_Socket = nullptr;
 }
@@ -71,60 +89,38 @@ void Client::Run()
 {
 	// When running for the first time, request the server version
 	RequestServerVersion();
+	m_LastRecvMS = Core::QueryMS();
 
 	for (;;)
 	{
-		if (m_CurrentRecvAttempt >= MAX_RECV_ATTEMPTS)
+		if (Core::QueryMS() - m_LastRecvMS >= RECV_TIMEOUT_MS)
 		{
-			m_CurrentRecvAttempt = 0;
 			break;
 		}
 
 		if (m_Status.Code == ClientStatusCode::UP_TO_DATE)
 		{
 			std::string zipFile = m_Config.UpdateBinaryPath + "/update.zip";
-			
-			// Construct the path to the target executable
-#if CAM_PLATFORM_WINDOWS
-			std::string camClientFile = m_Config.UpdateBinaryPath + "/CamClient.exe";
-#else
-			std::string camClientFile = m_Config.UpdateBinaryPath + "/CamClient";
-#endif
-
-
-			CAM_LOG_DEBUG("Extracting zip archive...");
-			Core::ZipArchive archive;
-			std::vector<Core::ZipFile> files = archive.Load(zipFile);
-			CAM_LOG_INFO("zip archive extracted successfully.");
+			std::string camClientFile = GetClientExecutablePath();
 
-			// Run through the archive and store the files on the disk.
-			CAM_LOG_DEBUG("Writing all files from archive to disk...");
-			for (const auto &file : files)
+			// Updates from the manifest are installed already, only a package has to be extracted.
+			if (Core::FileSystem::Get()->FileExists(zipFile))
 			{
-				std::string current_file = m_Config.UpdateBinaryPath + "/" + file.Name;
-				CAM_LOG_DEBUG("    Writing file {} to disk...", current_file);
-
-				bool writeSuccess = Core::FileSystem::Get()->WriteFile(current_file, file.Buffer, file.BufferSize);
-				if (!writeSuccess)
+				CAM_LOG_DEBUG("Extracting zip archive to {}...", GetStagingPath());
+				if (InstallPackage(zipFile))
 				{
-					CAM_LOG_ERROR("Failed to store file {} on disk!", current_file);
+					CAM_LOG_INFO("All files written successfully.");
 				}
-			}
-			CAM_LOG_INFO("All files written successfully.");
 
-			// Remove zip file
-			CAM_LOG_DEBUG("Trying to remove the update file...");
-			if (!Core::FileSystem::Get()->RemoveFile(zipFile))
-			{
-				CAM_LOG_ERROR("Failed to remove file {}", zipFile);
-			}
-			CAM_LOG_INFO("Update file successfully removed.");
-
-			// Clean up the RAM memory
-			for (auto &file : files)
-			{
-				delete[] file.Buffer;
-				file.Buffer = nullptr;
+				// The zip file was replaced together with the old files, unless the install failed.
+				if (Core::FileSystem::Get()->FileExists(zipFile))
+				{
+					CAM_LOG_DEBUG("Trying to remove the update file...");
+					if (!Core::FileSystem::Get()->RemoveFile(zipFile))
+					{
+						CAM_LOG_ERROR("Failed to remove file {}", zipFile);
+					}
+				}
 			}
 
 			// TODO: Update local version (maybe just receive it back from the server).
@@ -153,13 +149,18 @@ void Client::Run()
 		}
 
 		MessageLoop();
+		CarouselLoop();
 
 		// Process updates.
 		int64 now_ms = Core::QueryMS();
 		UpdateProgress(now_ms, m_Host);
 
-		// Limit the update rate.
-		Core::SleepMS(10);
+		// A finished update is installed right away, otherwise sleep until the server sends something or the next request is due.
+		if (m_Status.Code != ClientStatusCode::UP_TO_DATE)
+		{
+			Core::Socket *sockets[] = { m_Socket, m_CarouselSocket };
+			Core::Socket::WaitAny(sockets, m_CarouselSocket ? 2 : 1, GetWaitTimeoutMS(now_ms));
+		}
 	}
 }
 
@@ -173,11 +174,10 @@ void Client::MessageLoop()
 		int32 len = m_Socket->Recv(BUF, sizeof(BUF), &addr);
 		if (len < 0)
 		{
-			++m_CurrentRecvAttempt;
 			return;
 		}
 
-		m_CurrentRecvAttempt = 0;
+		m_LastRecvMS = Core::QueryMS();
 
 		// ignore all messages from unknown senders
 		if (addr.Value != m_Host.Value)
@@ -230,8 +230,44 @@ void Client::MessageLoop()
 				return;
 			}
 
+			// The begin request is repeated until the update starts, later answers would throw away the received pieces.
+			if (m_IsUpdating)
+			{
+				continue;
+			}
+
 			ServerUpdateBeginMessage *msg = (ServerUpdateBeginMessage *)BUF;
 			
+			// Verify that the piece size is one we can receive.
+			if (msg->PieceSize < MIN_PIECE_BYTES || msg->PieceSize > GetMaxPieceBytes(m_Config.MTU))
+			{
+				CAM_LOG_ERROR("Unexpected piece size {} proposed by the server!", msg->PieceSize);
+				return;
+			}
+
+			// The server sends the package instead, if it can not provide the requested payload.
+			uint16 payload = GetNextPayload();
+			if (msg->Payload != payload && msg->Payload != UpdatePayload::UPDATE_PACKAGE)
+			{
+				CAM_LOG_ERROR("Unexpected payload {} sent by the server!", msg->Payload);
+				return;
+			}
+
+			// Patches are only accepted for the package we still have.
+			if (msg->BaseVersion != 0 && (msg->Payload != UpdatePayload::UPDATE_PACKAGE || msg->BaseVersion != m_LocalVersion || m_ForceFullUpdate))
+			{
+				CAM_LOG_ERROR("Unexpected patch from version {} sent by the server!", msg->BaseVersion);
+				return;
+			}
+
+			// The chunk store has to belong to the received manifest, otherwise the server built a new update in the meantime.
+			if (msg->Payload == UpdatePayload::UPDATE_CHUNKS && msg->UpdateSize != m_Manifest.GetStoreSize())
+			{
+				CAM_LOG_WARN("The chunk store does not match the manifest, requesting the manifest again...");
+				m_HasManifest = false;
+				continue;
+			}
+
 			// Verify that the update size is reasonable (<200MB).
 			if (msg->UpdateSize == 0 || msg->UpdateSize >= (200 * 1024 * 1024))
 			{
@@ -239,26 +275,75 @@ void Client::MessageLoop()
 				return;
 			}
 
-			// Allocate space for update data.
-			if (!m_UpdateData.Alloc(msg->UpdateSize))
+			// The signature covers the root of the piece hashes, every piece is checked against them.
+			PieceRoot root = {};
+			memcpy(root.Root, msg->PieceRoot, sizeof(root.Root));
+			root.Version = m_ClientVersion;
+			root.BaseVersion = msg->BaseVersion;
+			root.UpdateSize = msg->UpdateSize;
+			root.PieceSize = msg->PieceSize;
+			root.Payload = msg->Payload;
+
+			if (!m_Crypto->TestSignature(msg->UpdateSignature.Data, SIG_BYTES, &root, sizeof(root), m_Config.PublicKey.Data, m_Config.PublicKey.Size))
 			{
-				CAM_LOG_ERROR("Could not allocated enough space for update!");
+				CAM_LOG_ERROR("The piece hashes of payload {} are not signed by the server!", msg->Payload);
+				m_Status.Code = ClientStatusCode::BAD_SIG;
 				return;
 			}
 
-			// Allocate space for the piece tracker table.
-			if (!m_UpdatePieces.Alloc((msg->UpdateSize + PIECE_BYTES - 1) / PIECE_BYTES))
+			m_PieceSize = msg->PieceSize;
+			m_Payload = msg->Payload;
+			m_BaseVersion = msg->BaseVersion;
+			m_PackageId = msg->PackageId;
+
+			uint32 piece_count = Core::MerkleTree::GetPieceCount(msg->UpdateSize, m_PieceSize);
+			m_HashesPerPiece = GetHashesPerPiece(m_PieceSize);
+			m_NodePieceCount = GetNodePieceCount(msg->UpdateSize, m_PieceSize);
+			m_HashPieceCount = GetHashPieceCount(msg->UpdateSize, m_PieceSize);
+			m_FirstDataPiece = m_NodePieceCount + m_HashPieceCount;
+
+			// The update is received into a file, a previous download of the same payload is continued.
+			bool resumed = false;
+			if (!m_Download.Open(GetPartialPath(), root, m_FirstDataPiece + piece_count, m_HashPieceCount * Core::SHA256_BYTES, piece_count * Core::SHA256_BYTES, &resumed))
 			{
-				CAM_LOG_ERROR("Could not allocated enough space for update!");
+				CAM_LOG_ERROR("Could not map the file {} for the update!", GetPartialPath());
 				return;
 			}
 
-			memcpy(&m_UpdateSignature, &msg->UpdateSignature, sizeof(Signature));
-			CAM_LOG_DEBUG("Received update begin request, total size: {}", msg->UpdateSize);
+			memcpy(m_PieceRoot, msg->PieceRoot, sizeof(m_PieceRoot));
+			m_PendingPieces.assign(m_FirstDataPiece + piece_count, false);
+			m_ReceivedNodePieces = 0;
+			m_CorruptPieceCount = 0;
+			m_HasPieceNodes = false;
+			m_Transfer.Reset(m_FirstDataPiece + piece_count);
+
+			if (m_Payload == UpdatePayload::UPDATE_CHUNKS)
+			{
+				SkipLocalChunks();
+			}
+
+			m_TransferStartMS = Core::QueryMS();
+
+			// Only the full package is sent in the carousel.
+			m_UpdateId = m_Payload == UpdatePayload::UPDATE_PACKAGE && m_BaseVersion == 0 ? msg->UpdateId : 0;
+			m_CarouselFirstPiece = CAM_INVALID_ID;
+			m_CarouselLastPiece = CAM_INVALID_ID;
+			m_CarouselPieceCount = 0;
+			m_CarouselWrapped = false;
+			m_CarouselRoundDone = false;
+			m_LastCarouselMS = 0;
+
+			CAM_LOG_DEBUG("Received update begin request, payload: {0}, total size: {1}, piece size: {2}, base version: {3}", m_Payload, msg->UpdateSize, m_PieceSize, m_BaseVersion);
 
 			m_Status.Bytes = 0;
-			m_Status.Total = m_UpdateData.Size;
+			m_Status.Total = m_Download.GetDataSize();
 
+			if (resumed)
+			{
+				ResumePieces();
+			}
+
+			m_LastFlushMS = m_TransferStartMS;
 			m_IsUpdating = true;
 			m_IsFinished = false;
 		}
@@ -270,6 +355,12 @@ void Client::MessageLoop()
 				return;
 			}
 
+			if (len < sizeof(ServerUpdatePieceMessage))
+			{
+				CAM_LOG_ERROR("Received wrong package size");
+				return;
+			}
+
 			ServerUpdatePieceMessage *msg = (ServerUpdatePieceMessage *)BUF;
 
 			// Verify that the tokens match.
@@ -280,9 +371,9 @@ void Client::MessageLoop()
 			}
 
 			// Verify that the message piece size is valid.
-			if (msg->PieceSize > PIECE_BYTES)
+			if (msg->PieceSize > m_PieceSize)
 			{
-				CAM_LOG_ERROR("Unexpected message piece size! Expected {0}, but got {1}", PIECE_BYTES, msg->PieceSize);
+				CAM_LOG_ERROR("Unexpected message piece size! Expected {0}, but got {1}", m_PieceSize, msg->PieceSize);
 				return;
 			}
 
@@ -294,48 +385,57 @@ void Client::MessageLoop()
 			}
 
 			// Verify that the position is on a piece boundry and something we actually requested.
-			if ((msg->PiecePos % PIECE_BYTES) != 0)
+			if ((msg->PiecePos % m_PieceSize) != 0)
 			{
 				// TODO: Log error
 				return;
 			}
 
-			// Verify that the data doesn't write outside the buffer.
-			if (msg->PiecePos + msg->PieceSize > m_UpdateData.Size)
+			// Verify the piece position.
+			uint32 idx = msg->PiecePos / m_PieceSize;
+			if (idx >= m_Transfer.GetPieceCount())
 			{
-				CAM_LOG_ERROR("The piece pos offset is larger than the update size!");
+				CAM_LOG_ERROR("The piece index is larger than the update size!");
 				return;
 			}
 
-			// Verify the piece position.
-			uint32 idx = msg->PiecePos / PIECE_BYTES;
-			if (idx >= m_UpdatePieces.Size)
+			// Validate that the piece size aligns with how we request data, this also keeps it inside the buffer.
+			if (msg->PieceSize != GetPieceBytes(idx))
 			{
-				CAM_LOG_ERROR("The piece index is larger than the update size!");
+				CAM_LOG_ERROR("Unexpected size {0} of piece {1}!", msg->PieceSize, idx);
 				return;
 			}
 
-			// Verify that we need the piece.
-			if (m_UpdatePieces.Ptr[idx])
+			// Pieces, which were requested again because they were late, can arrive twice.
+			if (m_Transfer.IsReceived(idx))
 			{
-				// TODO: Log error
+				continue;
+			}
+
+			m_Transfer.OnPieceReceived(idx, msg->RequestUS, Core::QueryUS());
+			AcceptPiece(idx, BUF + sizeof(ServerUpdatePieceMessage), msg->PieceSize);
+		}
+		else if (header->Type == MessageType::SERVER_UPDATE_RESTART)
+		{
+			if (len != sizeof(ServerUpdateRestartMessage))
+			{
+				CAM_LOG_ERROR("Received wrong package size");
 				return;
 			}
 
-			// Validate that the piece size aligns with how we request data.
-			if (idx < m_UpdatePieces.Size - 1)
+			// Every outstanding request is answered, only the first answer for the running download restarts it.
+			ServerUpdateRestartMessage *msg = (ServerUpdateRestartMessage *)BUF;
+			if (!m_IsUpdating || msg->ClientToken != m_ClientToken || msg->ServerToken != m_ServerToken || msg->PackageId != m_PackageId)
 			{
-				if (msg->PieceSize != PIECE_BYTES)
-				{
-					// TODO: Log error
-					return;
-				}
+				continue;
 			}
 
-			// Copy the update piece into the target buffer.
-			memcpy(m_UpdateData.Ptr + msg->PiecePos, BUF + sizeof(ServerUpdatePieceMessage), msg->PieceSize);
-			m_UpdatePieces.Ptr[idx] = 1;
-			m_Status.Bytes += msg->PieceSize;
+			// The manifest belongs to the replaced package as well, the next begin request is sent right away.
+			CAM_LOG_WARN("The server replaced the package {}, starting the update over...", msg->PackageId);
+			m_Download.Flush();
+			m_IsUpdating = false;
+			m_HasManifest = false;
+			m_LastUpdateMS = 0;
 		}
 		else if (header->Type == MessageType::SERVER_UPDATE_TOKEN)
 		{
@@ -358,6 +458,287 @@ void Client::MessageLoop()
 	}
 }
 
+void Client::CarouselLoop()
+{
+	if (!m_CarouselSocket)
+	{
+		return;
+	}
+
+	for (;;)
+	{
+		static Byte BUF[65536];
+
+		Core::addr_t addr;
+		int32 len = m_CarouselSocket->Recv(BUF, sizeof(BUF), &addr);
+		if (len < 0)
+		{
+			return;
+		}
+
+		// The group may be shared, only the pieces of our server for the package we download are used.
+		if (addr.Value != m_Host.Value || !m_IsUpdating || m_UpdateId == 0 || len < sizeof(ServerCarouselPieceMessage))
+		{
+			continue;
+		}
+
+		ServerCarouselPieceMessage *msg = (ServerCarouselPieceMessage *)BUF;
+		if (msg->Header.Type != MessageType::SERVER_CAROUSEL_PIECE || msg->UpdateId != m_UpdateId || msg->UpdateSize != m_Download.GetDataSize())
+		{
+			continue;
+		}
+
+		if (len != sizeof(ServerCarouselPieceMessage) + msg->PieceSize || (uint64)msg->PiecePos + msg->PieceSize > m_Download.GetDataSize())
+		{
+			CAM_LOG_ERROR("Received a damaged carousel piece!");
+			continue;
+		}
+
+		int64 now_ms = Core::QueryMS();
+		m_LastRecvMS = now_ms;
+		m_LastCarouselMS = now_ms;
+
+		// The carousel may use larger pieces than the ones we request, the pieces it covers completely are taken from it.
+		if ((msg->PiecePos % m_PieceSize) != 0)
+		{
+			continue;
+		}
+
+		// The carousel only carries the payload, its pieces come after the tree nodes and the piece hashes.
+		uint32 first = msg->PiecePos / m_PieceSize;
+		uint32 end = msg->PiecePos + msg->PieceSize;
+		for (uint32 idx = first; m_FirstDataPiece + idx < m_Transfer.GetPieceCount(); ++idx)
+		{
+			uint32 piece_pos = idx * m_PieceSize;
+			uint32 piece_size = GetPieceBytes(m_FirstDataPiece + idx);
+			if (piece_pos + piece_size > end)
+			{
+				break;
+			}
+
+			if (m_Transfer.IsReceived(m_FirstDataPiece + idx))
+			{
+				continue;
+			}
+
+			m_Transfer.Skip(m_FirstDataPiece + idx);
+			AcceptPiece(m_FirstDataPiece + idx, BUF + sizeof(ServerCarouselPieceMessage) + (piece_pos - msg->PiecePos), piece_size);
+			++m_CarouselPieceCount;
+		}
+
+		if (m_CarouselFirstPiece == CAM_INVALID_ID)
+		{
+			m_CarouselFirstPiece = first;
+		}
+		else if (first < m_CarouselLastPiece)
+		{
+			m_CarouselWrapped = true;
+		}
+
+		if (m_CarouselWrapped && first >= m_CarouselFirstPiece)
+		{
+			m_CarouselRoundDone = true;
+		}
+
+		m_CarouselLastPiece = first;
+	}
+}
+
+void Client::AcceptPiece(uint32 piece, const Byte *data, uint32 size)
+{
+	if (piece < m_NodePieceCount)
+	{
+		memcpy(m_Download.GetNodes() + (size_t)piece * m_PieceSize, data, size);
+		m_Download.SetStored(piece, true);
+
+		if (++m_ReceivedNodePieces == m_NodePieceCount)
+		{
+			VerifyPieceNodes();
+		}
+
+		return;
+	}
+
+	if (piece < m_FirstDataPiece)
+	{
+		memcpy(m_Download.GetHashes() + (size_t)(piece - m_NodePieceCount) * m_HashesPerPiece * Core::SHA256_BYTES, data, size);
+	}
+	else
+	{
+		memcpy(m_Download.GetData() + (size_t)(piece - m_FirstDataPiece) * m_PieceSize, data, size);
+		m_Status.Bytes += size;
+	}
+
+	m_Download.SetStored(piece, true);
+	m_PendingPieces[piece] = true;
+	VerifyPiece(piece);
+}
+
+void Client::VerifyPieceNodes()
+{
+	Byte root[Core::SHA256_BYTES];
+	Core::MerkleTree::ComputeRoot(m_Download.GetNodes(), m_HashPieceCount, root);
+
+	// The nodes can only be checked together, so all of them are requested again. There are few of them.
+	if (memcmp(root, m_PieceRoot, sizeof(root)) != 0)
+	{
+		CAM_LOG_WARN("The tree nodes do not match the signed root, requesting them again...");
+		for (uint32 i = 0; i < m_NodePieceCount; ++i)
+		{
+			m_Transfer.Reject(i);
+			m_Download.SetStored(i, false);
+		}
+
+		m_ReceivedNodePieces = 0;
+		m_CorruptPieceCount += m_NodePieceCount;
+		return;
+	}
+
+	m_HasPieceNodes = true;
+
+	for (uint32 piece = m_NodePieceCount; piece < m_FirstDataPiece; ++piece)
+	{
+		if (m_PendingPieces[piece])
+		{
+			VerifyPiece(piece);
+		}
+	}
+}
+
+void Client::VerifyPiece(uint32 piece)
+{
+	if (piece < m_FirstDataPiece)
+	{
+		if (!m_HasPieceNodes)
+		{
+			return;
+		}
+
+		uint32 hash_piece = piece - m_NodePieceCount;
+		uint32 first = hash_piece * m_HashesPerPiece;
+		uint32 count = GetPieceBytes(piece) / Core::SHA256_BYTES;
+
+		Byte node[Core::SHA256_BYTES];
+		Core::MerkleTree::ComputeRoot(m_Download.GetHashes() + (size_t)first * Core::SHA256_BYTES, count, node);
+		if (memcmp(node, m_Download.GetNodes() + (size_t)hash_piece * Core::SHA256_BYTES, sizeof(node)) != 0)
+		{
+			RejectPiece(piece);
+			return;
+		}
+
+		m_PendingPieces[piece] = false;
+
+		// The pieces of the payload, which arrived before their hashes, are checked now.
+		for (uint32 i = first; i < first + count; ++i)
+		{
+			if (m_PendingPieces[m_FirstDataPiece + i])
+			{
+				VerifyPiece(m_FirstDataPiece + i);
+			}
+		}
+
+		return;
+	}
+
+	// A hash piece is verified, once it has been received and is no longer pending.
+	uint32 data_piece = piece - m_FirstDataPiece;
+	uint32 hash_piece = m_NodePieceCount + data_piece / m_HashesPerPiece;
+	if (!m_Transfer.IsReceived(hash_piece) || m_PendingPieces[hash_piece])
+	{
+		return;
+	}
+
+	if (!Core::MerkleTree::VerifyPiece(m_Download.GetData() + (size_t)data_piece * m_PieceSize, GetPieceBytes(piece), m_Download.GetHashes() + (size_t)data_piece * Core::SHA256_BYTES))
+	{
+		RejectPiece(piece);
+		return;
+	}
+
+	m_PendingPieces[piece] = false;
+}
+
+void Client::RejectPiece(uint32 piece)
+{
+	CAM_LOG_WARN("Piece {} is corrupt, requesting it again...", piece);
+	m_Transfer.Reject(piece);
+	m_Download.SetStored(piece, false);
+	m_PendingPieces[piece] = false;
+	++m_CorruptPieceCount;
+
+	if (piece >= m_FirstDataPiece)
+	{
+		m_Status.Bytes -= GetPieceBytes(piece);
+	}
+}
+
+uint32 Client::GetPieceBytes(uint32 piece) const
+{
+	uint32 size = m_Download.GetDataSize();
+	uint32 pos = (piece - m_FirstDataPiece) * m_PieceSize;
+	uint32 piece_size = m_PieceSize;
+
+	if (piece < m_NodePieceCount)
+	{
+		size = m_HashPieceCount * Core::SHA256_BYTES;
+		pos = piece * m_PieceSize;
+	}
+	else if (piece < m_FirstDataPiece)
+	{
+		piece_size = m_HashesPerPiece * Core::SHA256_BYTES;
+		size = (m_Transfer.GetPieceCount() - m_FirstDataPiece) * Core::SHA256_BYTES;
+		pos = (piece - m_NodePieceCount) * piece_size;
+	}
+
+	return pos < size ? Core::utils::Min<uint32>(size - pos, piece_size) : 0;
+}
+
+void Client::ResumePieces()
+{
+	// The stored pieces are verified again, the pieces and their bits may have reached the disk in any order before the client stopped.
+	for (uint32 piece = 0; piece < m_Transfer.GetPieceCount(); ++piece)
+	{
+		if (!m_Download.IsStored(piece) || m_Transfer.IsReceived(piece))
+		{
+			continue;
+		}
+
+		m_Transfer.Skip(piece);
+		m_PendingPieces[piece] = true;
+
+		if (piece < m_NodePieceCount)
+		{
+			++m_ReceivedNodePieces;
+		}
+		else if (piece >= m_FirstDataPiece)
+		{
+			m_Status.Bytes += GetPieceBytes(piece);
+		}
+	}
+
+	CAM_LOG_INFO("Resuming the download of payload {0} with {1} of {2} pieces.", m_Payload, m_Transfer.GetReceivedCount(), m_Transfer.GetPieceCount());
+
+	if (m_ReceivedNodePieces == m_NodePieceCount)
+	{
+		VerifyPieceNodes();
+	}
+}
+
+std::string Client::GetPartialPath() const
+{
+	return m_Config.UpdateBinaryPath + "/update.part";
+}
+
+bool Client::IsWaitingForCarousel(int64 now_ms) const
+{
+	if (!m_CarouselSocket || m_UpdateId == 0 || m_CarouselRoundDone)
+	{
+		return false;
+	}
+
+	int64 last_ms = m_LastCarouselMS > m_TransferStartMS ? m_LastCarouselMS : m_TransferStartMS;
+	return now_ms - last_ms < CAROUSEL_TIMEOUT_MS;
+}
+
 #if 0
 bool Client::ExtractUpdate(const std::string &zipPath)
 {
@@ -418,6 +799,80 @@ bool Client::ExtractUpdate(const std::string &zipPath)
 }
 #endif
 
+std::string Client::GetPackagePath(uint32 version) const
+{
+	return m_Config.UpdateBinaryPath + "/package-" + std::to_string(version) + ".zip";
+}
+
+bool Client::ApplyPatch(std::vector<Byte> *out_package)
+{
+	uint32 base_size = 0;
+	Byte *base = Core::FileSystem::Get()->ReadFile(GetPackagePath(m_BaseVersion), &base_size);
+	if (!base)
+	{
+		CAM_LOG_ERROR("Could not read the package of version {}!", m_BaseVersion);
+		return false;
+	}
+
+	bool applied = Core::BinaryDelta::Apply(base, base_size, m_Download.GetData(), m_Download.GetDataSize(), out_package);
+
+	delete[] base;
+	base = nullptr;
+
+	return applied;
+}
+
+void Client::StorePackage(const Byte *package, uint32 package_size)
+{
+	std::string old_package = GetPackagePath(m_LocalVersion);
+	if (m_LocalVersion != m_ClientVersion && Core::FileSystem::Get()->FileExists(old_package))
+	{
+		if (!Core::FileSystem::Get()->RemoveFile(old_package))
+		{
+			CAM_LOG_ERROR("Failed to remove file {}", old_package);
+		}
+	}
+
+	std::string new_package = GetPackagePath(m_ClientVersion);
+	if (Core::FileSystem::Get()->FileExists(new_package))
+	{
+		Core::FileSystem::Get()->RemoveFile(new_package);
+	}
+
+	if (!Core::FileSystem::Get()->WriteFile(new_package, (void *)package, package_size))
+	{
+		CAM_LOG_ERROR("Failed to store file {} on disk!", new_package);
+	}
+}
+
+int32 Client::GetWaitTimeoutMS(int64 now_ms) const
+{
+	int64 deadline_ms = m_LastRecvMS + RECV_TIMEOUT_MS;
+	if (!m_IsFinished)
+	{
+		int64 next_request_ms = m_LastUpdateMS + UPDATE_BEGIN_INTERVAL_MS;
+		if (m_IsUpdating && IsWaitingForCarousel(now_ms))
+		{
+			// The missing pieces are requested, once the carousel stalls.
+			int64 last_ms = m_LastCarouselMS > m_TransferStartMS ? m_LastCarouselMS : m_TransferStartMS;
+			next_request_ms = last_ms + CAROUSEL_TIMEOUT_MS;
+		}
+		else if (m_IsUpdating)
+		{
+			// Pieces are requested again, once the oldest request timed out. Rounded up, so that it has timed out after the wait.
+			int64 timeout_us = m_Transfer.GetNextTimeoutUS();
+			next_request_ms = timeout_us < 0 ? now_ms : (timeout_us + 999) / 1000;
+		}
+
+		if (next_request_ms < deadline_ms)
+		{
+			deadline_ms = next_request_ms;
+		}
+	}
+
+	return deadline_ms > now_ms ? (int32)(deadline_ms - now_ms) : 0;
+}
+
 bool Client::LoadLocalVersion()
 {
 	// First load the local client version
@@ -433,16 +888,19 @@ bool Client::LoadLocalVersion()
 
 void Client::Reset()
 {
-	m_UpdateData.Free();
-	m_UpdatePieces.Free();
+	m_Download.Close();
+	m_Transfer.Reset(0);
+	m_PieceSize = 0;
+	m_Payload = UpdatePayload::UPDATE_PACKAGE;
+	m_BaseVersion = 0;
+	m_PackageId = 0;
+	m_UpdateId = 0;
 
 	m_IsFinished = true;
 	m_IsUpdating = false;
 
 	m_ClientToken = 0;
 	m_ServerToken = 0;
-
-	m_UpdateIdx = 0;
 }
 
 void Client::UpdateProgress(int64 now_ms, Core::addr_t addr)
@@ -455,7 +913,7 @@ void Client::UpdateProgress(int64 now_ms, Core::addr_t addr)
 
 	if (!m_IsUpdating)
 	{
-		if (now_ms - m_LastUpdateMS >= 1000)
+		if (now_ms - m_LastUpdateMS >= UPDATE_BEGIN_INTERVAL_MS)
 		{
 			m_LastUpdateMS = now_ms;
 			m_ClientToken = m_Crypto->GenToken();
@@ -468,6 +926,12 @@ void Client::UpdateProgress(int64 now_ms, Core::addr_t addr)
 			begin_update.ClientVersion = m_ClientVersion;
 			begin_update.ClientToken = m_ClientToken;
 			begin_update.ServerToken = m_ServerToken;
+			begin_update.MaxPieceSize = GetMaxPieceBytes(m_Config.MTU);
+			begin_update.Payload = GetNextPayload();
+
+			// With the package of the installed version at hand, a patch from it is enough.
+			bool has_package = !m_ForceFullUpdate && Core::FileSystem::Get()->FileExists(GetPackagePath(m_LocalVersion));
+			begin_update.LocalVersion = has_package ? m_LocalVersion : 0;
 			m_Socket->Send(&begin_update, sizeof(begin_update), m_Host);
 			m_Status.Code = ClientStatusCode::NONE;
 		}
@@ -476,79 +940,416 @@ void Client::UpdateProgress(int64 now_ms, Core::addr_t addr)
 	}
 
 	// We are updating
-	CAM_LOG_DEBUG("Loading update: {0} / {1}", m_UpdateIdx, m_UpdateData.Size);
-	if (m_UpdateIdx >= m_UpdatePieces.Size)
+	if (m_Transfer.IsComplete())
 	{
-		if (m_Crypto->TestSignature(m_UpdateSignature.Data, SIG_BYTES, m_UpdateData.Ptr, m_UpdateData.Size, m_Config.PublicKey.Data, m_Config.PublicKey.Size))
+		int64 duration_ms = Core::QueryMS() - m_TransferStartMS;
+		CAM_LOG_INFO("Received payload {0} with {1} bytes in {2} ms ({3:.1f} KB/s), {4} pieces requested again, {5} corrupt, window {6}, round trip {7} us, {8} pieces from the carousel.",
+			m_Payload, m_Status.Bytes, duration_ms, duration_ms > 0 ? (double)m_Status.Bytes / (double)duration_ms : 0.0,
+			m_Transfer.GetLostCount(), m_CorruptPieceCount, m_Transfer.GetWindow(), m_Transfer.GetRoundTripUS(), m_CarouselPieceCount);
+
+		switch (m_Payload)
 		{
-			std::string update_file = m_Config.UpdateBinaryPath + "/update.zip";
-			CAM_LOG_DEBUG("Writing file {}", update_file);
-			bool writeSuccess = Core::FileSystem::Get()->WriteFile(update_file, m_UpdateData.Ptr, m_UpdateData.Size);
-			m_IsFinished = true;
-			m_Status.Code = ClientStatusCode::UP_TO_DATE;
-			CAM_LOG_INFO("File {} written successfully.", update_file);
-			return;
+			case UpdatePayload::UPDATE_MANIFEST:
+				FinishManifest();
+				break;
+
+			case UpdatePayload::UPDATE_CHUNKS:
+				FinishChunks();
+				break;
+
+			default:
+				FinishPackage();
+				break;
 		}
-		else
+
+		return;
+	}
+
+	if (now_ms - m_LastFlushMS >= FLUSH_INTERVAL_MS)
+	{
+		m_LastFlushMS = now_ms;
+		m_Download.Flush();
+	}
+
+	// While the carousel delivers the package, only the pieces it missed are requested afterwards.
+	if (IsWaitingForCarousel(now_ms))
+	{
+		return;
+	}
+
+	// Update in progress, request the pieces the window has room for.
+	m_Transfer.DetectTimeouts(Core::QueryUS());
+	RequestPieces();
+}
+
+void Client::RequestPieces()
+{
+	ClientUpdatePieceMessage msg = {};
+	msg.Header.Version = m_LocalVersion;
+	msg.Header.Type = MessageType::CLIENT_UPDATE_PIECE;
+	msg.ClientToken = m_ClientToken;
+	msg.ServerToken = m_ServerToken;
+	msg.Payload = m_Payload;
+	msg.PackageId = m_PackageId;
+	msg.BaseVersion = m_BaseVersion;
+	msg.PieceSize = m_PieceSize;
+
+	// All requests of one call share the request time, the server answers them in order.
+	int64 now_us = Core::QueryUS();
+	msg.RequestUS = now_us;
+
+	while (m_Transfer.CanRequest())
+	{
+		msg.PieceCount = (uint16)m_Transfer.TakeRequests(now_us, msg.Pieces, MAX_PIECE_REQUESTS);
+		if (msg.PieceCount == 0)
 		{
-			m_Status.Code = ClientStatusCode::BAD_SIG;
-			CAM_DEBUG_BREAK;
+			break;
 		}
 
+		m_Socket->Send(&msg, GetPieceRequestBytes(msg.PieceCount), m_Host);
+	}
+}
+
+std::string Client::GetClientExecutablePath() const
+{
+#if CAM_PLATFORM_WINDOWS
+	return m_Config.UpdateBinaryPath + "/CamClient.exe";
+#else
+	return m_Config.UpdateBinaryPath + "/CamClient";
+#endif
+}
+
+uint16 Client::GetNextPayload() const
+{
+	if (m_HasManifest)
+	{
+		return UpdatePayload::UPDATE_CHUNKS;
+	}
+
+	if (m_ForceFullUpdate || Core::FileSystem::Get()->FileExists(GetPackagePath(m_LocalVersion)))
+	{
+		return UpdatePayload::UPDATE_PACKAGE;
+	}
+
+	// Without installed files, there are no chunks to reuse and the package is smaller.
+	return Core::FileSystem::Get()->FileExists(GetClientExecutablePath()) ? UpdatePayload::UPDATE_MANIFEST : UpdatePayload::UPDATE_PACKAGE;
+}
+
+void Client::FinishPackage()
+{
+	// Every piece matched the signed piece hashes on arrival. The patched package is verified against the hash stored in the patch.
+	std::vector<Byte> patched_package;
+	if (m_BaseVersion != 0 && !ApplyPatch(&patched_package))
+	{
+		CAM_LOG_WARN("Could not apply the patch from version {}, requesting the full package...", m_BaseVersion);
+		FallBackToPackage();
+		return;
+	}
+
+	const Byte *package = m_BaseVersion != 0 ? patched_package.data() : m_Download.GetData();
+	uint32 package_size = m_BaseVersion != 0 ? (uint32)patched_package.size() : m_Download.GetDataSize();
+
+	std::string update_file = m_Config.UpdateBinaryPath + "/update.zip";
+	CAM_LOG_DEBUG("Writing file {}", update_file);
+	if (!Core::FileSystem::Get()->WriteFile(update_file, (void *)package, package_size))
+	{
+		m_Status.Code = ClientStatusCode::BAD_WRITE;
+
 		Reset();
 		return;
 	}
 
-	// Update in progress, request pieces.
-	if (now_ms - m_LastPieceMS >= 100)
+	StorePackage(package, package_size);
+	m_Download.Discard();
+
+	m_IsFinished = true;
+	m_Status.Code = ClientStatusCode::UP_TO_DATE;
+	CAM_LOG_INFO("File {} written successfully.", update_file);
+}
+
+void Client::FinishManifest()
+{
+	if (!m_Manifest.Read(m_Download.GetData(), m_Download.GetDataSize()) || m_Manifest.GetVersion() != m_ClientVersion)
+	{
+		CAM_LOG_WARN("The manifest is damaged or for a different version, requesting the full package...");
+		FallBackToPackage();
+		return;
+	}
+
+	uint32 missing = FindLocalChunks();
+	m_HasManifest = true;
+	CAM_LOG_INFO("Found {0} of {1} chunks on disk.", m_Manifest.GetChunks().size() - missing, m_Manifest.GetChunks().size());
+
+	if (missing == 0)
+	{
+		FinishChunks();
+		return;
+	}
+
+	// The next update begin request asks for the chunk store right away, the server token stays valid.
+	m_Download.Discard();
+	m_IsUpdating = false;
+	m_LastUpdateMS = 0;
+}
+
+void Client::FinishChunks()
+{
+	if (!InstallChunks(m_Payload == UpdatePayload::UPDATE_CHUNKS ? m_Download.GetData() : nullptr))
 	{
-		m_LastPieceMS = now_ms;
+		if (m_Status.Code != ClientStatusCode::BAD_WRITE)
+		{
+			CAM_LOG_WARN("The chunks did not match the manifest, requesting the full package...");
+			FallBackToPackage();
+		}
+		else
+		{
+			Reset();
+		}
+
+		return;
+	}
+
+	m_HasManifest = false;
+	m_LocalChunks.clear();
+	m_LocalChunkOffsets.clear();
+	m_Download.Discard();
+
+	m_IsFinished = true;
+	m_Status.Code = ClientStatusCode::UP_TO_DATE;
+	CAM_LOG_INFO("Installed {} files from the manifest.", m_Manifest.GetFiles().size());
+}
 
-		CAM_LOG_DEBUG("Sending update piece request...");
-		ClientUpdatePieceMessage msg = {};
-		msg.Header.Version = m_LocalVersion;
-		msg.Header.Type = MessageType::CLIENT_UPDATE_PIECE;
-		msg.ClientToken = m_ClientToken;
-		msg.ServerToken = m_ServerToken;
+uint32 Client::FindLocalChunks()
+{
+	const std::vector<Core::ManifestChunk> &chunks = m_Manifest.GetChunks();
+	m_LocalChunks.clear();
+	m_LocalChunkOffsets.assign(chunks.size(), CAM_INVALID_ID);
 
-		bool found_missing = false;
-		uint32 end_idx = 0;
-		uint32 num_pieces = 0;
+	uint32 missing = (uint32)chunks.size();
+	std::vector<Core::chunk_t> file_chunks;
 
-		// Request missing piecees.
-		for (uint32 idx = m_UpdateIdx, end = m_UpdatePieces.Size; idx < end; ++idx)
+	for (const Core::ManifestFile &file : m_Manifest.GetFiles())
+	{
+		std::string path = m_Config.UpdateBinaryPath + "/" + file.Name;
+		if (!Core::FileSystem::Get()->FileExists(path))
 		{
-			if (!m_UpdatePieces.Ptr[idx])
+			continue;
+		}
+
+		uint32 size = 0;
+		Byte *data = Core::FileSystem::Get()->ReadFile(path, &size);
+		if (!data)
+		{
+			continue;
+		}
+
+		// The boundaries only depend on the contents, so unchanged parts of a file produce the same chunks as on the server.
+		Core::Chunker::Split(data, size, &file_chunks);
+		for (const Core::chunk_t &chunk : file_chunks)
+		{
+			Byte hash[Core::SHA256_BYTES];
+			Core::Sha256(data + chunk.Offset, chunk.Size, hash);
+
+			uint32 idx = m_Manifest.FindChunk(hash);
+			if (idx == CAM_INVALID_ID || m_LocalChunkOffsets[idx] != CAM_INVALID_ID)
 			{
-				// Keep track of the last valid idx.
-				if (!found_missing)
-				{
-					found_missing = true;
-					end_idx = idx;
-				}
+				continue;
+			}
 
-				msg.PiecePos = idx * PIECE_BYTES;
-				m_Socket->Send(&msg, sizeof(msg), m_Host);
+			m_LocalChunkOffsets[idx] = (uint32)m_LocalChunks.size();
+			m_LocalChunks.insert(m_LocalChunks.end(), data + chunk.Offset, data + chunk.Offset + chunk.Size);
+			--missing;
+		}
 
-				num_pieces += 1;
-				if (num_pieces > MAX_REQUESTS)
-				{
-					// Don't send too many.
-					break;
-				}
+		delete[] data;
+		data = nullptr;
+	}
+
+	return missing;
+}
+
+void Client::SkipLocalChunks()
+{
+	// The tree nodes and the piece hashes are always requested, the chunk store pieces come after them.
+	uint32 piece_count = m_Transfer.GetPieceCount() - m_FirstDataPiece;
+	std::vector<bool> needed(piece_count, false);
+
+	const std::vector<Core::ManifestChunk> &chunks = m_Manifest.GetChunks();
+	for (uint32 i = 0; i < chunks.size(); ++i)
+	{
+		if (m_LocalChunkOffsets[i] != CAM_INVALID_ID || chunks[i].StoredSize == 0)
+		{
+			continue;
+		}
+
+		uint32 first = chunks[i].StoredOffset / m_PieceSize;
+		uint32 last = (chunks[i].StoredOffset + chunks[i].StoredSize - 1) / m_PieceSize;
+		for (uint32 piece = first; piece <= last && piece < piece_count; ++piece)
+		{
+			needed[piece] = true;
+		}
+	}
+
+	for (uint32 piece = 0; piece < piece_count; ++piece)
+	{
+		if (!needed[piece])
+		{
+			m_Transfer.Skip(m_FirstDataPiece + piece);
+		}
+	}
+
+	CAM_LOG_INFO("Requesting {0} of {1} pieces of the chunk store.", piece_count - m_Transfer.GetReceivedCount(), piece_count);
+}
+
+bool Client::InstallChunks(const Byte *store)
+{
+	const std::vector<Core::ManifestChunk> &chunks = m_Manifest.GetChunks();
+	const std::vector<Core::ManifestFile> &files = m_Manifest.GetFiles();
+
+	// All files are assembled before the first one is written, the local chunks may come from any of them.
+	std::vector<std::vector<Byte>> contents(files.size());
+	for (uint32 i = 0; i < files.size(); ++i)
+	{
+		contents[i].resize(files[i].Size);
+
+		uint32 offset = 0;
+		for (uint32 chunk : files[i].Chunks)
+		{
+			Byte *dst = contents[i].data() + offset;
+			offset += chunks[chunk].Size;
+
+			if (m_LocalChunkOffsets[chunk] != CAM_INVALID_ID)
+			{
+				memcpy(dst, m_LocalChunks.data() + m_LocalChunkOffsets[chunk], chunks[chunk].Size);
+				continue;
 			}
+
+			if (!store || !m_Manifest.ExtractChunk(chunk, store + chunks[chunk].StoredOffset, dst))
+			{
+				CAM_LOG_ERROR("The chunk {0} of file {1} is damaged!", chunk, files[i].Name);
+				return false;
+			}
+		}
+	}
+
+	if (!PrepareStaging())
+	{
+		m_Status.Code = ClientStatusCode::BAD_WRITE;
+		return false;
+	}
+
+	for (uint32 i = 0; i < files.size(); ++i)
+	{
+		std::string path = GetStagingPath() + "/" + files[i].Name;
+		CAM_LOG_DEBUG("    Writing file {} to disk...", path);
+
+		// The staged files are created new, so they need the mode from the manifest to stay executable.
+		if (!Core::FileSystem::Get()->CreateDirectories(path.substr(0, path.find_last_of('/'))) ||
+			!Core::FileSystem::Get()->WriteFile(path, contents[i].data(), files[i].Size) ||
+			(files[i].Mode != 0 && !Core::FileSystem::Get()->SetFileMode(path, files[i].Mode)))
+		{
+			CAM_LOG_ERROR("Failed to store file {} on disk!", path);
+			Core::FileSystem::Get()->RemoveDirectoryTree(GetStagingPath());
+			m_Status.Code = ClientStatusCode::BAD_WRITE;
+			return false;
 		}
+	}
 
-		if (end_idx > m_UpdateIdx)
+	if (!CommitStaging())
+	{
+		m_Status.Code = ClientStatusCode::BAD_WRITE;
+		return false;
+	}
+
+	return true;
+}
+
+bool Client::InstallPackage(const std::string &zip_file)
+{
+	if (!PrepareStaging())
+	{
+		return false;
+	}
+
+	// The entries are decompressed straight into their files, neither the archive nor the files are held in memory.
+	Core::ThreadPool pool;
+	Core::ZipArchive archive;
+	if (!archive.Extract(zip_file, GetStagingPath(), &pool))
+	{
+		CAM_LOG_ERROR("Failed to extract the zip archive {}!", zip_file);
+		Core::FileSystem::Get()->RemoveDirectoryTree(GetStagingPath());
+		return false;
+	}
+
+	CAM_LOG_INFO("zip archive extracted successfully on {} threads.", pool.GetThreadCount());
+	return CommitStaging();
+}
+
+std::string Client::GetStagingPath() const
+{
+	return m_Config.UpdateBinaryPath + ".staging";
+}
+
+bool Client::PrepareStaging()
+{
+	std::string staging = GetStagingPath();
+	if (Core::FileSystem::Get()->DirectoryExists(staging) && !Core::FileSystem::Get()->RemoveDirectoryTree(staging))
+	{
+		CAM_LOG_ERROR("Failed to remove the directory {}", staging);
+		return false;
+	}
+
+	if (!Core::FileSystem::Get()->CreateDirectories(staging))
+	{
+		CAM_LOG_ERROR("Failed to create the directory {}", staging);
+		return false;
+	}
+
+	return true;
+}
+
+bool Client::CommitStaging()
+{
+	std::string staging = GetStagingPath();
+
+	// The kept packages are not part of the install, they are moved along, so that the next update can still be a patch.
+	std::vector<std::string> moved;
+	for (uint32 version : { m_ClientVersion, m_LocalVersion })
+	{
+		std::string package = GetPackagePath(version);
+		std::string staged_package = staging + package.substr(m_Config.UpdateBinaryPath.size());
+		if (Core::FileSystem::Get()->FileExists(package) && Core::FileSystem::Get()->RenameFile(package, staged_package))
 		{
-			m_UpdateIdx = end_idx;
+			moved.push_back(package);
 		}
+	}
 
-		if (!found_missing)
+	if (!Core::FileSystem::Get()->ReplaceDirectory(staging, m_Config.UpdateBinaryPath))
+	{
+		CAM_LOG_ERROR("Failed to replace the directory {0} with {1}", m_Config.UpdateBinaryPath, staging);
+
+		for (const std::string &package : moved)
 		{
-			m_UpdateIdx = m_UpdatePieces.Size;
-			CAM_LOG_INFO("Requested all update pieces successfully.");
+			Core::FileSystem::Get()->RenameFile(staging + package.substr(m_Config.UpdateBinaryPath.size()), package);
 		}
+
+		Core::FileSystem::Get()->RemoveDirectoryTree(staging);
+		return false;
 	}
+
+	return true;
 }
 
+void Client::FallBackToPackage()
+{
+	m_ForceFullUpdate = true;
+	m_HasManifest = false;
+	m_LocalChunks.clear();
+	m_LocalChunkOffsets.clear();
+
+	// The partial file holds the payload, which could not be used.
+	m_Download.Discard();
+	Reset();
+	m_IsFinished = false;
+	m_LastUpdateMS = 0;
+}
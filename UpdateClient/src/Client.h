@@ -3,8 +3,12 @@
 #include <Cam-Core.h>
 
 #include <string>
+#include <vector>
 
 #include "Message.h"
+#include "PartialDownload.h"
+#include "TransferWindow.h"
+#include "Utils/UpdateManifest.h"
 
 struct ClientConfig
 {
@@ -28,6 +32,27 @@ struct ClientConfig
 	/// </summary>
 	uint16 Port;
 
+	/// <summary>
+	/// The MTU of the network, the largest update piece, which still fits into a single datagram, is requested from the server.
+	/// </summary>
+	uint32 MTU = DEFAULT_MTU;
+
+	/// <summary>
+	/// The multicast group of the server carousel, the full package is received from it and only the missing pieces are requested.
+	/// An empty string disables the carousel.
+	/// </summary>
+	std::string MulticastGroup;
+
+	/// <summary>
+	/// The port of the multicast group.
+	/// </summary>
+	uint16 MulticastPort = 0;
+
+	/// <summary>
+	/// The IP v4 address of the interface the group is joined on, an empty string lets the system choose.
+	/// </summary>
+	std::string MulticastInterface;
+
 	/// <summary>
 	/// The public key, generated when starting the update client
 	/// </summary>
@@ -84,24 +109,225 @@ public:
 
 private:
 
+	/// <summary>
+	/// Requests as many missing pieces from the server, as the transfer window allows.
+	/// </summary>
+	void RequestPieces();
+
 	void MessageLoop();
+
+	/// <summary>
+	/// Stores a received piece and verifies it, corrupt pieces are requested again right away.
+	/// Pieces, which arrive before the hashes they are checked against, stay pending until those have been verified.
+	/// </summary>
+	/// <param name="piece">The index of the piece across the node pieces, the hash pieces and the pieces of the payload.</param>
+	void AcceptPiece(uint32 piece, const Byte *data, uint32 size);
+
+	/// <summary>
+	/// Checks the received tree nodes against the signed root and verifies the pending hash pieces.
+	/// </summary>
+	void VerifyPieceNodes();
+
+	/// <summary>
+	/// Verifies a pending hash piece against its tree node, or a pending piece of the payload against its hash.
+	/// Nothing happens, if the node or the hash has not been verified yet.
+	/// </summary>
+	void VerifyPiece(uint32 piece);
+
+	/// <summary>
+	/// Marks a corrupt piece as missing, so that it is requested again.
+	/// </summary>
+	void RejectPiece(uint32 piece);
+
+	/// <summary>
+	/// Returns the expected size of a piece, the last piece of each section may be shorter.
+	/// </summary>
+	uint32 GetPieceBytes(uint32 piece) const;
+
+	/// <summary>
+	/// Marks the pieces as received, which a previous run of the client stored in the partial file.
+	/// They are verified like pieces from the server, before they are used.
+	/// </summary>
+	void ResumePieces();
+
+	/// <summary>
+	/// Returns the path of the partial file, the update is downloaded into.
+	/// </summary>
+	std::string GetPartialPath() const;
+
+	/// <summary>
+	/// Receives the pieces of the server carousel, which belong to the package being downloaded.
+	/// </summary>
+	void CarouselLoop();
+
+	/// <summary>
+	/// Returns true, if the pieces are still expected from the carousel, missing pieces are only requested once a round is over or the carousel stalls.
+	/// </summary>
+	/// <param name="now_ms">The current time in milliseconds.</param>
+	bool IsWaitingForCarousel(int64 now_ms) const;
+
+	/// <summary>
+	/// Returns the time, the client can sleep until it has to send the next request or gives up waiting for the server.
+	/// </summary>
+	/// <param name="now_ms">The current time in milliseconds.</param>
+	int32 GetWaitTimeoutMS(int64 now_ms) const;
+
+	/// <summary>
+	/// Returns the path, where the package of the given version is kept, so that the next update can be a patch from it.
+	/// </summary>
+	std::string GetPackagePath(uint32 version) const;
+
+	/// <summary>
+	/// Applies the received patch to the kept package of the base version.
+	/// </summary>
+	/// <returns>Returns false, if the package is missing or does not match the patch.</returns>
+	bool ApplyPatch(std::vector<Byte> *out_package);
+
+	/// <summary>
+	/// Keeps the received package of the new version and removes the one of the installed version.
+	/// </summary>
+	void StorePackage(const Byte *package, uint32 package_size);
+
+	/// <summary>
+	/// Returns the path of the CamClient executable, which is installed by the update.
+	/// </summary>
+	std::string GetClientExecutablePath() const;
+
+	/// <summary>
+	/// Returns the payload, which is requested with the next update begin request.
+	/// The manifest is preferred, if a client is installed and there is no package to patch.
+	/// </summary>
+	uint16 GetNextPayload() const;
+
+	/// <summary>
+	/// Handles a completely received payload.
+	/// </summary>
+	void FinishPackage();
+	void FinishManifest();
+	void FinishChunks();
+
+	/// <summary>
+	/// Splits the installed files into chunks and keeps the ones, which are part of the manifest.
+	/// </summary>
+	/// <returns>Returns the number of chunks, which have to be downloaded.</returns>
+	uint32 FindLocalChunks();
+
+	/// <summary>
+	/// Marks all pieces of the chunk store as received, which only contain chunks found on disk.
+	/// </summary>
+	void SkipLocalChunks();
+
+	/// <summary>
+	/// Assembles the files of the manifest from the local chunks and the chunk store and writes them to disk.
+	/// </summary>
+	/// <param name="store">The received chunk store, may be nullptr if all chunks were found on disk.</param>
+	/// <returns>Returns false, if a chunk is missing or damaged.</returns>
+	bool InstallChunks(const Byte *store);
+
+	/// <summary>
+	/// Drops the manifest and restarts the update with the full package.
+	/// </summary>
+	void FallBackToPackage();
+
+	/// <summary>
+	/// Extracts the received package into the staging directory, using all cores, and swaps it in.
+	/// </summary>
+	/// <returns>Returns false, if the package could not be extracted. The installed files are left untouched then.</returns>
+	bool InstallPackage(const std::string &zip_file);
+
+	/// <summary>
+	/// Returns the directory, the new files are written to, before they replace the installed ones at once.
+	/// </summary>
+	std::string GetStagingPath() const;
+
+	/// <summary>
+	/// Creates an empty staging directory, left overs of an interrupted install are removed.
+	/// </summary>
+	bool PrepareStaging();
+
+	/// <summary>
+	/// Moves the kept packages into the staging directory and replaces the installed files with it.
+	/// </summary>
+	bool CommitStaging();
+
 	//bool ExtractUpdate(const std::string &zipPath);
 	bool LoadLocalVersion();
 
 private:
 
-	static constexpr uint32 MAX_REQUESTS = 32;
+	/// <summary>
+	/// The interval, in which the update begin request is repeated until the server starts the update.
+	/// </summary>
+	static constexpr int64 UPDATE_BEGIN_INTERVAL_MS = 1000;
+
+	/// <summary>
+	/// The client stops, if the server did not send anything for this long.
+	/// </summary>
+	static constexpr int64 RECV_TIMEOUT_MS = 2500;
+
+	/// <summary>
+	/// The missing pieces are requested from the server, if the carousel did not send anything for this long.
+	/// </summary>
+	static constexpr int64 CAROUSEL_TIMEOUT_MS = 1000;
+
+	/// <summary>
+	/// The received pieces are written back to the partial file at this interval, a crash loses at most this much of the download.
+	/// </summary>
+	static constexpr int64 FLUSH_INTERVAL_MS = 1000;
 
 	ClientConfig m_Config;
 	Core::Socket *m_Socket = nullptr;
+	Core::Socket *m_CarouselSocket = nullptr;
 	Core::Crypto *m_Crypto = nullptr;
 	Core::addr_t m_Host;
 
-	Core::Buffer m_UpdateData;
-	Core::Buffer m_UpdatePieces;
+	PartialDownload m_Download;
+	TransferWindow m_Transfer;
+	uint16 m_PieceSize = 0;
+
+	// The hash tree of the payload, the nodes and hashes are stored in m_Download. The node pieces come first, then the hash pieces
+	// and the pieces of the payload from m_FirstDataPiece on. Received pieces, which have not been verified yet, are marked in m_PendingPieces.
+	Byte m_PieceRoot[Core::SHA256_BYTES];
+	std::vector<bool> m_PendingPieces;
+	uint32 m_HashesPerPiece = 0;
+	uint32 m_NodePieceCount = 0;
+	uint32 m_HashPieceCount = 0;
+	uint32 m_FirstDataPiece = 0;
+	uint32 m_ReceivedNodePieces = 0;
+	uint32 m_CorruptPieceCount = 0;
+	bool m_HasPieceNodes = false;
+
+	// The version the update is a patch for, 0 while the full package is downloaded.
+	uint32 m_BaseVersion = 0;
+
+	// The build of the update on the server, the pieces are requested from it until the download is done.
+	uint64 m_PackageId = 0;
+
+	// Set, if a patch or the chunks could not be applied. Only the full package is requested from then on.
+	bool m_ForceFullUpdate = false;
+
+	// The payload, which is downloaded at the moment.
+	uint16 m_Payload = UpdatePayload::UPDATE_PACKAGE;
+
+	// The received manifest. The chunks found on disk are kept in m_LocalChunks, the offsets are CAM_INVALID_ID for missing chunks.
+	Core::UpdateManifest m_Manifest;
+	std::vector<Byte> m_LocalChunks;
+	std::vector<uint32> m_LocalChunkOffsets;
+	bool m_HasManifest = false;
+
+	// The carousel pieces of the current package. A round is complete, once the carousel wrapped around and reached the first received piece again.
+	uint64 m_UpdateId = 0;
+	uint32 m_CarouselFirstPiece = CAM_INVALID_ID;
+	uint32 m_CarouselLastPiece = CAM_INVALID_ID;
+	uint32 m_CarouselPieceCount = 0;
+	bool m_CarouselWrapped = false;
+	bool m_CarouselRoundDone = false;
+	int64 m_LastCarouselMS = 0;
 
-	int64 m_LastUpdateMS;
-	int64 m_LastPieceMS;
+	int64 m_LastUpdateMS = 0;
+	int64 m_LastRecvMS = 0;
+	int64 m_TransferStartMS = 0;
+	int64 m_LastFlushMS = 0;
 	uint64 m_ClientToken;
 	uint64 m_ServerToken;
 	uint32 m_ClientVersion;
@@ -109,8 +335,5 @@ private:
 	ClientStatus m_Status;
 	bool m_IsFinished = true;
 	bool m_IsUpdating = false;
-	uint32 m_UpdateIdx;
-	uint32 m_CurrentRecvAttempt = 0;
-	Signature m_UpdateSignature;
 };
 
@@ -30,6 +30,9 @@ int main(int argc, char *argv[])
 	config.UpdateBinaryPath = "../CamClient/new_update";
 	config.ServerIP = "127.0.0.1";
 	config.Port = 44200;
+	config.MulticastGroup = "239.255.42.1";
+	config.MulticastPort = 44201;
+	config.MulticastInterface = "127.0.0.1";
 	Client c(config);
 
 	// Run the client
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Cam-Core.h>
+#include <cstddef>
 
 enum MessageType : uint16
 {
@@ -11,11 +12,45 @@ enum MessageType : uint16
 	SERVER_RECEIVE_VERSION,
 	SERVER_UPDATE_TOKEN,
 	SERVER_UPDATE_BEGIN,
-	SERVER_UPDATE_PIECE
+	SERVER_UPDATE_PIECE,
+	SERVER_CAROUSEL_PIECE,
+	SERVER_UPDATE_RESTART
+};
+
+/// <summary>
+/// What is transferred with the update pieces.
+/// </summary>
+enum UpdatePayload : uint16
+{
+	/// <summary>
+	/// The zip package, or a patch to it if the client has the package of an older version.
+	/// </summary>
+	UPDATE_PACKAGE = 0,
+
+	/// <summary>
+	/// The signed manifest, which lists the chunks of all files.
+	/// </summary>
+	UPDATE_MANIFEST,
+
+	/// <summary>
+	/// The chunk store of the manifest, the client only requests the pieces with chunks it does not have.
+	/// </summary>
+	UPDATE_CHUNKS
 };
 
 #define SIG_BYTES 512
-#define PIECE_BYTES 1024
+
+// The MTU, which is assumed if nothing else is configured (Ethernet).
+#define DEFAULT_MTU 1500
+
+// The IPv4 and UDP headers, which are part of every datagram.
+#define UDP_HEADER_BYTES 28
+
+// The smallest piece size, which both sides have to support.
+#define MIN_PIECE_BYTES 512
+
+// The number of pieces, which can be requested with a single message.
+#define MAX_PIECE_REQUESTS 64
 
 struct Signature
 {
@@ -47,14 +82,65 @@ struct ClientUpdateBeginMessage
 	uint64 ClientToken;
 	uint64 ServerToken;
 	uint32 ClientVersion;
+
+	/// <summary>
+	/// The largest piece size the client can receive, the server answers with the piece size used for the update.
+	/// </summary>
+	uint16 MaxPieceSize;
+
+	/// <summary>
+	/// The requested UpdatePayload.
+	/// </summary>
+	uint16 Payload;
+
+	/// <summary>
+	/// The version of the package the client still has, the server sends a patch from it, if it has one.
+	/// 0 requests the full package.
+	/// </summary>
+	uint32 LocalVersion;
 };
 
+/// <summary>
+/// Describes a payload as it is split into pieces, the server signs it and sends the signature with the update begin message.
+/// The root is the root of the hash tree over all pieces (see Core::MerkleTree). The pieces of an update are sent in three sections:
+/// the tree nodes, which cover the leaves of one hash piece each, the hash pieces with the piece hashes, and the pieces of the payload.
+/// The nodes are checked against the root, each hash piece against its node and each payload piece against its hash, as soon as they arrive.
+/// </summary>
+struct PieceRoot
+{
+	Byte Root[Core::SHA256_BYTES];
+	uint32 Version;
+	uint32 BaseVersion;
+	uint32 UpdateSize;
+	uint16 PieceSize;
+	uint16 Payload;
+};
+
+/// <summary>
+/// Requests several pieces at once, the server answers with one ServerUpdatePieceMessage per piece.
+/// Only the first PieceCount entries of Pieces are sent, see GetPieceRequestBytes.
+/// The pieces are numbered across the node pieces, the hash pieces and the pieces of the payload, see PieceRoot.
+/// </summary>
 struct ClientUpdatePieceMessage
 {
 	header_t Header;
 	uint64 ClientToken;
 	uint64 ServerToken;
-	uint32 PiecePos;
+
+	/// <summary>
+	/// The time the request was sent in microseconds, echoed by the server to measure the round trip time.
+	/// </summary>
+	int64 RequestUS;
+
+	/// <summary>
+	/// The package, payload, base version and piece size, which the server announced in the update begin message.
+	/// </summary>
+	uint64 PackageId;
+	uint16 Payload;
+	uint32 BaseVersion;
+	uint16 PieceSize;
+	uint16 PieceCount;
+	uint32 Pieces[MAX_PIECE_REQUESTS];
 };
 
 struct ServerVersionInfoMessage
@@ -70,6 +156,31 @@ struct ServerUpdateBeginMessage
 	uint64 ClientToken;
 	uint64 ServerToken;
 	uint32 UpdateSize;
+	uint16 PieceSize;
+	uint16 Payload;
+
+	/// <summary>
+	/// The version the update is a patch for, or 0 if the update is the full package.
+	/// The size and the signature belong to the patch in that case.
+	/// The chunk store is not signed, its chunks are checked against the hashes in the manifest.
+	/// </summary>
+	uint32 BaseVersion;
+
+	/// <summary>
+	/// The root of the hashes of all pieces, UpdateSignature signs the PieceRoot built from it.
+	/// </summary>
+	Byte PieceRoot[Core::SHA256_BYTES];
+
+	/// <summary>
+	/// Identifies the build of the update the payload belongs to. The server keeps sending the pieces of this build,
+	/// even if it has been replaced by a newer one in the meantime.
+	/// </summary>
+	uint64 PackageId;
+
+	/// <summary>
+	/// Identifies the full package in the carousel pieces, or 0 if the server does not send the update in a carousel.
+	/// </summary>
+	uint64 UpdateId;
 	Signature UpdateSignature;
 };
 
@@ -85,9 +196,91 @@ struct ServerUpdatePieceMessage
 	header_t Header;
 	uint64 ClientToken;
 	uint64 ServerToken;
+	int64 RequestUS;
+	uint32 PiecePos;
+	uint16 PieceSize;
+};
+
+/// <summary>
+/// Answers a piece request for a package, which the server does not have anymore, because it has been replaced more than once
+/// during the download. The client starts the update over with CLIENT_UPDATE_BEGIN.
+/// </summary>
+struct ServerUpdateRestartMessage
+{
+	header_t Header;
+	uint64 ClientToken;
+	uint64 ServerToken;
+	uint64 PackageId;
+};
+
+/// <summary>
+/// A piece of the full package, which the server streams to the multicast group in a carousel, while clients download the package.
+/// Every client, which downloads the same package, uses it. The piece data follows the message.
+/// </summary>
+struct ServerCarouselPieceMessage
+{
+	header_t Header;
+	uint64 UpdateId;
+	uint32 UpdateSize;
 	uint32 PiecePos;
 	uint16 PieceSize;
 };
 
 #pragma pack(pop)
 
+/// <summary>
+/// Returns the size of a piece request message, which requests the given number of pieces.
+/// </summary>
+inline uint32 GetPieceRequestBytes(uint32 piece_count)
+{
+	return (uint32)(offsetof(ClientUpdatePieceMessage, Pieces) + piece_count * sizeof(uint32));
+}
+
+/// <summary>
+/// Returns the number of piece hashes in a hash piece. It is a power of two, so that each hash piece is covered by a single tree node.
+/// </summary>
+inline uint32 GetHashesPerPiece(uint16 piece_size)
+{
+	uint32 count = 1;
+	while (count * 2 * Core::SHA256_BYTES <= piece_size)
+	{
+		count *= 2;
+	}
+
+	return count;
+}
+
+/// <summary>
+/// Returns the number of hash pieces of a payload, they come after the node pieces.
+/// </summary>
+inline uint32 GetHashPieceCount(uint32 update_size, uint16 piece_size)
+{
+	uint32 piece_count = (update_size + piece_size - 1) / piece_size;
+	return (piece_count + GetHashesPerPiece(piece_size) - 1) / GetHashesPerPiece(piece_size);
+}
+
+/// <summary>
+/// Returns the number of node pieces of a payload, they are the first pieces of the update.
+/// </summary>
+inline uint32 GetNodePieceCount(uint32 update_size, uint16 piece_size)
+{
+	uint64 node_bytes = (uint64)GetHashPieceCount(update_size, piece_size) * Core::SHA256_BYTES;
+	return (uint32)((node_bytes + piece_size - 1) / piece_size);
+}
+
+/// <summary>
+/// Returns the largest piece size, for which a piece message still fits into a single datagram of the given MTU.
+/// </summary>
+inline uint16 GetMaxPieceBytes(uint32 mtu)
+{
+	const uint32 overhead = UDP_HEADER_BYTES + sizeof(ServerUpdatePieceMessage);
+	const uint32 max_datagram = 65535;
+
+	if (mtu > max_datagram)
+	{
+		mtu = max_datagram;
+	}
+
+	return mtu > overhead + MIN_PIECE_BYTES ? (uint16)(mtu - overhead) : MIN_PIECE_BYTES;
+}
+
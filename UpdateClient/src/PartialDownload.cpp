@@ -0,0 +1,95 @@
+#include "PartialDownload.h"
+
+#include <string.h>
+
+#include "Core/Log.h"
+
+PartialDownload::PartialDownload()
+{
+	m_File = Core::MappedFile::Create();
+}
+
+PartialDownload::~PartialDownload()
+{
+	delete m_File;
+	m_File = nullptr;
+}
+
+bool PartialDownload::Open(const std::string &path, const PieceRoot &root, uint32 piece_count, uint32 node_bytes, uint32 hash_bytes, bool *out_resumed)
+{
+	Close();
+
+	m_Path = path;
+	m_NodeOffset = sizeof(FileHeader);
+	m_HashOffset = m_NodeOffset + node_bytes;
+	m_DataOffset = m_HashOffset + hash_bytes;
+	m_BitsOffset = m_DataOffset + root.UpdateSize;
+	m_DataSize = root.UpdateSize;
+	m_PieceCount = piece_count;
+
+	uint64 file_size = m_BitsOffset + (piece_count + 7) / 8;
+	if (!m_File->Open(path, file_size))
+	{
+		return false;
+	}
+
+	// The signed root identifies the contents, a file of another version, payload or piece size starts over.
+	FileHeader *header = (FileHeader *)m_File->GetData();
+	*out_resumed = header->Magic == MAGIC && header->PieceCount == piece_count && memcmp(&header->Root, &root, sizeof(root)) == 0;
+
+	if (!*out_resumed)
+	{
+		memset(m_File->GetData() + m_BitsOffset, 0, (piece_count + 7) / 8);
+
+		header->Magic = MAGIC;
+		header->PieceCount = piece_count;
+		header->Root = root;
+	}
+
+	return true;
+}
+
+void PartialDownload::Close()
+{
+	m_File->Close();
+}
+
+void PartialDownload::Discard()
+{
+	if (m_Path.empty())
+	{
+		return;
+	}
+
+	m_File->Close();
+	if (Core::FileSystem::Get()->FileExists(m_Path) && !Core::FileSystem::Get()->RemoveFile(m_Path))
+	{
+		CAM_LOG_ERROR("Failed to remove file {}", m_Path);
+	}
+
+	m_Path.clear();
+}
+
+void PartialDownload::Flush()
+{
+	m_File->Flush();
+}
+
+void PartialDownload::SetStored(uint32 piece, bool stored)
+{
+	Byte *bits = m_File->GetData() + m_BitsOffset;
+	if (stored)
+	{
+		bits[piece / 8] |= (Byte)(1 << (piece % 8));
+	}
+	else
+	{
+		bits[piece / 8] &= (Byte)~(1 << (piece % 8));
+	}
+}
+
+bool PartialDownload::IsStored(uint32 piece) const
+{
+	const Byte *bits = m_File->GetData() + m_BitsOffset;
+	return piece < m_PieceCount && (bits[piece / 8] & (1 << (piece % 8))) != 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Cam-Core.h>
+
+#include <string>
+
+#include "Message.h"
+
+/// <summary>
+/// Keeps a download in a memory-mapped file, so that the update does not have to fit into the heap and a restarted client
+/// continues where it stopped. The file holds a header, the tree nodes, the piece hashes, the payload and one bit per stored piece.
+/// </summary>
+class PartialDownload
+{
+public:
+
+	PartialDownload();
+	~PartialDownload();
+
+	/// <summary>
+	/// Opens the partial file for the payload described by root. The contents of an existing file are kept,
+	/// if it belongs to the same payload, otherwise the file starts over empty.
+	/// </summary>
+	/// <param name="piece_count">The number of pieces across the node pieces, the hash pieces and the pieces of the payload.</param>
+	/// <param name="node_bytes">The size of the tree nodes.</param>
+	/// <param name="hash_bytes">The size of the piece hashes.</param>
+	/// <param name="out_resumed">Set to true, if the file already contains pieces of this payload.</param>
+	/// <returns>Returns false, if the file could not be mapped.</returns>
+	bool Open(const std::string &path, const PieceRoot &root, uint32 piece_count, uint32 node_bytes, uint32 hash_bytes, bool *out_resumed);
+
+	/// <summary>
+	/// Closes the file and keeps it, the download can be resumed from it.
+	/// </summary>
+	void Close();
+
+	/// <summary>
+	/// Closes and removes the file, once the payload has been used or can not be used.
+	/// </summary>
+	void Discard();
+
+	/// <summary>
+	/// Starts writing the received pieces back to the file.
+	/// </summary>
+	void Flush();
+
+	bool IsOpen() const { return m_File->IsOpen(); }
+
+	/// <summary>
+	/// Marks a piece as stored in the file, or as missing again.
+	/// </summary>
+	void SetStored(uint32 piece, bool stored);
+	bool IsStored(uint32 piece) const;
+
+	Byte *GetNodes() const { return m_File->GetData() + m_NodeOffset; }
+	Byte *GetHashes() const { return m_File->GetData() + m_HashOffset; }
+	Byte *GetData() const { return m_File->GetData() + m_DataOffset; }
+	uint32 GetDataSize() const { return m_DataSize; }
+
+private:
+
+	struct FileHeader
+	{
+		uint32 Magic;
+		uint32 PieceCount;
+		PieceRoot Root;
+	};
+
+	// 'CAMP'
+	static constexpr uint32 MAGIC = 0x504D4143;
+
+private:
+
+	Core::MappedFile *m_File = nullptr;
+	std::string m_Path;
+
+	uint64 m_NodeOffset = 0;
+	uint64 m_HashOffset = 0;
+	uint64 m_DataOffset = 0;
+	uint64 m_BitsOffset = 0;
+	uint32 m_DataSize = 0;
+	uint32 m_PieceCount = 0;
+};
@@ -0,0 +1,246 @@
+#include "TransferWindow.h"
+
+void TransferWindow::Reset(uint32 piece_count)
+{
+	m_States.assign(piece_count, PieceState::Missing);
+	m_RequestUS.assign(piece_count, 0);
+	m_InFlight.clear();
+	m_Lost.clear();
+
+	m_NextPiece = 0;
+	m_ReceivedCount = 0;
+	m_InFlightCount = 0;
+	m_LostCount = 0;
+
+	m_Window = INITIAL_WINDOW;
+	m_SlowStartThreshold = MAX_WINDOW;
+	m_RecoveryUS = 0;
+
+	m_SmoothedRTTUS = -1;
+	m_RTTVarianceUS = 0;
+	m_TimeoutUS = INITIAL_TIMEOUT_US;
+}
+
+void TransferWindow::Skip(uint32 piece)
+{
+	if (piece >= m_States.size() || m_States[piece] == PieceState::Received)
+	{
+		return;
+	}
+
+	// The request stays in m_InFlight, it is skipped once it reaches the front.
+	if (m_States[piece] == PieceState::InFlight)
+	{
+		--m_InFlightCount;
+	}
+
+	m_States[piece] = PieceState::Received;
+	++m_ReceivedCount;
+}
+
+uint32 TransferWindow::TakeRequests(int64 now_us, uint32 *out_pieces, uint32 max_count)
+{
+	uint32 count = 0;
+	while (count < max_count && m_InFlightCount < (uint32)m_Window)
+	{
+		uint32 piece = CAM_INVALID_ID;
+
+		// Lost pieces may have arrived late in the meantime, those are skipped.
+		while (!m_Lost.empty())
+		{
+			uint32 lost = m_Lost.front();
+			m_Lost.pop_front();
+
+			if (m_States[lost] == PieceState::Missing)
+			{
+				piece = lost;
+				break;
+			}
+		}
+
+		if (piece == CAM_INVALID_ID)
+		{
+			while (m_NextPiece < m_States.size() && m_States[m_NextPiece] != PieceState::Missing)
+			{
+				++m_NextPiece;
+			}
+
+			if (m_NextPiece >= m_States.size())
+			{
+				break;
+			}
+
+			piece = m_NextPiece++;
+		}
+
+		m_States[piece] = PieceState::InFlight;
+		m_RequestUS[piece] = now_us;
+		m_InFlight.push_back({ piece, now_us });
+		++m_InFlightCount;
+
+		out_pieces[count++] = piece;
+	}
+
+	return count;
+}
+
+void TransferWindow::Reject(uint32 piece)
+{
+	if (piece >= m_States.size() || m_States[piece] == PieceState::Missing)
+	{
+		return;
+	}
+
+	if (m_States[piece] == PieceState::Received)
+	{
+		--m_ReceivedCount;
+	}
+	else
+	{
+		--m_InFlightCount;
+	}
+
+	m_States[piece] = PieceState::Missing;
+	m_Lost.push_front(piece);
+}
+
+bool TransferWindow::OnPieceReceived(uint32 piece, int64 request_us, int64 now_us)
+{
+	if (piece >= m_States.size() || m_States[piece] == PieceState::Received)
+	{
+		return false;
+	}
+
+	bool was_in_flight = m_States[piece] == PieceState::InFlight;
+	m_States[piece] = PieceState::Received;
+	++m_ReceivedCount;
+
+	// The echoed time identifies the request, so answers to an earlier request of the same piece do not distort the round trip.
+	if (request_us == m_RequestUS[piece] && request_us <= now_us)
+	{
+		UpdateRoundTrip(now_us - request_us);
+	}
+
+	if (was_in_flight)
+	{
+		--m_InFlightCount;
+
+		// Slow start doubles the window every round trip, afterwards it grows by one piece per round trip.
+		m_Window += m_Window < m_SlowStartThreshold ? 1.0 : 1.0 / m_Window;
+		if (m_Window > MAX_WINDOW)
+		{
+			m_Window = MAX_WINDOW;
+		}
+	}
+
+	// The server answers in request order, so pieces requested before this one, which are still missing, are lost.
+	while (!m_InFlight.empty())
+	{
+		const Request &oldest = m_InFlight.front();
+		if (IsPending(oldest))
+		{
+			if (oldest.RequestUS >= request_us)
+			{
+				break;
+			}
+
+			OnPieceLost(oldest, now_us);
+		}
+
+		m_InFlight.pop_front();
+	}
+
+	return true;
+}
+
+void TransferWindow::DetectTimeouts(int64 now_us)
+{
+	bool timed_out = false;
+	while (!m_InFlight.empty())
+	{
+		const Request &oldest = m_InFlight.front();
+		if (IsPending(oldest))
+		{
+			if (oldest.RequestUS + m_TimeoutUS > now_us)
+			{
+				break;
+			}
+
+			OnPieceLost(oldest, now_us);
+			timed_out = true;
+		}
+
+		m_InFlight.pop_front();
+	}
+
+	// Back off until the next answer arrives, the link may be congested or the round trip grew.
+	if (timed_out)
+	{
+		m_TimeoutUS = m_TimeoutUS * 2 < MAX_TIMEOUT_US ? m_TimeoutUS * 2 : MAX_TIMEOUT_US;
+	}
+}
+
+int64 TransferWindow::GetNextTimeoutUS() const
+{
+	for (const Request &request : m_InFlight)
+	{
+		if (IsPending(request))
+		{
+			return request.RequestUS + m_TimeoutUS;
+		}
+	}
+
+	return -1;
+}
+
+bool TransferWindow::CanRequest() const
+{
+	return m_InFlightCount < (uint32)m_Window && m_ReceivedCount + m_InFlightCount < m_States.size();
+}
+
+bool TransferWindow::IsPending(const Request &request) const
+{
+	return m_States[request.Piece] == PieceState::InFlight && m_RequestUS[request.Piece] == request.RequestUS;
+}
+
+void TransferWindow::OnPieceLost(const Request &request, int64 now_us)
+{
+	m_States[request.Piece] = PieceState::Missing;
+	m_Lost.push_back(request.Piece);
+	--m_InFlightCount;
+	++m_LostCount;
+
+	// All pieces requested before the window was shrunk got lost in the same congestion, so it is only shrunk once for them.
+	if (request.RequestUS >= m_RecoveryUS)
+	{
+		m_SlowStartThreshold = m_Window / 2.0 > MIN_WINDOW ? m_Window / 2.0 : MIN_WINDOW;
+		m_Window = m_SlowStartThreshold;
+		m_RecoveryUS = now_us;
+	}
+}
+
+void TransferWindow::UpdateRoundTrip(int64 sample_us)
+{
+	// Smoothing as in TCP (RFC 6298).
+	if (m_SmoothedRTTUS < 0)
+	{
+		m_SmoothedRTTUS = sample_us;
+		m_RTTVarianceUS = sample_us / 2;
+	}
+	else
+	{
+		int64 deviation = m_SmoothedRTTUS > sample_us ? m_SmoothedRTTUS - sample_us : sample_us - m_SmoothedRTTUS;
+		m_RTTVarianceUS = (3 * m_RTTVarianceUS + deviation) / 4;
+		m_SmoothedRTTUS = (7 * m_SmoothedRTTUS + sample_us) / 8;
+	}
+
+	m_TimeoutUS = m_SmoothedRTTUS + 4 * m_RTTVarianceUS;
+	if (m_TimeoutUS < MIN_TIMEOUT_US)
+	{
+		m_TimeoutUS = MIN_TIMEOUT_US;
+	}
+	else if (m_TimeoutUS > MAX_TIMEOUT_US)
+	{
+		m_TimeoutUS = MAX_TIMEOUT_US;
+	}
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <Cam-Core.h>
+
+#include <deque>
+#include <vector>
+
+/// <summary>
+/// Decides, which pieces of an update are requested and when. Keeps as many pieces in flight as the window allows,
+/// grows the window additively while pieces arrive and halves it once per round trip, if pieces get lost (AIMD).
+/// Lost pieces are detected by a timeout derived from the measured round trip time, or if a piece arrives, which was
+/// requested after them. Only the lost pieces are requested again.
+/// </summary>
+class TransferWindow
+{
+public:
+
+	/// <summary>
+	/// Starts a new transfer, all pieces are missing and nothing is in flight.
+	/// </summary>
+	/// <param name="piece_count">The number of pieces of the update.</param>
+	void Reset(uint32 piece_count);
+
+	/// <summary>
+	/// Marks a piece as received, which did not arrive as an answer to a request, like local chunks or carousel pieces.
+	/// A request in flight for the piece is dropped without touching the window or the round trip.
+	/// </summary>
+	void Skip(uint32 piece);
+
+	/// <summary>
+	/// Takes the pieces, which should be requested now. Lost pieces come first, then pieces which have not been requested yet.
+	/// The returned pieces count as in flight from now on.
+	/// </summary>
+	/// <param name="now_us">The current time in microseconds, the pieces are requested at this time.</param>
+	/// <param name="out_pieces">Receives the piece indices.</param>
+	/// <param name="max_count">The maximum number of pieces to take.</param>
+	/// <returns>Returns the number of pieces written to out_pieces.</returns>
+	uint32 TakeRequests(int64 now_us, uint32 *out_pieces, uint32 max_count);
+
+	/// <summary>
+	/// Marks a received piece as missing again, because its contents turned out to be corrupt.
+	/// It is requested again before all other pieces. The window is kept, the piece was not lost to congestion.
+	/// </summary>
+	void Reject(uint32 piece);
+
+	/// <summary>
+	/// Marks a piece as received and updates the round trip time and the window.
+	/// </summary>
+	/// <param name="piece">The index of the received piece.</param>
+	/// <param name="request_us">The request time, which was echoed by the server.</param>
+	/// <param name="now_us">The current time in microseconds.</param>
+	/// <returns>Returns false, if the piece has been received before.</returns>
+	bool OnPieceReceived(uint32 piece, int64 request_us, int64 now_us);
+
+	/// <summary>
+	/// Marks all pieces as lost, which are in flight for longer than the retransmission timeout.
+	/// </summary>
+	/// <param name="now_us">The current time in microseconds.</param>
+	void DetectTimeouts(int64 now_us);
+
+	/// <summary>
+	/// Returns the time in microseconds, at which the oldest piece in flight times out, or -1 if nothing is in flight.
+	/// </summary>
+	int64 GetNextTimeoutUS() const;
+
+	/// <summary>
+	/// Returns true, if the window has room for more requests and there are pieces left to request.
+	/// </summary>
+	bool CanRequest() const;
+
+	bool IsReceived(uint32 piece) const { return piece < m_States.size() && m_States[piece] == PieceState::Received; }
+	bool IsComplete() const { return m_ReceivedCount == (uint32)m_States.size(); }
+
+	uint32 GetPieceCount() const { return (uint32)m_States.size(); }
+	uint32 GetReceivedCount() const { return m_ReceivedCount; }
+	uint32 GetInFlightCount() const { return m_InFlightCount; }
+	uint32 GetWindow() const { return (uint32)m_Window; }
+	uint64 GetLostCount() const { return m_LostCount; }
+
+	/// <summary>
+	/// Returns the smoothed round trip time in microseconds, or -1 if it has not been measured yet.
+	/// </summary>
+	int64 GetRoundTripUS() const { return m_SmoothedRTTUS; }
+
+public:
+
+	/// <summary>
+	/// The window limits, in pieces. The initial window is small, slow start finds the link speed within a few round trips.
+	/// </summary>
+	static constexpr double INITIAL_WINDOW = 8.0;
+	static constexpr double MIN_WINDOW = 2.0;
+	static constexpr double MAX_WINDOW = 2048.0;
+
+	/// <summary>
+	/// The retransmission timeout is used until the first round trip has been measured, and is kept within these limits.
+	/// </summary>
+	static constexpr int64 INITIAL_TIMEOUT_US = 250000;
+	static constexpr int64 MIN_TIMEOUT_US = 10000;
+	static constexpr int64 MAX_TIMEOUT_US = 2000000;
+
+private:
+
+	enum class PieceState : Byte
+	{
+		Missing = 0,
+		InFlight,
+		Received
+	};
+
+	struct Request
+	{
+		uint32 Piece;
+		int64 RequestUS;
+	};
+
+	/// <summary>
+	/// Returns true, if the request is the latest one of its piece and still waits for an answer.
+	/// </summary>
+	bool IsPending(const Request &request) const;
+
+	/// <summary>
+	/// Marks the piece of the request as lost and shrinks the window, if this is the first loss of the current round trip.
+	/// </summary>
+	void OnPieceLost(const Request &request, int64 now_us);
+
+	void UpdateRoundTrip(int64 sample_us);
+
+private:
+
+	std::vector<PieceState> m_States;
+	std::vector<int64> m_RequestUS;
+
+	// All requests in the order they were sent. Entries of received or re-requested pieces are skipped, when they reach the front.
+	std::deque<Request> m_InFlight;
+	std::deque<uint32> m_Lost;
+
+	uint32 m_NextPiece = 0;
+	uint32 m_ReceivedCount = 0;
+	uint32 m_InFlightCount = 0;
+	uint64 m_LostCount = 0;
+
+	double m_Window = INITIAL_WINDOW;
+	double m_SlowStartThreshold = MAX_WINDOW;
+
+	// Requests sent before this time belong to the round trip, in which the window was shrunk the last time.
+	int64 m_RecoveryUS = 0;
+
+	int64 m_SmoothedRTTUS = -1;
+	int64 m_RTTVarianceUS = 0;
+	int64 m_TimeoutUS = INITIAL_TIMEOUT_US;
+};
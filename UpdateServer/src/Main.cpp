@@ -14,12 +14,18 @@ int main(int argc, char *argv[])
 	config.ServerPort = 44200;
 	config.TargetSourcePath = "../CamClient";
 	config.TargetBinaryPath = "../CamClient/bin/Debug-windows-x86_64/CamClient";
+	config.PackagePath = "../CamClient/packages";
+	config.MulticastGroup = "239.255.42.1";
+	config.MulticastPort = 44201;
+	config.MulticastInterface = "127.0.0.1";
 	config.PublicKeyPath = "../CamClient/public_key.key";
 	config.PrivateKeyPath = "../CamClient/private_key.key";
 	config.SignaturePath = "../CamClient/signature.sig";
+	config.PackageCachePath = "../CamClient/packages/package.cache";
 
 	Server *s = new Server(config);
-	if (!s->LoadUpdateFile(true))
+	// The keys are kept between restarts, so that the cached package and its signature stay valid.
+	if (!s->LoadUpdateFile())
 	{
 		std::cerr << "Could not load the update!" << std::endl;
 
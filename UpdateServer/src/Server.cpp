@@ -2,23 +2,86 @@
 
 #include <iostream>
 #include <filesystem>
+#include <algorithm>
+#include <functional>
 
 #include "Utils/Utils.h"
 #include "Utils/ZipArchive.h"
+#include "Utils/BinaryDelta.h"
+#include "Utils/MerkleTree.h"
 #include "Core/Log.h"
 
+static void FreePackageFiles(std::vector<Core::ZipFile> *files)
+{
+	for (Core::ZipFile &file : *files)
+	{
+		delete[] (Byte *)file.Buffer;
+		file.Buffer = nullptr;
+	}
+
+	files->clear();
+}
+
+// The files are created new on the clients, they only keep the permissions, which the package carries for them.
+static uint32 GetFileMode(const std::filesystem::path &path)
+{
+	std::error_code error;
+	std::filesystem::file_status status = std::filesystem::status(path, error);
+	return error ? 0 : (uint32)(status.permissions() & std::filesystem::perms::all);
+}
+
+// Hashes the header without its hashes, together with the size of the cache file.
+static uint64 GetCacheHeaderHash(PackageCacheHeader header, uint64 cache_size)
+{
+	header.HeaderHash = 0;
+	header.DataHash = 0;
+	return Core::Mix64(Core::Raw64(&header, sizeof(header)) ^ cache_size);
+}
+
 Server::Server(const ServerConfig &config)
-	: m_Config(config)
+	: m_Config(config), m_Bandwidth(config.Bandwidth)
 {
 	m_LastUpdateCheckMS = 0;
 	m_LastUpdateWriteMS = 0;
-	m_UpdateSignature = {};
 
-	m_Socket = Core::Socket::Create();
+	for (uint32 i = 0; i < RECV_BATCH; ++i)
+	{
+		m_RecvBuffers[i] = { m_RecvData[i], MAX_MESSAGE_BYTES };
+		m_Received[i] = { &m_RecvBuffers[i], 1, {}, 0 };
+	}
+
+	for (uint32 i = 0; i < SEND_BATCH; ++i)
+	{
+		m_PieceBuffers[i][0] = { &m_PieceHeaders[i], sizeof(ServerUpdatePieceMessage) };
+		m_PieceDatagrams[i] = { m_PieceBuffers[i], 2, {}, 0 };
+
+		m_CarouselBuffers[i][0] = { &m_CarouselHeaders[i], sizeof(ServerCarouselPieceMessage) };
+		m_CarouselDatagrams[i] = { m_CarouselBuffers[i], 2, {}, 0 };
+	}
+
+	m_Socket = Core::Socket::Create(Core::SocketType::Datagram);
 	m_Crypto = Core::Crypto::Create();
+	m_BuildCrypto = Core::Crypto::Create();
 	m_IPTable = new Core::IPTable();
 	m_Clients = new Core::Clients(m_Crypto, m_IPTable);
 
+	if (!m_Config.MulticastGroup.empty())
+	{
+		m_CarouselAddr = m_Socket->Lookup(m_Config.MulticastGroup, m_Config.MulticastPort);
+		m_CarouselPieceSize = GetMaxPieceBytes(m_Config.MTU);
+	}
+
+	if (m_Config.MeasureLiveTraffic)
+	{
+		m_InterfaceCounters = Core::InterfaceCounters::Create();
+		if (!m_InterfaceCounters->Open(m_Config.LiveInterface))
+		{
+			CAM_LOG_ERROR("Could not read the traffic counters of interface '{}', live video is not measured.", m_Config.LiveInterface);
+			delete m_InterfaceCounters;
+			m_InterfaceCounters = nullptr;
+		}
+	}
+
 	//m_LocalVersion = Core::utils::GetLocalVersion(m_Config.TargetSourcePath);
 	m_LocalVersion = 101;
 
@@ -33,6 +96,9 @@ Server::Server(const ServerConfig &config)
 	CAM_LOG_INFO("Signature path        : {}", config.SignaturePath);
 	CAM_LOG_INFO("Target binary path    : {}", config.TargetBinaryPath);
 	CAM_LOG_INFO("Target source path    : {}", config.TargetSourcePath);
+	CAM_LOG_INFO("Package path          : {}", config.PackagePath);
+	CAM_LOG_INFO("Multicast group       : {0}:{1}", config.MulticastGroup, config.MulticastPort);
+	CAM_LOG_INFO("Live interface        : {}", m_InterfaceCounters ? (config.LiveInterface.empty() ? "all" : config.LiveInterface) : "not measured");
 	CAM_LOG_INFO("Current Server version: {}", m_LocalVersion);
 	CAM_LOG_INFO("Current CWD           : {}", cwd);
 	CAM_LOG_INFO("================================================================");
@@ -42,6 +108,17 @@ Server::~Server()
 {
 	Core::FileSystemWatcher::Stop();
 
+	if (m_RebuildThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_RebuildMutex);
+			m_StopRebuild = true;
+		}
+
+		m_RebuildCondition.notify_one();
+		m_RebuildThread.join();
+	}
+
 	delete m_Clients;
 	m_Clients = nullptr;
 
@@ -51,6 +128,12 @@ Server::~Server()
 	delete m_Crypto;
 	m_Crypto = nullptr;
 
+	delete m_BuildCrypto;
+	m_BuildCrypto = nullptr;
+
+	delete m_InterfaceCounters;
+	m_InterfaceCounters = nullptr;
+
 	delete m_Socket;
 	m_Socket = nullptr;
 }
@@ -69,6 +152,11 @@ void Server::Run()
 			break;
 		}
 
+		if (!m_Config.MulticastGroup.empty() && !m_Socket->SetMulticastSender(m_Config.MulticastInterface, CAROUSEL_TTL, true))
+		{
+			CAM_LOG_ERROR("Could not set up the carousel on interface {}", m_Config.MulticastInterface);
+		}
+
 		for (;;)
 		{
 			if (!Step())
@@ -88,109 +176,33 @@ void Server::Run()
 
 bool Server::LoadUpdateFile(bool forceDeleteSignature, bool skipDebugFiles)
 {
-	// First check, if the update path is valid
-	std::string update_path = m_Config.TargetBinaryPath;
-	std::string update_file = update_path + "/update.zip";
-
-	if (!Core::FileSystem::Get()->DirectoryExists(update_path))
+	if (!LoadKeys(forceDeleteSignature))
 	{
-		CAM_LOG_ERROR("Binary path from source does not exist! Please re-check your binary path or build the source first.");
 		return false;
 	}
 
-	CAM_LOG_INFO("Generating new update package at location {} ...", update_file);
-
-	// then delete an existing update file
-	if (Core::FileSystem::Get()->FileExists(update_file))
-	{
-		if (!Core::FileSystem::Get()->RemoveFile(update_file))
-		{
-			CAM_LOG_ERROR("Could not delete the file {}", update_file);
-			return false;
-		}
-		else
-		{
-			CAM_LOG_INFO("Deleted existing packaged update from disk.");
-		}
-	}
-
-	// load the contents of the directory and store them into the zip file
-	std::vector<Core::ZipFile> files;
-	for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(update_path))
+	// A restart with the same files serves the cached package, instead of compressing and signing everything again.
+	m_Package = LoadCachedPackage(skipDebugFiles);
+	m_VerifyCache = m_Package != nullptr;
+	if (!m_Package)
 	{
-		const std::filesystem::path p = entry.path();
-		std::string zip_name = p.filename().string();
-		std::string current_file_name = p.string();
-	
-		// skip the archive itself
-		if (current_file_name.find("update") != std::string::npos)
-		{
-			CAM_LOG_INFO("Skipping update file.");
-			continue;
-		}
-
-		if (current_file_name.find("logs") != std::string::npos)
-		{
-			CAM_LOG_INFO("Skipping logs.");
-			continue;
-		}
-
-		if (skipDebugFiles)
-		{
-			if (current_file_name.find(".pdb") != std::string::npos)
-			{
-				CAM_LOG_INFO("Skipping debug file {}", zip_name);
-				continue;
-			}
-		}
-	
-		CAM_LOG_INFO("Adding {}...", zip_name);
-
-		uint32 file_size = 0;
-		Byte *data = Core::FileSystem::Get()->ReadFile(current_file_name, &file_size);
-		if (!data)
+		m_Package = BuildPackage(m_Crypto, skipDebugFiles, 0);
+		if (!m_Package)
 		{
-			CAM_LOG_ERROR("Could not read file {}!", current_file_name);
 			return false;
 		}
-		
-		Core::ZipFile file;
-		file.Name = std::filesystem::path(current_file_name).filename().string();
-		file.Path = current_file_name;
-		file.Buffer = data;
-		file.BufferSize = file_size;
-		files.push_back(file);
-	}
-
-	CAM_LOG_INFO("Added all files.");
-
-	// Now trying to store the whole contents into the zip file
-	CAM_LOG_INFO("Writing zip file to memory...");
-	Core::ZipArchive archive;
-	if (!archive.Store(files, update_file))
-	{
-		CAM_LOG_ERROR("Could not save the zip file!");
-		return false;
-	}
-
-	CAM_LOG_INFO("Zip file written successfully to {}", update_file);
 
-	// Cleanup the memory.
-	for (auto &file : files)
-	{
-		delete[] file.Buffer;
-		file.Buffer = nullptr;
+		StorePackageCache(*m_Package);
 	}
 
-	// Load the whole ZIP file into memory
-	m_UpdateFile.Data = Core::FileSystem::Get()->ReadFile(update_file, &m_UpdateFile.Size);
-	
-	if (!m_UpdateFile.Data)
-	{
-		CAM_LOG_ERROR("Could not read back in the update file!");
-		return false;
-	}
+	m_BuiltFilesHash = m_Package->FilesHash;
+	m_PreviousPackage.reset();
+	m_CarouselPiece = 0;
+	return true;
+}
 
+bool Server::LoadKeys(bool forceDeleteSignature)
+{
 	if (forceDeleteSignature)
 	{
 		if (Core::FileSystem::Get()->FileExists(m_Config.PrivateKeyPath))
@@ -225,26 +237,26 @@ bool Server::LoadUpdateFile(bool forceDeleteSignature, bool skipDebugFiles)
 	if (Core::FileSystem::Get()->FileExists(m_Config.PrivateKeyPath))
 	{
 		Byte *public_key_data = Core::FileSystem::Get()->ReadFile(m_Config.PublicKeyPath, &public_key.Size);
+		if (!public_key_data)
+		{
+			CAM_LOG_ERROR("Could not read the public key!");
+			return false;
+		}
+
 		memcpy(public_key.Data, public_key_data, public_key.Size);
 		delete[] public_key_data;
 		public_key_data = nullptr;
 
-		if (!public_key.Data)
+		Byte *private_key_data = Core::FileSystem::Get()->ReadFile(m_Config.PrivateKeyPath, &private_key.Size);
+		if (!private_key_data)
 		{
-			CAM_LOG_ERROR("Could not read the public key!");
+			CAM_LOG_ERROR("Could not read the private key!");
 			return false;
 		}
-		
-		Byte *private_key_data = Core::FileSystem::Get()->ReadFile(m_Config.PrivateKeyPath, &private_key.Size);
+
 		memcpy(private_key.Data, private_key_data, private_key.Size);
 		delete[] private_key_data;
 		private_key_data = nullptr;
-
-		if (!private_key.Data)
-		{
-			CAM_LOG_ERROR("Could not read the private key!");
-			return false;
-		}
 	}
 	else
 	{
@@ -255,28 +267,6 @@ bool Server::LoadUpdateFile(bool forceDeleteSignature, bool skipDebugFiles)
 		}
 	}
 
-	// make the signature for the file
-	if (!m_Crypto->SignSignature(
-		m_UpdateSignature.Data, 
-		sizeof(m_UpdateSignature.Data), 
-		m_UpdateFile.Data, 
-		m_UpdateFile.Size, 
-		private_key.Data, 
-		private_key.Size))
-	{
-		CAM_LOG_ERROR("Could not sign the update!");
-		return false;
-	}
-
-	if (Core::FileSystem::Get()->FileExists(m_Config.SignaturePath))
-	{
-		if (!Core::FileSystem::Get()->RemoveFile(m_Config.SignaturePath))
-		{
-			CAM_LOG_ERROR("Could not delete the old signature file!");
-			return false;
-		}
-	}
-
 	// Now write the security files
 	if (!Core::FileSystem::Get()->FileExists(m_Config.PrivateKeyPath))
 	{
@@ -287,188 +277,863 @@ bool Server::LoadUpdateFile(bool forceDeleteSignature, bool skipDebugFiles)
 		}
 	}
 
-	if (!Core::FileSystem::Get()->WriteFile(m_Config.PublicKeyPath, public_key.Data, public_key.Size))
+	if (Core::FileSystem::Get()->FileExists(m_Config.PublicKeyPath) && !Core::FileSystem::Get()->RemoveFile(m_Config.PublicKeyPath))
 	{
-		CAM_LOG_ERROR("Could not write public key file!");
+		CAM_LOG_ERROR("Could not delete the old public key file!");
 		return false;
 	}
 
-	if (!Core::FileSystem::Get()->WriteFile(m_Config.SignaturePath, m_UpdateSignature.Data, SIG_BYTES))
+	if (!Core::FileSystem::Get()->WriteFile(m_Config.PublicKeyPath, public_key.Data, public_key.Size))
 	{
-		CAM_LOG_ERROR("Could not write the new signature!");
+		CAM_LOG_ERROR("Could not write public key file!");
 		return false;
 	}
 
 	m_PublicKey.Size = public_key.Size;
 	memcpy(m_PublicKey.Data, public_key.Data, sizeof(public_key.Data));
-	CAM_LOG_INFO("Loaded update with size {}", m_UpdateFile.Size);
-	
+	m_PrivateKey = private_key;
 	return true;
 }
 
-void Server::StartFileWatcher()
-{
-	Server *instance = this;
-	Core::FileSystemWatcher::Start(m_Config.TargetBinaryPath, [instance](const Core::FileSystemWatcherContext &context) mutable
-	{
-		CAM_LOG_INFO("Something happened with file {}", context.FilePath);
-		switch (context.Action)
-		{
-			case Core::FileSystemWatcherAction::Added:
-			case Core::FileSystemWatcherAction::Modified:
-			case Core::FileSystemWatcherAction::Removed:
-			case Core::FileSystemWatcherAction::Renamed:
-				instance->m_UpdateFile.Free();
-				instance->m_UpdateSignature = {};
-				instance->LoadUpdateFile(true);
-				break;
-		}
-	});
-}
-
-bool Server::Step()
+bool Server::ListPackageFiles(bool skipDebugFiles, std::vector<std::filesystem::path> *out_paths, uint64 *out_files_stamp)
 {
-	static Byte BUF[65536];
-
-	Core::addr_t addr;
-	int32 len = m_Socket->Recv(BUF, sizeof(BUF), &addr);
-	if (len < 0)
+	// First check, if the update path is valid
+	std::string update_path = m_Config.TargetBinaryPath;
+	if (!Core::FileSystem::Get()->DirectoryExists(update_path))
 	{
+		CAM_LOG_ERROR("Binary path from source does not exist! Please re-check your binary path or build the source first.");
 		return false;
 	}
 
-	if (len < sizeof(header_t))
+	// load the contents of the directory, sorted by name, so that the same files always give the same package
+	std::vector<std::filesystem::path> paths;
+	for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(update_path))
 	{
-		return true;
+		paths.push_back(entry.path());
 	}
 
-	header_t *header = (header_t *)BUF;
-	if (header->Type == MessageType::CLIENT_UPDATE_BEGIN)
+	std::sort(paths.begin(), paths.end());
+
+	uint64 files_stamp = 0;
+	for (const std::filesystem::path &p : paths)
 	{
-		if (len != sizeof(ClientUpdateBeginMessage))
+		std::string zip_name = p.filename().string();
+		std::string current_file_name = p.string();
+	
+		// skip the archive itself
+		if (current_file_name.find("update") != std::string::npos)
 		{
-			return true;
+			CAM_LOG_DEBUG("Skipping update file.");
+			continue;
 		}
 
-		ClientUpdateBeginMessage *msg = (ClientUpdateBeginMessage *)BUF;
-		CAM_LOG_DEBUG("Received Update begin request with client token: {}", msg->ClientToken);
-
-		int64 now_ms = Core::QueryMS();
-		Core::Clients::Node *client = m_Clients->Insert(addr, now_ms);
-
-		if (!client)
+		if (current_file_name.find("logs") != std::string::npos)
 		{
-			CAM_LOG_ERROR("Client could not be inserted!");
-			return true;
+			CAM_LOG_DEBUG("Skipping logs.");
+			continue;
 		}
 
-		if (!client->IsBandwidthAvailable(now_ms))
+		if (skipDebugFiles)
 		{
-		//	CAM_LOG_ERROR("Client has no bandwidth available!");
-			return true;
+			if (current_file_name.find(".pdb") != std::string::npos)
+			{
+				CAM_LOG_DEBUG("Skipping debug file {}", zip_name);
+				continue;
+			}
 		}
 
-		if (msg->ServerToken != client->ServerToken)
-		{
-			CAM_LOG_WARN("Server tokens did not match! Sending Server update token message...");
-			ServerUpdateTokenMessage res = {};
-			res.Header.Type = MessageType::SERVER_UPDATE_TOKEN;
-			res.Header.Version = m_LocalVersion;
-			res.ClientToken = msg->ClientToken;
-			res.ServerToken = client->ServerToken;
-			m_Socket->Send(&res, sizeof(res), addr);
-
-			client->Bandwidth += sizeof(ServerUpdateTokenMessage);
-
-			return true;
-		}
+		// The files are stamped before they are read, a file written in between gets a newer stamp and is not mistaken for the read one.
+		std::error_code error;
+		uint64 file_size = std::filesystem::file_size(p, error);
+		int64 write_time = (int64)std::filesystem::last_write_time(p, error).time_since_epoch().count();
+		uint32 mode = GetFileMode(p);
 
-		CAM_LOG_DEBUG("Sending update begin response...");
-		ServerUpdateBeginMessage res;
-		memset(&res, 0, sizeof(res));
+		files_stamp = Core::Mix64(files_stamp ^ Core::Raw64(zip_name.data(), (uint32)zip_name.size()));
+		files_stamp = Core::Mix64(files_stamp ^ file_size ^ Core::Mix64((uint64)write_time) ^ ((uint64)mode << 32));
+		out_paths->push_back(p);
+	}
 
-		res.Header.Version = m_LocalVersion;
-		res.Header.Type = MessageType::SERVER_UPDATE_BEGIN;
-		res.ClientToken = msg->ClientToken;
-		res.ServerToken = client->ServerToken;
-		res.UpdateSize = m_UpdateFile.Size;
-		res.UpdateSignature = m_UpdateSignature;
-		m_Socket->Send(&res, sizeof(res), addr);
+	*out_files_stamp = files_stamp;
+	return true;
+}
 
-		client->Bandwidth += sizeof(ServerUpdateBeginMessage);
+bool Server::ReadPackageFiles(bool skipDebugFiles, std::vector<Core::ZipFile> *out_files, uint64 *out_files_hash, uint64 *out_files_stamp)
+{
+	std::vector<std::filesystem::path> paths;
+	if (!ListPackageFiles(skipDebugFiles, &paths, out_files_stamp))
+	{
+		return false;
 	}
-	else if (header->Type == MessageType::CLIENT_UPDATE_PIECE)
+
+	uint64 files_hash = 0;
+	for (const std::filesystem::path &p : paths)
 	{
-		if (len != sizeof(ClientUpdatePieceMessage))
+		std::string zip_name = p.filename().string();
+		std::string current_file_name = p.string();
+
+		uint32 file_size = 0;
+		Byte *data = Core::FileSystem::Get()->ReadFile(current_file_name, &file_size);
+		if (!data)
 		{
-			return true;
+			CAM_LOG_ERROR("Could not read file {}!", current_file_name);
+			FreePackageFiles(out_files);
+			return false;
 		}
+		
+		Core::ZipFile file;
+		file.Name = zip_name;
+		file.Path = current_file_name;
+		file.Buffer = data;
+		file.BufferSize = file_size;
+		file.Mode = GetFileMode(p);
+		out_files->push_back(file);
 
-		int64 now_ms = Core::QueryMS();
+		// A file, which only became executable, needs a new package as well.
+		files_hash = Core::Mix64(files_hash ^ Core::Raw64(zip_name.data(), (uint32)zip_name.size()));
+		files_hash = Core::Mix64(files_hash ^ (file_size > 0 ? Core::Raw64(data, file_size) : 0) ^ file_size ^ ((uint64)file.Mode << 32));
+	}
 
-		ClientUpdatePieceMessage *msg = (ClientUpdatePieceMessage *)BUF;
+	*out_files_hash = files_hash;
+	return true;
+}
 
-		if (msg->PiecePos >= m_UpdateFile.Size)
-		{
-			CAM_LOG_ERROR("The request position was larger than the file!");
-			return true;
-		}
+std::unique_ptr<UpdatePackage> Server::BuildPackage(Core::Crypto *crypto, bool skipDebugFiles, uint64 unchanged_hash)
+{
+	std::string update_file = m_Config.TargetBinaryPath + "/update.zip";
 
-		Core::Clients::Node *client = m_Clients->Insert(addr, now_ms);
+	std::vector<Core::ZipFile> files;
+	uint64 files_hash = 0;
+	uint64 files_stamp = 0;
+	if (!ReadPackageFiles(skipDebugFiles, &files, &files_hash, &files_stamp))
+	{
+		return nullptr;
+	}
 
-		if (!client)
-		{
-			CAM_LOG_ERROR("Could not find the client for addr {0}, port {1}", addr.Host, addr.Port);
-			return true;
-		}
+	// Saving a file without changing it, or touching files outside of the package, does not need a new package.
+	if (unchanged_hash != 0 && files_hash == unchanged_hash)
+	{
+		CAM_LOG_INFO("The files of the update did not change, keeping the current package.");
+		FreePackageFiles(&files);
+		return nullptr;
+	}
 
-		if (!client->IsBandwidthAvailable(now_ms))
-		{
+	CAM_LOG_INFO("Generating new update package at location {} with {} files...", update_file, files.size());
+
+	// then delete an existing update file
+	if (Core::FileSystem::Get()->FileExists(update_file) && !Core::FileSystem::Get()->RemoveFile(update_file))
+	{
+		CAM_LOG_ERROR("Could not delete the file {}", update_file);
+		FreePackageFiles(&files);
+		return nullptr;
+	}
+
+	// Now trying to store the whole contents into the zip file
+	int64 zip_start_ms = Core::QueryMS();
+	Core::ZipArchive archive;
+	if (!archive.Store(files, update_file, &m_BuildPool, &m_ZipCache))
+	{
+		CAM_LOG_ERROR("Could not save the zip file!");
+		FreePackageFiles(&files);
+		return nullptr;
+	}
+
+	CAM_LOG_INFO("Zip file written successfully to {0} in {1} ms, {2} files compressed on {3} threads, {4} unchanged.",
+		update_file, Core::QueryMS() - zip_start_ms, m_ZipCache.GetMissCount(), m_BuildPool.GetThreadCount(), m_ZipCache.GetHitCount());
+
+	std::unique_ptr<UpdatePackage> package = std::make_unique<UpdatePackage>();
+	package->FilesHash = files_hash;
+	package->FilesStamp = files_stamp;
+
+	// The same files are offered as content defined chunks, so clients only download the chunks they do not have yet.
+	if (package->Manifest.Build(m_LocalVersion, files, &package->ChunkStoreBuffer))
+	{
+		package->Manifest.Write(&package->ManifestBuffer);
+		package->ManifestData = package->ManifestBuffer;
+		package->ChunkStore = package->ChunkStoreBuffer;
+		CAM_LOG_INFO("Built manifest with {0} chunks, chunk store size {1}", package->Manifest.GetChunks().size(), package->ChunkStore.Size);
+	}
+	else
+	{
+		CAM_LOG_ERROR("Could not build the manifest, only the package is available.");
+		package->ManifestBuffer.clear();
+		package->ChunkStoreBuffer.clear();
+	}
+
+	FreePackageFiles(&files);
+
+	// Load the whole ZIP file into memory
+	package->FileBuffer.Data = Core::FileSystem::Get()->ReadFile(update_file, &package->FileBuffer.Size);
+	if (!package->FileBuffer.Data)
+	{
+		CAM_LOG_ERROR("Could not read back in the update file!");
+		return nullptr;
+	}
+
+	package->File = PackageData(package->FileBuffer.Data, package->FileBuffer.Size);
+
+	package->Id = Core::Raw64(package->File.Data, package->File.Size);
+
+	// make the signature for the file
+	if (!crypto->SignSignature(
+		package->FileSignature.Data,
+		sizeof(package->FileSignature.Data),
+		package->File.Data,
+		package->File.Size,
+		m_PrivateKey.Data,
+		m_PrivateKey.Size))
+	{
+		CAM_LOG_ERROR("Could not sign the update!");
+		return nullptr;
+	}
+
+	if (Core::FileSystem::Get()->FileExists(m_Config.SignaturePath))
+	{
+		if (!Core::FileSystem::Get()->RemoveFile(m_Config.SignaturePath))
+		{
+			CAM_LOG_ERROR("Could not delete the old signature file!");
+			return nullptr;
+		}
+	}
+
+	if (!Core::FileSystem::Get()->WriteFile(m_Config.SignaturePath, package->FileSignature.Data, SIG_BYTES))
+	{
+		CAM_LOG_ERROR("Could not write the new signature!");
+		return nullptr;
+	}
+
+	CAM_LOG_INFO("Loaded update with size {}", package->File.Size);
+
+	BuildPatches(package.get());
+
+	BuildDefaultPieceTrees(package.get(), crypto);
+	return package;
+}
+
+void Server::BuildDefaultPieceTrees(UpdatePackage *package, Core::Crypto *crypto)
+{
+	// The piece hashes for the default piece size are ready before the first client asks, other piece sizes are hashed on demand.
+	uint16 piece_size = GetMaxPieceBytes(m_Config.MTU);
+	GetPieceTree(package, crypto, UpdatePayload::UPDATE_PACKAGE, 0, piece_size);
+	GetPieceTree(package, crypto, UpdatePayload::UPDATE_MANIFEST, 0, piece_size);
+	GetPieceTree(package, crypto, UpdatePayload::UPDATE_CHUNKS, 0, piece_size);
+	for (const UpdatePatch &patch : package->Patches)
+	{
+		GetPieceTree(package, crypto, UpdatePayload::UPDATE_PACKAGE, patch.BaseVersion, piece_size);
+	}
+}
+
+std::unique_ptr<UpdatePackage> Server::LoadCachedPackage(bool skipDebugFiles)
+{
+	if (m_Config.PackageCachePath.empty() || !Core::FileSystem::Get()->FileExists(m_Config.PackageCachePath))
+	{
+		return nullptr;
+	}
+
+	int64 start_ms = Core::QueryMS();
+
+	// Only the sizes and write times of the files are compared, reading and hashing them would take longer than mapping the cache.
+	std::vector<std::filesystem::path> paths;
+	uint64 files_stamp = 0;
+	if (!ListPackageFiles(skipDebugFiles, &paths, &files_stamp))
+	{
+		return nullptr;
+	}
+
+	int64 cache_size = Core::FileSystem::Get()->Size(m_Config.PackageCachePath);
+	if (cache_size < (int64)sizeof(PackageCacheHeader))
+	{
+		CAM_LOG_WARN("The package cache {} is too small, building the package.", m_Config.PackageCachePath);
+		return nullptr;
+	}
+
+	std::unique_ptr<Core::MappedFile> cache(Core::MappedFile::Create());
+	if (!cache->Open(m_Config.PackageCachePath, (uint64)cache_size))
+	{
+		CAM_LOG_WARN("Could not map the package cache {}, building the package.", m_Config.PackageCachePath);
+		return nullptr;
+	}
+
+	const Byte *data = cache->GetData();
+	const Byte *end = data + cache->GetSize();
+
+	PackageCacheHeader header;
+	memcpy(&header, data, sizeof(header));
+	data += sizeof(header);
+
+	if (header.Magic != PackageCacheHeader::MAGIC || header.FormatVersion != PackageCacheHeader::FORMAT_VERSION)
+	{
+		CAM_LOG_WARN("The package cache {} has an unknown format, building the package.", m_Config.PackageCachePath);
+		return nullptr;
+	}
+
+	if (header.HeaderHash != GetCacheHeaderHash(header, cache->GetSize()) || header.ChunkStoreSize > UINT32_MAX
+		|| (uint64)header.FileSize + header.ManifestSize + header.ChunkStoreSize > (uint64)(end - data))
+	{
+		CAM_LOG_WARN("The package cache {} is damaged, building the package.", m_Config.PackageCachePath);
+		return nullptr;
+	}
+
+	if (header.FilesStamp != files_stamp || header.LocalVersion != m_LocalVersion)
+	{
+		CAM_LOG_INFO("The files of the update changed since the package was cached, building the package.");
+		return nullptr;
+	}
+
+	if (header.KeyHash != Core::Raw64(m_PublicKey.Data, m_PublicKey.Size))
+	{
+		CAM_LOG_INFO("The keys changed since the package was cached, building the package.");
+		return nullptr;
+	}
+
+	// The payloads are served straight from the mapping, the pages are only read from the disk once they are sent.
+	std::unique_ptr<UpdatePackage> package = std::make_unique<UpdatePackage>();
+	package->FilesHash = header.FilesHash;
+	package->FilesStamp = header.FilesStamp;
+	package->Id = header.PackageId;
+	package->FileSignature = header.FileSignature;
+
+	package->File = PackageData(data, header.FileSize);
+	data += header.FileSize;
+
+	package->ManifestData = PackageData(data, header.ManifestSize);
+	data += header.ManifestSize;
+
+	package->ChunkStore = PackageData(data, (uint32)header.ChunkStoreSize);
+	data += header.ChunkStoreSize;
+
+	if (!package->ManifestData.IsEmpty() && !package->Manifest.Read(package->ManifestData.Data, package->ManifestData.Size))
+	{
+		CAM_LOG_WARN("Could not read the cached manifest, only the package is available.");
+		package->ManifestData = {};
+		package->ChunkStore = {};
+	}
+
+	for (uint32 i = 0; i < header.PatchCount; ++i)
+	{
+		uint32 patch_header[2];
+		if ((uint64)(end - data) < sizeof(patch_header))
+		{
+			CAM_LOG_WARN("The package cache {} is damaged, building the package.", m_Config.PackageCachePath);
+			return nullptr;
+		}
+
+		memcpy(patch_header, data, sizeof(patch_header));
+		data += sizeof(patch_header);
+		if ((uint64)(end - data) < patch_header[1])
+		{
+			CAM_LOG_WARN("The package cache {} is damaged, building the package.", m_Config.PackageCachePath);
+			return nullptr;
+		}
+
+		// A patch is only offered, while its base package is still kept.
+		std::string base_file = m_Config.PackagePath + "/" + std::to_string(patch_header[0]) + ".zip";
+		if (Core::FileSystem::Get()->FileExists(base_file))
+		{
+			UpdatePatch patch;
+			patch.BaseVersion = patch_header[0];
+			patch.Data = PackageData(data, patch_header[1]);
+			package->Patches.push_back(std::move(patch));
+		}
+
+		data += patch_header[1];
+	}
+
+	// The piece hashes were signed, when the package was built. They are only kept for the payloads, which are still offered.
+	for (uint32 i = 0; i < header.TreeCount; ++i)
+	{
+		PackageCacheTree cached_tree;
+		if ((uint64)(end - data) < sizeof(cached_tree))
+		{
+			CAM_LOG_WARN("The package cache {} is damaged, building the package.", m_Config.PackageCachePath);
+			return nullptr;
+		}
+
+		memcpy(&cached_tree, data, sizeof(cached_tree));
+		data += sizeof(cached_tree);
+		if ((uint64)(end - data) < (uint64)cached_tree.NodesSize + cached_tree.HashesSize)
+		{
+			CAM_LOG_WARN("The package cache {} is damaged, building the package.", m_Config.PackageCachePath);
+			return nullptr;
+		}
+
+		uint32 payload_size = 0;
+		if (GetPayload(package.get(), cached_tree.Root.Payload, cached_tree.Root.BaseVersion, &payload_size) && payload_size == cached_tree.Root.UpdateSize)
+		{
+			PieceTree tree = {};
+			tree.Root = cached_tree.Root;
+			tree.RootSignature = cached_tree.RootSignature;
+			tree.Nodes = PackageData(data, cached_tree.NodesSize);
+			tree.Hashes = PackageData(data + cached_tree.NodesSize, cached_tree.HashesSize);
+			package->PieceTrees.push_back(std::move(tree));
+		}
+
+		data += (uint64)cached_tree.NodesSize + cached_tree.HashesSize;
+	}
+
+	package->Cache = std::move(cache);
+
+	// Only the piece sizes, which were not cached, are hashed, e.g. after the MTU changed.
+	BuildDefaultPieceTrees(package.get(), m_Crypto);
+
+	CAM_LOG_INFO("Loaded the cached update with size {0} and {1} patches in {2} ms", package->File.Size, package->Patches.size(), Core::QueryMS() - start_ms);
+	return package;
+}
+
+void Server::StorePackageCache(const UpdatePackage &package)
+{
+	if (m_Config.PackageCachePath.empty())
+	{
+		return;
+	}
+
+	uint64 cache_size = sizeof(PackageCacheHeader) + (uint64)package.File.Size + package.ManifestData.Size + package.ChunkStore.Size;
+	for (const UpdatePatch &patch : package.Patches)
+	{
+		cache_size += sizeof(uint32) * 2 + patch.Data.Size;
+	}
+
+	for (const PieceTree &tree : package.PieceTrees)
+	{
+		cache_size += sizeof(PackageCacheTree) + (uint64)tree.Nodes.Size + tree.Hashes.Size;
+	}
+
+	if (cache_size - sizeof(PackageCacheHeader) > UINT32_MAX)
+	{
+		CAM_LOG_WARN("The package is too large for the package cache.");
+		return;
+	}
+
+	// Written next to the cache and moved over it, a server killed while writing keeps the previous cache.
+	std::string temp_path = m_Config.PackageCachePath + ".tmp";
+	std::unique_ptr<Core::MappedFile> cache(Core::MappedFile::Create());
+	if (!cache->Open(temp_path, cache_size))
+	{
+		CAM_LOG_WARN("Could not write the package cache {}", temp_path);
+		return;
+	}
+
+	Byte *data = cache->GetData() + sizeof(PackageCacheHeader);
+	auto write = [&data](const void *src, uint64 size)
+	{
+		if (size > 0)
+		{
+			memcpy(data, src, size);
+			data += size;
+		}
+	};
+
+	write(package.File.Data, package.File.Size);
+	write(package.ManifestData.Data, package.ManifestData.Size);
+	write(package.ChunkStore.Data, package.ChunkStore.Size);
+	for (const UpdatePatch &patch : package.Patches)
+	{
+		uint32 patch_header[2] = { patch.BaseVersion, patch.Data.Size };
+		write(patch_header, sizeof(patch_header));
+		write(patch.Data.Data, patch.Data.Size);
+	}
+
+	for (const PieceTree &tree : package.PieceTrees)
+	{
+		PackageCacheTree cached_tree = {};
+		cached_tree.Root = tree.Root;
+		cached_tree.RootSignature = tree.RootSignature;
+		cached_tree.NodesSize = tree.Nodes.Size;
+		cached_tree.HashesSize = tree.Hashes.Size;
+		write(&cached_tree, sizeof(cached_tree));
+		write(tree.Nodes.Data, tree.Nodes.Size);
+		write(tree.Hashes.Data, tree.Hashes.Size);
+	}
+
+	PackageCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.Magic = PackageCacheHeader::MAGIC;
+	header.FormatVersion = PackageCacheHeader::FORMAT_VERSION;
+	header.LocalVersion = m_LocalVersion;
+	header.PatchCount = (uint32)package.Patches.size();
+	header.TreeCount = (uint32)package.PieceTrees.size();
+	header.FilesStamp = package.FilesStamp;
+	header.FilesHash = package.FilesHash;
+	header.KeyHash = Core::Raw64(m_PublicKey.Data, m_PublicKey.Size);
+	header.PackageId = package.Id;
+	header.ChunkStoreSize = package.ChunkStore.Size;
+	header.FileSize = package.File.Size;
+	header.ManifestSize = package.ManifestData.Size;
+	header.FileSignature = package.FileSignature;
+	header.HeaderHash = GetCacheHeaderHash(header, cache_size);
+	header.DataHash = Core::Raw64(cache->GetData() + sizeof(header), (uint32)(cache_size - sizeof(header)));
+	memcpy(cache->GetData(), &header, sizeof(header));
+
+	cache->Flush();
+	cache->Close();
+
+	// On Linux a package served from the old cache keeps its mapping of the replaced file. Windows does not replace a mapped file,
+	// the old cache stays and the next start builds the package.
+	if (!Core::FileSystem::Get()->RenameFile(temp_path, m_Config.PackageCachePath))
+	{
+		CAM_LOG_WARN("Could not replace the package cache {}", m_Config.PackageCachePath);
+		Core::FileSystem::Get()->RemoveFile(temp_path);
+	}
+}
+
+bool Server::VerifyPackageCache()
+{
+	std::unique_ptr<Core::MappedFile> cache(Core::MappedFile::Create());
+	int64 cache_size = Core::FileSystem::Get()->Size(m_Config.PackageCachePath);
+	if (cache_size < (int64)sizeof(PackageCacheHeader) || !cache->Open(m_Config.PackageCachePath, (uint64)cache_size))
+	{
+		return false;
+	}
+
+	PackageCacheHeader header;
+	memcpy(&header, cache->GetData(), sizeof(header));
+
+	uint64 data_size = cache->GetSize() - sizeof(header);
+	return data_size <= UINT32_MAX && header.DataHash == Core::Raw64(cache->GetData() + sizeof(header), (uint32)data_size);
+}
+
+void Server::StartFileWatcher()
+{
+	if (!m_RebuildThread.joinable())
+	{
+		m_RebuildThread = std::thread(&Server::RebuildLoop, this);
+	}
+
+	// The watcher only notes the change, the package is rebuilt once the changes stopped.
+	Server *instance = this;
+	Core::FileSystemWatcher::Start(m_Config.TargetBinaryPath, [instance](const Core::FileSystemWatcherContext &context) mutable
+	{
+		CAM_LOG_DEBUG("Something happened with file {}", context.FilePath);
+		switch (context.Action)
+		{
+			case Core::FileSystemWatcherAction::Added:
+			case Core::FileSystemWatcherAction::Modified:
+			case Core::FileSystemWatcherAction::Removed:
+			case Core::FileSystemWatcherAction::Renamed:
+			{
+				std::lock_guard<std::mutex> lock(instance->m_RebuildMutex);
+				instance->m_LastChangeMS = Core::QueryMS();
+				instance->m_HasChanges = true;
+				instance->m_RebuildCondition.notify_one();
+				break;
+			}
+		}
+	});
+}
+
+void Server::SetBandwidthLimits(const Core::BandwidthLimits &limits)
+{
+	m_Bandwidth.SetLimits(limits);
+	CAM_LOG_INFO("Changed the egress budget to {0} bytes/s, {1} bytes/s while live video is sent", limits.EgressBytesPerSecond, limits.UpdateBytesPerSecondWhileLive);
+}
+
+void Server::ReportLiveTraffic(uint32 bytes)
+{
+	m_Bandwidth.ReportLive(bytes);
+}
+
+void Server::RebuildLoop()
+{
+	// The cached package is already served, a damaged cache replaces it with a new build.
+	if (m_VerifyCache && !VerifyPackageCache())
+	{
+		CAM_LOG_WARN("The package cache {} is damaged, building the package.", m_Config.PackageCachePath);
+
+		std::lock_guard<std::mutex> lock(m_RebuildMutex);
+		m_BuiltFilesHash = 0;
+		m_HasChanges = true;
+	}
+
+	m_VerifyCache = false;
+
+	std::unique_lock<std::mutex> lock(m_RebuildMutex);
+	for (;;)
+	{
+		m_RebuildCondition.wait(lock, [this]() { return m_StopRebuild || m_HasChanges; });
+		if (m_StopRebuild)
+		{
+			return;
+		}
+
+		// Every change restarts the quiet window, a build writing many files leads to a single rebuild.
+		int64 quiet_ms = m_LastChangeMS + REBUILD_QUIET_MS - Core::QueryMS();
+		if (quiet_ms > 0)
+		{
+			m_RebuildCondition.wait_for(lock, std::chrono::milliseconds(quiet_ms), [this]() { return m_StopRebuild; });
+			continue;
+		}
+
+		m_HasChanges = false;
+		lock.unlock();
+
+		// The clients keep getting the current package while the new one is built.
+		std::unique_ptr<UpdatePackage> package = BuildPackage(m_BuildCrypto, true, m_BuiltFilesHash);
+		if (package)
+		{
+			m_BuiltFilesHash = package->FilesHash;
+			StorePackageCache(*package);
+
+			std::lock_guard<std::mutex> package_lock(m_PackageMutex);
+			m_NextPackage = std::move(package);
+			m_HasNextPackage = true;
+		}
+
+		lock.lock();
+	}
+}
+
+void Server::SwapPackage()
+{
+	if (!m_HasNextPackage)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_PackageMutex);
+	m_HasNextPackage = false;
+
+	// Clients in the middle of a download still receive the pieces of the replaced package.
+	m_PreviousPackage = std::move(m_Package);
+	m_Package = std::move(m_NextPackage);
+
+	// The carousel starts over with the new package, once a client asks for it.
+	m_CarouselPiece = 0;
+	m_CarouselUntilMS = 0;
+	CAM_LOG_INFO("Switched to the new package with size {}", m_Package->File.Size);
+}
+
+UpdatePackage *Server::FindPackage(uint64 package_id) const
+{
+	if (m_Package && m_Package->Id == package_id)
+	{
+		return m_Package.get();
+	}
+
+	if (m_PreviousPackage && m_PreviousPackage->Id == package_id)
+	{
+		return m_PreviousPackage.get();
+	}
+
+	return nullptr;
+}
+
+bool Server::Step()
+{
+	SwapPackage();
+	SampleLiveTraffic();
+
+	// While the carousel runs, the socket is only waited on until the next carousel pieces are due.
+	int32 timeout_ms = GetCarouselWaitMS();
+	if (timeout_ms < 0 || m_Socket->Wait(timeout_ms))
+	{
+		int32 count = m_Socket->RecvBatch(m_Received, RECV_BATCH);
+		if (count < 0)
+		{
+			return false;
+		}
+
+		for (int32 i = 0; i < count; ++i)
+		{
+			HandleMessage(m_RecvData[i], (int32)m_Received[i].Size, m_Received[i].Addr);
+		}
+
+		// The pieces for all requests of the batch go out together.
+		FlushPieces();
+	}
+
+	SendCarousel();
+	return true;
+}
+
+void Server::HandleMessage(Byte *message, int32 len, Core::addr_t addr)
+{
+	if (len < sizeof(header_t))
+	{
+		return;
+	}
+
+	header_t *header = (header_t *)message;
+	if (header->Type == MessageType::CLIENT_UPDATE_BEGIN)
+	{
+		if (len != sizeof(ClientUpdateBeginMessage))
+		{
+			return;
+		}
+
+		ClientUpdateBeginMessage *msg = (ClientUpdateBeginMessage *)message;
+		CAM_LOG_DEBUG("Received Update begin request with client token: {}", msg->ClientToken);
+
+		int64 now_ms = Core::QueryMS();
+		Core::Clients::Node *client = m_Clients->Insert(addr, now_ms);
+
+		if (!client)
+		{
+			CAM_LOG_ERROR("Client could not be inserted!");
+			return;
+		}
+
+		if (!m_Bandwidth.IsAvailable(&client->Bandwidth, Core::QueryUS()))
+		{
 		//	CAM_LOG_ERROR("Client has no bandwidth available!");
-			return true;
+			return;
 		}
 
-		if (msg->ServerToken != client->ServerToken)
-		{
-			CAM_LOG_ERROR("Server tokens did not match!");
-			return true;
+		if (msg->ServerToken != client->ServerToken)
+		{
+			CAM_LOG_WARN("Server tokens did not match! Sending Server update token message...");
+			ServerUpdateTokenMessage res = {};
+			res.Header.Type = MessageType::SERVER_UPDATE_TOKEN;
+			res.Header.Version = m_LocalVersion;
+			res.ClientToken = msg->ClientToken;
+			res.ServerToken = client->ServerToken;
+			m_Socket->Send(&res, sizeof(res), addr);
+			m_SentBytes += sizeof(res) + DATAGRAM_OVERHEAD_BYTES;
+
+			m_Bandwidth.Consume(&client->Bandwidth, sizeof(ServerUpdateTokenMessage));
+
+			return;
 		}
 
-		CAM_LOG_DEBUG("Sending update: {0} / {1}", msg->PiecePos, m_UpdateFile.Size);
-		ServerUpdatePieceMessage res = {};
+		CAM_LOG_DEBUG("Sending update begin response...");
+		ServerUpdateBeginMessage res;
+		memset(&res, 0, sizeof(res));
+
 		res.Header.Version = m_LocalVersion;
-		res.Header.Type = MessageType::SERVER_UPDATE_PIECE;
+		res.Header.Type = MessageType::SERVER_UPDATE_BEGIN;
 		res.ClientToken = msg->ClientToken;
 		res.ServerToken = client->ServerToken;
-		res.PiecePos = msg->PiecePos;
-		res.PieceSize = (uint16)Core::utils::Min<uint32>(m_UpdateFile.Size - msg->PiecePos, PIECE_BYTES);
+		res.Payload = msg->Payload;
+		res.BaseVersion = 0;
+
+		res.PackageId = m_Package->Id;
+
+		if (msg->Payload == UpdatePayload::UPDATE_MANIFEST && !m_Package->ManifestData.IsEmpty())
+		{
+			res.UpdateSize = m_Package->ManifestData.Size;
+		}
+		else if (msg->Payload == UpdatePayload::UPDATE_CHUNKS && !m_Package->ChunkStore.IsEmpty())
+		{
+			res.UpdateSize = m_Package->ChunkStore.Size;
+		}
+		else
+		{
+			// Without a manifest the client gets the package. Clients, which still have a previous package, receive the patch from it, if there is one.
+			const UpdatePatch *patch = msg->LocalVersion != 0 ? FindPatch(m_Package.get(), msg->LocalVersion) : nullptr;
+			res.Payload = UpdatePayload::UPDATE_PACKAGE;
+
+			if (patch)
+			{
+				res.UpdateSize = patch->Data.Size;
+				res.BaseVersion = patch->BaseVersion;
+			}
+			else
+			{
+				res.UpdateSize = m_Package->File.Size;
+
+				// The id tells the client to take the pieces from the carousel.
+				res.UpdateId = ExtendCarousel(now_ms) ? m_Package->Id : 0;
+			}
+		}
+
+		// The client announces the largest piece it can receive, the MTU of the server may limit it further.
+		res.PieceSize = GetServedPieceSize(msg->MaxPieceSize);
+
+		// Only the root of the piece hashes is signed, the client checks every piece against its hash on arrival.
+		const PieceTree *tree = GetPieceTree(m_Package.get(), m_Crypto, res.Payload, res.BaseVersion, res.PieceSize);
+		if (!tree)
+		{
+			CAM_LOG_ERROR("The payload {0} with base version {1} is not available!", res.Payload, res.BaseVersion);
+			return;
+		}
+
+		memcpy(res.PieceRoot, tree->Root.Root, sizeof(res.PieceRoot));
+		res.UpdateSignature = tree->RootSignature;
 
-		char* send_buf = (char*)malloc(sizeof(res) + res.PieceSize);
-		if (!send_buf)
+		m_Socket->Send(&res, sizeof(res), addr);
+		m_SentBytes += sizeof(res) + DATAGRAM_OVERHEAD_BYTES;
+
+		m_Bandwidth.Consume(&client->Bandwidth, sizeof(ServerUpdateBeginMessage));
+	}
+	else if (header->Type == MessageType::CLIENT_UPDATE_PIECE)
+	{
+		if (len < GetPieceRequestBytes(0))
+		{
+			return;
+		}
+
+		ClientUpdatePieceMessage *msg = (ClientUpdatePieceMessage *)message;
+		if (msg->PieceCount > MAX_PIECE_REQUESTS || len != GetPieceRequestBytes(msg->PieceCount))
+		{
+			CAM_LOG_ERROR("ClientUpdatePieceMessage: Unexpected message size.");
+			return;
+		}
+
+		// Every other piece size would have to be hashed and signed first, only the negotiated sizes are served.
+		if (!IsServedPieceSize(msg->PieceSize))
+		{
+			CAM_LOG_ERROR("The requested piece size {} is not supported!", msg->PieceSize);
+			return;
+		}
+
+		int64 now_ms = Core::QueryMS();
+		Core::Clients::Node *client = m_Clients->Insert(addr, now_ms);
+
+		if (!client)
+		{
+			CAM_LOG_ERROR("Could not find the client for addr {0}, port {1}", addr.Host, addr.Port);
+			return;
+		}
+
+		if (msg->ServerToken != client->ServerToken)
 		{
-			CAM_LOG_ERROR("Failed to allocate enough space for the update package!");
-			return true;
+			CAM_LOG_ERROR("Server tokens did not match!");
+			return;
 		}
 
-		memcpy(send_buf, &res, sizeof(res));
-		memcpy(send_buf + sizeof(res), m_UpdateFile.Data + msg->PiecePos, res.PieceSize);
+		// A replaced package is still served, until its clients are done. Clients of an older package have to start over.
+		UpdatePackage *package = FindPackage(msg->PackageId);
+		if (!package)
+		{
+			CAM_LOG_WARN("The requested package {} is no longer available, restarting the update of the client.", msg->PackageId);
+
+			ServerUpdateRestartMessage res = {};
+			res.Header.Type = MessageType::SERVER_UPDATE_RESTART;
+			res.Header.Version = m_LocalVersion;
+			res.ClientToken = msg->ClientToken;
+			res.ServerToken = client->ServerToken;
+			res.PackageId = msg->PackageId;
+
+			m_Socket->Send(&res, sizeof(res), addr);
+			m_SentBytes += sizeof(res) + DATAGRAM_OVERHEAD_BYTES;
+			return;
+		}
 
-		uint32 send_bytes = sizeof(res) + res.PieceSize;
-		m_Socket->Send(send_buf, send_bytes, addr);
+		uint32 payload_size = 0;
+		const Byte *payload = GetPayload(package, msg->Payload, msg->BaseVersion, &payload_size);
+		const PieceTree *tree = payload ? GetPieceTree(package, m_Crypto, msg->Payload, msg->BaseVersion, msg->PieceSize) : nullptr;
+		if (!tree)
+		{
+			CAM_LOG_ERROR("The payload {0} with base version {1} is not available!", msg->Payload, msg->BaseVersion);
+			return;
+		}
 
-		free(send_buf);
-		send_buf = nullptr;
-		client->Bandwidth += send_bytes;
+		// The pieces are answered in the requested order, the client relies on it to detect lost pieces.
+		for (uint32 i = 0; i < msg->PieceCount; ++i)
+		{
+			if (!QueuePiece(client, msg, tree, payload, payload_size, msg->Pieces[i], addr, now_ms))
+			{
+				break;
+			}
+		}
 	}
 	else if (header->Type == MessageType::CLIENT_REQUEST_VERSION)
 	{
 		if (len != sizeof(ClientWantsVersionMessage))
 		{
 			CAM_LOG_ERROR("ClientWantsVersionMessage: Unexpected message size.");
-			return true;
+			return;
 		}
 
-		ClientWantsVersionMessage *msg = (ClientWantsVersionMessage *)BUF;
+		ClientWantsVersionMessage *msg = (ClientWantsVersionMessage *)message;
 		uint32 client_version = msg->LocalVersion;
 
 		CAM_LOG_DEBUG("Received server version request for version: {}", msg->LocalVersion);
@@ -481,8 +1146,430 @@ bool Server::Step()
 		res.PublicKey.Size = m_PublicKey.Size;
 		memcpy(res.PublicKey.Data, m_PublicKey.Data, m_PublicKey.Size);
 		m_Socket->Send(&res, sizeof(res), addr);
+		m_SentBytes += sizeof(res) + DATAGRAM_OVERHEAD_BYTES;
+	}
+}
+
+bool Server::QueuePiece(Core::Clients::Node *client, const ClientUpdatePieceMessage *msg, const PieceTree *tree, const Byte *payload, uint32 payload_size, uint32 piece, Core::addr_t addr, int64 now_ms)
+{
+	// The tree nodes and the piece hashes come first, the positions count on across all sections.
+	uint32 node_pieces = GetNodePieceCount(payload_size, msg->PieceSize);
+	uint32 hash_pieces = GetHashPieceCount(payload_size, msg->PieceSize);
+	uint32 hash_bytes = GetHashesPerPiece(msg->PieceSize) * Core::SHA256_BYTES;
+
+	const Byte *data = payload;
+	uint32 data_size = payload_size;
+	uint64 data_pos = 0;
+	uint32 data_piece_size = msg->PieceSize;
+
+	if (piece < node_pieces)
+	{
+		data = tree->Nodes.Data;
+		data_size = tree->Nodes.Size;
+		data_pos = (uint64)piece * msg->PieceSize;
+	}
+	else if (piece < node_pieces + hash_pieces)
+	{
+		data = tree->Hashes.Data;
+		data_size = tree->Hashes.Size;
+		data_pos = (uint64)(piece - node_pieces) * hash_bytes;
+		data_piece_size = hash_bytes;
+	}
+	else
+	{
+		data_pos = (uint64)(piece - node_pieces - hash_pieces) * msg->PieceSize;
+	}
+
+	uint64 piece_pos = (uint64)piece * msg->PieceSize;
+	if (data_pos >= data_size || piece_pos > UINT32_MAX)
+	{
+		CAM_LOG_ERROR("The request position was larger than the file!");
+		return true;
+	}
+
+	if (!m_Bandwidth.IsAvailable(&client->Bandwidth, Core::QueryUS()))
+	{
+		return false;
+	}
+
+	if (m_PendingPieces == SEND_BATCH)
+	{
+		FlushPieces();
+	}
+
+	uint32 idx = m_PendingPieces++;
+	ServerUpdatePieceMessage &res = m_PieceHeaders[idx];
+	res = {};
+	res.Header.Version = m_LocalVersion;
+	res.Header.Type = MessageType::SERVER_UPDATE_PIECE;
+	res.ClientToken = msg->ClientToken;
+	res.ServerToken = client->ServerToken;
+	res.RequestUS = msg->RequestUS;
+	res.PiecePos = (uint32)piece_pos;
+	res.PieceSize = (uint16)Core::utils::Min<uint64>(data_size - data_pos, data_piece_size);
+
+	// The piece is sent straight from the update file or patch, only the header is written.
+	m_PieceBuffers[idx][1] = { (Byte *)data + data_pos, res.PieceSize };
+	m_PieceDatagrams[idx].Addr = addr;
+
+	m_Bandwidth.Consume(&client->Bandwidth, sizeof(res) + res.PieceSize);
+	m_SentBytes += sizeof(res) + res.PieceSize + DATAGRAM_OVERHEAD_BYTES;
+	return true;
+}
+
+void Server::FlushPieces()
+{
+	if (m_PendingPieces == 0)
+	{
+		return;
+	}
+
+	m_Socket->SendBatch(m_PieceDatagrams, m_PendingPieces);
+	m_PendingPieces = 0;
+}
+
+void Server::BuildPatches(UpdatePackage *package)
+{
+	package->Patches.clear();
+
+	if (m_Config.PackagePath.empty())
+	{
+		return;
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories(m_Config.PackagePath, error);
+	if (error)
+	{
+		CAM_LOG_ERROR("Could not create the package directory {}", m_Config.PackagePath);
+		return;
+	}
+
+	// Keep the current package, the next versions are patched from it.
+	std::string package_file = m_Config.PackagePath + "/" + std::to_string(m_LocalVersion) + ".zip";
+	if (Core::FileSystem::Get()->FileExists(package_file) && !Core::FileSystem::Get()->RemoveFile(package_file))
+	{
+		CAM_LOG_ERROR("Could not delete the old package {}", package_file);
+		return;
+	}
+
+	if (!Core::FileSystem::Get()->WriteFile(package_file, (void *)package->File.Data, package->File.Size))
+	{
+		CAM_LOG_ERROR("Could not write the package {}", package_file);
+		return;
+	}
+
+	// The packages are named after their version, the newest ones are patched first.
+	std::vector<uint32> versions;
+	for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(m_Config.PackagePath, error))
+	{
+		const std::filesystem::path p = entry.path();
+		if (p.extension() != ".zip")
+		{
+			continue;
+		}
+
+		std::string name = p.stem().string();
+		char *end = nullptr;
+		uint32 version = (uint32)strtoul(name.c_str(), &end, 10);
+		if (version == 0 || *end != '\0' || version == m_LocalVersion)
+		{
+			continue;
+		}
+
+		versions.push_back(version);
+	}
+
+	std::sort(versions.begin(), versions.end(), std::greater<uint32>());
+
+	for (uint32 i = 0; i < versions.size(); ++i)
+	{
+		std::string base_file = m_Config.PackagePath + "/" + std::to_string(versions[i]) + ".zip";
+		if (i >= MAX_PATCH_VERSIONS)
+		{
+			CAM_LOG_INFO("Removing the old package {}", base_file);
+			if (!Core::FileSystem::Get()->RemoveFile(base_file))
+			{
+				CAM_LOG_ERROR("Could not delete the old package {}", base_file);
+			}
+
+			continue;
+		}
+
+		uint32 base_size = 0;
+		Byte *base = Core::FileSystem::Get()->ReadFile(base_file, &base_size);
+		if (!base)
+		{
+			CAM_LOG_ERROR("Could not read the package {}", base_file);
+			continue;
+		}
+
+		UpdatePatch patch;
+		patch.BaseVersion = versions[i];
+		bool created = Core::BinaryDelta::Create(base, base_size, package->File.Data, package->File.Size, &patch.Buffer);
+
+		delete[] base;
+		base = nullptr;
+
+		if (!created || patch.Buffer.size() >= package->File.Size)
+		{
+			CAM_LOG_INFO("Skipping the patch from version {}, it is not smaller than the full package.", patch.BaseVersion);
+			continue;
+		}
+
+		patch.Data = patch.Buffer;
+		CAM_LOG_INFO("Created patch from version {0} with size {1}", patch.BaseVersion, patch.Data.Size);
+		package->Patches.push_back(std::move(patch));
+	}
+}
+
+bool Server::ExtendCarousel(int64 now_ms)
+{
+	if (m_CarouselPieceSize == 0 || m_Config.CarouselBytesPerSecond == 0)
+	{
+		return false;
 	}
 
+	int64 round_ms = (int64)m_Package->File.Size * 1000 / m_Config.CarouselBytesPerSecond + 1;
+	if (now_ms >= m_CarouselUntilMS)
+	{
+		CAM_LOG_INFO("Starting the carousel, one round takes {} ms.", round_ms);
+		m_CarouselNextUS = Core::QueryUS();
+	}
+
+	m_CarouselUntilMS = now_ms + round_ms;
 	return true;
 }
 
+void Server::SendCarousel()
+{
+	if (!m_Package || m_CarouselPieceSize == 0 || Core::QueryMS() >= m_CarouselUntilMS)
+	{
+		return;
+	}
+
+	int64 now_us = Core::QueryUS();
+	int64 piece_us = Core::utils::Max<int64>((int64)m_CarouselPieceSize * 1000000 / m_Config.CarouselBytesPerSecond, 1);
+	const PackageData &file = m_Package->File;
+	uint32 piece_count = (file.Size + m_CarouselPieceSize - 1) / m_CarouselPieceSize;
+
+	if (m_CarouselNextUS < now_us - CAROUSEL_MAX_LAG_US)
+	{
+		m_CarouselNextUS = now_us;
+	}
+
+	// The carousel is update traffic as well, it pauses while the update class has no bandwidth left.
+	uint32 count = 0;
+	while (m_CarouselNextUS <= now_us && count < SEND_BATCH && m_Bandwidth.IsClassAvailable(now_us))
+	{
+		if (m_CarouselPiece >= piece_count)
+		{
+			m_CarouselPiece = 0;
+		}
+
+		uint32 piece_pos = m_CarouselPiece * m_CarouselPieceSize;
+
+		ServerCarouselPieceMessage &msg = m_CarouselHeaders[count];
+		msg = {};
+		msg.Header.Version = m_LocalVersion;
+		msg.Header.Type = MessageType::SERVER_CAROUSEL_PIECE;
+		msg.UpdateId = m_Package->Id;
+		msg.UpdateSize = file.Size;
+		msg.PiecePos = piece_pos;
+		msg.PieceSize = (uint16)Core::utils::Min<uint32>(file.Size - piece_pos, m_CarouselPieceSize);
+
+		m_CarouselBuffers[count][1] = { (Byte *)file.Data + piece_pos, msg.PieceSize };
+		m_CarouselDatagrams[count].Addr = m_CarouselAddr;
+		m_Bandwidth.ConsumeClass(sizeof(msg) + msg.PieceSize);
+		m_SentBytes += sizeof(msg) + msg.PieceSize + DATAGRAM_OVERHEAD_BYTES;
+
+		++count;
+		++m_CarouselPiece;
+		m_CarouselNextUS += piece_us;
+	}
+
+	if (count > 0)
+	{
+		m_Socket->SendBatch(m_CarouselDatagrams, count);
+	}
+}
+
+int32 Server::GetCarouselWaitMS() const
+{
+	if (!m_Package || m_CarouselPieceSize == 0 || Core::QueryMS() >= m_CarouselUntilMS)
+	{
+		return -1;
+	}
+
+	// Rounded up, so that the pieces are due after the wait.
+	int64 now_us = Core::QueryUS();
+	int64 wait_us = Core::utils::Max<int64>(m_CarouselNextUS - now_us, m_Bandwidth.GetClassWaitUS(now_us));
+	return wait_us > 0 ? (int32)((wait_us + 999) / 1000) : 0;
+}
+
+void Server::SampleLiveTraffic()
+{
+	if (!m_InterfaceCounters)
+	{
+		return;
+	}
+
+	int64 now_us = Core::QueryUS();
+	int64 elapsed_us = now_us - m_LastSampleUS;
+	if (m_LastSampleUS != 0 && elapsed_us < LIVE_SAMPLE_US)
+	{
+		return;
+	}
+
+	uint64 interface_bytes = 0;
+	if (!m_InterfaceCounters->GetSentBytes(&interface_bytes))
+	{
+		return;
+	}
+
+	// The first sample only starts the counting, a counter, which was reset, starts it again.
+	uint64 foreign_bytes = 0;
+	if (m_LastSampleUS != 0 && interface_bytes >= m_InterfaceSentBytes)
+	{
+		uint64 interface_sent = interface_bytes - m_InterfaceSentBytes;
+		uint64 server_sent = m_SentBytes - m_SampledSentBytes;
+		foreign_bytes = interface_sent > server_sent ? interface_sent - server_sent : 0;
+	}
+
+	m_InterfaceSentBytes = interface_bytes;
+	m_SampledSentBytes = m_SentBytes;
+	m_LastSampleUS = now_us;
+
+	if (foreign_bytes == 0 || foreign_bytes * 1000000 < (uint64)m_Config.LiveThresholdBytesPerSecond * (uint64)elapsed_us)
+	{
+		return;
+	}
+
+	// The network loop sleeps while no client asks for pieces, then the bytes are spread over a longer time.
+	// Only the share of one sample period is charged, the rest was sent while the server was idle.
+	if (elapsed_us > LIVE_SAMPLE_US)
+	{
+		foreign_bytes = foreign_bytes * LIVE_SAMPLE_US / elapsed_us;
+	}
+
+	ReportLiveTraffic((uint32)Core::utils::Min<uint64>(foreign_bytes, UINT32_MAX));
+}
+
+const Byte *Server::GetPayload(const UpdatePackage *package, uint16 payload, uint32 base_version, uint32 *out_size) const
+{
+	if (payload == UpdatePayload::UPDATE_MANIFEST)
+	{
+		*out_size = package->ManifestData.Size;
+		return package->ManifestData.Data;
+	}
+
+	if (payload == UpdatePayload::UPDATE_CHUNKS)
+	{
+		*out_size = package->ChunkStore.Size;
+		return package->ChunkStore.Data;
+	}
+
+	if (base_version != 0)
+	{
+		const UpdatePatch *patch = FindPatch(package, base_version);
+		if (!patch)
+		{
+			return nullptr;
+		}
+
+		*out_size = patch->Data.Size;
+		return patch->Data.Data;
+	}
+
+	*out_size = package->File.Size;
+	return package->File.Data;
+}
+
+uint16 Server::GetServedPieceSize(uint16 max_piece_size) const
+{
+	uint16 max_bytes = GetMaxPieceBytes(m_Config.MTU);
+	if (max_piece_size >= max_bytes)
+	{
+		return max_bytes;
+	}
+
+	uint32 piece_size = MIN_PIECE_BYTES;
+	while (piece_size * 2 <= max_piece_size)
+	{
+		piece_size *= 2;
+	}
+
+	return (uint16)piece_size;
+}
+
+bool Server::IsServedPieceSize(uint16 piece_size) const
+{
+	return GetServedPieceSize(piece_size) == piece_size;
+}
+
+const PieceTree *Server::GetPieceTree(UpdatePackage *package, Core::Crypto *crypto, uint16 payload, uint32 base_version, uint16 piece_size) const
+{
+	uint32 payload_size = 0;
+	const Byte *data = GetPayload(package, payload, base_version, &payload_size);
+	if (!data)
+	{
+		return nullptr;
+	}
+
+	for (const PieceTree &tree : package->PieceTrees)
+	{
+		if (tree.Root.Payload == payload && tree.Root.BaseVersion == base_version && tree.Root.PieceSize == piece_size)
+		{
+			return &tree;
+		}
+	}
+
+	if (package->PieceTrees.size() >= MAX_PIECE_TREES)
+	{
+		CAM_LOG_ERROR("The package already has {} piece trees, pieces of {} bytes are not served!", MAX_PIECE_TREES, piece_size);
+		return nullptr;
+	}
+
+	PieceTree tree = {};
+	tree.Root.Version = m_LocalVersion;
+	tree.Root.BaseVersion = base_version;
+	tree.Root.UpdateSize = payload_size;
+	tree.Root.PieceSize = piece_size;
+	tree.Root.Payload = payload;
+
+	Core::MerkleTree::HashPieces(data, payload_size, piece_size, &tree.HashBuffer);
+	Core::MerkleTree::ComputeLevel(tree.HashBuffer.data(), Core::MerkleTree::GetPieceCount(payload_size, piece_size), GetHashesPerPiece(piece_size), &tree.NodeBuffer);
+	Core::MerkleTree::ComputeRoot(tree.NodeBuffer.data(), (uint32)(tree.NodeBuffer.size() / Core::SHA256_BYTES), tree.Root.Root);
+	tree.Nodes = tree.NodeBuffer;
+	tree.Hashes = tree.HashBuffer;
+
+	// The signature covers the version, the payload and the piece layout as well, so no other payload can be passed off with it.
+	if (!crypto->SignSignature(
+		tree.RootSignature.Data,
+		sizeof(tree.RootSignature.Data),
+		(Byte *)&tree.Root,
+		sizeof(tree.Root),
+		m_PrivateKey.Data,
+		m_PrivateKey.Size))
+	{
+		CAM_LOG_ERROR("Could not sign the piece hashes of payload {0} with base version {1}!", payload, base_version);
+		return nullptr;
+	}
+
+	CAM_LOG_DEBUG("Hashed payload {0} with base version {1} into pieces of {2} bytes.", payload, base_version, piece_size);
+	package->PieceTrees.push_back(std::move(tree));
+	return &package->PieceTrees.back();
+}
+
+const UpdatePatch *Server::FindPatch(const UpdatePackage *package, uint32 base_version) const
+{
+	for (const UpdatePatch &patch : package->Patches)
+	{
+		if (patch.BaseVersion == base_version)
+		{
+			return &patch;
+		}
+	}
+
+	return nullptr;
+}
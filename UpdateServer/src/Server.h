@@ -1,9 +1,18 @@
 #pragma once
 
 #include <Cam-Core.h>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "Message.h"
+#include "Utils/UpdateManifest.h"
+#include "Utils/ZipArchive.h"
 
 struct ServerConfig
 {
@@ -27,6 +36,61 @@ struct ServerConfig
 	/// </summary>
 	uint16 ServerPort;
 
+	/// <summary>
+	/// The directory, in which the packages of the previous versions are kept. Clients, which still have one of them,
+	/// receive a patch to the current version instead of the full package.
+	/// </summary>
+	std::string PackagePath;
+
+	/// <summary>
+	/// The MTU of the network, limits the piece size, which is negotiated with the clients.
+	/// </summary>
+	uint32 MTU = DEFAULT_MTU;
+
+	/// <summary>
+	/// The multicast group, to which the pieces of the full package are streamed in a carousel while clients download it.
+	/// An empty string disables the carousel.
+	/// </summary>
+	std::string MulticastGroup;
+
+	/// <summary>
+	/// The port of the multicast group.
+	/// </summary>
+	uint16 MulticastPort = 0;
+
+	/// <summary>
+	/// The IP v4 address of the interface the carousel is sent on, an empty string lets the system choose.
+	/// Use "127.0.0.1" for clients on the same host, Linux needs multicast enabled on the loopback interface for that.
+	/// </summary>
+	std::string MulticastInterface;
+
+	/// <summary>
+	/// The rate of the carousel in bytes per second. The carousel counts towards the update traffic in Bandwidth.
+	/// </summary>
+	uint32 CarouselBytesPerSecond = 4 * 1024 * 1024;
+
+	/// <summary>
+	/// The egress budget of the server, and the update traffic, which is left while live video is sent.
+	/// The clients share the update traffic evenly. Can be changed at runtime with Server::SetBandwidthLimits.
+	/// </summary>
+	Core::BandwidthLimits Bandwidth;
+
+	/// <summary>
+	/// Measures the live video on the uplink with the traffic counters of the network interface. Everything the interface sent,
+	/// which the server did not send itself, counts as live video. Other applications can report their traffic with Server::ReportLiveTraffic.
+	/// </summary>
+	bool MeasureLiveTraffic = true;
+
+	/// <summary>
+	/// The interface, which the cameras and the server share, e.g. "eth0". An empty string sums up all interfaces except loopback.
+	/// </summary>
+	std::string LiveInterface;
+
+	/// <summary>
+	/// Foreign traffic below this rate in bytes per second is not taken for live video, e.g. the traffic of a remote shell.
+	/// </summary>
+	uint32 LiveThresholdBytesPerSecond = 256 * 1024;
+
 	/// <summary>
 	/// the path to the public key
 	/// </summary>
@@ -41,6 +105,164 @@ struct ServerConfig
 	/// The path to the signature
 	/// </summary>
 	std::string SignaturePath;
+
+	/// <summary>
+	/// The file, in which the signed package is kept between restarts of the server. An empty string disables the cache.
+	/// </summary>
+	std::string PackageCachePath;
+};
+
+/// <summary>
+/// Points to data, which the server sends. It is either owned by the package or mapped from the package cache.
+/// </summary>
+struct PackageData
+{
+	const Byte *Data = nullptr;
+	uint32 Size = 0;
+
+	PackageData() = default;
+
+	PackageData(const Byte *data, uint32 size)
+		: Data(size > 0 ? data : nullptr), Size(data ? size : 0)
+	{
+	}
+
+	PackageData(const std::vector<Byte> &data)
+		: PackageData(data.data(), (uint32)data.size())
+	{
+	}
+
+	bool IsEmpty() const { return Size == 0; }
+};
+
+struct UpdatePatch
+{
+	/// <summary>
+	/// The version the patch has to be applied to.
+	/// </summary>
+	uint32 BaseVersion;
+	PackageData Data;
+
+	/// <summary>
+	/// Holds the data of a patch, which was created by this server. Empty for a patch from the package cache.
+	/// </summary>
+	std::vector<Byte> Buffer;
+};
+
+/// <summary>
+/// The piece hashes of a payload for one piece size, the tree nodes which cover one hash piece each, and the signature of the root.
+/// </summary>
+struct PieceTree
+{
+	PieceRoot Root;
+	PackageData Nodes;
+	PackageData Hashes;
+	Signature RootSignature;
+
+	/// <summary>
+	/// Hold the nodes and hashes, which were computed by this server. Empty for a tree from the package cache.
+	/// </summary>
+	std::vector<Byte> NodeBuffer;
+	std::vector<Byte> HashBuffer;
+};
+
+/// <summary>
+/// Everything the server sends for one build of the update. A new build is prepared next to the current one and swapped in at once.
+/// </summary>
+struct UpdatePackage
+{
+	PackageData File;
+	Signature FileSignature;
+
+	/// <summary>
+	/// Identifies the build towards the clients, a hash of the package.
+	/// </summary>
+	uint64 Id = 0;
+
+	/// <summary>
+	/// A hash of the names and contents of the packaged files, a rebuild with the same files is skipped.
+	/// </summary>
+	uint64 FilesHash = 0;
+
+	/// <summary>
+	/// A hash of the names, sizes and write times of the packaged files, the package cache is only used while they match.
+	/// </summary>
+	uint64 FilesStamp = 0;
+
+	std::vector<UpdatePatch> Patches;
+
+	// The files of the update as content defined chunks.
+	Core::UpdateManifest Manifest;
+	PackageData ManifestData;
+	PackageData ChunkStore;
+
+	// The piece hashes of all payloads, for every piece size which has been requested.
+	std::vector<PieceTree> PieceTrees;
+
+	// A built package owns its data, a package from the cache keeps the cache file mapped and is served from it.
+	Core::FileSystemBuffer FileBuffer;
+	std::vector<Byte> ManifestBuffer;
+	std::vector<Byte> ChunkStoreBuffer;
+	std::unique_ptr<Core::MappedFile> Cache;
+};
+
+/// <summary>
+/// Starts the package cache file. It is followed by the package, the manifest, the chunk store, the patches and the piece trees.
+/// Every patch has its base version and size in front of it, every tree a PackageCacheTree.
+/// </summary>
+struct PackageCacheHeader
+{
+	static constexpr uint32 MAGIC = 0x43504D43;
+	static constexpr uint32 FORMAT_VERSION = 3;
+
+	uint32 Magic;
+	uint32 FormatVersion;
+	uint32 LocalVersion;
+	uint32 PatchCount;
+	uint32 TreeCount;
+	uint32 Reserved;
+
+	/// <summary>
+	/// The FilesStamp of the cached package, the cache is only used while the files of the update still match it.
+	/// </summary>
+	uint64 FilesStamp;
+
+	/// <summary>
+	/// The FilesHash of the cached package.
+	/// </summary>
+	uint64 FilesHash;
+
+	/// <summary>
+	/// A hash of the public key, the cached signatures are useless once the keys changed.
+	/// </summary>
+	uint64 KeyHash;
+
+	/// <summary>
+	/// A hash of the header and the size of the cache file, a cache file which was cut off is not used.
+	/// </summary>
+	uint64 HeaderHash;
+
+	/// <summary>
+	/// A hash of everything behind the header. It is checked on the rebuild thread, while the package is already served.
+	/// </summary>
+	uint64 DataHash;
+
+	uint64 PackageId;
+	uint64 ChunkStoreSize;
+	uint32 FileSize;
+	uint32 ManifestSize;
+	Signature FileSignature;
+};
+
+/// <summary>
+/// Starts a piece tree in the package cache, it is followed by the nodes and the hashes.
+/// </summary>
+struct PackageCacheTree
+{
+	PieceRoot Root;
+	Signature RootSignature;
+	uint32 NodesSize;
+	uint32 HashesSize;
 };
 
 class Server
@@ -66,25 +288,282 @@ public:
 	/// </summary>
 	void StartFileWatcher();
 
+	/// <summary>
+	/// Changes the bandwidth limits of the running server. Can be called from any thread.
+	/// </summary>
+	void SetBandwidthLimits(const Core::BandwidthLimits &limits);
+
+	/// <summary>
+	/// Reports live video, which was sent over the same uplink. The update traffic backs off, while there is live video.
+	/// The live video on the interface is measured already, if MeasureLiveTraffic is set. Can be called from any thread.
+	/// </summary>
+	void ReportLiveTraffic(uint32 bytes);
+
 private:
 
+	/// <summary>
+	/// Loads the key pair, which signs the updates, or generates a new one.
+	/// </summary>
+	/// <param name="forceDeleteSignature">Generates a new key pair, even if there is one on disk.</param>
+	bool LoadKeys(bool forceDeleteSignature);
+
+	/// <summary>
+	/// Lists the files, which belong into the update, sorted by name, and hashes their names, sizes and write times.
+	/// </summary>
+	bool ListPackageFiles(bool skipDebugFiles, std::vector<std::filesystem::path> *out_paths, uint64 *out_files_stamp);
+
+	/// <summary>
+	/// Reads the files, which belong into the update, sorted by name, and hashes their names and contents.
+	/// The caller deletes the buffers of the files.
+	/// </summary>
+	bool ReadPackageFiles(bool skipDebugFiles, std::vector<Core::ZipFile> *out_files, uint64 *out_files_hash, uint64 *out_files_stamp);
+
+	/// <summary>
+	/// Maps the package cache and serves the package from it, if it was built from the same files, for the same version and with the same keys.
+	/// The files are only compared by their sizes and write times, the cached signatures and piece hashes are used as they are.
+	/// </summary>
+	/// <returns>Returns nullptr, if there is no usable cache and the package has to be built.</returns>
+	std::unique_ptr<UpdatePackage> LoadCachedPackage(bool skipDebugFiles);
+
+	/// <summary>
+	/// Writes the package to the package cache, so that the next start of the server can skip the build.
+	/// </summary>
+	void StorePackageCache(const UpdatePackage &package);
+
+	/// <summary>
+	/// Hashes the package cache, which the package was loaded from.
+	/// </summary>
+	/// <returns>Returns false, if the cache was damaged after it was written.</returns>
+	bool VerifyPackageCache();
+
+	/// <summary>
+	/// Builds the piece hashes for the default piece size, before the first client asks for them.
+	/// </summary>
+	void BuildDefaultPieceTrees(UpdatePackage *package, Core::Crypto *crypto);
+
+	/// <summary>
+	/// Reads the files of the update and builds a package from them, with the manifest, the patches and the signed piece hashes.
+	/// </summary>
+	/// <param name="crypto">Signs the package, the build thread uses its own instance.</param>
+	/// <param name="unchanged_hash">The FilesHash of the current package, no package is built if the files still match it. 0 always builds one.</param>
+	/// <returns>Returns nullptr, if the files did not change or the package could not be built.</returns>
+	std::unique_ptr<UpdatePackage> BuildPackage(Core::Crypto *crypto, bool skipDebugFiles, uint64 unchanged_hash);
+
+	/// <summary>
+	/// Rebuilds the package on its own thread, once the file watcher reported changes and no further changes came in for REBUILD_QUIET_MS.
+	/// </summary>
+	void RebuildLoop();
+
+	/// <summary>
+	/// Makes a newly built package the current one. The replaced package is kept for the clients, which are still downloading it.
+	/// </summary>
+	void SwapPackage();
+
+	/// <summary>
+	/// Returns the current or the replaced package with the given id, or nullptr if it is neither.
+	/// </summary>
+	UpdatePackage *FindPackage(uint64 package_id) const;
+
+	/// <summary>
+	/// Receives all queued client messages with a single system call and handles them.
+	/// </summary>
+	/// <returns>Returns false, if the socket failed.</returns>
 	bool Step();
 
+	/// <summary>
+	/// Handles a single message from a client.
+	/// </summary>
+	void HandleMessage(Byte *message, int32 len, Core::addr_t addr);
+
+	/// <summary>
+	/// Queues a single requested piece of the update for the client, it is sent with the next FlushPieces.
+	/// </summary>
+	/// <param name="tree">The tree nodes and piece hashes of the payload, they are sent before the pieces of the payload.</param>
+	/// <param name="payload">The package, patch, manifest or chunk store, which the client is downloading.</param>
+	/// <returns>Returns false, if the client has no bandwidth left and the remaining pieces of the request should be skipped.</returns>
+	bool QueuePiece(Core::Clients::Node *client, const ClientUpdatePieceMessage *msg, const PieceTree *tree, const Byte *payload, uint32 payload_size, uint32 piece, Core::addr_t addr, int64 now_ms);
+
+	/// <summary>
+	/// Sends all queued pieces with as few system calls as possible.
+	/// </summary>
+	void FlushPieces();
+
+	/// <summary>
+	/// Keeps the carousel running for one more round, so that a client, which just started to download the package, sees every piece once.
+	/// </summary>
+	/// <returns>Returns false, if no carousel is configured.</returns>
+	bool ExtendCarousel(int64 now_ms);
+
+	/// <summary>
+	/// Sends the carousel pieces, which are due at the configured rate.
+	/// </summary>
+	void SendCarousel();
+
+	/// <summary>
+	/// Returns the time until the next carousel pieces are due, or -1 if the carousel does not run.
+	/// </summary>
+	int32 GetCarouselWaitMS() const;
+
+	/// <summary>
+	/// Reads the interface counters, once LIVE_SAMPLE_US passed, and reports the bytes the server did not send as live traffic.
+	/// </summary>
+	void SampleLiveTraffic();
+
+	/// <summary>
+	/// Keeps the current package in the package directory and creates patches from the previous packages to it.
+	/// Patches, which are not smaller than the package, are dropped.
+	/// </summary>
+	void BuildPatches(UpdatePackage *package);
+
+	/// <summary>
+	/// Returns the data of the requested payload, or nullptr if the server does not have it.
+	/// </summary>
+	/// <param name="base_version">The version a patch was requested for, 0 for the full package.</param>
+	const Byte *GetPayload(const UpdatePackage *package, uint16 payload, uint32 base_version, uint32 *out_size) const;
+
+	/// <summary>
+	/// Returns the patch from the given version to the current one, or nullptr if there is none.
+	/// </summary>
+	const UpdatePatch *FindPatch(const UpdatePackage *package, uint32 base_version) const;
+
+	/// <summary>
+	/// Returns the piece size, in which a client is served, that can receive pieces up to the given size.
+	/// Only the largest piece size of the MTU and the powers of two below it are served, so that every payload has only a few piece trees.
+	/// </summary>
+	uint16 GetServedPieceSize(uint16 max_piece_size) const;
+
+	/// <summary>
+	/// Returns true, if the piece size is one of the sizes GetServedPieceSize hands out.
+	/// </summary>
+	bool IsServedPieceSize(uint16 piece_size) const;
+
+	/// <summary>
+	/// Returns the signed piece hashes of the payload for the piece size, they are built on the first request of a piece size.
+	/// </summary>
+	/// <returns>Returns nullptr, if the payload is not available, the package already has MAX_PIECE_TREES or the root could not be signed.</returns>
+	const PieceTree *GetPieceTree(UpdatePackage *package, Core::Crypto *crypto, uint16 payload, uint32 base_version, uint16 piece_size) const;
+
+private:
+
+	/// <summary>
+	/// Patches are created from this many previous versions, older packages are removed.
+	/// </summary>
+	static constexpr uint32 MAX_PATCH_VERSIONS = 4;
+
+	/// <summary>
+	/// Covers the served piece sizes of all payloads, a package never hashes more trees than this.
+	/// </summary>
+	static constexpr uint32 MAX_PIECE_TREES = 64;
+
+	/// <summary>
+	/// The package is rebuilt, once the watched files did not change for this long.
+	/// </summary>
+	static constexpr int64 REBUILD_QUIET_MS = 2000;
+
+	/// <summary>
+	/// The carousel stays on the local network.
+	/// </summary>
+	static constexpr uint8 CAROUSEL_TTL = 1;
+
+	/// <summary>
+	/// After a pause the carousel continues at its rate, instead of sending the missed pieces in a burst.
+	/// </summary>
+	static constexpr int64 CAROUSEL_MAX_LAG_US = 10000;
+
+	/// <summary>
+	/// The interface counters are read this often, while the server handles requests.
+	/// </summary>
+	static constexpr int64 LIVE_SAMPLE_US = 50000;
+
+	/// <summary>
+	/// The Ethernet, IP and UDP headers of a datagram, which the interface counts as well.
+	/// </summary>
+	static constexpr uint32 DATAGRAM_OVERHEAD_BYTES = 14 + 20 + 8;
+
+	/// <summary>
+	/// The number of client messages received at once, and the number of pieces sent at once.
+	/// </summary>
+	static constexpr uint32 RECV_BATCH = 32;
+	static constexpr uint32 SEND_BATCH = Core::Socket::MAX_BATCH;
+
+	/// <summary>
+	/// The largest client message, larger messages are truncated and rejected.
+	/// </summary>
+	static constexpr uint32 MAX_MESSAGE_BYTES = 2048;
+
 private:
 
 	ServerConfig m_Config;
 	Core::Socket *m_Socket = nullptr;
 	Core::Crypto *m_Crypto = nullptr;
+	Core::Crypto *m_BuildCrypto = nullptr;
 	Core::IPTable *m_IPTable = nullptr;
 	Core::Clients *m_Clients = nullptr;
 
 	Core::Crypto::key_t m_PublicKey = {};
+	Core::Crypto::key_t m_PrivateKey = {};
 
 	// Update data.
 	int64 m_LastUpdateCheckMS;
 	int64 m_LastUpdateWriteMS;
 	uint32 m_LocalVersion;
-	Signature m_UpdateSignature;
-	Core::FileSystemBuffer m_UpdateFile;
+
+	// The package clients get, and the one it replaced, which is still served to the clients in the middle of a download.
+	// Both are only used by the network thread.
+	std::unique_ptr<UpdatePackage> m_Package;
+	std::unique_ptr<UpdatePackage> m_PreviousPackage;
+
+	// A package the build thread finished, it is swapped in before the next client messages are handled.
+	std::mutex m_PackageMutex;
+	std::unique_ptr<UpdatePackage> m_NextPackage;
+	std::atomic<bool> m_HasNextPackage = false;
+
+	// Shares the egress budget between the live video, the carousel and the clients.
+	Core::BandwidthScheduler m_Bandwidth;
+
+	// The bytes the interface and the server sent, when the interface counters were read last.
+	Core::InterfaceCounters *m_InterfaceCounters = nullptr;
+	uint64 m_InterfaceSentBytes = 0;
+	uint64 m_SampledSentBytes = 0;
+	uint64 m_SentBytes = 0;
+	int64 m_LastSampleUS = 0;
+
+	// The package is compressed on the build pool, files which did not change since the last build come from the cache.
+	Core::ThreadPool m_BuildPool;
+	Core::ZipEntryCache m_ZipCache;
+	uint64 m_BuiltFilesHash = 0;
+
+	// The package came from the package cache, the rebuild thread checks the cache before it waits for changes.
+	bool m_VerifyCache = false;
+
+	// The changes reported by the file watcher, they are collected until the quiet window passed.
+	std::thread m_RebuildThread;
+	std::mutex m_RebuildMutex;
+	std::condition_variable m_RebuildCondition;
+	int64 m_LastChangeMS = 0;
+	bool m_HasChanges = false;
+	bool m_StopRebuild = false;
+
+	// Receive slots for a batch of client messages.
+	Byte m_RecvData[RECV_BATCH][MAX_MESSAGE_BYTES];
+	Core::io_buffer_t m_RecvBuffers[RECV_BATCH];
+	Core::datagram_t m_Received[RECV_BATCH];
+
+	// Queued piece messages, each is a header and a slice of the update file.
+	ServerUpdatePieceMessage m_PieceHeaders[SEND_BATCH];
+	Core::io_buffer_t m_PieceBuffers[SEND_BATCH][2];
+	Core::datagram_t m_PieceDatagrams[SEND_BATCH];
+	uint32 m_PendingPieces = 0;
+
+	// The multicast carousel, it sends the pieces of the full package round after round while it runs.
+	Core::addr_t m_CarouselAddr = {};
+	uint16 m_CarouselPieceSize = 0;
+	uint32 m_CarouselPiece = 0;
+	int64 m_CarouselNextUS = 0;
+	int64 m_CarouselUntilMS = 0;
+
+	ServerCarouselPieceMessage m_CarouselHeaders[SEND_BATCH];
+	Core::io_buffer_t m_CarouselBuffers[SEND_BATCH][2];
+	Core::datagram_t m_CarouselDatagrams[SEND_BATCH];
 };
 
@@ -39,3 +39,8 @@ workspace "CamVision"
 		include "UpdateServer"
 	group ""
 
+	group "Benchmarks"
+		include "Benchmarks/ClientsBench"
+		include "Benchmarks/SocketBench"
+	group ""
+